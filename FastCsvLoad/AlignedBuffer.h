@@ -0,0 +1,91 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+#ifdef _WIN32
+#include <malloc.h> // _aligned_malloc
+#endif
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 64バイト境界に揃えた未初期化バッファ（列バッファ用）
+// ・先頭アドレスは ALIGNED_BUFFER_ALIGNMENT の倍数（AVX-512 / キャッシュライン / Arrow 推奨値）
+// ・確保サイズは 64 バイトの倍数に切り上げ、末尾の余りは 0 で埋める（Arrow のパディング規約）
+// ・確保時に値を初期化しないので、パースループが最初に書き込む
+//////////////////////////////////////////////////////////////////////////////////////////////
+#define ALIGNED_BUFFER_ALIGNMENT 64
+
+class AlignedBuffer {
+public:
+    AlignedBuffer() = default;
+    explicit AlignedBuffer(size_t bytes) { Allocate(bytes); }
+    ~AlignedBuffer() { Free(); }
+
+    AlignedBuffer(const AlignedBuffer&) = delete;
+    AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+    AlignedBuffer(AlignedBuffer&& other) noexcept { Swap(other); }
+    AlignedBuffer& operator=(AlignedBuffer&& other) noexcept {
+        if (this != &other) {
+            Free();
+            Swap(other);
+        }
+        return *this;
+    }
+
+    // bytes バイトを確保（既存の内容は破棄、中身は未初期化）
+    // alignment は ALIGNED_BUFFER_ALIGNMENT 以上の2の累乗（O_DIRECT 用の 4096 など）
+    void Allocate(size_t bytes, size_t alignment = ALIGNED_BUFFER_ALIGNMENT) {
+        Free();
+        if (bytes == 0) {
+            return;
+        }
+        size_t padded = PaddedSize(bytes);
+#ifdef _WIN32
+        ptr_ = static_cast<unsigned char*>(_aligned_malloc(padded, alignment));
+#else
+        void* p = nullptr;
+        ptr_ = (posix_memalign(&p, alignment, padded) == 0) ? static_cast<unsigned char*>(p) : nullptr;
+#endif
+        if (ptr_ == nullptr) {
+            throw std::bad_alloc();
+        }
+        size_ = bytes;
+        capacity_ = padded;
+        std::memset(ptr_ + size_, 0, capacity_ - size_);
+    }
+
+    void Free() {
+        if (ptr_) {
+#ifdef _WIN32
+            _aligned_free(ptr_);
+#else
+            std::free(ptr_);
+#endif
+        }
+        ptr_ = nullptr;
+        size_ = 0;
+        capacity_ = 0;
+    }
+
+    unsigned char*       data()           { return ptr_; }
+    const unsigned char* data()     const { return ptr_; }
+    size_t               size()     const { return size_; }     // 要求したバイト数
+    size_t               capacity() const { return capacity_; } // パディング込みのバイト数
+    bool                 empty()    const { return size_ == 0; }
+
+    static size_t PaddedSize(size_t bytes) {
+        return (bytes + ALIGNED_BUFFER_ALIGNMENT - 1) / ALIGNED_BUFFER_ALIGNMENT * ALIGNED_BUFFER_ALIGNMENT;
+    }
+
+private:
+    void Swap(AlignedBuffer& other) noexcept {
+        std::swap(ptr_, other.ptr_);
+        std::swap(size_, other.size_);
+        std::swap(capacity_, other.capacity_);
+    }
+
+    unsigned char* ptr_ = nullptr;
+    size_t         size_ = 0;
+    size_t         capacity_ = 0;
+};
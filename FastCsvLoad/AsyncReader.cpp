@@ -0,0 +1,311 @@
+﻿#ifdef _WIN32
+#define NOMINMAX // この定義をWindows.hをインクルードする前に追加しないとエラーになる
+#include <windows.h>
+#else
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // O_DIRECT
+#endif
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "AsyncReader.h"
+#include "MappedFile.h" // NarrowPath
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// ファイルを開く
+#ifdef _WIN32
+int AsyncBlockReader::Open(const std::wstring& filename, const AsyncReadOptions& opt)
+{
+    Close();
+
+    // 非バッファ読み込みで開き、失敗したら通常の読み込みで開き直す
+    direct_ = opt.direct;
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    if (direct_) {
+        hFile = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING, NULL);
+        direct_ = (hFile != INVALID_HANDLE_VALUE);
+    }
+    if (hFile == INVALID_HANDLE_VALUE) {
+        hFile = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    }
+    if (hFile == INVALID_HANDLE_VALUE) {
+        std::wcerr << L"ファイルを開けません: " << filename << std::endl;
+        return 1;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(hFile, &fileSize)) {
+        std::wcerr << L"ファイルサイズの取得に失敗しました。" << std::endl;
+        CloseHandle(hFile);
+        return 1;
+    }
+    hFile_ = hFile;
+    filename_ = filename;
+    fileSize_ = static_cast<uint64_t>(fileSize.QuadPart);
+#else
+int AsyncBlockReader::Open(const std::wstring& filename, const AsyncReadOptions& opt)
+{
+    Close();
+    const std::string path = NarrowPath(filename);
+
+    // O_DIRECT で開き、失敗したら（tmpfs など）通常の読み込みで開き直す
+    int fd = -1;
+    direct_ = false;
+#ifdef O_DIRECT
+    if (opt.direct) {
+        fd = open(path.c_str(), O_RDONLY | O_DIRECT);
+        direct_ = (fd >= 0);
+    }
+#endif
+    if (fd < 0) {
+        fd = open(path.c_str(), O_RDONLY);
+    }
+    if (fd < 0) {
+        std::cerr << "ファイルを開けません: " << path << " (" << std::strerror(errno) << ")" << std::endl;
+        return 1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        std::cerr << "ファイルサイズの取得に失敗しました。" << std::endl;
+        close(fd);
+        return 1;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (!direct_) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+#endif
+    fd_ = fd;
+    path_ = path;
+    fileSize_ = static_cast<uint64_t>(st.st_size);
+#endif
+
+    // リングバッファを確保して読み込みスレッドを開始
+    blockSize_ = (std::max<size_t>(opt.blockSize, 1) + ASYNC_READ_ALIGNMENT - 1) / ASYNC_READ_ALIGNMENT * ASYNC_READ_ALIGNMENT;
+    numBlocks_ = static_cast<int64_t>((fileSize_ + blockSize_ - 1) / blockSize_);
+    next_ = released_ = 0;
+    stop_ = failed_ = false;
+    buffered_ = false;
+    readSeconds_ = waitSeconds_ = 0.0;
+
+    slots_.resize(std::max(opt.numBuffers, 2));
+    for (Slot& s : slots_) {
+        s.buffer.Allocate(ASYNC_READ_HEADROOM + blockSize_, ASYNC_READ_ALIGNMENT);
+        s.block = -1;
+        s.size = 0;
+    }
+
+    const int numThreads = std::max(1, std::min(opt.readThreads, static_cast<int>(slots_.size())));
+    threadSeconds_.assign(numThreads, 0.0);
+    for (int t = 0; t < numThreads; ++t) {
+        threads_.emplace_back(&AsyncBlockReader::ReadLoop, this, t);
+    }
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 非バッファ読み込みが整列の条件（EINVAL / ERROR_INVALID_PARAMETER）で失敗した場合に、
+// 通常の読み込みでファイルを開き直す（最初に失敗したスレッドが開き、以降の読み込みはすべてこちらを使う）
+bool AsyncBlockReader::OpenBuffered()
+{
+    std::lock_guard<std::mutex> lock(bufferedMutex_);
+    if (buffered_) {
+        return true;
+    }
+#ifdef _WIN32
+    HANDLE hFile = CreateFileW(filename_.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    hBuffered_ = hFile;
+#else
+    const int fd = open(path_.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    bufferedFd_ = fd;
+#endif
+    buffered_ = true;
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// offset から length バイトを読む　読めたバイト数（EOF で短くなる）、エラー時は -1
+long long AsyncBlockReader::ReadAt(char* dst, size_t length, uint64_t offset)
+{
+    size_t done = 0;
+    while (done < length) {
+        const bool buffered = buffered_;
+#ifdef _WIN32
+        OVERLAPPED ov = {};
+        const uint64_t pos = offset + done;
+        ov.Offset = static_cast<DWORD>(pos & 0xFFFFFFFF);
+        ov.OffsetHigh = static_cast<DWORD>(pos >> 32);
+        DWORD n = 0;
+        if (!ReadFile(static_cast<HANDLE>(buffered ? hBuffered_ : hFile_), dst + done, static_cast<DWORD>(length - done), &n, &ov)) {
+            const DWORD error = GetLastError();
+            if (error == ERROR_HANDLE_EOF) {
+                break;
+            }
+            if (error == ERROR_INVALID_PARAMETER && direct_ && !buffered && OpenBuffered()) {
+                continue; // 通常の読み込みで読み直す
+            }
+            return -1;
+        }
+#else
+        const ssize_t n = pread(buffered ? bufferedFd_ : fd_, dst + done, length - done, static_cast<off_t>(offset + done));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EINVAL && direct_ && !buffered && OpenBuffered()) {
+                continue; // 通常の読み込みで読み直す
+            }
+            return -1;
+        }
+#endif
+        if (n == 0) {
+            break;
+        }
+        done += static_cast<size_t>(n);
+    }
+    return static_cast<long long>(done);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 読み込みスレッド　ブロック k をスロット k % numBuffers に読む
+// スレッド t はブロック t, t + numThreads, ... を担当する
+void AsyncBlockReader::ReadLoop(int thread)
+{
+    const int64_t numSlots = static_cast<int64_t>(slots_.size());
+    const int64_t numThreads = static_cast<int64_t>(threadSeconds_.size());
+    for (int64_t k = thread; k < numBlocks_; k += numThreads) {
+        Slot& slot = slots_[k % numSlots];
+        {
+            // 同じスロットを使う前のブロックが返却されるまで待つ
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [&] { return stop_ || k < released_ + numSlots; });
+            if (stop_) {
+                return;
+            }
+        }
+
+        const auto t0 = std::chrono::steady_clock::now();
+        const uint64_t offset = static_cast<uint64_t>(k) * blockSize_;
+        const size_t want = static_cast<size_t>(std::min<uint64_t>(blockSize_, fileSize_ - offset));
+        // 非バッファ読み込みは長さも整列単位の倍数にする（ファイル末尾では短く読める）
+        const size_t request = direct_
+            ? (want + ASYNC_READ_ALIGNMENT - 1) / ASYNC_READ_ALIGNMENT * ASYNC_READ_ALIGNMENT
+            : want;
+        char* dst = reinterpret_cast<char*>(slot.buffer.data()) + ASYNC_READ_HEADROOM;
+        const long long n = ReadAt(dst, request, offset);
+        threadSeconds_[thread] += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (n < static_cast<long long>(want)) {
+            failed_ = true;
+            stop_ = true;
+        }
+        slot.size = want;
+        slot.block = k;
+        cv_.notify_all();
+        if (failed_) {
+            return;
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 次のブロックを受け取る
+bool AsyncBlockReader::Next(AsyncBlock& block)
+{
+    if (next_ >= numBlocks_ || slots_.empty()) {
+        return false;
+    }
+    const int64_t k = next_;
+    const int slotIndex = static_cast<int>(k % static_cast<int64_t>(slots_.size()));
+    Slot& slot = slots_[slotIndex];
+
+    const auto t0 = std::chrono::steady_clock::now();
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&] { return failed_ || stop_ || slot.block == k; });
+        if (slot.block != k) {
+            if (failed_) {
+                std::cerr << "ファイルの読み込みに失敗しました。" << std::endl;
+            }
+            return false;
+        }
+    }
+    waitSeconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    block.data = reinterpret_cast<char*>(slot.buffer.data()) + ASYNC_READ_HEADROOM;
+    block.size = slot.size;
+    block.offset = static_cast<uint64_t>(k) * blockSize_;
+    block.last = (k + 1 == numBlocks_);
+    block.slot = slotIndex;
+    ++next_;
+    return true;
+}
+
+// ブロックは受け取った順に返却すること
+void AsyncBlockReader::Release(const AsyncBlock& block)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    slots_[block.slot].block = -1;
+    ++released_;
+    cv_.notify_all();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+void AsyncBlockReader::Close()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        cv_.notify_all();
+    }
+    for (std::thread& th : threads_) {
+        th.join();
+    }
+    threads_.clear();
+    for (double s : threadSeconds_) {
+        readSeconds_ += s;
+    }
+    threadSeconds_.clear();
+    slots_.clear();
+
+#ifdef _WIN32
+    if (hFile_) {
+        CloseHandle(static_cast<HANDLE>(hFile_));
+        hFile_ = nullptr;
+    }
+    if (hBuffered_) {
+        CloseHandle(static_cast<HANDLE>(hBuffered_));
+        hBuffered_ = nullptr;
+    }
+#else
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+    if (bufferedFd_ >= 0) {
+        close(bufferedFd_);
+        bufferedFd_ = -1;
+    }
+#endif
+}
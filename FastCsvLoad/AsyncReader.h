@@ -0,0 +1,105 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "AlignedBuffer.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 先読みスレッドによる非同期ブロック読み込み（メモリマップの代わりの入力経路）
+// 読み込みスレッドが大きな整列済みブロックをリングバッファに先行して読み込み、
+// パース側は読み終わったブロックを順に受け取る。パース中も次のブロックの読み込みが進む。
+// Windows: FILE_FLAG_NO_BUFFERING + ReadFile / POSIX: O_DIRECT + pread
+// （非バッファ読み込みを開けない、または開けても読み込みが整列の条件で失敗するファイルシステムでは
+//   通常の読み込みに切り替える）
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+#define ASYNC_READ_ALIGNMENT 4096      // O_DIRECT / NO_BUFFERING の整列単位
+#define ASYNC_READ_HEADROOM  (64 << 10) // ブロックの前に確保する領域（前のブロックから続く行を置く、長い行は別に置く）
+
+struct AsyncReadOptions {
+    size_t blockSize   = 8u << 20; // 1回の読み込みサイズ（ASYNC_READ_ALIGNMENT の倍数に切り上げ）
+    int    numBuffers  = 4;        // リングバッファの数（2 以上）
+    int    readThreads = 2;        // 同時に発行する読み込み数
+    bool   direct      = true;     // ページキャッシュを経由しない読み込み
+};
+
+struct AsyncBlock {
+    char*    data   = nullptr; // ブロック先頭　data の前に ASYNC_READ_HEADROOM バイト書き込める
+    size_t   size   = 0;
+    uint64_t offset = 0;       // ファイル内の位置
+    bool     last   = false;   // ファイル最後のブロック
+    int      slot   = -1;
+};
+
+class AsyncBlockReader {
+public:
+    AsyncBlockReader() = default;
+    ~AsyncBlockReader() { Close(); }
+
+    AsyncBlockReader(const AsyncBlockReader&) = delete;
+    AsyncBlockReader& operator=(const AsyncBlockReader&) = delete;
+
+    // @brief ファイルを開いて読み込みスレッドを開始する
+    // @return 成功時は 0、失敗時は非 0
+    int Open(const std::wstring& filename, const AsyncReadOptions& opt = AsyncReadOptions());
+
+    // 次のブロックを受け取る（読み込み完了まで待つ）　終端または読み込みエラーで false
+    bool Next(AsyncBlock& block);
+
+    // 受け取ったブロックを返却する（バッファが次の読み込みに使われる）
+    void Release(const AsyncBlock& block);
+
+    // 読み込みスレッドを止めてファイルを閉じる
+    void Close();
+
+    uint64_t FileSize()    const { return fileSize_; }
+    bool     Failed()      const { return failed_; }
+    bool     Direct()      const { return direct_ && !buffered_; } // 最後まで非バッファ読み込みだったか
+    double   ReadSeconds() const { return readSeconds_; } // 読み込みスレッドの合計時間（Close 後に確定）
+    double   WaitSeconds() const { return waitSeconds_; } // Next で読み込み完了を待った時間
+
+private:
+    struct Slot {
+        AlignedBuffer buffer;     // [HEADROOM | blockSize]
+        int64_t       block = -1; // 読み込み済みのブロック番号（-1 は空き）
+        size_t        size  = 0;
+    };
+
+    void ReadLoop(int thread);
+    long long ReadAt(char* dst, size_t length, uint64_t offset);
+    bool OpenBuffered(); // 非バッファ読み込みが失敗した場合に通常の読み込みで開き直す
+
+    std::vector<Slot>        slots_;
+    std::vector<std::thread> threads_;
+    std::vector<double>      threadSeconds_;
+    std::mutex               mutex_;
+    std::condition_variable  cv_;
+
+    uint64_t fileSize_  = 0;
+    size_t   blockSize_ = 0;
+    int64_t  numBlocks_ = 0;
+    int64_t  next_      = 0; // 次に Next で渡すブロック
+    int64_t  released_  = 0; // 返却済みのブロック数
+    bool     stop_      = false;
+    bool     failed_    = false;
+    bool     direct_    = false;
+    std::atomic<bool> buffered_{ false }; // 非バッファ読み込みから通常の読み込みに切り替えた
+    std::mutex        bufferedMutex_;
+    double   readSeconds_ = 0.0;
+    double   waitSeconds_ = 0.0;
+
+#ifdef _WIN32
+    std::wstring filename_;
+    void* hFile_ = nullptr;
+    void* hBuffered_ = nullptr; // 通常の読み込みのハンドル（buffered_ の後に有効）
+#else
+    std::string path_;
+    int   fd_    = -1;
+    int   bufferedFd_ = -1;     // 通常の読み込みのファイル（buffered_ の後に有効）
+#endif
+};
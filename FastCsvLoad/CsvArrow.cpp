@@ -0,0 +1,166 @@
+﻿#include <vector>
+#include <string>
+#include <iostream>
+
+#include "CsvArrow.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 列型に対応する Arrow のフォーマット文字列
+const char* ArrowFormat(int type)
+{
+    switch (type) {
+    case COLTYPE_FLOAT:  return "f";
+    case COLTYPE_DOUBLE: return "g";
+    case COLTYPE_INT32:  return "i";
+    case COLTYPE_INT64:  return "l";
+    case COLTYPE_UINT8:  return "C";
+    default:             return nullptr;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 子配列（1列分）　列バッファの所有権を持つ
+// 利用側が子だけを取り出して親を解放できるよう、子ごとに release を持たせる
+struct ArrowColumnPrivate {
+    AlignedBuffer data;
+    const void*   buffers[2]; // [0] validity（null なし）, [1] 値
+};
+
+static void ReleaseColumnArray(ArrowArray* array)
+{
+    delete static_cast<ArrowColumnPrivate*>(array->private_data);
+    array->release = nullptr;
+}
+
+struct ArrowTablePrivate {
+    std::vector<ArrowArray>  children;
+    std::vector<ArrowArray*> childPtrs;
+    const void*              buffers[1]; // struct 配列は validity のみ
+};
+
+static void ReleaseTableArray(ArrowArray* array)
+{
+    ArrowTablePrivate* priv = static_cast<ArrowTablePrivate*>(array->private_data);
+    for (ArrowArray* child : priv->childPtrs) {
+        if (child->release) {
+            child->release(child);
+        }
+    }
+    delete priv;
+    array->release = nullptr;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// スキーマ側
+struct ArrowColumnSchemaPrivate {
+    std::string name;
+};
+
+static void ReleaseColumnSchema(ArrowSchema* schema)
+{
+    delete static_cast<ArrowColumnSchemaPrivate*>(schema->private_data);
+    schema->release = nullptr;
+}
+
+struct ArrowTableSchemaPrivate {
+    std::vector<ArrowSchema>  children;
+    std::vector<ArrowSchema*> childPtrs;
+};
+
+static void ReleaseTableSchema(ArrowSchema* schema)
+{
+    ArrowTableSchemaPrivate* priv = static_cast<ArrowTableSchemaPrivate*>(schema->private_data);
+    for (ArrowSchema* child : priv->childPtrs) {
+        if (child->release) {
+            child->release(child);
+        }
+    }
+    delete priv;
+    schema->release = nullptr;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// @brief CsvTable を Arrow の struct 配列としてエクスポートする（ゼロコピー）
+int ExportArrowTable(CsvTable& table, ArrowArray* array, ArrowSchema* schema)
+{
+    const size_t numCols = table.columns.size();
+    for (const CsvColumn& col : table.columns) {
+        if (ArrowFormat(col.type) == nullptr) {
+            std::cerr << "Arrow に変換できない列型です: " << col.name << std::endl;
+            return 1;
+        }
+    }
+
+    ArrowTablePrivate* arrPriv = new ArrowTablePrivate();
+    ArrowTableSchemaPrivate* schPriv = new ArrowTableSchemaPrivate();
+    arrPriv->children.resize(numCols);
+    arrPriv->childPtrs.resize(numCols);
+    arrPriv->buffers[0] = nullptr;
+    schPriv->children.resize(numCols);
+    schPriv->childPtrs.resize(numCols);
+
+    const int64_t length = static_cast<int64_t>(table.rows);
+    for (size_t i = 0; i < numCols; ++i) {
+        CsvColumn& col = table.columns[i];
+
+        // 配列（列バッファを移す）
+        ArrowColumnPrivate* colPriv = new ArrowColumnPrivate();
+        colPriv->data = std::move(col.data);
+        colPriv->buffers[0] = nullptr;
+        colPriv->buffers[1] = colPriv->data.data();
+
+        ArrowArray& child = arrPriv->children[i];
+        child.length = length;
+        child.null_count = 0;
+        child.offset = 0;
+        child.n_buffers = 2;
+        child.n_children = 0;
+        child.buffers = colPriv->buffers;
+        child.children = nullptr;
+        child.dictionary = nullptr;
+        child.release = ReleaseColumnArray;
+        child.private_data = colPriv;
+        arrPriv->childPtrs[i] = &child;
+
+        // スキーマ
+        ArrowColumnSchemaPrivate* colSchPriv = new ArrowColumnSchemaPrivate();
+        colSchPriv->name = col.name;
+
+        ArrowSchema& childSchema = schPriv->children[i];
+        childSchema.format = ArrowFormat(col.type);
+        childSchema.name = colSchPriv->name.c_str();
+        childSchema.metadata = nullptr;
+        childSchema.flags = 0; // null を含まない
+        childSchema.n_children = 0;
+        childSchema.children = nullptr;
+        childSchema.dictionary = nullptr;
+        childSchema.release = ReleaseColumnSchema;
+        childSchema.private_data = colSchPriv;
+        schPriv->childPtrs[i] = &childSchema;
+    }
+
+    array->length = length;
+    array->null_count = 0;
+    array->offset = 0;
+    array->n_buffers = 1;
+    array->n_children = static_cast<int64_t>(numCols);
+    array->buffers = arrPriv->buffers;
+    array->children = arrPriv->childPtrs.data();
+    array->dictionary = nullptr;
+    array->release = ReleaseTableArray;
+    array->private_data = arrPriv;
+
+    schema->format = "+s";
+    schema->name = "";
+    schema->metadata = nullptr;
+    schema->flags = 0;
+    schema->n_children = static_cast<int64_t>(numCols);
+    schema->children = schPriv->childPtrs.data();
+    schema->dictionary = nullptr;
+    schema->release = ReleaseTableSchema;
+    schema->private_data = schPriv;
+
+    // 列バッファは ArrowArray 側に移ったので table は空にする
+    table = CsvTable();
+    return 0;
+}
@@ -0,0 +1,63 @@
+﻿#pragma once
+#include <cstdint>
+#include "FastCsvLoad.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// Apache Arrow C Data Interface
+// https://arrow.apache.org/docs/format/CDataInterface.html
+// 構造体定義は仕様書のものをそのまま使用（Arrow 本体のヘッダと同時に使えるようガード付き）
+//////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+    // Array type description
+    const char* format;
+    const char* name;
+    const char* metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema** children;
+    struct ArrowSchema* dictionary;
+
+    // Release callback
+    void (*release)(struct ArrowSchema*);
+    // Opaque producer-specific data
+    void* private_data;
+};
+
+struct ArrowArray {
+    // Array data description
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void** buffers;
+    struct ArrowArray** children;
+    struct ArrowArray* dictionary;
+
+    // Release callback
+    void (*release)(struct ArrowArray*);
+    // Opaque producer-specific data
+    void* private_data;
+};
+
+#endif  // ARROW_C_DATA_INTERFACE
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// @brief CsvTable を Arrow の struct 配列（列ごとに子配列）としてエクスポートする
+// 列バッファはコピーせず、table の中身を ArrowArray 側に移す（table は空になる）
+// バッファは release コールバックで解放される
+// @param[in,out] table   読み込み結果（エクスポート後は空）
+// @param[out]    array   エクスポート先の ArrowArray
+// @param[out]    schema  エクスポート先の ArrowSchema
+// @return                成功時は 0、失敗時は非 0
+int ExportArrowTable(CsvTable& table, ArrowArray* array, ArrowSchema* schema);
+
+// 列型に対応する Arrow のフォーマット文字列（"f", "g", "i", "l", "C"）
+const char* ArrowFormat(int type);
@@ -0,0 +1,512 @@
+﻿#ifdef _WIN32
+#define NOMINMAX // この定義をWindows.hをインクルードする前に追加しないとエラーになる
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <vector>
+#include <string>
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <omp.h>
+
+#include "FastCsvLoad.h"
+#include "CsvScan.h" // ScanLineOffsets
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// FastCsvBench: 行オフセット取得とパース方式のベンチマーク
+// ・合成 CSV を生成（行数・列数・改行コード・区切り・引用符・数値形式を指定、乱数の種は固定）
+// ・GetLineOffsets の各バリアント、FastCsvLoad の各方式、SlowCsvLoad を計測
+// ・スレッド数ごとのスケーリング、ページキャッシュの warm / cold を比較
+// ・結果は CSV（既定）または JSON Lines で標準出力に出す（回帰の追跡用）
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+#define NEWLINE_LF    0
+#define NEWLINE_CRLF  1
+#define NEWLINE_MIXED 2
+
+#define QUOTE_NONE 0
+#define QUOTE_SOME 1 // 4列に1列を引用符で囲む
+#define QUOTE_ALL  2
+
+#define NUMFMT_FIXED 0 // 123.456789（小数点以下 precision 桁）
+#define NUMFMT_SCI   1 // 1.23456789e+02
+#define NUMFMT_INT   2 // 123
+
+struct BenchConfig {
+    // 生成
+    std::string input;                       // 指定時は生成せずこのファイルを使う
+    std::string output = "fastcsvbench.csv"; // 生成先
+    long long   rows = 1000000;
+    int         cols = COLUMN_SIZE;
+    int         newline = NEWLINE_LF;
+    char        delimiter = ',';
+    bool        blanks = false;              // 区切りを 1〜3 個の空白・タブにする（whitespace で読む .xyz 形式）
+    int         quote = QUOTE_NONE;
+    int         numFormat = NUMFMT_FIXED;
+    int         precision = 6;
+    bool        keep = false;                // 生成したファイルを残す
+
+    // 計測
+    std::vector<int>         threads;        // 空なら 1, 2, 4, ... , 最大
+    std::vector<std::string> cases;          // 空なら全ケース
+    int                      reps = 3;
+    bool                     warm = true;
+    bool                     cold = false;
+    bool                     slow = false;   // SlowCsvLoad も計測する（遅い）
+    bool                     json = false;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 合成 CSV の生成
+static void AppendNumber(std::string& out, std::mt19937_64& rng, const BenchConfig& cfg)
+{
+    char buf[64];
+    char* p = buf;
+    uint64_t scale = 1;
+    for (int i = 0; i < cfg.precision; ++i) {
+        scale *= 10;
+    }
+    // 0 〜 1000 の値を固定小数で作る（浮動小数の書式化を使わず高速に生成）
+    const uint64_t v = rng() % (1000 * scale);
+    const uint64_t ip = v / scale;
+    const uint64_t fp = v % scale;
+
+    if (cfg.numFormat == NUMFMT_INT) {
+        p += std::snprintf(p, sizeof(buf), "%llu", static_cast<unsigned long long>(ip));
+    }
+    else if (cfg.numFormat == NUMFMT_SCI) {
+        // 仮数 d.ddd と指数
+        std::string digits = std::to_string(v);
+        int exponent = static_cast<int>(digits.size()) - 1 - cfg.precision;
+        *p++ = digits[0];
+        if (digits.size() > 1) {
+            *p++ = '.';
+            std::memcpy(p, digits.data() + 1, digits.size() - 1);
+            p += digits.size() - 1;
+        }
+        p += std::snprintf(p, 16, "e%+03d", exponent);
+    }
+    else {
+        p += std::snprintf(p, sizeof(buf), "%llu", static_cast<unsigned long long>(ip));
+        if (cfg.precision > 0) {
+            *p++ = '.';
+            uint64_t f = fp;
+            for (int i = cfg.precision - 1; i >= 0; --i) {
+                p[i] = static_cast<char>('0' + f % 10);
+                f /= 10;
+            }
+            p += cfg.precision;
+        }
+    }
+    out.append(buf, p);
+}
+
+static int GenerateCsv(const BenchConfig& cfg, const std::string& path)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "ファイルを作成できません: " << path << std::endl;
+        return 1;
+    }
+    std::mt19937_64 rng(12345); // 再現性のため固定
+    std::string buf;
+    buf.reserve(16 << 20);
+    for (long long r = 0; r < cfg.rows; ++r) {
+        for (int c = 0; c < cfg.cols; ++c) {
+            const bool quoted = (cfg.quote == QUOTE_ALL) || (cfg.quote == QUOTE_SOME && c % 4 == 1);
+            if (quoted) {
+                buf.push_back('"');
+            }
+            AppendNumber(buf, rng, cfg);
+            if (quoted) {
+                buf.push_back('"');
+            }
+            if (c + 1 < cfg.cols) {
+                if (cfg.blanks) {
+                    const uint64_t k = rng();
+                    buf.append(1 + k % 3, (k & 8) ? '\t' : ' ');
+                }
+                else {
+                    buf.push_back(cfg.delimiter);
+                }
+            }
+        }
+        const bool crlf = (cfg.newline == NEWLINE_CRLF) || (cfg.newline == NEWLINE_MIXED && (rng() & 1));
+        buf.append(crlf ? "\r\n" : "\n");
+        if (buf.size() >= (16 << 20) - 4096) {
+            out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+            buf.clear();
+        }
+    }
+    out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+    return out ? 0 : 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// ページキャッシュからファイルを追い出す（cold 計測用）
+// Linux: posix_fadvise(POSIX_FADV_DONTNEED)　変更のないページなら権限不要
+// Windows: 非バッファで開いて閉じるとキャッシュが破棄される
+static bool DropFileCache(const std::string& path)
+{
+#ifdef _WIN32
+    std::wstring wpath(path.begin(), path.end());
+    HANDLE h = CreateFileW(wpath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_FLAG_NO_BUFFERING, NULL);
+    if (h == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    CloseHandle(h);
+    return true;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    fdatasync(fd);
+    const int ret = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+    return ret == 0;
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 計測ケース
+// run() は計測対象の処理を1回実行し、読み込んだ行数を返す
+struct BenchCase {
+    std::string                 name;
+    std::function<size_t(void)> run;
+};
+
+typedef size_t (*GetLineOffsetsFn)(const char*, size_t, std::vector<size_t>&);
+
+static std::vector<BenchCase> MakeCases(const BenchConfig& cfg, const std::wstring& wpath)
+{
+    std::vector<BenchCase> cases;
+
+    // 行オフセット取得（マップ + 走査）
+    // マップ自体は仮想アドレスの割り当てのみで、cold のページフォルトは走査側に現れる
+    struct OffsetsVariant { const char* name; GetLineOffsetsFn fn; };
+    static const OffsetsVariant variants[] = {
+        { "GetLineOffsets",                  GetLineOffsets },
+        { "GetLineOffsets_OpenMP",           GetLineOffsets_OpenMP },
+        { "GetLineOffsets_LF_OpenMP",        GetLineOffsets_LF_OpenMP },
+        { "GetLineOffsets_CRLF_OpenMP",      GetLineOffsets_CRLF_OpenMP },
+        { "GetLineOffsets_LFCRLF_OpenMP",    GetLineOffsets_LFCRLF_OpenMP },
+        { "GetLineOffsets_AVX2_OpenMP",      GetLineOffsets_AVX2_OpenMP },
+        { "GetLineOffsets_LF_AVX2_OpenMP",   GetLineOffsets_LF_AVX2_OpenMP },
+        { "GetLineOffsets_CRLF_AVX2_OpenMP", GetLineOffsets_CRLF_AVX2_OpenMP },
+        { "GetLineOffsets_Mixed_AVX2_OpenMP", GetLineOffsets_Mixed_AVX2_OpenMP },
+    };
+    for (const OffsetsVariant& v : variants) {
+        GetLineOffsetsFn fn = v.fn;
+        cases.push_back({ v.name, [fn, wpath]() -> size_t {
+            MappedFile mf;
+            if (OpenMappedFile(wpath, mf) != 0) {
+                return 0;
+            }
+            std::vector<size_t> lineOffsets;
+            fn(mf.data, mf.size, lineOffsets);
+            CloseMappedFile(mf);
+            return lineOffsets.size();
+        } });
+    }
+
+    // 圧縮形式（ブロックの基準位置 + 32ビットの差）の行オフセット（2パス方式で使うもの）
+    cases.push_back({ "ScanLineOffsets", [wpath]() -> size_t {
+        MappedFile mf;
+        if (OpenMappedFile(wpath, mf) != 0) {
+            return 0;
+        }
+        LineOffsetArray lineOffsets;
+        ScanLineOffsets(mf.data, mf.size, lineOffsets);
+        CloseMappedFile(mf);
+        return lineOffsets.size;
+    } });
+
+    // 読み込み全体（マップ・走査・パース・解放）
+    struct LoadVariant { const char* name; int loadMode; int ioBackend; int quoting; };
+    static const LoadVariant loads[] = {
+        { "FastCsvLoad_TwoPass",    LOADMODE_TWOPASS,    IOBACKEND_MMAP,  QUOTING_NONE },
+        { "FastCsvLoad_Fused",      LOADMODE_FUSED,      IOBACKEND_MMAP,  QUOTING_NONE },
+        { "FastCsvLoad_Structural", LOADMODE_STRUCTURAL, IOBACKEND_MMAP,  QUOTING_NONE },
+        { "FastCsvLoad_Quoted",     LOADMODE_STRUCTURAL, IOBACKEND_MMAP,  QUOTING_RFC4180 },
+        { "FastCsvLoad_Async",      LOADMODE_FUSED,      IOBACKEND_ASYNC, QUOTING_NONE },
+    };
+    const int cols = std::min(cfg.cols, COLUMN_SIZE);
+    for (const LoadVariant& v : loads) {
+        if (cfg.blanks && v.quoting != QUOTING_NONE) {
+            continue; // 引用符付きでは whitespace を指定できない
+        }
+        CsvLoadOptions opt;
+        opt.loadMode = v.loadMode;
+        opt.ioBackend = v.ioBackend;
+        opt.quoting = v.quoting;
+        opt.delimiter = cfg.delimiter;
+        opt.whitespace = cfg.blanks;
+        opt.quiet = true;
+        cases.push_back({ v.name, [opt, wpath, cols]() -> size_t {
+            std::vector<PointCloud> pointClouds;
+            if (FastCsvLoad(wpath, pointClouds, cols, opt) != 0) {
+                return 0;
+            }
+            return pointClouds.size();
+        } });
+    }
+
+    if (cfg.slow) {
+        cases.push_back({ "SlowCsvLoad", [wpath]() -> size_t {
+            std::vector<PointCloud> pointClouds;
+            if (SlowCsvLoad(wpath, pointClouds) != 0) {
+                return 0;
+            }
+            return pointClouds.size();
+        } });
+    }
+
+    // ケースの絞り込み（名前の部分一致）
+    if (!cfg.cases.empty()) {
+        std::vector<BenchCase> selected;
+        for (const BenchCase& c : cases) {
+            for (const std::string& key : cfg.cases) {
+                if (c.name.find(key) != std::string::npos) {
+                    selected.push_back(c);
+                    break;
+                }
+            }
+        }
+        cases.swap(selected);
+    }
+    return cases;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 結果の出力
+struct BenchResult {
+    std::string name;
+    int         threads;
+    const char* cache;
+    uint64_t    bytes;
+    size_t      rows;
+    int         reps;
+    double      minSec;
+    double      medianSec;
+};
+
+static void PrintHeader(const BenchConfig& cfg)
+{
+    if (!cfg.json) {
+        std::printf("case,threads,cache,bytes,rows,reps,min_sec,median_sec,gb_per_sec,mrows_per_sec\n");
+    }
+}
+
+static void PrintResult(const BenchConfig& cfg, const BenchResult& r)
+{
+    // スループットは中央値から計算（読み込みに失敗した場合 rows = 0 とし、スループットも 0）
+    const double gbps = (r.medianSec > 0 && r.rows > 0) ? r.bytes / r.medianSec / 1e9 : 0.0;
+    const double mrps = (r.medianSec > 0) ? r.rows / r.medianSec / 1e6 : 0.0;
+    if (cfg.json) {
+        std::printf("{\"case\":\"%s\",\"threads\":%d,\"cache\":\"%s\",\"bytes\":%llu,\"rows\":%llu,\"reps\":%d,"
+            "\"min_sec\":%.6f,\"median_sec\":%.6f,\"gb_per_sec\":%.4f,\"mrows_per_sec\":%.4f}\n",
+            r.name.c_str(), r.threads, r.cache, static_cast<unsigned long long>(r.bytes),
+            static_cast<unsigned long long>(r.rows), r.reps, r.minSec, r.medianSec, gbps, mrps);
+    }
+    else {
+        std::printf("%s,%d,%s,%llu,%llu,%d,%.6f,%.6f,%.4f,%.4f\n",
+            r.name.c_str(), r.threads, r.cache, static_cast<unsigned long long>(r.bytes),
+            static_cast<unsigned long long>(r.rows), r.reps, r.minSec, r.medianSec, gbps, mrps);
+    }
+    std::fflush(stdout);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 引数の解析
+static std::vector<std::string> SplitList(const std::string& s)
+{
+    std::vector<std::string> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) {
+            out.push_back(item);
+        }
+    }
+    return out;
+}
+
+static void PrintUsage()
+{
+    std::cerr <<
+        "Usage: FastCsvBench [options]\n"
+        "  --input <file>            既存の CSV を使う（生成しない）\n"
+        "  --output <file>           生成先 (既定 fastcsvbench.csv)\n"
+        "  --rows <n>                生成する行数 (既定 1000000)\n"
+        "  --cols <n>                列数 (既定 10)\n"
+        "  --newline lf|crlf|mixed   改行コード\n"
+        "  --delimiter comma|tab|semicolon|space|blanks  区切り（blanks は連続する空白・タブ）\n"
+        "  --quote none|some|all     引用符\n"
+        "  --number fixed|sci|int    数値形式\n"
+        "  --precision <n>           小数点以下の桁数 (既定 6)\n"
+        "  --keep                    生成したファイルを残す\n"
+        "  --threads 1,2,4           スレッド数 (既定 1 から最大まで 2 倍ずつ)\n"
+        "  --cases a,b               計測するケース（名前の部分一致）\n"
+        "  --reps <n>                繰り返し回数 (既定 3)\n"
+        "  --cache warm|cold|both    ページキャッシュの状態 (既定 warm)\n"
+        "  --slow                    SlowCsvLoad も計測する\n"
+        "  --json                    JSON Lines で出力 (既定 CSV)\n";
+}
+
+static int ParseArgs(int argc, char* argv[], BenchConfig& cfg)
+{
+    for (int i = 1; i < argc; ++i) {
+        const std::string a = argv[i];
+        auto value = [&]() -> std::string {
+            return (i + 1 < argc) ? std::string(argv[++i]) : std::string();
+        };
+        if (a == "--input") cfg.input = value();
+        else if (a == "--output") cfg.output = value();
+        else if (a == "--rows") cfg.rows = std::atoll(value().c_str());
+        else if (a == "--cols") cfg.cols = std::max(1, std::atoi(value().c_str()));
+        else if (a == "--precision") cfg.precision = std::min(12, std::max(0, std::atoi(value().c_str())));
+        else if (a == "--reps") cfg.reps = std::max(1, std::atoi(value().c_str()));
+        else if (a == "--keep") cfg.keep = true;
+        else if (a == "--slow") cfg.slow = true;
+        else if (a == "--json") cfg.json = true;
+        else if (a == "--cases") cfg.cases = SplitList(value());
+        else if (a == "--threads") {
+            for (const std::string& t : SplitList(value())) {
+                cfg.threads.push_back(std::max(1, std::atoi(t.c_str())));
+            }
+        }
+        else if (a == "--newline") {
+            const std::string v = value();
+            cfg.newline = (v == "crlf") ? NEWLINE_CRLF : (v == "mixed") ? NEWLINE_MIXED : NEWLINE_LF;
+        }
+        else if (a == "--delimiter") {
+            const std::string v = value();
+            cfg.delimiter = (v == "tab") ? '\t' : (v == "semicolon") ? ';' : (v == "space" || v == "blanks") ? ' ' : ',';
+            cfg.blanks = (v == "blanks");
+        }
+        else if (a == "--quote") {
+            const std::string v = value();
+            cfg.quote = (v == "all") ? QUOTE_ALL : (v == "some") ? QUOTE_SOME : QUOTE_NONE;
+        }
+        else if (a == "--number") {
+            const std::string v = value();
+            cfg.numFormat = (v == "sci") ? NUMFMT_SCI : (v == "int") ? NUMFMT_INT : NUMFMT_FIXED;
+        }
+        else if (a == "--cache") {
+            const std::string v = value();
+            cfg.warm = (v != "cold");
+            cfg.cold = (v == "cold" || v == "both");
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (cfg.threads.empty()) {
+        const int maxThreads = omp_get_max_threads();
+        for (int t = 1; t < maxThreads; t *= 2) {
+            cfg.threads.push_back(t);
+        }
+        cfg.threads.push_back(maxThreads);
+    }
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char* argv[])
+{
+    BenchConfig cfg;
+    if (ParseArgs(argc, argv, cfg) != 0) {
+        return 1;
+    }
+
+    // 入力ファイルの用意
+    std::string path = cfg.input;
+    if (path.empty()) {
+        path = cfg.output;
+        std::cerr << "generating " << path << " (" << cfg.rows << " rows)" << std::endl;
+        if (GenerateCsv(cfg, path) != 0) {
+            return 1;
+        }
+    }
+    const std::wstring wpath(path.begin(), path.end());
+    uint64_t bytes = 0;
+    {
+        MappedFile mf;
+        if (OpenMappedFile(wpath, mf) != 0) {
+            return 1;
+        }
+        bytes = mf.size;
+        CloseMappedFile(mf);
+    }
+
+    std::vector<BenchCase> cases = MakeCases(cfg, wpath);
+    PrintHeader(cfg);
+
+    // 読み込み関数の標準出力（FileSize など）は結果に混ざらないよう捨てる
+    std::ostringstream sink;
+    std::streambuf* coutBuf = std::cout.rdbuf();
+
+    for (int cacheState = 0; cacheState < 2; ++cacheState) {
+        const bool cold = (cacheState == 1);
+        if ((cold && !cfg.cold) || (!cold && !cfg.warm)) {
+            continue;
+        }
+        for (const BenchCase& c : cases) {
+            for (int threads : cfg.threads) {
+                omp_set_num_threads(threads);
+                if (!cold) {
+                    // warm: 1回空読みしてページキャッシュに載せる
+                    std::cout.rdbuf(sink.rdbuf());
+                    c.run();
+                    std::cout.rdbuf(coutBuf);
+                }
+
+                std::vector<double> seconds;
+                size_t rows = 0;
+                for (int rep = 0; rep < cfg.reps; ++rep) {
+                    if (cold && !DropFileCache(path)) {
+                        std::cerr << "ページキャッシュを破棄できません: " << path << std::endl;
+                    }
+                    sink.str(std::string());
+                    std::cout.rdbuf(sink.rdbuf());
+                    const auto t0 = std::chrono::steady_clock::now();
+                    rows = c.run();
+                    const auto t1 = std::chrono::steady_clock::now();
+                    std::cout.rdbuf(coutBuf);
+                    seconds.push_back(std::chrono::duration<double>(t1 - t0).count());
+                }
+                std::sort(seconds.begin(), seconds.end());
+
+                BenchResult r;
+                r.name = c.name;
+                r.threads = threads;
+                r.cache = cold ? "cold" : "warm";
+                r.bytes = bytes;
+                r.rows = rows;
+                r.reps = cfg.reps;
+                r.minSec = seconds.front();
+                r.medianSec = seconds[seconds.size() / 2];
+                PrintResult(cfg, r);
+            }
+        }
+    }
+
+    if (cfg.input.empty() && !cfg.keep) {
+        std::remove(path.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,252 @@
+﻿#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <functional>
+#include <cstring>
+#include <omp.h>
+
+#include "CsvCache.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 元の CSV の識別情報（サイズ・更新時刻・サンプリングハッシュ）
+#define CSVCACHE_HASH_HEAD   (64 << 10) // 先頭と末尾から読むバイト数
+#define CSVCACHE_HASH_BLOCKS 16         // 途中から等間隔に読むブロック数
+#define CSVCACHE_HASH_BLOCK  4096
+
+static uint64_t Fnv1a(uint64_t h, const char* p, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        h ^= static_cast<unsigned char>(p[i]);
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+int GetCsvSourceStamp(const std::wstring& csvPath, CsvSourceStamp& stamp)
+{
+    uint64_t& size = stamp.size;
+    uint64_t& hash = stamp.hash;
+    std::error_code ec;
+    const std::filesystem::path path(csvPath);
+    size = static_cast<uint64_t>(std::filesystem::file_size(path, ec));
+    if (ec) {
+        return 1;
+    }
+    const auto t = std::filesystem::last_write_time(path, ec);
+    if (ec) {
+        return 1;
+    }
+    stamp.mtime = static_cast<int64_t>(t.time_since_epoch().count());
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return 1;
+    }
+    hash = 0xcbf29ce484222325ULL;
+    std::vector<char> buf(CSVCACHE_HASH_HEAD);
+    auto hashRange = [&](uint64_t offset, size_t len) {
+        file.seekg(static_cast<std::streamoff>(offset));
+        file.read(buf.data(), static_cast<std::streamsize>(len));
+        hash = Fnv1a(hash, buf.data(), static_cast<size_t>(file.gcount()));
+        file.clear();
+    };
+    hashRange(0, static_cast<size_t>(std::min<uint64_t>(size, CSVCACHE_HASH_HEAD)));
+    if (size > 2 * CSVCACHE_HASH_HEAD) {
+        for (int i = 1; i <= CSVCACHE_HASH_BLOCKS; ++i) {
+            hashRange(size / (CSVCACHE_HASH_BLOCKS + 1) * i, CSVCACHE_HASH_BLOCK);
+        }
+        hashRange(size - CSVCACHE_HASH_HEAD, CSVCACHE_HASH_HEAD);
+    }
+    return 0;
+}
+
+static uint64_t AlignUp(uint64_t v)
+{
+    return (v + CSVCACHE_ALIGNMENT - 1) / CSVCACHE_ALIGNMENT * CSVCACHE_ALIGNMENT;
+}
+
+std::wstring CsvCachePath(const std::wstring& csvPath)
+{
+    return csvPath + L".fcc";
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// キャッシュを開いて検証する
+int OpenCsvCache(const std::wstring& csvPath, const std::vector<CsvColumnDef>& columns, CsvCacheView& view)
+{
+    view = CsvCacheView();
+
+    std::error_code ec;
+    const std::wstring cachePath = CsvCachePath(csvPath);
+    if (!std::filesystem::exists(std::filesystem::path(cachePath), ec)) {
+        return 1;
+    }
+    CsvSourceStamp stamp;
+    if (GetCsvSourceStamp(csvPath, stamp) != 0) {
+        return 1;
+    }
+
+    MapOptions mapOpt;
+    mapOpt.advice = MAPADVICE_WILLNEED;
+    if (OpenMappedFile(cachePath, view.mf, mapOpt) != 0) {
+        return 1;
+    }
+
+    // ヘッダと列定義の検証
+    const char* base = view.mf.data;
+    const size_t fileSize = view.mf.size;
+    CsvCacheHeader h;
+    bool valid = (fileSize >= sizeof(h));
+    if (valid) {
+        std::memcpy(&h, base, sizeof(h));
+        valid = std::memcmp(h.magic, CSVCACHE_MAGIC, sizeof(h.magic)) == 0 &&
+            h.version == CSVCACHE_VERSION &&
+            h.sourceSize == stamp.size && h.sourceMtime == stamp.mtime && h.sourceHash == stamp.hash &&
+            h.numColumns == columns.size() &&
+            fileSize >= sizeof(h) + sizeof(CsvCacheColumn) * h.numColumns;
+    }
+    for (uint32_t i = 0; valid && i < h.numColumns; ++i) {
+        CsvCacheColumn c;
+        std::memcpy(&c, base + sizeof(h) + sizeof(c) * i, sizeof(c));
+        c.name[CSVCACHE_NAME_SIZE - 1] = '\0';
+        const uint64_t bytes = h.rows * ColumnTypeSize(static_cast<int>(c.type));
+        valid = columns[i].name == c.name && columns[i].type == static_cast<int>(c.type) &&
+            c.offset % CSVCACHE_ALIGNMENT == 0 && c.offset + bytes <= fileSize;
+        if (valid) {
+            CsvCacheView::Column col;
+            col.name = c.name;
+            col.type = static_cast<int>(c.type);
+            col.data = base + c.offset;
+            view.columns.push_back(col);
+        }
+    }
+    if (!valid) {
+        CloseCsvCache(view);
+        return 1;
+    }
+    view.rows = static_cast<size_t>(h.rows);
+    return 0;
+}
+
+void CloseCsvCache(CsvCacheView& view)
+{
+    CloseMappedFile(view.mf);
+    view = CsvCacheView();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// キャッシュの書き出し（列データは columnData(i, scratch) で1列ずつ受け取る）
+static int WriteCacheFile(const std::wstring& csvPath, const std::vector<CsvColumnDef>& columns, size_t rows,
+    const std::function<const void*(size_t, AlignedBuffer&)>& columnData)
+{
+    CsvCacheHeader h = {};
+    std::memcpy(h.magic, CSVCACHE_MAGIC, sizeof(h.magic));
+    h.version = CSVCACHE_VERSION;
+    h.numColumns = static_cast<uint32_t>(columns.size());
+    h.rows = rows;
+    CsvSourceStamp stamp;
+    if (GetCsvSourceStamp(csvPath, stamp) != 0) {
+        std::cerr << "キャッシュ作成用に元ファイルの情報を取得できません。" << std::endl;
+        return 1;
+    }
+    h.sourceSize = stamp.size;
+    h.sourceMtime = stamp.mtime;
+    h.sourceHash = stamp.hash;
+
+    // 列定義と列データの配置
+    std::vector<CsvCacheColumn> descs(columns.size());
+    uint64_t offset = AlignUp(sizeof(h) + sizeof(CsvCacheColumn) * columns.size());
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (columns[i].name.size() >= CSVCACHE_NAME_SIZE) {
+            std::cerr << "列名が長すぎるためキャッシュを作成できません: " << columns[i].name << std::endl;
+            return 1;
+        }
+        CsvCacheColumn& d = descs[i];
+        std::memset(&d, 0, sizeof(d));
+        std::memcpy(d.name, columns[i].name.data(), columns[i].name.size());
+        d.type = static_cast<uint32_t>(columns[i].type);
+        d.offset = offset;
+        offset = AlignUp(offset + rows * ColumnTypeSize(columns[i].type));
+    }
+
+    // 一時ファイルに書いてから置き換える（書き込み途中のキャッシュを読ませない）
+    const std::filesystem::path cachePath(CsvCachePath(csvPath));
+    std::filesystem::path tmpPath = cachePath;
+    tmpPath += L".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "キャッシュファイルを作成できません。" << std::endl;
+            return 1;
+        }
+        static const char zeros[CSVCACHE_ALIGNMENT] = {};
+        uint64_t written = 0;
+        auto put = [&](const void* p, uint64_t n) {
+            out.write(static_cast<const char*>(p), static_cast<std::streamsize>(n));
+            written += n;
+        };
+        auto pad = [&]() {
+            put(zeros, AlignUp(written) - written);
+        };
+
+        put(&h, sizeof(h));
+        put(descs.data(), sizeof(CsvCacheColumn) * descs.size());
+        pad();
+        AlignedBuffer scratch;
+        for (size_t i = 0; i < columns.size(); ++i) {
+            put(columnData(i, scratch), rows * ColumnTypeSize(columns[i].type));
+            pad();
+        }
+        if (!out) {
+            std::cerr << "キャッシュファイルの書き込みに失敗しました。" << std::endl;
+            out.close();
+            std::error_code ec;
+            std::filesystem::remove(tmpPath, ec);
+            return 1;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmpPath, cachePath, ec);
+    if (ec) {
+        std::cerr << "キャッシュファイルの置き換えに失敗しました。" << std::endl;
+        std::filesystem::remove(tmpPath, ec);
+        return 1;
+    }
+    return 0;
+}
+
+int WriteCsvCache(const std::wstring& csvPath, const CsvTable& table)
+{
+    std::vector<CsvColumnDef> columns;
+    for (const CsvColumn& col : table.columns) {
+        columns.push_back({ col.name, col.type });
+    }
+    return WriteCacheFile(csvPath, columns, table.rows,
+        [&](size_t i, AlignedBuffer&) -> const void* {
+            return table.columns[i].data.data();
+        });
+}
+
+int WriteCsvCache(const std::wstring& csvPath, const std::vector<PointCloud>& pointClouds, int num_cols)
+{
+    std::vector<CsvColumnDef> columns = PointCloudSchema().columns;
+    if (num_cols <= 0 || num_cols > static_cast<int>(columns.size())) {
+        return 1;
+    }
+    columns.resize(num_cols);
+    const long long rows = static_cast<long long>(pointClouds.size());
+    return WriteCacheFile(csvPath, columns, pointClouds.size(),
+        [&](size_t i, AlignedBuffer& scratch) -> const void* {
+            // 構造体の配列から1列分を取り出す
+            scratch.Allocate(pointClouds.size() * sizeof(float));
+            float* dst = reinterpret_cast<float*>(scratch.data());
+#pragma omp parallel for
+            for (long long r = 0; r < rows; ++r) {
+                dst[r] = pointClouds[r].fields[i];
+            }
+            return dst;
+        });
+}
@@ -0,0 +1,70 @@
+﻿#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "FastCsvLoad.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// パース済みの列を保存するバイナリキャッシュ（CSV の隣に置く <csv>.fcc）
+// 2回目以降はキャッシュをメモリマップするだけで読み込める。
+//
+// ファイル構成（リトルエンディアン、ネイティブの型サイズ）
+//   CsvCacheHeader
+//   CsvCacheColumn x numColumns
+//   列データ（各列は CSVCACHE_ALIGNMENT 境界から連続）
+//
+// 元の CSV のサイズ・更新時刻・サンプリングしたハッシュが一致しない場合は無効とする。
+// ハッシュはファイル全体ではなく先頭・末尾と等間隔のブロックから計算する（キャッシュ判定で全体を読まないため）
+// 不正な行がなかった読み込みからだけ書くので、errorPolicy によらず同じ内容になる
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+#define CSVCACHE_MAGIC     "FCSVCACH"
+#define CSVCACHE_VERSION   1
+#define CSVCACHE_ALIGNMENT 64
+#define CSVCACHE_NAME_SIZE 48
+
+struct CsvCacheHeader {
+    char     magic[8];     // CSVCACHE_MAGIC
+    uint32_t version;      // CSVCACHE_VERSION
+    uint32_t numColumns;
+    uint64_t rows;
+    uint64_t sourceSize;   // 元の CSV のバイト数
+    int64_t  sourceMtime;  // 元の CSV の更新時刻（std::filesystem::file_time_type の生の値）
+    uint64_t sourceHash;   // 元の CSV のサンプリングハッシュ（FNV-1a 64）
+};
+
+struct CsvCacheColumn {
+    char     name[CSVCACHE_NAME_SIZE]; // 0 終端
+    uint32_t type;                     // COLTYPE_*
+    uint32_t reserved;
+    uint64_t offset;                   // ファイル先頭からの列データ位置
+};
+
+// 元の CSV の識別情報（キャッシュ・行インデックスの有効性判定に使う）
+struct CsvSourceStamp {
+    uint64_t size  = 0; // バイト数
+    int64_t  mtime = 0; // 更新時刻（std::filesystem::file_time_type の生の値）
+    uint64_t hash  = 0; // サンプリングハッシュ（FNV-1a 64）
+};
+
+int GetCsvSourceStamp(const std::wstring& csvPath, CsvSourceStamp& stamp);
+
+// csvPath に対応するキャッシュファイルのパス
+std::wstring CsvCachePath(const std::wstring& csvPath);
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// @brief キャッシュが csvPath の現在の内容と一致していればマップする
+// @param[in]  csvPath  元の CSV のパス
+// @param[in]  columns  期待する列（名前と型が順に一致すること）
+// @param[out] view     マップ結果（使い終わったら CloseCsvCache）
+// @return              有効なキャッシュをマップできたら 0、キャッシュがない・古い・列が違う場合は非 0
+// CsvCacheView と CloseCsvCache は FastCsvLoad.h（FastCsvLoadColumnsView の結果として公開）
+int OpenCsvCache(const std::wstring& csvPath, const std::vector<CsvColumnDef>& columns, CsvCacheView& view);
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// @brief 読み込んだ表をキャッシュに書き出す（一時ファイルに書いてから置き換える）
+// @return 成功時は 0、失敗時は非 0
+int WriteCsvCache(const std::wstring& csvPath, const CsvTable& table);
+
+// PointCloud の先頭 num_cols 列を float 列としてキャッシュに書き出す
+int WriteCsvCache(const std::wstring& csvPath, const std::vector<PointCloud>& pointClouds, int num_cols);
@@ -0,0 +1,563 @@
+﻿#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#ifdef FASTCSVLOAD_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef FASTCSVLOAD_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "CsvCompressed.h"
+#include "MappedFile.h"
+#include "TaskScheduler.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 圧縮形式の判定
+int DetectCompression(const char* data, size_t size)
+{
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    if (size >= 2 && p[0] == 0x1F && p[1] == 0x8B) {
+        return COMPRESSION_GZIP;
+    }
+    if (size >= 4 && p[0] == 0x28 && p[1] == 0xB5 && p[2] == 0x2F && p[3] == 0xFD) {
+        return COMPRESSION_ZSTD;
+    }
+    return COMPRESSION_NONE;
+}
+
+int DetectFileCompression(const std::wstring& filename)
+{
+    MappedFile mf;
+    if (OpenFileForViews(filename, mf) != 0) {
+        return COMPRESSION_NONE;
+    }
+    int compression = COMPRESSION_NONE;
+    MappedView view;
+    if (mf.size > 0 && MapFileView(mf, 0, std::min<size_t>(mf.size, 4), view) == 0) {
+        compression = DetectCompression(view.data, view.size);
+        UnmapFileView(view);
+    }
+    CloseMappedFile(mf);
+    return compression;
+}
+
+bool CompressionSupported(int compression)
+{
+    switch (compression) {
+#ifdef FASTCSVLOAD_HAVE_ZLIB
+    case COMPRESSION_GZIP: return true;
+#endif
+#ifdef FASTCSVLOAD_HAVE_ZSTD
+    case COMPRESSION_ZSTD: return true;
+#endif
+    default: return false;
+    }
+}
+
+const char* CompressionName(int compression)
+{
+    switch (compression) {
+    case COMPRESSION_GZIP: return "gzip";
+    case COMPRESSION_ZSTD: return "zstd";
+    default:               return "none";
+    }
+}
+
+static uint32_t ReadLE32(const unsigned char* p)
+{
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+        (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+size_t DecompressedSizeHint(const char* data, size_t size, int compression)
+{
+#ifdef FASTCSVLOAD_HAVE_ZSTD
+    if (compression == COMPRESSION_ZSTD) {
+        // フレームヘッダだけをたどって展開後のサイズを足す
+        size_t pos = 0;
+        size_t total = 0;
+        while (pos < size) {
+            const size_t frameSize = ZSTD_findFrameCompressedSize(data + pos, size - pos);
+            const unsigned long long n = ZSTD_isError(frameSize) ? ZSTD_CONTENTSIZE_ERROR : ZSTD_getFrameContentSize(data + pos, frameSize);
+            if (n == ZSTD_CONTENTSIZE_UNKNOWN || n == ZSTD_CONTENTSIZE_ERROR) {
+                return size * 4;
+            }
+            total += static_cast<size_t>(n);
+            pos += frameSize;
+        }
+        return total;
+    }
+#endif
+    if (compression == COMPRESSION_GZIP && size >= 4) {
+        // 4GB 以上は下位 32 ビットしか残らないので、圧縮率の見込みと大きい方を使う
+        return std::max<size_t>(ReadLE32(reinterpret_cast<const unsigned char*>(data + size - 4)), size * 4);
+    }
+    return size * 4;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 独立したフレームへの分割
+// zstd: フレームヘッダに展開後のサイズがあれば使える（zstd コマンドでファイルを圧縮した場合は入る）
+// gzip: BGZF（各メンバーの拡張フィールド "BC" に圧縮後のサイズ、末尾の ISIZE に展開後のサイズ）
+static bool SplitZstdFrames(const char* data, size_t size, std::vector<CompressedFrame>& frames)
+{
+#ifdef FASTCSVLOAD_HAVE_ZSTD
+    size_t pos = 0;
+    size_t out = 0;
+    while (pos < size) {
+        const size_t frameSize = ZSTD_findFrameCompressedSize(data + pos, size - pos);
+        if (ZSTD_isError(frameSize)) {
+            return false;
+        }
+        // スキップ可能フレーム（pzstd のサイズ情報など）は 0 になる
+        const unsigned long long contentSize = ZSTD_getFrameContentSize(data + pos, frameSize);
+        if (contentSize == ZSTD_CONTENTSIZE_UNKNOWN || contentSize == ZSTD_CONTENTSIZE_ERROR) {
+            return false;
+        }
+        if (contentSize > 0) {
+            frames.push_back({ pos, frameSize, out, static_cast<size_t>(contentSize) });
+            out += static_cast<size_t>(contentSize);
+        }
+        pos += frameSize;
+    }
+    return frames.size() >= 2;
+#else
+    (void)data; (void)size; (void)frames;
+    return false;
+#endif
+}
+
+static bool SplitBgzfMembers(const char* data, size_t size, std::vector<CompressedFrame>& frames)
+{
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    size_t pos = 0;
+    size_t out = 0;
+    while (pos < size) {
+        // ID1 ID2 CM FLG MTIME(4) XFL OS XLEN(2) の後に拡張フィールド
+        if (size - pos < 18 || p[pos] != 0x1F || p[pos + 1] != 0x8B || p[pos + 2] != 8 || (p[pos + 3] & 0x04) == 0) {
+            return false;
+        }
+        const size_t xlen = static_cast<size_t>(p[pos + 10]) | (static_cast<size_t>(p[pos + 11]) << 8);
+        if (size - pos < 12 + xlen) {
+            return false;
+        }
+        size_t memberSize = 0;
+        for (size_t x = pos + 12; x + 4 <= pos + 12 + xlen; ) {
+            const size_t slen = static_cast<size_t>(p[x + 2]) | (static_cast<size_t>(p[x + 3]) << 8);
+            if (p[x] == 'B' && p[x + 1] == 'C' && slen == 2 && x + 6 <= pos + 12 + xlen) {
+                memberSize = (static_cast<size_t>(p[x + 4]) | (static_cast<size_t>(p[x + 5]) << 8)) + 1;
+            }
+            x += 4 + slen;
+        }
+        if (memberSize < 12 + xlen + 8 || memberSize > size - pos) {
+            return false;
+        }
+        const size_t isize = ReadLE32(p + pos + memberSize - 4);
+        if (isize > 0) { // 末尾の EOF マーカーは空のメンバー
+            frames.push_back({ pos, memberSize, out, isize });
+            out += isize;
+        }
+        pos += memberSize;
+    }
+    return frames.size() >= 2;
+}
+
+bool SplitCompressedFrames(const char* data, size_t size, int compression, std::vector<CompressedFrame>& frames)
+{
+    frames.clear();
+    const bool split = (compression == COMPRESSION_ZSTD) ? SplitZstdFrames(data, size, frames)
+        : (compression == COMPRESSION_GZIP) ? SplitBgzfMembers(data, size, frames)
+        : false;
+    if (!split) {
+        frames.clear();
+    }
+    return split;
+}
+
+// 1フレームを dst（frame.outSize バイト）に展開する
+static int DecompressFrame(const char* data, int compression, const CompressedFrame& frame, char* dst)
+{
+#ifdef FASTCSVLOAD_HAVE_ZSTD
+    if (compression == COMPRESSION_ZSTD) {
+        const size_t n = ZSTD_decompress(dst, frame.outSize, data + frame.offset, frame.size);
+        return (!ZSTD_isError(n) && n == frame.outSize) ? 0 : 1;
+    }
+#endif
+#ifdef FASTCSVLOAD_HAVE_ZLIB
+    if (compression == COMPRESSION_GZIP) {
+        // BGZF のメンバーは 64KB 未満なので uInt に収まる
+        z_stream zs = {};
+        if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK) {
+            return 1;
+        }
+        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data + frame.offset));
+        zs.avail_in = static_cast<uInt>(frame.size);
+        zs.next_out = reinterpret_cast<Bytef*>(dst);
+        zs.avail_out = static_cast<uInt>(frame.outSize);
+        const int ret = inflate(&zs, Z_FINISH);
+        const bool ok = (ret == Z_STREAM_END && zs.total_out == frame.outSize);
+        inflateEnd(&zs);
+        return ok ? 0 : 1;
+    }
+#endif
+    (void)data; (void)frame; (void)dst;
+    return 1;
+}
+
+int DecompressFrames(const char* data, int compression, const std::vector<CompressedFrame>& frames, AlignedBuffer& out)
+{
+    const size_t total = frames.empty() ? 0 : frames.back().outOffset + frames.back().outSize;
+    out.Allocate(total);
+    char* dst = reinterpret_cast<char*>(out.data());
+    std::atomic<bool> failed{ false };
+    // フレームの大きさは揃っているとは限らないのでワークスティーリングで分配する
+    RunStealingTasks(frames.size(), [&](size_t f, int) {
+        if (!failed.load(std::memory_order_relaxed) && DecompressFrame(data, compression, frames[f], dst + frames[f].outOffset) != 0) {
+            failed.store(true, std::memory_order_relaxed);
+        }
+    });
+    if (failed) {
+        std::cerr << CompressionName(compression) << " の展開に失敗しました。" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 順に展開する（形式ごとの状態）
+class StreamDecoder {
+public:
+    StreamDecoder() = default;
+    ~StreamDecoder() { End(); }
+
+    StreamDecoder(const StreamDecoder&) = delete;
+    StreamDecoder& operator=(const StreamDecoder&) = delete;
+
+    int Init(const char* data, size_t size, int compression);
+
+    // @brief dst に最大 capacity バイト展開する
+    // @param[out] produced  展開したバイト数
+    // @param[out] finished  圧縮データの終わりまで展開した
+    // @return 成功時は 0、失敗時は非 0
+    int Read(char* dst, size_t capacity, size_t& produced, bool& finished);
+
+private:
+    void End();
+
+    int compression_ = COMPRESSION_NONE;
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef FASTCSVLOAD_HAVE_ZLIB
+    int ReadGzip(char* dst, size_t capacity, size_t& produced, bool& finished);
+    z_stream zs_ = {};
+    bool     zsInit_ = false;
+    size_t   inPos_ = 0; // zs_ に渡し終えた入力の位置（avail_in は 32 ビットなので分けて渡す）
+#endif
+#ifdef FASTCSVLOAD_HAVE_ZSTD
+    int ReadZstd(char* dst, size_t capacity, size_t& produced, bool& finished);
+    ZSTD_DCtx*    dctx_ = nullptr;
+    ZSTD_inBuffer zin_ = {};
+#endif
+};
+
+int StreamDecoder::Init(const char* data, size_t size, int compression)
+{
+    End();
+    compression_ = compression;
+    data_ = data;
+    size_ = size;
+#ifdef FASTCSVLOAD_HAVE_ZLIB
+    if (compression == COMPRESSION_GZIP) {
+        zs_ = z_stream();
+        // gzip ヘッダを自動判定（zlib 形式も読める）
+        if (inflateInit2(&zs_, 32 + MAX_WBITS) != Z_OK) {
+            return 1;
+        }
+        zsInit_ = true;
+        inPos_ = 0;
+        return 0;
+    }
+#endif
+#ifdef FASTCSVLOAD_HAVE_ZSTD
+    if (compression == COMPRESSION_ZSTD) {
+        dctx_ = ZSTD_createDCtx();
+        zin_.src = data;
+        zin_.size = size;
+        zin_.pos = 0;
+        return dctx_ ? 0 : 1;
+    }
+#endif
+    std::cerr << CompressionName(compression) << " の展開には対応していません（ビルド時に無効）。" << std::endl;
+    return 1;
+}
+
+void StreamDecoder::End()
+{
+#ifdef FASTCSVLOAD_HAVE_ZLIB
+    if (zsInit_) {
+        inflateEnd(&zs_);
+        zsInit_ = false;
+    }
+#endif
+#ifdef FASTCSVLOAD_HAVE_ZSTD
+    if (dctx_) {
+        ZSTD_freeDCtx(dctx_);
+        dctx_ = nullptr;
+    }
+#endif
+}
+
+int StreamDecoder::Read(char* dst, size_t capacity, size_t& produced, bool& finished)
+{
+    produced = 0;
+    finished = false;
+#ifdef FASTCSVLOAD_HAVE_ZLIB
+    if (compression_ == COMPRESSION_GZIP) {
+        return ReadGzip(dst, capacity, produced, finished);
+    }
+#endif
+#ifdef FASTCSVLOAD_HAVE_ZSTD
+    if (compression_ == COMPRESSION_ZSTD) {
+        return ReadZstd(dst, capacity, produced, finished);
+    }
+#endif
+    (void)dst; (void)capacity;
+    return 1;
+}
+
+#ifdef FASTCSVLOAD_HAVE_ZLIB
+int StreamDecoder::ReadGzip(char* dst, size_t capacity, size_t& produced, bool& finished)
+{
+    const size_t kMaxChunk = 1u << 30;
+    while (produced < capacity) {
+        if (zs_.avail_in == 0 && inPos_ < size_) {
+            const size_t chunk = std::min(size_ - inPos_, kMaxChunk);
+            zs_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data_ + inPos_));
+            zs_.avail_in = static_cast<uInt>(chunk);
+            inPos_ += chunk;
+        }
+        const uInt room = static_cast<uInt>(std::min(capacity - produced, kMaxChunk));
+        zs_.next_out = reinterpret_cast<Bytef*>(dst + produced);
+        zs_.avail_out = room;
+        const int ret = inflate(&zs_, Z_NO_FLUSH);
+        produced += room - zs_.avail_out;
+        if (ret == Z_STREAM_END) {
+            // 連結された gzip（複数メンバー）は次のメンバーから続ける　それ以外の末尾のデータは無視する
+            const size_t rest = zs_.avail_in + (size_ - inPos_);
+            const unsigned char* next = zs_.avail_in ? zs_.next_in : reinterpret_cast<const unsigned char*>(data_ + inPos_);
+            if (rest >= 2 && next[0] == 0x1F && next[1] == 0x8B) {
+                inflateReset(&zs_);
+                continue;
+            }
+            finished = true;
+            return 0;
+        }
+        if (ret != Z_OK) {
+            std::cerr << "gzip の展開に失敗しました" << (ret == Z_BUF_ERROR ? "（データが途中で終わっています）。" : "。") << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
+#endif
+
+#ifdef FASTCSVLOAD_HAVE_ZSTD
+int StreamDecoder::ReadZstd(char* dst, size_t capacity, size_t& produced, bool& finished)
+{
+    // 連結されたフレームは ZSTD_decompressStream がそのまま続けて展開する
+    ZSTD_outBuffer out = { dst, capacity, 0 };
+    while (out.pos < out.size) {
+        const size_t before = out.pos;
+        const size_t ret = ZSTD_decompressStream(dctx_, &out, &zin_);
+        if (ZSTD_isError(ret)) {
+            std::cerr << "zstd の展開に失敗しました（" << ZSTD_getErrorName(ret) << "）。" << std::endl;
+            return 1;
+        }
+        if (zin_.pos == zin_.size) {
+            if (ret == 0) {
+                finished = true;
+                break;
+            }
+            if (out.pos == before) {
+                std::cerr << "zstd の展開に失敗しました（データが途中で終わっています）。" << std::endl;
+                return 1;
+            }
+        }
+    }
+    produced = out.pos;
+    return 0;
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+int DecompressAll(const char* data, size_t size, int compression, AlignedBuffer& out, size_t& outSize)
+{
+    outSize = 0;
+    if (!CompressionSupported(compression)) {
+        std::cerr << CompressionName(compression) << " の展開には対応していません（ビルド時に無効）。" << std::endl;
+        return 1;
+    }
+    std::vector<CompressedFrame> frames;
+    if (SplitCompressedFrames(data, size, compression, frames)) {
+        if (DecompressFrames(data, compression, frames, out) != 0) {
+            return 1;
+        }
+        outSize = out.size();
+        return 0;
+    }
+
+    StreamDecoder decoder;
+    if (decoder.Init(data, size, compression) != 0) {
+        return 1;
+    }
+    // 展開後のサイズの見込みで確保し、足りなければ倍にして移す
+    out.Allocate(std::max<size_t>(DecompressedSizeHint(data, size, compression), 1u << 16));
+    for (;;) {
+        size_t produced;
+        bool finished;
+        if (decoder.Read(reinterpret_cast<char*>(out.data()) + outSize, out.size() - outSize, produced, finished) != 0) {
+            return 1;
+        }
+        outSize += produced;
+        if (finished) {
+            return 0;
+        }
+        if (outSize == out.size()) {
+            AlignedBuffer grown(out.size() * 2);
+            std::memcpy(grown.data(), out.data(), outSize);
+            out = std::move(grown);
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 展開スレッド
+int DecompressBlockReader::Open(const char* data, size_t size, int compression, const AsyncReadOptions& opt)
+{
+    Close();
+    if (!CompressionSupported(compression)) {
+        std::cerr << CompressionName(compression) << " の展開には対応していません（ビルド時に無効）。" << std::endl;
+        return 1;
+    }
+    data_ = data;
+    size_ = size;
+    compression_ = compression;
+
+    blockSize_ = AlignedBuffer::PaddedSize(std::max<size_t>(opt.blockSize, 1));
+    next_ = released_ = 0;
+    done_ = stop_ = failed_ = false;
+    outputBytes_ = 0;
+    decompressSeconds_ = waitSeconds_ = 0.0;
+
+    slots_.resize(std::max(opt.numBuffers, 2));
+    for (Slot& s : slots_) {
+        s.buffer.Allocate(ASYNC_READ_HEADROOM + blockSize_);
+        s.block = -1;
+        s.size = 0;
+        s.last = false;
+    }
+    thread_ = std::thread(&DecompressBlockReader::DecompressLoop, this);
+    return 0;
+}
+
+bool DecompressBlockReader::WaitSlot(int64_t k)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [&] { return stop_ || k < released_ + static_cast<int64_t>(slots_.size()); });
+    return !stop_;
+}
+
+void DecompressBlockReader::Publish(int64_t k, size_t size, bool last, bool failed)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (failed) {
+        failed_ = true;
+        stop_ = true;
+    } else {
+        Slot& slot = slots_[k % static_cast<int64_t>(slots_.size())];
+        slot.size = size;
+        slot.last = last;
+        slot.block = k;
+    }
+    cv_.notify_all();
+}
+
+// ブロック k をスロット k % numBuffers に展開する
+void DecompressBlockReader::DecompressLoop()
+{
+    StreamDecoder decoder;
+    if (decoder.Init(data_, size_, compression_) != 0) {
+        Publish(0, 0, true, true);
+        return;
+    }
+    for (int64_t k = 0; ; ++k) {
+        if (!WaitSlot(k)) {
+            return;
+        }
+        Slot& slot = slots_[k % static_cast<int64_t>(slots_.size())];
+        const auto t0 = std::chrono::steady_clock::now();
+        size_t produced;
+        bool finished;
+        const int ret = decoder.Read(reinterpret_cast<char*>(slot.buffer.data()) + ASYNC_READ_HEADROOM, blockSize_, produced, finished);
+        decompressSeconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        outputBytes_ += produced;
+        Publish(k, produced, finished, ret != 0);
+        if (finished || ret != 0) {
+            return;
+        }
+    }
+}
+
+bool DecompressBlockReader::Next(AsyncBlock& block)
+{
+    if (done_ || slots_.empty()) {
+        return false;
+    }
+    const int64_t k = next_;
+    const int slotIndex = static_cast<int>(k % static_cast<int64_t>(slots_.size()));
+    Slot& slot = slots_[slotIndex];
+
+    const auto t0 = std::chrono::steady_clock::now();
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&] { return failed_ || stop_ || slot.block == k; });
+        if (slot.block != k) {
+            return false; // 展開の失敗は展開スレッドが出力済み
+        }
+    }
+    waitSeconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    block.data = reinterpret_cast<char*>(slot.buffer.data()) + ASYNC_READ_HEADROOM;
+    block.size = slot.size;
+    block.offset = static_cast<uint64_t>(k) * blockSize_;
+    block.last = slot.last;
+    block.slot = slotIndex;
+    done_ = slot.last;
+    ++next_;
+    return true;
+}
+
+void DecompressBlockReader::Release(const AsyncBlock& block)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    slots_[block.slot].block = -1;
+    ++released_;
+    cv_.notify_all();
+}
+
+void DecompressBlockReader::Close()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        cv_.notify_all();
+    }
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    slots_.clear();
+}
@@ -0,0 +1,129 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "AlignedBuffer.h"
+#include "AsyncReader.h" // AsyncBlock / AsyncReadOptions / ASYNC_READ_HEADROOM
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 圧縮された CSV（gzip / zstd）の展開
+// ・独立に展開できるフレームに分かれていれば（zstd の複数フレーム・pzstd、gzip の BGZF・bgzip）、
+//   フレームごとに並列に展開する（展開後のサイズがヘッダから分かるので、書き込み位置を先に決められる）
+// ・分かれていなければ展開スレッドが順に展開し、AsyncBlockReader と同じ形でブロックを渡す
+//   （パース側は展開済みのブロックを並列にパースし、その間に次のブロックの展開が進む）
+// ビルド時に FASTCSVLOAD_HAVE_ZLIB / FASTCSVLOAD_HAVE_ZSTD を定義した形式だけ展開できる
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+// CsvLoadOptions::compression
+#define COMPRESSION_AUTO 0 // 先頭のマジックナンバーで判定（既定）
+#define COMPRESSION_NONE 1 // 圧縮されていないものとして読む
+#define COMPRESSION_GZIP 2
+#define COMPRESSION_ZSTD 3
+
+// @brief 先頭のマジックナンバーから圧縮形式を判定する
+// @return COMPRESSION_GZIP / COMPRESSION_ZSTD / COMPRESSION_NONE
+int DetectCompression(const char* data, size_t size);
+
+// @brief ファイルの先頭だけを読んで圧縮形式を判定する（ファイル全体はマップしない）
+// @return COMPRESSION_GZIP / COMPRESSION_ZSTD / COMPRESSION_NONE（開けない場合も NONE）
+int DetectFileCompression(const std::wstring& filename);
+
+// compression の展開に対応してビルドされているか
+bool CompressionSupported(int compression);
+
+const char* CompressionName(int compression);
+
+// @brief 展開後のバイト数の見込み（出力の予約用）
+// zstd はフレームヘッダの展開後サイズの合計、gzip は末尾の ISIZE（4GB 未満の1メンバーなら正確）
+// @return 分からない場合は圧縮後のバイト数の 4 倍
+size_t DecompressedSizeHint(const char* data, size_t size, int compression);
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 独立に展開できるフレーム
+struct CompressedFrame {
+    size_t offset;    // 圧縮データ内の位置
+    size_t size;      // 圧縮後のバイト数
+    size_t outOffset; // 展開後の位置（前のフレームの展開後サイズの累積和）
+    size_t outSize;   // 展開後のバイト数
+};
+
+// @brief 圧縮データを展開後のサイズが分かる独立したフレームに分ける
+// @return 2つ以上のフレームに分けられた場合 true（1フレームだけ・展開後のサイズが不明なら false）
+bool SplitCompressedFrames(const char* data, size_t size, int compression, std::vector<CompressedFrame>& frames);
+
+// @brief フレームを並列に展開する（out は展開後の合計サイズで確保し直す）
+// @return 成功時は 0、失敗時は非 0
+int DecompressFrames(const char* data, int compression, const std::vector<CompressedFrame>& frames, AlignedBuffer& out);
+
+// @brief 圧縮データ全体を out に展開する（フレームに分けられれば並列、そうでなければ順に展開）
+// @param[out] outSize  展開後のバイト数（out.size() は確保したバイト数）
+// @return 成功時は 0、失敗時は非 0
+int DecompressAll(const char* data, size_t size, int compression, AlignedBuffer& out, size_t& outSize);
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 展開スレッドによるブロック単位の展開（AsyncBlockReader と同じ使い方）
+// 展開スレッドが blockSize バイトずつリングバッファに展開し、Next で順に受け取る。
+// ブロックの前には ASYNC_READ_HEADROOM バイト書き込めるので、前のブロックから続く行を置ける。
+class DecompressBlockReader {
+public:
+    DecompressBlockReader() = default;
+    ~DecompressBlockReader() { Close(); }
+
+    DecompressBlockReader(const DecompressBlockReader&) = delete;
+    DecompressBlockReader& operator=(const DecompressBlockReader&) = delete;
+
+    // @brief 圧縮データ [data, data + size) の展開スレッドを開始する（data は Close まで有効であること）
+    // opt.blockSize / opt.numBuffers を使う
+    // @return 成功時は 0、失敗時は非 0
+    int Open(const char* data, size_t size, int compression, const AsyncReadOptions& opt = AsyncReadOptions());
+
+    // 次のブロックを受け取る（展開完了まで待つ）　終端または展開エラーで false
+    // 最後のブロック（last）は空のことがある
+    bool Next(AsyncBlock& block);
+
+    // 受け取ったブロックを返却する（受け取った順に返却すること）
+    void Release(const AsyncBlock& block);
+
+    // 展開スレッドを止める
+    void Close();
+
+    bool     Failed()            const { return failed_; }
+    uint64_t OutputBytes()       const { return outputBytes_; }        // 展開したバイト数（Close 後に確定）
+    double   DecompressSeconds() const { return decompressSeconds_; } // 展開スレッドの時間（Close 後に確定）
+    double   WaitSeconds()       const { return waitSeconds_; }       // Next で展開完了を待った時間
+
+private:
+    struct Slot {
+        AlignedBuffer buffer;     // [HEADROOM | blockSize]
+        int64_t       block = -1; // 展開済みのブロック番号（-1 は空き）
+        size_t        size  = 0;
+        bool          last  = false;
+    };
+
+    void DecompressLoop();
+    bool WaitSlot(int64_t k); // スロットが空くまで待つ　止める場合は false
+    void Publish(int64_t k, size_t size, bool last, bool failed);
+
+    const char* data_ = nullptr;
+    size_t      size_ = 0;
+    int         compression_ = COMPRESSION_NONE;
+
+    std::vector<Slot>       slots_;
+    std::thread             thread_;
+    std::mutex              mutex_;
+    std::condition_variable cv_;
+
+    size_t  blockSize_ = 0;
+    int64_t next_      = 0; // 次に Next で渡すブロック
+    int64_t released_  = 0; // 返却済みのブロック数
+    bool    done_      = false; // 最後のブロックを Next で渡した
+    bool    stop_      = false;
+    bool    failed_    = false;
+    uint64_t outputBytes_ = 0;
+    double  decompressSeconds_ = 0.0;
+    double  waitSeconds_ = 0.0;
+};
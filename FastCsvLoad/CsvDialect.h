@@ -0,0 +1,139 @@
+﻿#pragma once
+#include <cstddef>
+#include "CsvErrors.h" // IsFieldEnd
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 区切り文字・空白・コメント行（CsvLoadOptions::delimiter / whitespace / comment）
+// 読み込みごとに形式を一度だけ選び、行のパースはその形式に特殊化したテンプレートで行う
+// （パースループ内では区切りの種類を判定しない）
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+// CsvLoadOptions::comment（組み合わせ可）
+#define COMMENT_NONE  0
+#define COMMENT_HASH  1 // '#' で始まる行を読み飛ばす
+#define COMMENT_SLASH 2 // "//" で始まる行を読み飛ばす
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 以下は内部ヘルパー
+
+// 読み込み1回分の形式（CsvLoadOptions から作る）
+struct CsvDialect {
+    char delimiter = ',';
+    bool whitespace = false;
+    int  comment = COMMENT_NONE;
+
+    // 既定（',' 区切り・空白もコメント行もなし）か
+    bool IsDefault() const { return delimiter == ',' && !whitespace && comment == COMMENT_NONE; }
+};
+
+// 空白（' ' / '\t'）か
+static inline bool IsBlank(char c)
+{
+    return (c == ' ') | (c == '\t');
+}
+
+static inline const char* SkipBlanks(const char* ptr, const char* end)
+{
+    while (ptr < end && IsBlank(*ptr)) {
+        ++ptr;
+    }
+    return ptr;
+}
+
+// 行 [pos, end) がコメント行か（comment は COMMENT_* の組み合わせ）
+static inline bool IsCommentLine(const char* pos, const char* end, int comment)
+{
+    if (pos >= end) {
+        return false;
+    }
+    return ((comment & COMMENT_HASH) && *pos == '#') ||
+           ((comment & COMMENT_SLASH) && *pos == '/' && pos + 1 < end && pos[1] == '/');
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// フィールドの区切り方（行パースのテンプレート引数）
+//   IgnoreLine(pos, end)  行 [pos, end) を読み飛ばすか（コメント行・空白だけの行）
+//   FieldBegin(ptr, end)  フィールドの先頭（前の空白を飛ばす）
+//   Next(ptr, end)        数値の後ろ ptr が区切り・行末かを返し、ptr を次のフィールドの先頭へ進める
+//   Skip(ptr, end)        フィールドを区切りまで読み飛ばし、次のフィールドの先頭を返す
+
+// 区切り文字 delimiter でだけ区切る（既定の ',' もこれ）
+template <bool Comments>
+struct DelimitedFields {
+    char delimiter;
+    int  comment;
+
+    bool IgnoreLine(const char* pos, const char* end) const
+    {
+        return Comments && IsCommentLine(pos, end, comment);
+    }
+
+    const char* FieldBegin(const char* ptr, const char*) const { return ptr; }
+
+    bool Next(const char*& ptr, const char* end) const
+    {
+        const bool ok = IsFieldEnd(ptr, end, delimiter);
+        ptr += (ptr < end && *ptr == delimiter);
+        return ok;
+    }
+
+    const char* Skip(const char* ptr, const char* end) const
+    {
+        while (ptr < end && *ptr != delimiter && *ptr != '\n' && *ptr != '\r') {
+            ++ptr;
+        }
+        return (ptr < end && *ptr == delimiter) ? ptr + 1 : ptr;
+    }
+};
+
+// フィールドの前後の空白を読み飛ばす（CsvLoadOptions::whitespace）
+// 区切り文字が空白・タブなら、連続する空白・タブを1つの区切りとみなす（.xyz / .pts）
+template <bool Comments>
+struct BlankFields {
+    char delimiter;
+    int  comment;
+    bool blankDelimiter; // IsBlank(delimiter)
+
+    bool IgnoreLine(const char* pos, const char* end) const
+    {
+        pos = SkipBlanks(pos, end);
+        return pos == end || (Comments && IsCommentLine(pos, end, comment));
+    }
+
+    const char* FieldBegin(const char* ptr, const char* end) const { return SkipBlanks(ptr, end); }
+
+    bool Next(const char*& ptr, const char* end) const
+    {
+        const char* q = SkipBlanks(ptr, end);
+        // 区切りが空白なら、数値の直後に空白が1つ以上あれば区切り
+        const bool ok = IsFieldEnd(q, end, delimiter) || (blankDelimiter && q > ptr);
+        ptr = q + (q < end && *q == delimiter);
+        return ok;
+    }
+
+    const char* Skip(const char* ptr, const char* end) const
+    {
+        while (ptr < end && !IsBlank(*ptr) && *ptr != delimiter && *ptr != '\n' && *ptr != '\r') {
+            ++ptr;
+        }
+        ptr = SkipBlanks(ptr, end);
+        return (ptr < end && *ptr == delimiter) ? ptr + 1 : ptr;
+    }
+};
+
+// @brief dialect に合う区切り方を選び、body(fields) を呼ぶ（行のループごと body を特殊化する）
+template <class Body>
+static inline auto WithFields(const CsvDialect& dialect, Body&& body)
+{
+    if (dialect.whitespace) {
+        const bool blank = IsBlank(dialect.delimiter);
+        if (dialect.comment != COMMENT_NONE) {
+            return body(BlankFields<true>{ dialect.delimiter, dialect.comment, blank });
+        }
+        return body(BlankFields<false>{ dialect.delimiter, dialect.comment, blank });
+    }
+    if (dialect.comment != COMMENT_NONE) {
+        return body(DelimitedFields<true>{ dialect.delimiter, dialect.comment });
+    }
+    return body(DelimitedFields<false>{ dialect.delimiter, dialect.comment });
+}
@@ -0,0 +1,120 @@
+﻿#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "CsvErrors.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+RowErrorSink MakeRowErrorSink(int policy, CsvLoadErrors* out, size_t maxRecords)
+{
+    RowErrorSink sink;
+    sink.policy = policy;
+    sink.maxRecords = maxRecords;
+    sink.out = out;
+    if (out) {
+        *out = CsvLoadErrors();
+    }
+    return sink;
+}
+
+int CheckRowErrors(const RowErrorSink& sink)
+{
+    if (sink.policy != ERRORPOLICY_STRICT || sink.count == 0) {
+        return 0;
+    }
+    std::cerr << "不正な行があります（行 " << sink.first.row
+        << "、バイト位置 " << sink.first.byteOffset
+        << "、列 " << sink.first.column << "）。" << std::endl;
+    return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// タスクごとの不正な行の記録
+bool RowErrorLog::Add(size_t task, size_t row, uint64_t byteOffset, int column)
+{
+    Task& t = tasks_[task];
+    ++t.count;
+    if (t.records.size() < std::max<size_t>(maxRecords_, 1)) {
+        // 最初の行は maxRecords が 0 でも残す（ERRORPOLICY_STRICT のメッセージ用）
+        t.records.push_back({ row, byteOffset, column });
+    }
+    if (policy_ == ERRORPOLICY_SKIP) {
+        t.skipped.push_back(row);
+    }
+    if (policy_ == ERRORPOLICY_STRICT) {
+        size_t stop = stopTask_.load(std::memory_order_relaxed);
+        while (task < stop && !stopTask_.compare_exchange_weak(stop, task, std::memory_order_relaxed)) {
+        }
+    }
+    return policy_ == ERRORPOLICY_FILLNAN;
+}
+
+size_t RowErrorLog::Count() const
+{
+    size_t n = 0;
+    for (const Task& t : tasks_) {
+        n += t.count;
+    }
+    return n;
+}
+
+std::vector<size_t> RowErrorLog::SkippedRows() const
+{
+    std::vector<size_t> rows;
+    for (const Task& t : tasks_) {
+        rows.insert(rows.end(), t.skipped.begin(), t.skipped.end());
+    }
+    return rows;
+}
+
+void RowErrorLog::Finish(RowErrorSink& sink, const std::vector<size_t>* rowBase, const std::vector<size_t>* taskFile) const
+{
+    // タスク内の行番号は昇順なので、タスク順に並べれば行番号順になる
+    std::vector<CsvRowError> records;
+    size_t count = 0;
+    for (size_t t = 0; t < tasks_.size(); ++t) {
+        count += tasks_[t].count;
+        for (CsvRowError e : tasks_[t].records) {
+            e.row += sink.rows + (rowBase ? (*rowBase)[t] : 0);
+            e.byteOffset += sink.bytes;
+            e.file = taskFile ? (*taskFile)[t] : 0;
+            records.push_back(e);
+        }
+    }
+    if (count == 0) {
+        return;
+    }
+    if (policy_ == ERRORPOLICY_STRICT) {
+        // 最初の不正な行より後ろは打ち切ったタスクがあり、行番号が確定しない
+        count = 1;
+        records.resize(1);
+    }
+    if (sink.count == 0) {
+        sink.first = records.front();
+    }
+    sink.count += count;
+    if (sink.out) {
+        sink.out->count += count;
+        const size_t room = (sink.maxRecords > sink.out->records.size()) ? sink.maxRecords - sink.out->records.size() : 0;
+        sink.out->records.insert(sink.out->records.end(), records.begin(), records.begin() + std::min(room, records.size()));
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+size_t CompactRows(unsigned char* data, size_t rowBytes, size_t rows, const std::vector<size_t>& removed)
+{
+    if (removed.empty()) {
+        return rows;
+    }
+    // 除く行の間の区間ごとにまとめて前へ移す
+    size_t dst = removed[0];
+    for (size_t k = 0; k < removed.size(); ++k) {
+        const size_t begin = removed[k] + 1;
+        const size_t end = (k + 1 < removed.size()) ? removed[k + 1] : rows;
+        if (end > begin) {
+            std::memmove(data + dst * rowBytes, data + begin * rowBytes, (end - begin) * rowBytes);
+            dst += end - begin;
+        }
+    }
+    return dst;
+}
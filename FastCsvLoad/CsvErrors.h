@@ -0,0 +1,110 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <atomic>
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 不正な行（読めないフィールド・列の不足）の扱いと記録
+// 正常な行では、フィールドごとに「変換に成功し、直後が区切りか行末か」を判定してビットを OR するだけで、
+// 分岐は行ごとに1回（不正な列があるか）だけ。不正な行だけを遅い経路で読み直して記録する。
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+// CsvLoadOptions::errorPolicy
+#define ERRORPOLICY_FILLNAN 0 // 読めない列を NaN（整数列は 0）にして行は残す（既定）
+#define ERRORPOLICY_SKIP    1 // 不正な行を出力から除き、数だけ数える
+#define ERRORPOLICY_STRICT  2 // 不正な行があれば読み込みを失敗させる（見つけた時点で打ち切り、出力は空にする）
+
+// 不正な行1つ分の記録
+struct CsvRowError {
+    size_t   row;        // 入力の行番号（0 始まり　空行・コメント行は数えず、ERRORPOLICY_SKIP で除いた行は数える）
+    uint64_t byteOffset; // 行頭のファイル先頭からのバイト位置（構造インデックスの場合は先頭フィールドの位置）
+    int      column;     // 最初に読めなかった列（0 始まり）
+    size_t   file = 0;   // FastCsvLoadBatch のファイル番号（行番号・バイト位置はそのファイル内、他の読み込みでは 0）
+};
+
+// 不正な行の集計（CsvLoadOptions::errors に渡すと書き込む）
+struct CsvLoadErrors {
+    size_t count = 0;                 // 不正な行の数（ERRORPOLICY_STRICT は最初の1行だけを記録するので 1）
+    std::vector<CsvRowError> records; // 行番号の小さい順に最大 CsvLoadOptions::maxErrorRecords 件
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 以下は内部ヘルパー
+
+// フィールドの変換後の位置 ptr が区切り・行末か（数値の後ろに余計な文字がない）
+static inline bool IsFieldEnd(const char* ptr, const char* end, char delimiter = ',')
+{
+    if (ptr >= end) {
+        return true;
+    }
+    const char c = *ptr;
+    return (c == delimiter) | (c == '\n') | (c == '\r');
+}
+
+// 読み込み1回分の不正な行の扱い（分割して読む場合は rows / bytes を進めながら使い回す）
+struct RowErrorSink {
+    int            policy = ERRORPOLICY_FILLNAN;
+    size_t         maxRecords = 0;
+    CsvLoadErrors* out = nullptr;  // nullptr なら記録しない（数と最初の行だけ数える）
+    size_t         rows = 0;       // これまでに読んだ入力の行数（次に渡す行番号の基準）
+    uint64_t       bytes = 0;      // これまでに読んだバイト数（次に渡すバイト位置の基準）
+    size_t         count = 0;      // 不正な行の数
+    CsvRowError    first = {};     // 最初の不正な行（count > 0 のとき有効）
+};
+
+// @brief policy / out / maxRecords を設定し、out を空にした RowErrorSink を返す
+RowErrorSink MakeRowErrorSink(int policy, CsvLoadErrors* out, size_t maxRecords);
+
+// ERRORPOLICY_STRICT で不正な行があった場合に最初の行を標準エラー出力に書き、非 0 を返す
+int CheckRowErrors(const RowErrorSink& sink);
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// タスクごとの不正な行の記録
+// 各タスクは自分の要素にだけ書くのでロックは不要。行番号・バイト位置はタスク内の基準からでよく、
+// Finish でタスクごとの行番号の基準と sink の基準を足して sink にまとめる。
+class RowErrorLog {
+public:
+    RowErrorLog(const RowErrorSink& sink, size_t numTasks)
+        : policy_(sink.policy), maxRecords_(sink.maxRecords), tasks_(numTasks) {}
+
+    int Policy() const { return policy_; }
+
+    // タスク task の行 row（行頭 byteOffset）を不正な行として記録する
+    // @return 行を出力に残すか（ERRORPOLICY_FILLNAN のみ true）
+    bool Add(size_t task, size_t row, uint64_t byteOffset, int column);
+
+    // タスク task の記録を捨てる（投機的なパースのやり直し用）
+    void Reset(size_t task) { tasks_[task] = Task(); }
+
+    // ERRORPOLICY_STRICT で不正な行が見つかったタスクより後ろのタスクは処理しなくてよい
+    // （前のタスクは最後まで処理するので、最初の不正な行とその行番号が確定する）
+    bool Skip(size_t task) const { return task > stopTask_.load(std::memory_order_relaxed); }
+
+    size_t Count() const;
+
+    // ERRORPOLICY_SKIP で除く行（タスク内の行番号のまま、タスク順・行番号順）
+    // 行番号が全体の行番号である2パス方式・固定長の行で使う
+    std::vector<size_t> SkippedRows() const;
+
+    // 記録を sink にまとめる（rowBase[task] はタスクの先頭の行番号、nullptr なら 0）
+    // taskFile[task] はタスクのファイル番号（複数ファイルの場合、nullptr なら 0）
+    // ERRORPOLICY_STRICT では最初の1行だけをまとめる
+    void Finish(RowErrorSink& sink, const std::vector<size_t>* rowBase, const std::vector<size_t>* taskFile = nullptr) const;
+
+private:
+    struct alignas(64) Task {
+        size_t count = 0;
+        std::vector<CsvRowError> records; // 最大 maxRecords_ 件
+        std::vector<size_t> skipped;      // ERRORPOLICY_SKIP の場合は全件
+    };
+
+    int policy_;
+    size_t maxRecords_;
+    std::vector<Task> tasks_;
+    std::atomic<size_t> stopTask_{ SIZE_MAX }; // 不正な行が見つかった最小のタスク
+};
+
+// @brief 行 removed（昇順）を除いて後ろの行を詰める（rowBytes バイトの行が rows 行並んだ領域）
+// @return 残った行数
+size_t CompactRows(unsigned char* data, size_t rowBytes, size_t rows, const std::vector<size_t>& removed);
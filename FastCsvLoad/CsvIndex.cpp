@@ -0,0 +1,195 @@
+﻿#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+
+#include "CsvIndex.h"
+#include "CsvCache.h" // CsvSourceStamp
+#include "CsvScan.h"  // ScanLineOffsets
+
+std::wstring CsvIndexPath(const std::wstring& csvPath)
+{
+    return csvPath + L".fci";
+}
+
+static size_t NumSamples(size_t rows, size_t interval)
+{
+    return (rows + interval - 1) / interval;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// インデックスの書き出し
+// lineOffsets[i] で行 i のオフセットが得られる配列（std::vector<size_t> / LineOffsetArray）
+template <class Offsets>
+static int WriteCsvIndexImpl(const std::wstring& csvPath, const Offsets& lineOffsets, size_t rows, size_t interval)
+{
+    interval = std::max<size_t>(interval, 1);
+    const size_t numSamples = NumSamples(rows, interval);
+
+    CsvIndexHeader h = {};
+    std::memcpy(h.magic, CSVINDEX_MAGIC, sizeof(h.magic));
+    h.version = CSVINDEX_VERSION;
+    h.interval = static_cast<uint32_t>(interval);
+    h.rows = rows;
+    CsvSourceStamp stamp;
+    if (GetCsvSourceStamp(csvPath, stamp) != 0) {
+        std::cerr << "インデックス作成用に元ファイルの情報を取得できません。" << std::endl;
+        return 1;
+    }
+    h.sourceSize = stamp.size;
+    h.sourceMtime = stamp.mtime;
+    h.sourceHash = stamp.hash;
+
+    // 区間ごとの先頭オフセットと、差分の最大値から差分の幅を決める
+    std::vector<uint64_t> samples(numSamples);
+    uint64_t maxDelta = 0;
+    for (size_t s = 0; s < numSamples; ++s) {
+        const size_t first = s * interval;
+        const size_t last = std::min(first + interval, rows) - 1;
+        samples[s] = lineOffsets[first];
+        maxDelta = std::max<uint64_t>(maxDelta, lineOffsets[last] - lineOffsets[first]);
+    }
+    if (maxDelta > 0xFFFFFFFFULL) {
+        std::cerr << "行が長すぎるためインデックスを作成できません。" << std::endl;
+        return 1;
+    }
+    h.deltaWidth = (maxDelta <= 0xFFFF) ? 2 : 4;
+
+    // 一時ファイルに書いてから置き換える
+    const std::filesystem::path indexPath(CsvIndexPath(csvPath));
+    std::filesystem::path tmpPath = indexPath;
+    tmpPath += L".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "インデックスファイルを作成できません。" << std::endl;
+            return 1;
+        }
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        out.write(reinterpret_cast<const char*>(samples.data()), static_cast<std::streamsize>(samples.size() * sizeof(uint64_t)));
+
+        // 差分は区間ごとにまとめて書く
+        std::vector<char> buf(interval * h.deltaWidth);
+        for (size_t s = 0; s < numSamples; ++s) {
+            const size_t first = s * interval;
+            const size_t n = std::min(first + interval, rows) - first;
+            for (size_t i = 0; i < n; ++i) {
+                const uint64_t d = lineOffsets[first + i] - samples[s];
+                if (h.deltaWidth == 2) {
+                    const uint16_t v = static_cast<uint16_t>(d);
+                    std::memcpy(&buf[i * 2], &v, 2);
+                }
+                else {
+                    const uint32_t v = static_cast<uint32_t>(d);
+                    std::memcpy(&buf[i * 4], &v, 4);
+                }
+            }
+            out.write(buf.data(), static_cast<std::streamsize>(n * h.deltaWidth));
+        }
+        if (!out) {
+            std::cerr << "インデックスファイルの書き込みに失敗しました。" << std::endl;
+            out.close();
+            std::error_code ec;
+            std::filesystem::remove(tmpPath, ec);
+            return 1;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmpPath, indexPath, ec);
+    if (ec) {
+        std::cerr << "インデックスファイルの置き換えに失敗しました。" << std::endl;
+        std::filesystem::remove(tmpPath, ec);
+        return 1;
+    }
+    return 0;
+}
+
+int WriteCsvIndex(const std::wstring& csvPath, const std::vector<size_t>& lineOffsets, size_t interval)
+{
+    return WriteCsvIndexImpl(csvPath, lineOffsets, lineOffsets.size(), interval);
+}
+
+int WriteCsvIndex(const std::wstring& csvPath, const LineOffsetArray& lineOffsets, size_t interval)
+{
+    return WriteCsvIndexImpl(csvPath, lineOffsets, lineOffsets.size, interval);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// CSV を走査してインデックスを作る
+int BuildCsvIndex(const std::wstring& csvPath, const CsvLoadOptions& opt)
+{
+    MappedFile mf;
+    if (OpenMappedFile(csvPath, mf, opt.map) != 0) {
+        return 1;
+    }
+    // 行インデックスはファイル内の位置なので、圧縮ファイルには作れない
+    if (opt.compression != COMPRESSION_NONE && DetectCompression(mf.data, mf.size) != COMPRESSION_NONE) {
+        std::cerr << "圧縮ファイルには行インデックスを作れません。" << std::endl;
+        CloseMappedFile(mf);
+        return 1;
+    }
+    LineOffsetArray lineOffsets;
+    ScanLineOffsets(mf.data, mf.size, lineOffsets);
+    CloseMappedFile(mf);
+    return WriteCsvIndex(csvPath, lineOffsets);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// インデックスを開いて検証する
+int OpenCsvIndex(const std::wstring& csvPath, CsvIndex& index)
+{
+    index = CsvIndex();
+
+    std::error_code ec;
+    const std::wstring indexPath = CsvIndexPath(csvPath);
+    if (!std::filesystem::exists(std::filesystem::path(indexPath), ec)) {
+        return 1;
+    }
+    CsvSourceStamp stamp;
+    if (GetCsvSourceStamp(csvPath, stamp) != 0) {
+        return 1;
+    }
+
+    MapOptions mapOpt;
+    mapOpt.advice = MAPADVICE_RANDOM;
+    if (OpenMappedFile(indexPath, index.mf, mapOpt) != 0) {
+        return 1;
+    }
+
+    const char* base = index.mf.data;
+    CsvIndexHeader h;
+    bool valid = (index.mf.size >= sizeof(h));
+    if (valid) {
+        std::memcpy(&h, base, sizeof(h));
+        valid = std::memcmp(h.magic, CSVINDEX_MAGIC, sizeof(h.magic)) == 0 &&
+            h.version == CSVINDEX_VERSION && h.interval > 0 &&
+            (h.deltaWidth == 2 || h.deltaWidth == 4) &&
+            h.sourceSize == stamp.size && h.sourceMtime == stamp.mtime && h.sourceHash == stamp.hash;
+    }
+    const size_t numSamples = valid ? NumSamples(static_cast<size_t>(h.rows), h.interval) : 0;
+    if (valid) {
+        valid = index.mf.size >= sizeof(h) + numSamples * sizeof(uint64_t) + h.rows * h.deltaWidth;
+    }
+    if (!valid) {
+        CloseCsvIndex(index);
+        return 1;
+    }
+
+    index.rows = static_cast<size_t>(h.rows);
+    index.interval = h.interval;
+    index.sourceSize = h.sourceSize;
+    index.deltaWidth = h.deltaWidth;
+    index.samples = reinterpret_cast<const uint64_t*>(base + sizeof(h)); // ヘッダは 8 バイトの倍数
+    index.deltas = base + sizeof(h) + numSamples * sizeof(uint64_t);
+    return 0;
+}
+
+void CloseCsvIndex(CsvIndex& index)
+{
+    CloseMappedFile(index.mf);
+    index = CsvIndex();
+}
@@ -0,0 +1,79 @@
+﻿#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "FastCsvLoad.h"
+
+struct LineOffsetArray; // CsvScan.h
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 永続化する行インデックス（CSV の隣に置く <csv>.fci）
+// GetLineOffsets_* の結果を一度だけ保存し、任意の行の開始位置を O(1) で求める。
+//
+// ファイル構成（リトルエンディアン）
+//   CsvIndexHeader
+//   samples[ceil(rows / interval)]  uint64  interval 行ごとの行頭オフセット
+//   deltas[rows]                    uint16 / uint32（deltaWidth）  同じ区間の先頭行からの差分
+//
+// 行 i の開始位置 = samples[i / interval] + deltas[i]
+// 1区間（interval 行）が 64KB 未満なら差分は 2 バイト、そうでなければ 4 バイトで持つ
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+#define CSVINDEX_MAGIC    "FCSVIDX1"
+#define CSVINDEX_VERSION  1
+#define CSVINDEX_INTERVAL 64 // 既定のサンプリング間隔（行）
+
+struct CsvIndexHeader {
+    char     magic[8];    // CSVINDEX_MAGIC
+    uint32_t version;     // CSVINDEX_VERSION
+    uint32_t interval;    // サンプリング間隔（行）
+    uint64_t rows;
+    uint64_t sourceSize;  // 元の CSV の識別情報（CsvSourceStamp）
+    int64_t  sourceMtime;
+    uint64_t sourceHash;
+    uint32_t deltaWidth;  // 差分のバイト数（2 or 4）
+    uint32_t reserved;
+};
+
+// インデックスをマップした結果
+struct CsvIndex {
+    MappedFile      mf;
+    size_t          rows = 0;
+    size_t          interval = 0;
+    uint64_t        sourceSize = 0;
+    uint32_t        deltaWidth = 0;
+    const uint64_t* samples = nullptr;
+    const void*     deltas = nullptr;
+
+    // 行 row の開始位置（row == rows ならファイル末尾）
+    uint64_t Offset(size_t row) const {
+        if (row >= rows) {
+            return sourceSize;
+        }
+        const uint64_t base = samples[row / interval];
+        return base + ((deltaWidth == 2)
+            ? static_cast<const uint16_t*>(deltas)[row]
+            : static_cast<const uint32_t*>(deltas)[row]);
+    }
+};
+
+// csvPath に対応するインデックスファイルのパス
+std::wstring CsvIndexPath(const std::wstring& csvPath);
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// @brief 行頭オフセットをインデックスファイルに書き出す
+// @param[in] csvPath      元の CSV のパス
+// @param[in] lineOffsets  GetLineOffsets_* / ScanLineOffsets の結果
+// @param[in] interval     サンプリング間隔（行）
+// @return                 成功時は 0、失敗時は非 0
+int WriteCsvIndex(const std::wstring& csvPath, const std::vector<size_t>& lineOffsets, size_t interval = CSVINDEX_INTERVAL);
+int WriteCsvIndex(const std::wstring& csvPath, const LineOffsetArray& lineOffsets, size_t interval = CSVINDEX_INTERVAL);
+
+// CSV を走査してインデックスを作る（ScanLineOffsets + WriteCsvIndex）
+int BuildCsvIndex(const std::wstring& csvPath, const CsvLoadOptions& opt = CsvLoadOptions());
+
+// @brief インデックスが csvPath の現在の内容と一致していればマップする
+// @return 有効なインデックスをマップできたら 0、ない・古い場合は非 0
+int OpenCsvIndex(const std::wstring& csvPath, CsvIndex& index);
+
+void CloseCsvIndex(CsvIndex& index);
@@ -0,0 +1,320 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h>    // MSVCのビルトイン関数
+#endif
+#include <immintrin.h> // SSE2 / AVX2 ヘッダ
+#include "FastCsvLoad.h" // SIMD_* の定義
+#include "AlignedBuffer.h"
+#include "CsvStats.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 行・区切り文字の走査に使う内部ヘルパー（FastCsvLoad.cpp 以外の翻訳単位からも使う）
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+// GCC / Clang では関数単位で命令セットを有効にする（MSVC は指定不要）
+// AVX2 以上の関数はこれで有効にし、DetectSimdLevel の結果で呼び分ける（-mavx2 なしでビルドする）
+#if defined(__GNUC__) || defined(__clang__)
+#define FASTCSV_TARGET(x) __attribute__((target(x)))
+#else
+#define FASTCSV_TARGET(x)
+#endif
+
+// 実行中の CPU で使える最上位レベル（SIMD_SSE42 / SIMD_AVX2 / SIMD_AVX512BW）を CPUID で判定
+int DetectSimdLevel();
+
+// AVX2 版の関数を使えるか（判定は翻訳単位ごとに最初の呼び出しで1回だけ）
+static inline bool UseAvx2()
+{
+    static const bool avx2 = DetectSimdLevel() >= SIMD_AVX2;
+    return avx2;
+}
+
+/////////////////////////////////////////////////////////////////////////
+#define NEWLINETYPE_CR      4 // CR だけの改行を含む
+#define NEWLINETYPE_MIXED   3 // LF と CRLF が混在
+#define NEWLINETYPE_CRLF    2
+#define NEWLINETYPE_LF      1
+#define NEWLINETYPE_UNKNOWN 0 // 改行がない
+/////////////////////////////////////////////////////////////////////////
+// 改行コードの種類を判別する
+// 行数の見積もりと同じ標本（LINEESTIMATE_SAMPLES か所）で '\r' の後でない '\n'・CRLF・'\n' が続かない '\r' を探す
+// （標本に改行がなければファイル全体を調べるので、NEWLINETYPE_UNKNOWN は正確）。
+// 標本の外だけにある混在は検出できないので、結果は走査関数の選択（GetLineOffsets_OpenMP）の目安にだけ使う。
+// 読み込み（行頭オフセットの走査 ScanLineOffsets・1パス方式・構造インデックス）は判別結果によらず
+// '\n' と '\r' のどちらでも行を区切る
+int DetectNewlineType(const char* fileContent, size_t contentSize);
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 行頭オフセットの配列（圧縮形式）
+// LINEOFFSET_BLOCK_ROWS 行ごとに 64ビットの基準位置を持ち、各行は基準位置からの 32ビットの差で表す。
+// size_t の配列の約半分のメモリ・帯域で済む。ブロック内の差が 32ビットに収まらない場合
+// （1行あたり平均 1MB を超えるような極端なファイル）だけ、行ごとの 64ビット（wide）にする。
+// 未初期化の1回の確保に直接書き込む（std::vector のゼロ埋めを避ける）
+#define LINEOFFSET_BLOCK_SHIFT 12
+#define LINEOFFSET_BLOCK_ROWS  (static_cast<size_t>(1) << LINEOFFSET_BLOCK_SHIFT)
+
+struct LineOffsetArray {
+    AlignedBuffer base;  // ブロックごとの基準位置（uint64_t）　wide の場合は行ごとのオフセット
+    AlignedBuffer delta; // 行ごとの基準位置からの差（uint32_t）　wide の場合は未使用
+    size_t size = 0;
+    bool   wide = false;
+
+    size_t operator[](size_t i) const
+    {
+        const uint64_t* b = reinterpret_cast<const uint64_t*>(base.data());
+        if (wide) {
+            return static_cast<size_t>(b[i]);
+        }
+        return static_cast<size_t>(b[i >> LINEOFFSET_BLOCK_SHIFT] + reinterpret_cast<const uint32_t*>(delta.data())[i]);
+    }
+
+    // 行 i のオフセットを書く（InitLineOffsetArray で基準位置を決めた後）
+    void Set(size_t i, size_t offset)
+    {
+        uint64_t* b = reinterpret_cast<uint64_t*>(base.data());
+        if (wide) {
+            b[i] = offset;
+        }
+        else {
+            reinterpret_cast<uint32_t*>(delta.data())[i] = static_cast<uint32_t>(offset - b[i >> LINEOFFSET_BLOCK_SHIFT]);
+        }
+    }
+
+    // 確保しているバイト数
+    size_t Bytes() const { return base.size() + delta.size(); }
+};
+
+// @brief 行数 rows の配列を確保し、ブロックの基準位置を決める
+// offsetOf(row) は行 row のオフセット（ブロックの先頭と末尾の行についてだけ呼ぶ）
+template <class OffsetOf>
+static inline void InitLineOffsetArray(LineOffsetArray& a, size_t rows, OffsetOf&& offsetOf)
+{
+    const size_t numBlocks = (rows + LINEOFFSET_BLOCK_ROWS - 1) >> LINEOFFSET_BLOCK_SHIFT;
+    a.size = rows;
+    a.wide = false;
+    a.delta.Free();
+    a.base.Allocate(numBlocks * sizeof(uint64_t));
+    uint64_t* b = reinterpret_cast<uint64_t*>(a.base.data());
+    for (size_t blk = 0; blk < numBlocks; ++blk) {
+        const size_t first = blk << LINEOFFSET_BLOCK_SHIFT;
+        const size_t last = std::min(rows, first + LINEOFFSET_BLOCK_ROWS) - 1;
+        b[blk] = offsetOf(first);
+        if (offsetOf(last) - b[blk] > 0xFFFFFFFFULL) {
+            a.wide = true;
+        }
+    }
+    if (a.wide) {
+        a.base.Allocate(rows * sizeof(uint64_t));
+    }
+    else {
+        a.delta.Allocate(rows * sizeof(uint32_t));
+    }
+}
+
+// @brief size_t の配列から LineOffsetArray を作る（スカラー版・汎用版の結果の変換用）
+void AssignLineOffsets(LineOffsetArray& lineOffsets, const size_t* offsets, size_t rows);
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 出力の予約に使う行数の見積もり
+// ファイル全体から等間隔に LINEESTIMATE_SAMPLES か所、LINEESTIMATE_SAMPLE_BYTES バイトずつ改行を数える。
+// 最初の行だけで決めると、長いヘッダや短い先頭行で数 GB 多く確保したり、足りずに再確保を繰り返したりする。
+// 見積もりは整数で計算する（数十億行でも double の丸めで行数がずれない）
+#define LINEESTIMATE_SAMPLES      64
+#define LINEESTIMATE_SAMPLE_BYTES (64 * 1024)
+#define LINEESTIMATE_MARGIN       64 // 見積もりに 1/64（約 1.6%）の余裕を足す
+
+struct RowDensity {
+    uint64_t newlines = 0; // 標本の改行の数（'\n' がなければ '\r'）
+    uint64_t bytes = 0;    // 標本のバイト数
+
+    // @brief bytes バイトの見込み行数（余裕を含む）
+    size_t Rows(size_t n) const
+    {
+        if (bytes == 0) {
+            return 0;
+        }
+        if (newlines == 0) {
+            return static_cast<size_t>(n / bytes + 1); // 標本より長い行
+        }
+        // n * newlines / bytes を桁あふれなしに求める（標本は 2^22 バイト以下）
+        const uint64_t r = n / bytes * newlines + n % bytes * newlines / bytes;
+        return static_cast<size_t>(r + r / LINEESTIMATE_MARGIN + 1);
+    }
+
+    // 1行の平均のバイト数（改行を含む、切り捨て）
+    size_t BytesPerRow() const
+    {
+        return static_cast<size_t>(std::max<uint64_t>(bytes / std::max<uint64_t>(newlines, 1), 1));
+    }
+};
+
+// @brief [data, data + size) の行の密度を標本から求める（標本の合計より小さければ全体を数える）
+RowDensity SampleRowDensity(const char* data, size_t size);
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 固定長の行（CsvLoadOptions::fixedWidth）
+// 全行が同じバイト数なら行 r の先頭は r * rowLength なので、行頭オフセットの走査を省ける
+#define FIXEDROW_SAMPLES 1024 // 判定で中身まで調べる行数
+
+struct FixedRowLayout {
+    size_t rowLength = 0;     // 改行を含む1行のバイト数
+    size_t newlineLength = 0; // 1 (LF) / 2 (CRLF)
+    size_t rows = 0;          // 行数（最後の行は改行がなくてもよい）
+};
+
+// @brief 最初の行の長さで割り切れるか・一部の行の行末が改行かで、全行が同じ長さかを判定する
+// 調べていない行の途中に改行があっても検出できないので、パース中に CheckFixedRow で各行の行末を確かめる
+// @return 固定長とみなせる場合は true
+bool DetectFixedRows(const char* fileContent, size_t contentSize, FixedRowLayout& layout);
+
+// 行 r の行末が固定長の配置どおり改行になっているか
+static inline bool CheckFixedRow(const char* fileContent, size_t contentSize, const FixedRowLayout& layout, size_t r)
+{
+    const size_t next = (r + 1) * layout.rowLength; // 次の行の先頭
+    if (next > contentSize) {
+        return r + 1 == layout.rows; // 末尾の改行のない最後の行
+    }
+    return fileContent[next - 1] == '\n' && (layout.newlineLength == 1 || fileContent[next - 2] == '\r');
+}
+
+// 行 r の改行を除いた範囲 [begin, end)
+static inline size_t FixedRowEnd(size_t contentSize, const FixedRowLayout& layout, size_t r)
+{
+    return std::min(contentSize, (r + 1) * layout.rowLength - layout.newlineLength);
+}
+
+// @brief 行頭オフセットを AVX2 + OpenMP で求めて lineOffsets に格納する（GetLineOffsets_AVX2_OpenMP と同じ結果）
+// タスクごとの結果（タスク先頭からの 32ビットの相対位置）は事前に確保した領域に書き、
+// 累積和で決めた位置へ並列に圧縮形式で書き込む
+// @return 行数
+size_t ScanLineOffsets(const char* fileContent, size_t contentSize, LineOffsetArray& lineOffsets, CsvLoadStats* stats = nullptr);
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 最下位の1ビットの位置を取得（MSVC の _BitScanForward と GCC/Clang の __builtin_ctz の共通化）
+// mask は 0 以外であること
+static inline unsigned long BitScanForward32(unsigned int mask)
+{
+#ifdef _MSC_VER
+    unsigned long offset;
+    _BitScanForward(&offset, mask);
+    return offset;
+#else
+    return static_cast<unsigned long>(__builtin_ctz(mask));
+#endif
+}
+
+// 1のビットの数
+static inline int PopCount32(unsigned int mask)
+{
+#ifdef _MSC_VER
+    return static_cast<int>(__popcnt(mask));
+#else
+    return __builtin_popcount(mask);
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// [pos, end) から文字 c を検索　見つからなければ end を返す
+// AVX2 版は 32バイトずつ、SSE2 版は 16バイトずつ比較する（FindChar が CPU に合わせて選ぶ）
+FASTCSV_TARGET("avx2")
+static inline const char* FindChar_AVX2(const char* pos, const char* end, char c)
+{
+    const __m256i vC = _mm256_set1_epi8(c);
+    while (pos + 32 <= end) {
+        __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pos));
+        int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(data, vC));
+        if (mask != 0) {
+            return pos + BitScanForward32(mask);
+        }
+        pos += 32;
+    }
+    // 32バイト未満の残り領域は逐次走査
+    while (pos < end && *pos != c) {
+        ++pos;
+    }
+    return pos;
+}
+
+static inline const char* FindChar_SSE2(const char* pos, const char* end, char c)
+{
+    const __m128i vC = _mm_set1_epi8(c);
+    while (pos + 16 <= end) {
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(data, vC));
+        if (mask != 0) {
+            return pos + BitScanForward32(mask);
+        }
+        pos += 16;
+    }
+    while (pos < end && *pos != c) {
+        ++pos;
+    }
+    return pos;
+}
+
+static inline const char* FindChar(const char* pos, const char* end, char c)
+{
+    return UseAvx2() ? FindChar_AVX2(pos, end, c) : FindChar_SSE2(pos, end, c);
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// [pos, end) から改行文字（'\n' または '\r'）を検索　見つからなければ end を返す
+// CRLF の行は '\r' で終わり、続く '\n' は空行として読み飛ばす（LF / CRLF / CR の混在・空行をまとめて扱える）
+FASTCSV_TARGET("avx2")
+static inline const char* FindNewline_AVX2(const char* pos, const char* end)
+{
+    const __m256i vLF = _mm256_set1_epi8('\n');
+    const __m256i vCR = _mm256_set1_epi8('\r');
+    while (pos + 32 <= end) {
+        __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pos));
+        int mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(data, vLF), _mm256_cmpeq_epi8(data, vCR)));
+        if (mask != 0) {
+            return pos + BitScanForward32(mask);
+        }
+        pos += 32;
+    }
+    // 32バイト未満の残り領域は逐次走査
+    while (pos < end && *pos != '\n' && *pos != '\r') {
+        ++pos;
+    }
+    return pos;
+}
+
+static inline const char* FindNewline_SSE2(const char* pos, const char* end)
+{
+    const __m128i vLF = _mm_set1_epi8('\n');
+    const __m128i vCR = _mm_set1_epi8('\r');
+    while (pos + 16 <= end) {
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(data, vLF), _mm_cmpeq_epi8(data, vCR)));
+        if (mask != 0) {
+            return pos + BitScanForward32(mask);
+        }
+        pos += 16;
+    }
+    while (pos < end && *pos != '\n' && *pos != '\r') {
+        ++pos;
+    }
+    return pos;
+}
+
+static inline const char* FindNewline(const char* pos, const char* end)
+{
+    return UseAvx2() ? FindNewline_AVX2(pos, end) : FindNewline_SSE2(pos, end);
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// pos 以降で最初の行頭（先頭 or 改行文字の直後）を返す　チャンク境界の調整用
+// CRLF の間で区切られた場合、後ろのチャンクは '\n' だけの空行から始まる
+static inline size_t AlignToLineStart(const char* fileContent, size_t contentSize, size_t pos)
+{
+    if (pos == 0 || pos >= contentSize) {
+        return (pos == 0) ? 0 : contentSize;
+    }
+    const char* end = fileContent + contentSize;
+    const char* nl = FindNewline(fileContent + pos - 1, end);
+    return (nl < end) ? static_cast<size_t>(nl - fileContent) + 1 : contentSize;
+}
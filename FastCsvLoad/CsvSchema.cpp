@@ -0,0 +1,873 @@
+﻿#include <vector>
+#include <string>
+#include <iostream>
+#include <cstring>
+#include <charconv>
+#include <cstdint>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <omp.h>
+
+// fast_float ライブラリを使用
+// 下記から入手
+// https://github.com/fastfloat/fast_float
+#include "../fast_float/fast_float.h"  // fast_floatヘッダファイルのインクルード
+
+#include "FastCsvLoad.h"
+#include "CsvScan.h"
+#include "StructuralIndex.h"
+#include "CsvCache.h"
+#include "TaskScheduler.h"
+#include "FixedDecimal.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 列型のバイト数
+size_t ColumnTypeSize(int type)
+{
+    switch (type) {
+    case COLTYPE_FLOAT:  return sizeof(float);
+    case COLTYPE_DOUBLE: return sizeof(double);
+    case COLTYPE_INT32:  return sizeof(int32_t);
+    case COLTYPE_INT64:  return sizeof(int64_t);
+    case COLTYPE_UINT8:  return sizeof(uint8_t);
+    default:             return 0;
+    }
+}
+
+CsvSchema PointCloudSchema()
+{
+    CsvSchema schema;
+    schema.Add("x", COLTYPE_FLOAT).Add("y", COLTYPE_FLOAT).Add("z", COLTYPE_FLOAT)
+          .Add("acc", COLTYPE_FLOAT)
+          .Add("r", COLTYPE_FLOAT).Add("g", COLTYPE_FLOAT).Add("b", COLTYPE_FLOAT)
+          .Add("nx", COLTYPE_FLOAT).Add("ny", COLTYPE_FLOAT).Add("nz", COLTYPE_FLOAT);
+    return schema;
+}
+
+CsvColumn* CsvTable::Find(const std::string& name)
+{
+    for (auto& col : columns) {
+        if (col.name == name) {
+            return &col;
+        }
+    }
+    return nullptr;
+}
+
+const CsvColumn* CsvTable::Find(const std::string& name) const
+{
+    return const_cast<CsvTable*>(this)->Find(name);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 列ごとのパース関数
+// 型と区切り方 Fields（CsvDialect.h の DelimitedFields / BlankFields）ごとにテンプレートで特殊化し、
+// スキーマのコンパイル時に関数ポインタとして束縛する（fields は束縛した Fields の値）
+// 戻り値は次のフィールドの先頭　bad には読めなかったか（変換の失敗、浮動小数点は数値の後ろの余計な文字も）を返す
+// 読めなかったフィールドには欠損値（浮動小数点は NaN、整数は 0）を書く
+typedef const char* (*FieldParser)(const void* fields, const char* ptr, const char* end, unsigned char* dst, bool& bad);
+
+// フィールドを区切りまで読み飛ばし、次のフィールドの先頭を返す
+template <class Fields>
+static inline const char* SkipToNext(const Fields& f, const char* ptr, const char* end)
+{
+    return f.Skip(ptr, end);
+}
+
+// 区切り文字だけで区切る場合は区切り文字を SIMD で探す（行 [ptr, end) の中に区切りがなければ end）
+template <bool Comments>
+static inline const char* SkipToNext(const DelimitedFields<Comments>& f, const char* ptr, const char* end)
+{
+    ptr = FindChar(ptr, end, f.delimiter);
+    return (ptr < end) ? ptr + 1 : end;
+}
+
+template <class T, class Fields>
+static const char* ParseFloatField(const void* fields, const char* ptr, const char* end, unsigned char* dst, bool& bad)
+{
+    const Fields& f = *static_cast<const Fields*>(fields);
+    ptr = f.FieldBegin(ptr, end);
+    T value = T();
+    auto result = ParseDecimal(ptr, end, value);
+    const char* next = result.ptr;
+    bad = (result.ec != std::errc()) | !f.Next(next, end);
+    *reinterpret_cast<T*>(dst) = bad ? std::numeric_limits<T>::quiet_NaN() : value;
+    return bad ? SkipToNext(f, ptr, end) : next;
+}
+
+template <class T, class Fields>
+static const char* ParseIntField(const void* fields, const char* ptr, const char* end, unsigned char* dst, bool& bad)
+{
+    const Fields& f = *static_cast<const Fields*>(fields);
+    ptr = f.FieldBegin(ptr, end);
+    T value = T();
+    auto result = std::from_chars(ptr, end, value);
+    // 整数の後ろの余計な文字（小数部など）は従来どおり読み飛ばし、変換の失敗だけを不正とする
+    bad = (result.ec != std::errc());
+    *reinterpret_cast<T*>(dst) = bad ? T() : value;
+    const char* next = result.ptr;
+    return f.Next(next, end) ? next : SkipToNext(f, ptr, end);
+}
+
+// 数値変換せずに区切りまで読み飛ばす
+template <class Fields>
+static const char* SkipField(const void* fields, const char* ptr, const char* end, unsigned char*, bool& bad)
+{
+    const Fields& f = *static_cast<const Fields*>(fields);
+    bad = false;
+    return SkipToNext(f, f.FieldBegin(ptr, end), end);
+}
+
+template <class Fields>
+static FieldParser SelectFieldParser(int type)
+{
+    switch (type) {
+    case COLTYPE_FLOAT:  return ParseFloatField<float, Fields>;
+    case COLTYPE_DOUBLE: return ParseFloatField<double, Fields>;
+    case COLTYPE_INT32:  return ParseIntField<int32_t, Fields>;
+    case COLTYPE_INT64:  return ParseIntField<int64_t, Fields>;
+    case COLTYPE_UINT8:  return ParseIntField<uint8_t, Fields>;
+    default:             return SkipField<Fields>;
+    }
+}
+
+// 行 [pos, end) を読み飛ばすか（コメント行・空白だけの行）
+template <class Fields>
+static bool IgnoreLine(const void* fields, const char* pos, const char* end)
+{
+    return static_cast<const Fields*>(fields)->IgnoreLine(pos, end);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// スキーマをコンパイルした結果
+// 行パース関数はここで一度だけ選択し、パースループ内では型を判定しない
+struct FieldOp {
+    FieldParser parse;
+    int         column; // 出力列番号（-1 は読み飛ばし）
+};
+
+typedef bool (*LineFilter)(const void* fields, const char* pos, const char* end);
+
+struct SchemaKernel;
+// 戻り値は最初に読めなかった列（CSV の列番号、-1 なら正常）
+typedef int (*RowParser)(const SchemaKernel& k, const char* ptr, const char* end, unsigned char* const* dst);
+
+struct SchemaKernel {
+    std::vector<FieldOp>  ops;      // 最後に使う列まで（それ以降の列は読まない）
+    std::vector<size_t>   elemSize; // 出力列ごとのバイト数
+    std::vector<uint64_t> missing;  // 出力列ごとの欠損値（先頭 elemSize バイト）
+    RowParser             parseRow = nullptr;
+    std::shared_ptr<const void> fields;   // 区切り方（Fields の値、列ごとの関数に渡す）
+    LineFilter            ignoreLine = nullptr; // 読み飛ばす行（コメント行・空白だけの行）があれば設定
+
+    // 行 [pos, end) を行として数えないか
+    bool Ignore(const char* pos, const char* end) const { return ignoreLine && ignoreLine(fields.get(), pos, end); }
+};
+
+// 汎用（列ごとに束縛済みの関数を呼ぶ）
+static int ParseRow_Generic(const SchemaKernel& k, const char* ptr, const char* end, unsigned char* const* dst)
+{
+    const int n = static_cast<int>(k.ops.size());
+    const void* const fields = k.fields.get();
+    int firstBad = -1;
+    for (int i = 0; i < n; ++i) {
+        const FieldOp& op = k.ops[i];
+        bool bad;
+        ptr = op.parse(fields, ptr, end, (op.column >= 0) ? dst[op.column] : nullptr, bad);
+        firstBad = (bad && firstBad < 0) ? i : firstBad;
+    }
+    return firstBad;
+}
+
+// 全列 float で読み飛ばしなし（PointCloud と同じ形式、FastCsvLoad の ParseLine と同じ形）
+// 列ごとの判定は OR だけにし、不正な列がある行だけ汎用の関数で読み直す
+template <class Fields>
+static int ParseRow_AllFloat(const SchemaKernel& k, const char* ptr, const char* end, unsigned char* const* dst)
+{
+    const Fields& f = *static_cast<const Fields*>(k.fields.get());
+    const char* const rowBegin = ptr;
+    const int n = static_cast<int>(k.ops.size());
+    bool bad = false;
+    for (int i = 0; i < n; ++i) {
+        float value = 0.0f;
+        ptr = f.FieldBegin(ptr, end);
+        auto result = ParseDecimal(ptr, end, value);
+        *reinterpret_cast<float*>(dst[i]) = value;
+        ptr = result.ptr;
+        bad |= (result.ec != std::errc()) | !f.Next(ptr, end);
+    }
+    return bad ? ParseRow_Generic(k, rowBegin, end, dst) : -1;
+}
+
+// 構造インデックスで読む1行分の判定（列の不足は行末で調べる）
+struct StructuralRowCheck {
+    int         firstBad = -1;
+    int         fields = 0;       // 受け取ったフィールド数
+    const char* begin = nullptr;  // 先頭フィールドの位置
+
+    void Field(const SchemaKernel& k, int field, const char* fieldBegin, const char* fieldEnd, unsigned char* const* dst)
+    {
+        if (field < static_cast<int>(k.ops.size()) && k.ops[field].column >= 0) {
+            bool bad;
+            k.ops[field].parse(k.fields.get(), fieldBegin, fieldEnd, dst[k.ops[field].column], bad);
+            firstBad = (bad && firstBad < 0) ? field : firstBad;
+        }
+        fields = field + 1;
+        begin = (field == 0) ? fieldBegin : begin;
+    }
+
+    // 行末の処理: 最初に読めなかった列（欠けた列を含む、-1 なら正常）を返し、次の行に備える
+    // 欠けた列は PrepareRow で欠損値を入れてある
+    int End(const SchemaKernel& k)
+    {
+        int bad = firstBad;
+        if (bad < 0 && fields < static_cast<int>(k.ops.size())) {
+            bad = fields;
+            while (k.ops[bad].column < 0) {
+                ++bad; // 最後の列は必ず読む列
+            }
+        }
+        firstBad = -1;
+        fields = 0;
+        return bad;
+    }
+};
+
+// 区切り方 Fields に特殊化した関数を束縛する（f は k が持つ）
+template <class Fields>
+static int CompileSchema(const CsvSchema& schema, const Fields& f, SchemaKernel& k, CsvTable& table)
+{
+    table = CsvTable();
+    k.fields = std::make_shared<const Fields>(f);
+    // 既定の区切り方には読み飛ばす行がない（空行は行のループで除く）
+    k.ignoreLine = std::is_same<Fields, DelimitedFields<false>>::value ? nullptr : IgnoreLine<Fields>;
+
+    // 最後に使う列を求める　それ以降の列は行末まで読まない
+    int lastUsed = -1;
+    for (int i = 0; i < static_cast<int>(schema.columns.size()); ++i) {
+        if (schema.columns[i].type != COLTYPE_SKIP) {
+            lastUsed = i;
+        }
+    }
+    if (lastUsed < 0) {
+        std::cerr << "スキーマに読み込む列がありません。" << std::endl;
+        return 1;
+    }
+
+    bool allFloat = true;
+    for (int i = 0; i <= lastUsed; ++i) {
+        const CsvColumnDef& def = schema.columns[i];
+        FieldOp op;
+        op.parse = SelectFieldParser<Fields>(def.type);
+        op.column = -1;
+        if (def.type != COLTYPE_SKIP) {
+            CsvColumn col;
+            col.name = def.name;
+            col.type = def.type;
+            col.elemSize = ColumnTypeSize(def.type);
+            op.column = static_cast<int>(table.columns.size());
+            k.elemSize.push_back(col.elemSize);
+            uint64_t missing = 0;
+            if (def.type == COLTYPE_FLOAT) {
+                const float nan = std::numeric_limits<float>::quiet_NaN();
+                std::memcpy(&missing, &nan, sizeof(nan));
+            }
+            else if (def.type == COLTYPE_DOUBLE) {
+                const double nan = std::numeric_limits<double>::quiet_NaN();
+                std::memcpy(&missing, &nan, sizeof(nan));
+            }
+            k.missing.push_back(missing);
+            table.columns.push_back(std::move(col));
+        }
+        if (def.type != COLTYPE_FLOAT) {
+            allFloat = false;
+        }
+        k.ops.push_back(op);
+    }
+    k.parseRow = allFloat ? ParseRow_AllFloat<Fields> : ParseRow_Generic;
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 1パス方式のチャンク内バッファ（列ごとのアリーナ）
+// チャンク c の行は各列のアリーナのタスク c の領域に書く（行ごと・チャンクごとの再確保なし）
+struct ChunkColumns {
+    std::vector<TaskArena> cols;
+
+    void Init(const SchemaKernel& k, size_t numChunks, size_t rowsPerChunk) {
+        cols.resize(k.elemSize.size());
+        for (size_t i = 0; i < cols.size(); ++i) {
+            cols[i].Init(numChunks, rowsPerChunk, k.elemSize[i]);
+        }
+    }
+
+    // チャンク c の次の行の格納先を dst に用意（fill の場合は欠けたフィールドが欠損値になるよう埋める）
+    // Commit しなかった行（除いた行）の格納先は次の PrepareRow で再利用される
+    void PrepareRow(const SchemaKernel& k, size_t c, unsigned char** dst, bool fill) {
+        for (size_t i = 0; i < cols.size(); ++i) {
+            dst[i] = cols[i].Reserve(c);
+            if (fill) {
+                std::memcpy(dst[i], &k.missing[i], k.elemSize[i]);
+            }
+        }
+    }
+    void CommitRow(size_t c) {
+        for (TaskArena& col : cols) {
+            col.Commit(c);
+        }
+    }
+    void Reset(size_t c) {
+        for (TaskArena& col : cols) {
+            col.Reset(c);
+        }
+    }
+    size_t Rows(size_t c) const { return cols.empty() ? 0 : cols[0].Count(c); }
+};
+
+// scan を指定すると構造インデックスでフィールド境界を求める（LOADMODE_STRUCTURAL）
+// quoted の場合は引用符付きフィールドに対応する（scan 必須）
+// firstTouch の場合は各チャンクをパースしたスレッドが列バッファにコピーする（NUMA_FIRSTTOUCH）
+// @return ERRORPOLICY_STRICT で不正な行があれば非 0、それ以外は 0
+static int LoadColumns_Fused(const char* fileContent, size_t contentSize,
+    const SchemaKernel& k, CsvTable& table, size_t estimatedLines, ScanBlockFn scan, bool quoted,
+    RowErrorSink& errors, CsvLoadStats* stats, bool firstTouch)
+{
+    StatsPhase parsePhase(stats ? &stats->parseSeconds : nullptr);
+    const int numThreads = omp_get_max_threads();
+    const int numChunks = quoted
+        ? numThreads * 4 // 行長の偏りを吸収するため多めに分割
+        : static_cast<int>(TaskCountForBytes(contentSize, numThreads)); // ワークスティーリングで分配
+    const int numCols = static_cast<int>(k.elemSize.size());
+    ChunkColumns chunks;
+    chunks.Init(k, numChunks, TaskRowsEstimate(estimatedLines, numChunks));
+    std::vector<int> chunkThread(numChunks, -1); // チャンクをパースしたスレッド
+    // 不正な行はチャンク内の行番号で記録し、チャンクごとの入力行数（除いた行を含む）の累積和で行番号にする
+    RowErrorLog log(errors, numChunks);
+    std::vector<size_t> chunkRows(numChunks, 0);
+
+    if (quoted) {
+        // 引用符の状態はチャンク先頭では分からないので、投機的にパースして後で修正する
+        const PrefixXorFn prefixXor = SelectPrefixXor();
+        RunQuotedChunks(contentSize, numChunks,
+            [&](int c, size_t nominalBegin, size_t nominalEnd, bool insideAtBegin) {
+                const double t0 = StatsNow();
+                chunkThread[c] = omp_get_thread_num();
+                chunks.Reset(c); // やり直しの場合は投機的な結果を捨てる
+                log.Reset(c);
+                std::vector<unsigned char*> dst(numCols);
+                auto prepareRow = [&]() { chunks.PrepareRow(k, c, dst.data(), true); };
+
+                size_t quotesHead, quotesBody;
+                size_t rowBegin = FindRowStartQuoted(fileContent, contentSize, nominalBegin, insideAtBegin, nominalEnd, quotesHead);
+                StructuralRowCheck row;
+                size_t rows = 0;
+                prepareRow();
+                WalkStructuralQuoted(fileContent + rowBegin, fileContent + nominalEnd, fileContent + contentSize, scan, prefixXor,
+                    [&](int field, const char* fieldBegin, const char* fieldEnd) {
+                        row.Field(k, field, fieldBegin, fieldEnd, dst.data());
+                    },
+                    [&]() {
+                        const int bad = row.End(k);
+                        if (bad < 0 || log.Add(c, rows, static_cast<uint64_t>(row.begin - fileContent), bad)) {
+                            chunks.CommitRow(c);
+                        }
+                        ++rows;
+                        prepareRow();
+                    },
+                    quotesBody);
+                chunkRows[c] = rows;
+                StatsAddBusy(stats, omp_get_thread_num(), StatsNow() - t0);
+                return static_cast<int>((quotesHead + quotesBody) & 1);
+            });
+    }
+    else {
+
+        // チャンク境界（行頭）を決定
+        std::vector<size_t> bounds(numChunks + 1);
+        for (int c = 0; c < numChunks; ++c) {
+            bounds[c] = AlignToLineStart(fileContent, contentSize, contentSize / numChunks * c);
+        }
+        bounds[numChunks] = contentSize;
+
+        RunStealingTasks(numChunks, [&](size_t c, int thread) {
+            if (log.Skip(c)) {
+                return;
+            }
+            const double t0 = StatsNow();
+            chunkThread[c] = thread;
+            std::vector<unsigned char*> dst(numCols);
+            // 構造インデックスの場合はフィールドが欠けた行もあるので欠損値で埋めておく
+            auto prepareRow = [&]() { chunks.PrepareRow(k, c, dst.data(), scan != nullptr); };
+
+            const char* pos = fileContent + bounds[c];
+            const char* end = fileContent + bounds[c + 1];
+            size_t rows = 0;
+            if (scan) {
+                // フィールド境界が分かっているので、列ごとの関数に [fieldBegin, fieldEnd) を直接渡す
+                StructuralRowCheck row;
+                prepareRow();
+                WalkStructural(pos, end, scan,
+                    [&](int field, const char* fieldBegin, const char* fieldEnd) {
+                        row.Field(k, field, fieldBegin, fieldEnd, dst.data());
+                    },
+                    [&]() {
+                        const int bad = row.End(k);
+                        if (bad < 0 || log.Add(c, rows, static_cast<uint64_t>(row.begin - fileContent), bad)) {
+                            chunks.CommitRow(c);
+                        }
+                        ++rows;
+                        prepareRow();
+                    });
+            }
+            else {
+                while (pos < end) {
+                    const char* nl = FindNewline(pos, end);
+                    // 空行（CRLF の '\r' と '\n' の間を含む）・コメント行は行として数えない
+                    if (nl > pos && !k.Ignore(pos, nl)) {
+                        prepareRow();
+                        const int bad = k.parseRow(k, pos, nl, dst.data());
+                        if (bad < 0 || log.Add(c, rows, static_cast<uint64_t>(pos - fileContent), bad)) {
+                            chunks.CommitRow(c);
+                        }
+                        else if (log.Policy() == ERRORPOLICY_STRICT) {
+                            break;
+                        }
+                        ++rows;
+                    }
+                    if (nl == end) {
+                        break;
+                    }
+                    pos = nl + 1;
+                }
+            }
+            chunkRows[c] = rows;
+            StatsAddBusy(stats, thread, StatsNow() - t0);
+        });
+    }
+    parsePhase.Stop();
+
+    // チャンクごとの入力行数を累積和して行番号の基準を決め、不正な行をまとめる
+    std::vector<size_t> rowBase(numChunks + 1, 0);
+    for (int c = 0; c < numChunks; ++c) {
+        rowBase[c + 1] = rowBase[c] + chunkRows[c];
+    }
+    log.Finish(errors, &rowBase);
+    if (log.Policy() == ERRORPOLICY_STRICT && log.Count() > 0) {
+        return 1;
+    }
+
+    // チャンクごとの行数を累積和して格納位置を決定
+    const std::vector<size_t> base = chunks.cols[0].Offsets();
+    table.rows = base[numChunks];
+    StatsPhase allocPhase(stats ? &stats->allocSeconds : nullptr);
+    for (int i = 0; i < numCols; ++i) {
+        table.columns[i].data.Allocate(table.rows * k.elemSize[i]);
+    }
+    allocPhase.Stop();
+
+    // 列バッファは未初期化なので、ページはここで最初に書き込まれる
+    StatsPhase mergePhase(stats ? &stats->mergeSeconds : nullptr);
+    auto copyChunk = [&](size_t c) {
+        for (int i = 0; i < numCols; ++i) {
+            chunks.cols[i].CopyTask(c, table.columns[i].data.data() + base[c] * k.elemSize[i]);
+        }
+    };
+    if (firstTouch) {
+        RunOwnedTasks(chunkThread, copyChunk);
+    }
+    else {
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int c = 0; c < numChunks; ++c) {
+            copyChunk(c);
+        }
+    }
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// キャッシュに入る列（COLTYPE_SKIP 以外、スキーマの順）
+static std::vector<CsvColumnDef> CachedColumns(const CsvSchema& schema)
+{
+    std::vector<CsvColumnDef> columns;
+    for (const CsvColumnDef& def : schema.columns) {
+        if (def.type != COLTYPE_SKIP) {
+            columns.push_back(def);
+        }
+    }
+    return columns;
+}
+
+// キャッシュをマップする（COLTYPE_SKIP 以外の列が名前・型とも一致する場合のみ）
+static int OpenColumnsCache(const std::wstring& filename, const std::vector<CsvColumnDef>& columns, CsvCacheView& view,
+    const CsvLoadOptions& opt)
+{
+    if (OpenCsvCache(filename, columns, view) != 0) {
+        return 1;
+    }
+    if (!opt.quiet) {
+        std::cout << "Cache: " << view.rows << " line" << std::endl;
+    }
+    if (opt.stats) {
+        opt.stats->fromCache = true;
+        opt.stats->bytes = view.mf.size;
+    }
+    return 0;
+}
+
+// キャッシュから読み込む（列バッファにコピーする）
+static int LoadColumns_Cache(const std::wstring& filename, const CsvSchema& schema, CsvTable& table, const CsvLoadOptions& opt)
+{
+    const std::vector<CsvColumnDef> columns = CachedColumns(schema);
+    CsvCacheView view;
+    if (OpenColumnsCache(filename, columns, view, opt) != 0) {
+        return 1;
+    }
+
+    StatsPhase allocPhase(opt.stats ? &opt.stats->allocSeconds : nullptr);
+    table = CsvTable();
+    table.rows = view.rows;
+    table.columns.resize(columns.size());
+    for (size_t i = 0; i < columns.size(); ++i) {
+        CsvColumn& col = table.columns[i];
+        col.name = columns[i].name;
+        col.type = columns[i].type;
+        col.elemSize = ColumnTypeSize(col.type);
+        col.data.Allocate(view.rows * col.elemSize);
+    }
+    allocPhase.Stop();
+
+    // 列バッファへのコピーは列ごと・ブロックごとに並列化
+    StatsPhase parsePhase(opt.stats ? &opt.stats->parseSeconds : nullptr);
+    const long long numCols = static_cast<long long>(columns.size());
+#pragma omp parallel for collapse(2) schedule(dynamic, 1)
+    for (long long i = 0; i < numCols; ++i) {
+        for (long long b = 0; b < 64; ++b) {
+            CsvColumn& col = table.columns[i];
+            const size_t bytes = col.data.size();
+            const size_t begin = bytes / 64 * b;
+            const size_t end = (b == 63) ? bytes : bytes / 64 * (b + 1);
+            if (end > begin) {
+                std::memcpy(col.data.data() + begin, static_cast<const unsigned char*>(view.columns[i].data) + begin, end - begin);
+            }
+        }
+    }
+    parsePhase.Stop();
+    StatsPhase unmapPhase(opt.stats ? &opt.stats->unmapSeconds : nullptr);
+    CloseCsvCache(view);
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 除いた行（ERRORPOLICY_SKIP、昇順）を列ごとに詰める
+static void RemoveRows(const SchemaKernel& k, CsvTable& table, const std::vector<size_t>& removed)
+{
+    if (removed.empty()) {
+        return;
+    }
+    size_t rows = table.rows;
+    for (size_t i = 0; i < table.columns.size(); ++i) {
+        rows = CompactRows(table.columns[i].data.data(), k.elemSize[i], table.rows, removed);
+    }
+    table.rows = rows;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 固定長の行（CsvLoadOptions::fixedWidth）
+// 行 r の先頭を r * rowLength で求めてパースする。行末が改行でない行があれば非 0（通常の方式で読み直す）
+// 不正な行は errors にまとめる（ERRORPOLICY_STRICT の判定は呼び出し側）
+static int LoadColumns_FixedWidth(const char* fileContent, size_t contentSize, const FixedRowLayout& layout,
+    const SchemaKernel& k, CsvTable& table, RowErrorSink& errors, CsvLoadStats* stats)
+{
+    const int numCols = static_cast<int>(k.elemSize.size());
+    StatsPhase allocPhase(stats ? &stats->allocSeconds : nullptr);
+    table.rows = layout.rows;
+    for (int i = 0; i < numCols; ++i) {
+        table.columns[i].data.Allocate(table.rows * k.elemSize[i]);
+    }
+    allocPhase.Stop();
+
+    StatsPhase parsePhase(stats ? &stats->parseSeconds : nullptr);
+    std::atomic<bool> mismatch(false);
+    const size_t numTasks = (layout.rows + TASK_ROWS - 1) / TASK_ROWS;
+    RowErrorLog log(errors, numTasks);
+    RunStealingTasks(numTasks, [&](size_t task, int thread) {
+        if (log.Skip(task)) {
+            return;
+        }
+        const double t0 = StatsNow();
+        std::vector<unsigned char*> dst(numCols);
+        const size_t taskEnd = std::min(layout.rows, (task + 1) * TASK_ROWS);
+        for (size_t r = task * TASK_ROWS; r < taskEnd; ++r) {
+            if (!CheckFixedRow(fileContent, contentSize, layout, r)) {
+                mismatch.store(true, std::memory_order_relaxed);
+                break;
+            }
+            for (int i = 0; i < numCols; ++i) {
+                dst[i] = table.columns[i].data.data() + r * k.elemSize[i];
+            }
+            const int bad = k.parseRow(k, fileContent + r * layout.rowLength, fileContent + FixedRowEnd(contentSize, layout, r), dst.data());
+            if (bad >= 0 && !log.Add(task, r, r * layout.rowLength, bad) && log.Policy() == ERRORPOLICY_STRICT) {
+                break;
+            }
+        }
+        StatsAddBusy(stats, thread, StatsNow() - t0);
+    });
+    if (mismatch.load()) {
+        return 1;
+    }
+    log.Finish(errors, nullptr);
+    if (log.Policy() == ERRORPOLICY_SKIP) {
+        RemoveRows(k, table, log.SkippedRows());
+    }
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// CSV をパースして読み込む（FastCsvLoadColumns の本体）
+// 不正な行は errors にまとめる（呼び出し側はその数でキャッシュを書くかを決める）
+static int LoadColumns_Csv(const std::wstring& filename, const CsvSchema& schema, CsvTable& table, const CsvLoadOptions& opt,
+    RowErrorSink& errors)
+{
+    // 区切り文字・空白・コメント行（既定以外は1パス方式で読む）
+    if (CheckDialect(opt) != 0) {
+        return 1;
+    }
+    const CsvDialect dialect = DialectOf(opt);
+
+    // スキーマと区切り方から行パース関数を一度だけ選択
+    SchemaKernel kernel;
+    if (WithFields(dialect, [&](const auto& f) { return CompileSchema(schema, f, kernel, table); }) != 0) {
+        return 1;
+    }
+    const int numCols = static_cast<int>(kernel.elemSize.size());
+
+    CsvLoadStats* stats = opt.stats;
+
+    // ファイルをメモリにマップ
+    MappedFile mf;
+    StatsPhase mapPhase(stats ? &stats->mapSeconds : nullptr);
+    if (OpenMappedFile(filename, mf, opt.map) != 0) {
+        return 1;
+    }
+    mapPhase.Stop();
+    const char* fileContent = mf.data;
+    size_t contentSize = mf.size;
+    if (stats) {
+        stats->bytes = contentSize;
+        stats->mapNumaPolicy = mf.numaPolicy;
+    }
+
+    if (!opt.quiet) {
+        std::cout.imbue(std::locale("")); // カンマ区切りの数値フォーマットを適用
+        std::cout << "FileSize: " << contentSize << " byte" << std::endl;
+    }
+
+    // 圧縮ファイルは全体を展開してから読む
+    // 独立したフレームに分けられれば（pzstd・BGZF）フレームごとに並列に展開する。分けられない1ストリームは
+    // 1スレッドで順に展開し、展開が終わってからパースする（FastCsvLoad と違い展開とパースを重ねない）
+    const int compression = (opt.compression == COMPRESSION_AUTO) ? DetectCompression(mf.data, mf.size) : opt.compression;
+    AlignedBuffer decompressed;
+    if (compression != COMPRESSION_NONE) {
+        StatsPhase decompressPhase(stats ? &stats->decompressSeconds : nullptr);
+        std::vector<CompressedFrame> frames;
+        const bool parallel = CompressionSupported(compression) && SplitCompressedFrames(mf.data, mf.size, compression, frames);
+        const int decompressResult = parallel
+            ? DecompressFrames(mf.data, compression, frames, decompressed)
+            : DecompressAll(mf.data, mf.size, compression, decompressed, contentSize);
+        decompressPhase.Stop();
+        if (decompressResult != 0) {
+            CloseMappedFile(mf);
+            return 1;
+        }
+        if (parallel) {
+            contentSize = decompressed.size();
+        }
+        fileContent = reinterpret_cast<const char*>(decompressed.data());
+        if (stats) {
+            stats->bytes = contentSize;
+            stats->compressedBytes = mf.size;
+        }
+        if (!opt.quiet) {
+            std::cout << "Decompress: " << CompressionName(compression) << " (" << (parallel ? "parallel" : "serial")
+                << ", " << frames.size() << " frames), " << contentSize << " byte" << std::endl;
+        }
+    }
+
+    // ファイル全体の標本から推定行数を計算
+    const size_t estimatedLines = SampleRowDensity(fileContent, contentSize).Rows(contentSize);
+    if (!opt.quiet) {
+        std::cout << "estimatedLines: " << estimatedLines << " line" << std::endl;
+    }
+
+    // 引用符付き CSV は常に構造インデックスを使う
+    const bool quoted = (opt.quoting == QUOTING_RFC4180);
+
+    // 固定長の行: 行頭を計算で求める（判定に失敗したら通常の方式）
+    FixedRowLayout fixedRows;
+    if (opt.fixedWidth && !quoted && dialect.IsDefault() && DetectFixedRows(fileContent, contentSize, fixedRows)) {
+        if (LoadColumns_FixedWidth(fileContent, contentSize, fixedRows, kernel, table, errors, stats) == 0) {
+            if (stats) {
+                stats->fixedRowLength = fixedRows.rowLength;
+            }
+            StatsPhase unmapPhase(stats ? &stats->unmapSeconds : nullptr);
+            CloseMappedFile(mf);
+            return CheckRowErrors(errors);
+        }
+        if (!opt.quiet) {
+            std::cout << "fixedWidth: 行の長さが一定でないため通常の方式で読み込みます" << std::endl;
+        }
+    }
+    // 1パス方式・構造インデックスは LF / CRLF / CR の混在も読める（引用符付きは常に構造インデックス）
+    // 区切りの指定がある場合も1パス方式（空白・コメント行・特殊化にない区切り文字は構造インデックスを使わない）
+    if (opt.loadMode == LOADMODE_FUSED || opt.loadMode == LOADMODE_STRUCTURAL || quoted || !dialect.IsDefault()) {
+        // 1パス方式
+        const bool structural = quoted || opt.loadMode == LOADMODE_STRUCTURAL;
+        ScanBlockFn scan = structural ? SelectDialectScan(opt.simdLevel, dialect) : nullptr;
+        LoadColumns_Fused(fileContent, contentSize, kernel, table, estimatedLines, scan, quoted, errors, stats,
+            (opt.numa & NUMA_FIRSTTOUCH) != 0);
+        StatsPhase unmapPhase(stats ? &stats->unmapSeconds : nullptr);
+        CloseMappedFile(mf);
+        return CheckRowErrors(errors);
+    }
+
+    // 1) 行頭オフセットの取得（アリーナから累積和の位置へ直接コピー）
+    LineOffsetArray lineOffsets;
+    ScanLineOffsets(fileContent, contentSize, lineOffsets, stats);
+
+    // 2) 列バッファを行数分確保
+    StatsPhase allocPhase(stats ? &stats->allocSeconds : nullptr);
+    table.rows = lineOffsets.size;
+    for (int i = 0; i < numCols; ++i) {
+        table.columns[i].data.Allocate(table.rows * kernel.elemSize[i]);
+    }
+    allocPhase.Stop();
+
+    // 3) 各行を並列でパース（TASK_ROWS 行ずつのタスクをワークスティーリングで分配）
+    StatsPhase parsePhase(stats ? &stats->parseSeconds : nullptr);
+    const size_t numTasks = (table.rows + TASK_ROWS - 1) / TASK_ROWS;
+    RowErrorLog log(errors, numTasks); // 行番号は全体の行番号のまま記録する
+    RunStealingTasks(numTasks, [&](size_t task, int thread) {
+        if (log.Skip(task)) {
+            return;
+        }
+        const double t0 = StatsNow();
+        std::vector<unsigned char*> dst(numCols);
+        const size_t taskEnd = std::min(table.rows, (task + 1) * TASK_ROWS);
+        size_t nextPos = lineOffsets[task * TASK_ROWS]; // オフセットは1行につき1回だけ読む
+        for (size_t lineIndex = task * TASK_ROWS; lineIndex < taskEnd; ++lineIndex) {
+            size_t startPos = nextPos;
+            size_t endPos = (lineIndex + 1 < table.rows)
+                ? lineOffsets[lineIndex + 1]
+                : contentSize;
+            nextPos = endPos;
+            for (int i = 0; i < numCols; ++i) {
+                dst[i] = table.columns[i].data.data() + lineIndex * kernel.elemSize[i];
+            }
+            const int bad = kernel.parseRow(kernel, &fileContent[startPos], &fileContent[endPos], dst.data());
+            if (bad >= 0 && !log.Add(task, lineIndex, startPos, bad) && log.Policy() == ERRORPOLICY_STRICT) {
+                break;
+            }
+        }
+        StatsAddBusy(stats, thread, StatsNow() - t0);
+    });
+    parsePhase.Stop();
+
+    // 不正な行をまとめ、ERRORPOLICY_SKIP の場合は除いた行を詰める
+    log.Finish(errors, nullptr);
+    if (log.Policy() == ERRORPOLICY_SKIP) {
+        RemoveRows(kernel, table, log.SkippedRows());
+    }
+
+    // メモリマップの後始末
+    StatsPhase unmapPhase(stats ? &stats->unmapSeconds : nullptr);
+    CloseMappedFile(mf);
+    return CheckRowErrors(errors); // ERRORPOLICY_STRICT で不正な行があれば非 0
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// @brief スキーマに従って CSV ファイルを読み込み、型付きの列バッファに格納する
+// @param[in]  filename  入力ファイルパス（ワイド文字列）
+// @param[in]  schema    列ごとの型（COLTYPE_SKIP の列は数値変換しない）
+// @param[out] table     読み込んだ列バッファ（失敗時は空）
+// @param[in]  opt       読み込みオプション
+// @return               成功時は 0、失敗時は非 0
+int FastCsvLoadColumns(const std::wstring& filename, const CsvSchema& schema, CsvTable& table, const CsvLoadOptions& opt)
+{
+    table = CsvTable();
+    CsvStatsContext statsCtx;
+    StatsBegin(opt.stats, opt.perfCounters, statsCtx);
+    NumaPinState pin;
+    if (opt.numa & NUMA_PIN) {
+        NumaPinThreads(pin);
+    }
+    StatsNuma(opt.stats, opt.numa, pin.pinned);
+
+    // 不正な行の扱いと記録先（キャッシュから読んだ場合は不正な行なしのまま）
+    RowErrorSink errors = MakeRowErrorSink(opt.errorPolicy, opt.errors, opt.maxErrorRecords);
+
+    // 有効なキャッシュがあればパースしない（キャッシュは既定の区切りで読んだ結果だけ）
+    int result = 1;
+    const bool cacheable = DialectOf(opt).IsDefault();
+    const bool fromCache = (cacheable && opt.cacheMode != CACHE_NONE && LoadColumns_Cache(filename, schema, table, opt) == 0);
+    if (!fromCache) {
+        result = LoadColumns_Csv(filename, schema, table, opt, errors);
+    }
+    NumaUnpinThreads(pin);
+    if (opt.stats) {
+        opt.stats->rows = (fromCache || result == 0) ? table.rows : 0;
+    }
+    StatsEnd(opt.stats, statsCtx);
+    if (fromCache) {
+        return 0;
+    }
+    if (result != 0) {
+        table = CsvTable();
+        return 1;
+    }
+
+    // キャッシュは不正な行がなかった読み込みからだけ書く（errorPolicy によらず同じ結果になる）
+    // キャッシュの書き出しに失敗しても読み込み結果は有効
+    if (cacheable && opt.cacheMode == CACHE_READWRITE && errors.count == 0) {
+        WriteCsvCache(filename, table);
+    }
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// @brief スキーマの列をキャッシュからコピーせずに参照する
+// @param[in]  filename  入力ファイルパス（ワイド文字列）
+// @param[in]  schema    列ごとの型（COLTYPE_SKIP 以外の列がキャッシュと名前・型とも一致すること）
+// @param[out] view      キャッシュをマップした列（使い終わったら CloseCsvCache）
+// @param[in]  opt       読み込みオプション（CACHE_READWRITE ならキャッシュがなければ作る）
+// @return               成功時は 0、有効なキャッシュがない・作れない場合は非 0
+int FastCsvLoadColumnsView(const std::wstring& filename, const CsvSchema& schema, CsvCacheView& view, const CsvLoadOptions& opt)
+{
+    if (!DialectOf(opt).IsDefault()) {
+        std::cerr << "キャッシュは既定の区切り（delimiter / whitespace / comment の指定なし）でのみ使えます。" << std::endl;
+        return 1;
+    }
+    const std::vector<CsvColumnDef> columns = CachedColumns(schema);
+    if (OpenColumnsCache(filename, columns, view, opt) == 0) {
+        // キャッシュは不正な行がなかった読み込みから書いたもの
+        MakeRowErrorSink(opt.errorPolicy, opt.errors, opt.maxErrorRecords);
+        return 0;
+    }
+    if (opt.cacheMode != CACHE_READWRITE) {
+        return 1;
+    }
+
+    // 読み込んでキャッシュを書き出し、書いたキャッシュをマップする（列バッファはすぐに捨てる）
+    {
+        CsvTable table;
+        if (FastCsvLoadColumns(filename, schema, table, opt) != 0) {
+            return 1;
+        }
+    }
+    if (OpenCsvCache(filename, columns, view) != 0) {
+        std::cerr << "キャッシュを作成できなかったため参照できません（不正な行がある場合は作成しません）。" << std::endl;
+        return 1;
+    }
+    return 0;
+}
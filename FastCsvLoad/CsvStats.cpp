@@ -0,0 +1,154 @@
+﻿#ifdef _WIN32
+#define NOMINMAX // この定義をWindows.hをインクルードする前に追加しないとエラーになる
+#include <windows.h>
+#include <psapi.h> // GetProcessMemoryInfo
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+#endif
+#include <algorithm>
+#include <cstring>
+#include <omp.h>
+
+#include "CsvStats.h"
+#include "NumaTopology.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// プロセス全体のページフォルト数
+static void GetPageFaults(uint64_t& minor, uint64_t& major)
+{
+#ifdef _WIN32
+    // Windows はソフト / ハードの区別がないので合計を minor に入れる
+    PROCESS_MEMORY_COUNTERS pmc;
+    minor = major = 0;
+    if (K32GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+        minor = pmc.PageFaultCount;
+    }
+#else
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    minor = static_cast<uint64_t>(ru.ru_minflt);
+    major = static_cast<uint64_t>(ru.ru_majflt);
+#endif
+}
+
+#ifdef __linux__
+// 呼び出したスレッドだけを数えるカウンタを開く（失敗時は -1）
+static int OpenPerfCounter(uint64_t config)
+{
+    struct perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+void StatsBegin(CsvLoadStats* stats, bool perfCounters, CsvStatsContext& ctx)
+{
+    if (!stats) {
+        return;
+    }
+    *stats = CsvLoadStats();
+    stats->threadBusySeconds.assign(omp_get_max_threads(), 0.0);
+    GetPageFaults(ctx.minorFaults, ctx.majorFaults);
+
+#ifdef __linux__
+    if (perfCounters) {
+        // OpenMP のスレッドごとに開く（perf_event は開いたスレッドだけを数える）
+        const int numThreads = omp_get_max_threads();
+        ctx.perfFds.assign(numThreads * 2, -1);
+#pragma omp parallel num_threads(numThreads)
+        {
+            const int t = omp_get_thread_num();
+            ctx.perfFds[t * 2] = OpenPerfCounter(PERF_COUNT_HW_CPU_CYCLES);
+            ctx.perfFds[t * 2 + 1] = OpenPerfCounter(PERF_COUNT_HW_INSTRUCTIONS);
+            for (int k = 0; k < 2; ++k) {
+                if (ctx.perfFds[t * 2 + k] >= 0) {
+                    ioctl(ctx.perfFds[t * 2 + k], PERF_EVENT_IOC_RESET, 0);
+                    ioctl(ctx.perfFds[t * 2 + k], PERF_EVENT_IOC_ENABLE, 0);
+                }
+            }
+        }
+    }
+#else
+    (void)perfCounters;
+#endif
+    ctx.start = StatsNow();
+}
+
+void StatsNuma(CsvLoadStats* stats, int numa, int pinnedThreads)
+{
+    if (!stats) {
+        return;
+    }
+    stats->numaNodes = NumaNodeCount();
+    stats->pinnedThreads = pinnedThreads;
+    stats->firstTouch = (numa & NUMA_FIRSTTOUCH) != 0;
+}
+
+void StatsEnd(CsvLoadStats* stats, CsvStatsContext& ctx)
+{
+    if (!stats) {
+        return;
+    }
+    stats->totalSeconds = StatsNow() - ctx.start;
+
+    uint64_t minor, major;
+    GetPageFaults(minor, major);
+    stats->minorFaults = minor - ctx.minorFaults;
+    stats->majorFaults = major - ctx.majorFaults;
+
+#ifdef __linux__
+    if (!ctx.perfFds.empty()) {
+        bool ok = true;
+        stats->threadCycles.assign(ctx.perfFds.size() / 2, 0);
+        stats->threadInstructions.assign(ctx.perfFds.size() / 2, 0);
+        for (size_t i = 0; i < ctx.perfFds.size(); ++i) {
+            const int fd = ctx.perfFds[i];
+            uint64_t value = 0;
+            if (fd < 0 || read(fd, &value, sizeof(value)) != sizeof(value)) {
+                ok = false;
+            }
+            else if (i % 2 == 0) {
+                stats->threadCycles[i / 2] = value;
+                stats->cycles += value;
+            }
+            else {
+                stats->threadInstructions[i / 2] = value;
+                stats->instructions += value;
+            }
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+        stats->hasPerf = ok;
+        if (!ok) {
+            stats->threadCycles.clear();
+            stats->threadInstructions.clear();
+            stats->cycles = stats->instructions = 0;
+        }
+        ctx.perfFds.clear();
+    }
+#endif
+
+    // 偏り = 最も忙しいスレッド / 平均
+    double sum = 0.0;
+    double maxBusy = 0.0;
+    for (double s : stats->threadBusySeconds) {
+        sum += s;
+        maxBusy = std::max(maxBusy, s);
+    }
+    const double mean = stats->threadBusySeconds.empty() ? 0.0 : sum / stats->threadBusySeconds.size();
+    stats->imbalance = (mean > 0.0) ? maxBusy / mean : 0.0;
+}
@@ -0,0 +1,94 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <chrono>
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 読み込みの計測値（CsvLoadOptions::stats に渡すと各フェーズの時間などを記録する）
+// フェーズ時間は壁時計の秒。1パス方式では走査とパースが一体なので scanSeconds は 0 で parseSeconds に含まれる
+//////////////////////////////////////////////////////////////////////////////////////////////
+struct CsvLoadStats {
+    // フェーズごとの経過時間（秒）
+    double   mapSeconds   = 0.0; // ファイルのマップ（非同期読み込みではオープン）
+    double   scanSeconds  = 0.0; // 行頭オフセットの走査（2パス方式）
+    double   mergeSeconds = 0.0; // スレッドごとの結果の結合
+    double   allocSeconds = 0.0; // 出力の確保
+    double   parseSeconds = 0.0; // 数値変換（1パス方式は走査を含む）
+    double   unmapSeconds = 0.0; // マップ解除
+    double   decompressSeconds = 0.0; // 圧縮ファイルの展開（展開とパースを重ねた場合は展開スレッドの時間）
+    double   totalSeconds = 0.0;
+
+    uint64_t bytes = 0;          // 入力バイト数（圧縮ファイルは展開後）
+    uint64_t compressedBytes = 0; // 圧縮ファイルの圧縮後のバイト数（圧縮されていなければ 0）
+    size_t   rows  = 0;          // 読み込んだ行数
+    bool     fromCache = false;  // バイナリキャッシュから読んだ
+    size_t   fixedRowLength = 0; // 固定長の行として読んだ場合の1行のバイト数（CsvLoadOptions::fixedWidth）
+
+    // スレッドごとの作業時間（走査 + パース）と偏り（最大 / 平均、1.0 が均等）
+    std::vector<double> threadBusySeconds;
+    double   imbalance = 0.0;
+
+    // ページフォルト（プロセス全体、読み込み前後の差分）
+    uint64_t minorFaults = 0;
+    uint64_t majorFaults = 0;
+
+    // ハードウェアカウンタ（CsvLoadOptions::perfCounters 指定時、Linux の perf_event のみ）
+    // OpenMP のワーカースレッドごとに計測する（非同期読み込み・展開のスレッドは含まない）
+    bool     hasPerf = false;
+    std::vector<uint64_t> threadCycles;       // OpenMP スレッド番号ごとの値
+    std::vector<uint64_t> threadInstructions;
+    uint64_t cycles = 0;                      // threadCycles の合計
+    uint64_t instructions = 0;                // threadInstructions の合計
+
+    // NUMA（CsvLoadOptions::numa / map.numaPolicy）
+    int      numaNodes = 1;         // CPU を持つノード数
+    int      pinnedThreads = 0;     // ノードに固定した OpenMP スレッド数（NUMA_PIN）
+    bool     firstTouch = false;    // 出力をパースしたスレッドが最初に書き込んだ（NUMA_FIRSTTOUCH）
+    int      mapNumaPolicy = 0;     // ファイルのマップに適用できた MAPNUMA_*
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 計測用の内部ヘルパー（stats が nullptr のときは何もしない）
+
+static inline double StatsNow()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 1フェーズ分の時間を target に加算する（Stop を呼ぶかスコープを抜けたとき）
+class StatsPhase {
+public:
+    explicit StatsPhase(double* target) : target_(target), start_(target ? StatsNow() : 0.0) {}
+    ~StatsPhase() { Stop(); }
+    void Stop() {
+        if (target_) {
+            *target_ += StatsNow() - start_;
+            target_ = nullptr;
+        }
+    }
+
+private:
+    double* target_;
+    double  start_;
+};
+
+// スレッド thread の作業時間を加算（各スレッドは自分の要素にだけ書く）
+static inline void StatsAddBusy(CsvLoadStats* stats, int thread, double seconds)
+{
+    if (stats && thread < static_cast<int>(stats->threadBusySeconds.size())) {
+        stats->threadBusySeconds[thread] += seconds;
+    }
+}
+
+// 読み込みの開始と終了（合計時間・ページフォルト・カウンタ・偏りを確定する）
+struct CsvStatsContext {
+    double   start = 0.0;
+    uint64_t minorFaults = 0;
+    uint64_t majorFaults = 0;
+    std::vector<int> perfFds; // スレッドごとの perf_event（cycles, instructions の順に2つずつ）
+};
+
+void StatsBegin(CsvLoadStats* stats, bool perfCounters, CsvStatsContext& ctx);
+void StatsNuma(CsvLoadStats* stats, int numa, int pinnedThreads);
+void StatsEnd(CsvLoadStats* stats, CsvStatsContext& ctx);
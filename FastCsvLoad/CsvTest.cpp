@@ -0,0 +1,1551 @@
+﻿#ifdef _WIN32
+#define NOMINMAX // この定義をWindows.hをインクルードする前に追加しないとエラーになる
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <omp.h>
+
+#ifdef FASTCSVLOAD_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef FASTCSVLOAD_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "FastCsvLoad.h"
+#include "FixedDecimal.h" // ParseDecimal
+#include "TaskScheduler.h" // TaskRowsEstimate
+#include "CsvIndex.h" // OpenCsvIndex
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// FastCsvTest: 結果が入力の内容だけで決まることの回帰テスト（ctest から実行）
+// ・固定小数点の高速パス（ParseDecimal）が fast_float::from_chars と値・次の位置まで一致する
+//   （読めないページの直前で終わる入力を含む）
+// ・引用符付き CSV で、チャンク境界が引用符の内側に落ちても行が正しく区切られる（投機的パースのやり直し）
+// ・不正な行の扱い（FILLNAN / SKIP / STRICT）ごとの出力行と記録
+// ・キャッシュ（<csv>.fcc）: コピーしない参照が FastCsvLoadColumns と一致し、CSV を変えると無効になる
+//   （不正な行があった読み込みからは作らない）
+// ・区切り・空白・コメント行の指定で、FastCsvLoad と FastCsvLoadColumns が読み込み方式によらず同じ値を読む
+// ・列の射影・行の絞り込み（columnMask / where）の結果と、範囲外の列数・列番号のエラー
+// ・gzip / zstd 圧縮の CSV（フレームに分けた並列展開と1ストリームの順の展開）が元の CSV と同じ値になる
+// ・数十億行（2^32 を超える行番号・バイト位置）の計算を、その大きさのファイルを作らずに確かめる
+// ・改行の混在（LF / CRLF / 単独の CR・空行）の行頭と読み込み結果、LF 用・CRLF 用の入口の従来どおりの区切り方
+// ・ストリーミング読み込み: 窓の境界で途切れた行・窓より長い行・batchRows ごとの受け渡しと中断
+// ・非同期読み込み: ヘッドルームより長い行がブロックをまたいでも、値と不正な行の位置がマップした場合と同じ
+// ・行インデックス（<csv>.fci）: 作成・範囲と間引きの読み込み・差分の幅・CSV を書き換えたときの作り直し
+// ・行頭オフセットの圧縮形式（ScanLineOffsets）が実際の入力で GetLineOffsets_* と同じ行頭になる
+// ・固定長の行（fixedWidth）: 行頭を計算で求めた結果と、パース中に長さの違う行を見つけて読み直した結果
+// ・複数ファイルの一括読み込み: ファイルごと・つなげた結果、ファイル番号付きの不正な行の記録
+// 失敗した項目を標準エラー出力に書き、1つでも失敗すれば 1 を返す
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+static int g_failures = 0;
+
+static void Check(bool ok, const std::string& what)
+{
+    if (!ok) {
+        ++g_failures;
+        if (g_failures <= 50) {
+            std::cerr << "NG: " << what << std::endl;
+        }
+    }
+}
+
+static std::wstring ToWide(const std::string& s)
+{
+    return std::wstring(s.begin(), s.end());
+}
+
+static bool WriteFile(const std::string& path, const std::string& content)
+{
+    std::ofstream out(path, std::ios::binary);
+    out.write(content.data(), static_cast<std::streamsize>(content.size()));
+    return static_cast<bool>(out);
+}
+
+// float のビット列が同じか（NaN 同士も一致とする）
+static bool SameFloat(float a, float b)
+{
+    if (std::isnan(a) || std::isnan(b)) {
+        return std::isnan(a) && std::isnan(b);
+    }
+    return std::memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+static std::string RowText(const PointCloud& p, int num_cols)
+{
+    std::string s;
+    for (int c = 0; c < num_cols; ++c) {
+        s += (c ? "," : "") + std::to_string(p.fields[c]);
+    }
+    return s;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 読めないページ（PROT_NONE / PAGE_NOACCESS）を後ろに置いた領域
+// ページの末尾で終わる入力を読ませ、16バイト読み込みがページをまたがないことを確かめる
+struct GuardedPage {
+    char*  page = nullptr; // 読める1ページ（直後のページは読めない）
+    size_t size = 0;
+
+    bool Init()
+    {
+#ifdef _WIN32
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        size = si.dwPageSize;
+        char* base = static_cast<char*>(VirtualAlloc(nullptr, size * 2, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+        DWORD old;
+        if (base == nullptr || !VirtualProtect(base + size, size, PAGE_NOACCESS, &old)) {
+            return false;
+        }
+#else
+        size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        void* m = mmap(nullptr, size * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m == MAP_FAILED) {
+            return false;
+        }
+        char* base = static_cast<char*>(m);
+        if (mprotect(base + size, size, PROT_NONE) != 0) {
+            return false;
+        }
+#endif
+        page = base;
+        return true;
+    }
+
+    ~GuardedPage()
+    {
+        if (page) {
+#ifdef _WIN32
+            VirtualFree(page, 0, MEM_RELEASE);
+#else
+            munmap(page, size * 2);
+#endif
+        }
+    }
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 1) ParseDecimal と fast_float::from_chars の比較
+// 固定小数点形式（桁数・小数桁数・符号・先頭の 0 を変える）と、指数・"123."・桁あふれなど
+// 高速パスに合わない形をまぜ、float / double の両方で値のビット列・次の位置・エラーを比べる
+static std::string RandomNumberText(std::mt19937_64& rng)
+{
+    static const char kAlphabet[] = "0123456789.-eE+,";
+    std::string s;
+    const int kind = static_cast<int>(rng() % 8);
+    if (kind == 0) {
+        // 任意の文字の並び
+        const int len = 1 + static_cast<int>(rng() % 24);
+        for (int i = 0; i < len; ++i) {
+            s += kAlphabet[rng() % (sizeof(kAlphabet) - 1)];
+        }
+        return s;
+    }
+    if (rng() % 2) {
+        s += '-';
+    }
+    const int intDigits = 1 + static_cast<int>(rng() % 17);
+    const bool leadingZeros = (rng() % 8) == 0;
+    for (int i = 0; i < intDigits; ++i) {
+        s += (leadingZeros && i < 2) ? '0' : static_cast<char>('0' + rng() % 10);
+    }
+    if (kind != 1) {
+        s += '.';
+        const int fracDigits = static_cast<int>(rng() % 17); // 0 なら "123."
+        for (int i = 0; i < fracDigits; ++i) {
+            s += static_cast<char>('0' + rng() % 10);
+        }
+    }
+    if (kind == 2) {
+        s += (rng() % 2) ? 'e' : 'E';
+        if (rng() % 2) {
+            s += (rng() % 2) ? '-' : '+';
+        }
+        const int expDigits = static_cast<int>(rng() % 3); // 0 なら指数の数字なし
+        for (int i = 0; i < expDigits; ++i) {
+            s += static_cast<char>('0' + rng() % 10);
+        }
+    }
+    return s;
+}
+
+template <class T>
+static bool SameResult(const char* first, const char* last)
+{
+    T fast = T(-1);
+    T ref = T(-1);
+    const fast_float::from_chars_result a = ParseDecimal(first, last, fast);
+    const fast_float::from_chars_result b = fast_float::from_chars(first, last, ref);
+    if (a.ec != b.ec || a.ptr != b.ptr) {
+        return false;
+    }
+    return a.ec != std::errc() || std::memcmp(&fast, &ref, sizeof(T)) == 0;
+}
+
+static void TestDecimal()
+{
+    GuardedPage guard;
+    Check(guard.Init(), "decimal: guard page");
+    std::mt19937_64 rng(20240517);
+    std::vector<char> buf(64);
+    const int kCount = 1000000;
+    int mismatches = 0;
+    for (int i = 0; i < kCount; ++i) {
+        const std::string s = RandomNumberText(rng);
+        // 後ろに区切り・改行・数字などが続く場合（16バイト読み込みで後ろまで見える）
+        static const char kTail[] = ",\n\r 9.e";
+        std::memcpy(buf.data(), s.data(), s.size());
+        for (size_t k = s.size(); k < buf.size(); ++k) {
+            buf[k] = kTail[rng() % (sizeof(kTail) - 1)];
+        }
+        const char* last = buf.data() + s.size() + rng() % 4; // 区切りの後ろまで渡す場合もある
+        bool ok = SameResult<float>(buf.data(), last) && SameResult<double>(buf.data(), last);
+
+        // 読めないページの直前で終わる場合
+        if (guard.page) {
+            char* first = guard.page + guard.size - s.size();
+            std::memcpy(first, s.data(), s.size());
+            ok = ok && SameResult<float>(first, guard.page + guard.size) && SameResult<double>(first, guard.page + guard.size);
+        }
+        if (!ok && ++mismatches <= 10) {
+            Check(false, "decimal: ParseDecimal differs from fast_float for \"" + s + "\"");
+        }
+    }
+    Check(mismatches == 0, "decimal: " + std::to_string(mismatches) + " mismatches in " + std::to_string(kCount) + " inputs");
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 2) 引用符付き CSV のチャンク境界
+// 2列目は '\n' '\r' ',' と行に見える文字列を含む引用符付きの文字列（数値ではない）。チャンクの先頭が引用符の内側だと
+// 投機的なパースは偽の行を作るので、やり直しが正しく働かないと行数・値がずれる
+static std::string MakeQuotedCsv(int rows, std::mt19937_64& rng)
+{
+    std::string csv;
+    for (int i = 0; i < rows; ++i) {
+        csv += std::to_string(i) + ".5,\"text ";
+        const int fakeRows = static_cast<int>(rng() % 40);
+        for (int k = 0; k < fakeRows; ++k) {
+            csv += (k % 3 == 2) ? "7,7,7\r\n" : "9,9,9\n";
+        }
+        csv += "\",-" + std::to_string(i) + ".25\n";
+    }
+    return csv;
+}
+
+// 公称のチャンク境界 contentSize / numChunks * c のうち、引用符の内側に落ちるものの数
+static int CountBoundariesInsideQuotes(const std::string& csv, int numChunks)
+{
+    int inside = 0;
+    for (int c = 1; c < numChunks; ++c) {
+        const size_t pos = csv.size() / numChunks * c;
+        size_t quotes = 0;
+        for (size_t p = 0; p < pos; ++p) {
+            quotes += (csv[p] == '"');
+        }
+        inside += static_cast<int>(quotes & 1);
+    }
+    return inside;
+}
+
+static void TestQuotedChunks()
+{
+    const int kRows = 3000;
+    const int kThreads = 4;
+    std::mt19937_64 rng(7);
+    const std::string csv = MakeQuotedCsv(kRows, rng);
+    const std::string path = "fastcsvtest_quoted.csv";
+    Check(WriteFile(path, csv), "quoted: write " + path);
+
+    // 引用符付きの1パス方式はスレッド数 x 4 のチャンクに分ける
+    omp_set_num_threads(kThreads);
+    Check(CountBoundariesInsideQuotes(csv, kThreads * 4) > 0, "quoted: no chunk boundary falls inside quotes");
+
+    static const int kModes[] = { LOADMODE_TWOPASS, LOADMODE_FUSED, LOADMODE_STRUCTURAL };
+    static const int kSimd[] = { SIMD_SSE42, SIMD_AVX2, SIMD_AUTO };
+    for (int mode : kModes) {
+        for (int simd : kSimd) {
+            for (int masked = 0; masked < 2; ++masked) {
+                const std::string name = "quoted: mode " + std::to_string(mode) + " simd " + std::to_string(simd) +
+                    (masked ? " columnMask" : "");
+                CsvLoadOptions opt;
+                opt.quiet = true;
+                opt.loadMode = mode;
+                opt.simdLevel = simd;
+                opt.quoting = QUOTING_RFC4180;
+                CsvLoadErrors errors;
+                opt.errors = &errors;
+                opt.maxErrorRecords = kRows;
+                if (masked) {
+                    opt.columnMask = 0x5; // 1列目と3列目だけ読む（文字列の列は読み飛ばして NaN）
+                }
+                std::vector<PointCloud> out;
+                const int rc = FastCsvLoad(ToWide(path), out, 3, opt);
+                Check(rc == 0, name + ": rc " + std::to_string(rc));
+                Check(out.size() == static_cast<size_t>(kRows), name + ": rows " + std::to_string(out.size()));
+                for (size_t i = 0; i < out.size() && i < static_cast<size_t>(kRows); ++i) {
+                    const float x = static_cast<float>(i) + 0.5f;
+                    const float z = -(static_cast<float>(i) + 0.25f);
+                    if (!SameFloat(out[i].x, x) || !std::isnan(out[i].y) || !SameFloat(out[i].z, z)) {
+                        Check(false, name + ": row " + std::to_string(i) + " = " + RowText(out[i], 3));
+                        break;
+                    }
+                }
+                // 文字列の列は読めないので、読む場合は全行が 1列目の不正として記録される
+                const size_t expectedErrors = masked ? 0 : kRows;
+                Check(errors.count == expectedErrors, name + ": error count " + std::to_string(errors.count));
+                Check(errors.records.size() == expectedErrors, name + ": error records " + std::to_string(errors.records.size()));
+                for (size_t k = 0; k < errors.records.size(); ++k) {
+                    const CsvRowError& e = errors.records[k];
+                    if (e.row != k || e.column != 1) {
+                        Check(false, name + ": error record " + std::to_string(k) + " row " + std::to_string(e.row) +
+                            " column " + std::to_string(e.column));
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    omp_set_num_threads(omp_get_num_procs());
+    std::remove(path.c_str());
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 3) 不正な行の扱い
+// 7行のブロックを繰り返す（複数のタスク・チャンクにまたがる）
+//   0: 1,2,3       正常
+//   1: 4,x,6       列 1 が読めない
+//   2: 7,8         列 2 がない
+//   3: 9,10,11     正常
+//   4: 1e,2,3      列 0 の後ろに余計な文字
+//   5: 12,13,14x   列 2 の後ろに余計な文字
+//   6: 15,16,17    正常
+struct PolicyLine {
+    const char* text;
+    int   badColumn; // -1 なら正常
+    float fields[3]; // FILLNAN の場合の値（読めない列は NaN）
+};
+
+static const float kNaN = std::numeric_limits<float>::quiet_NaN();
+
+static const PolicyLine kPolicyLines[] = {
+    { "1,2,3",     -1, { 1, 2, 3 } },
+    { "4,x,6",      1, { 4, kNaN, 6 } },
+    { "7,8",        2, { 7, 8, kNaN } },
+    { "9,10,11",   -1, { 9, 10, 11 } },
+    { "1e,2,3",     0, { kNaN, 2, 3 } },
+    { "12,13,14x",  2, { 12, 13, kNaN } },
+    { "15,16,17",  -1, { 15, 16, 17 } },
+};
+static const int kPolicyLineCount = static_cast<int>(sizeof(kPolicyLines) / sizeof(kPolicyLines[0]));
+
+static void TestErrorPolicies()
+{
+    const int kBlocks = 20000;
+    static const char* kNewlines[] = { "\n", "\r\n" };
+    static const int kModes[] = { LOADMODE_TWOPASS, LOADMODE_FUSED, LOADMODE_STRUCTURAL };
+    static const int kPolicies[] = { ERRORPOLICY_FILLNAN, ERRORPOLICY_SKIP, ERRORPOLICY_STRICT };
+
+    for (const char* newline : kNewlines) {
+        // ファイルと、行ごとの期待値（行頭のバイト位置・不正な列）
+        std::string csv;
+        std::vector<uint64_t> lineStart;
+        std::vector<int> lineKind;
+        for (int b = 0; b < kBlocks; ++b) {
+            for (int k = 0; k < kPolicyLineCount; ++k) {
+                lineStart.push_back(csv.size());
+                lineKind.push_back(k);
+                csv += kPolicyLines[k].text;
+                csv += newline;
+            }
+        }
+        const std::string path = "fastcsvtest_errors.csv";
+        Check(WriteFile(path, csv), "errors: write " + path);
+        const size_t numLines = lineKind.size();
+
+        for (int mode : kModes) {
+            for (int policy : kPolicies) {
+                const std::string name = std::string("errors: ") + (newline[0] == '\r' ? "CRLF" : "LF") +
+                    " mode " + std::to_string(mode) + " policy " + std::to_string(policy);
+                CsvLoadOptions opt;
+                opt.quiet = true;
+                opt.loadMode = mode;
+                opt.errorPolicy = policy;
+                CsvLoadErrors errors;
+                opt.errors = &errors;
+                opt.maxErrorRecords = numLines;
+                std::vector<PointCloud> out;
+                const int rc = FastCsvLoad(ToWide(path), out, 3, opt);
+
+                if (policy == ERRORPOLICY_STRICT) {
+                    // 最初の不正な行（1行目、列 1）で失敗し、出力は空
+                    Check(rc != 0, name + ": rc " + std::to_string(rc));
+                    Check(out.empty(), name + ": output not empty (" + std::to_string(out.size()) + ")");
+                    Check(errors.count == 1, name + ": error count " + std::to_string(errors.count));
+                    Check(errors.records.size() == 1 && errors.records[0].row == 1 && errors.records[0].column == 1 &&
+                        errors.records[0].byteOffset == lineStart[1], name + ": first error record");
+                    continue;
+                }
+
+                Check(rc == 0, name + ": rc " + std::to_string(rc));
+                // 期待する出力行
+                std::vector<const PolicyLine*> expected;
+                size_t badLines = 0;
+                for (size_t i = 0; i < numLines; ++i) {
+                    const PolicyLine& line = kPolicyLines[lineKind[i]];
+                    badLines += (line.badColumn >= 0);
+                    if (policy == ERRORPOLICY_FILLNAN || line.badColumn < 0) {
+                        expected.push_back(&line);
+                    }
+                }
+                Check(out.size() == expected.size(), name + ": rows " + std::to_string(out.size()) +
+                    " (expected " + std::to_string(expected.size()) + ")");
+                for (size_t i = 0; i < out.size() && i < expected.size(); ++i) {
+                    bool same = true;
+                    for (int c = 0; c < 3; ++c) {
+                        same = same && SameFloat(out[i].fields[c], expected[i]->fields[c]);
+                    }
+                    if (!same) {
+                        Check(false, name + ": row " + std::to_string(i) + " = " + RowText(out[i], 3) +
+                            " (expected " + expected[i]->text + ")");
+                        break;
+                    }
+                }
+
+                // 記録はどちらの扱いでも入力の行番号・行頭の位置・最初に読めなかった列
+                Check(errors.count == badLines, name + ": error count " + std::to_string(errors.count));
+                Check(errors.records.size() == badLines, name + ": error records " + std::to_string(errors.records.size()));
+                size_t k = 0;
+                for (size_t i = 0; i < numLines && k < errors.records.size(); ++i) {
+                    const PolicyLine& line = kPolicyLines[lineKind[i]];
+                    if (line.badColumn < 0) {
+                        continue;
+                    }
+                    const CsvRowError& e = errors.records[k++];
+                    if (e.row != i || e.byteOffset != lineStart[i] || e.column != line.badColumn) {
+                        Check(false, name + ": error record " + std::to_string(k - 1) + " row " + std::to_string(e.row) +
+                            " offset " + std::to_string(e.byteOffset) + " column " + std::to_string(e.column) +
+                            " (expected row " + std::to_string(i) + ")");
+                        break;
+                    }
+                }
+            }
+        }
+        std::remove(path.c_str());
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 4) キャッシュ
+// FastCsvLoadColumnsView の列はマップした領域を直接指し、値は FastCsvLoadColumns（CSV をパース）と同じ。
+// CSV を書き換えると古いキャッシュは使われず、CACHE_READWRITE なら作り直す。
+// 不正な行を SKIP で読んだときはキャッシュを書かない（STRICT の読み込みがキャッシュ経由で成功してはいけない）
+static std::string MakeCacheCsv(int rows, int seed)
+{
+    std::string csv;
+    for (int i = 0; i < rows; ++i) {
+        csv += std::to_string((i * 7 + seed) % 1000) + "." + std::to_string(i % 10) + "," +
+            std::to_string(i - rows / 2) + ",skip," + std::to_string(i * 3 + seed) + ".25\n";
+    }
+    return csv;
+}
+
+static bool SameColumns(const CsvCacheView& view, const CsvTable& table)
+{
+    if (view.rows != table.rows || view.columns.size() != table.columns.size()) {
+        return false;
+    }
+    for (size_t c = 0; c < view.columns.size(); ++c) {
+        const CsvColumn& col = table.columns[c];
+        if (view.columns[c].name != col.name || view.columns[c].type != col.type ||
+            std::memcmp(view.columns[c].data, col.data.data(), table.rows * col.elemSize) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void TestCache()
+{
+    const std::string path = "fastcsvtest_cache.csv";
+    const std::string cachePath = path + ".fcc";
+    CsvSchema schema;
+    schema.Add("a", COLTYPE_FLOAT).Add("b", COLTYPE_INT32).Add("s", COLTYPE_SKIP).Add("c", COLTYPE_DOUBLE);
+
+    CsvLoadOptions parseOpt;
+    parseOpt.quiet = true;
+    CsvLoadOptions readOpt = parseOpt;
+    readOpt.cacheMode = CACHE_READ;
+    CsvLoadOptions writeOpt = parseOpt;
+    writeOpt.cacheMode = CACHE_READWRITE;
+
+    for (int pass = 0; pass < 2; ++pass) {
+        const std::string name = "cache: pass " + std::to_string(pass);
+        // pass 1 は同じ行数で値だけ変える（古いキャッシュが残っている）
+        Check(WriteFile(path, MakeCacheCsv(20000, pass)), name + ": write " + path);
+        CsvTable parsed;
+        Check(FastCsvLoadColumns(ToWide(path), schema, parsed, parseOpt) == 0, name + ": parse");
+
+        CsvCacheView view;
+        Check(FastCsvLoadColumnsView(ToWide(path), schema, view, readOpt) != 0, name + ": view without a valid cache");
+        CloseCsvCache(view);
+
+        Check(FastCsvLoadColumnsView(ToWide(path), schema, view, writeOpt) == 0, name + ": view (write cache)");
+        Check(SameColumns(view, parsed), name + ": view differs from the parsed table");
+        bool inMapping = view.columns.size() == 3;
+        for (const CsvCacheView::Column& col : view.columns) {
+            const char* p = static_cast<const char*>(col.data);
+            inMapping = inMapping && p >= view.mf.data && p + view.rows * ColumnTypeSize(col.type) <= view.mf.data + view.mf.size;
+        }
+        Check(inMapping, name + ": view columns are not inside the mapping");
+        CloseCsvCache(view);
+
+        // 書いたキャッシュを CACHE_READ で読む（参照・コピーとも）
+        CsvLoadStats stats;
+        CsvLoadOptions statsOpt = readOpt;
+        statsOpt.stats = &stats;
+        Check(FastCsvLoadColumnsView(ToWide(path), schema, view, statsOpt) == 0 && stats.fromCache, name + ": view from cache");
+        Check(SameColumns(view, parsed), name + ": cached view differs from the parsed table");
+        CloseCsvCache(view);
+        CsvTable copied;
+        Check(FastCsvLoadColumns(ToWide(path), schema, copied, readOpt) == 0, name + ": copy from cache");
+        Check(copied.rows == parsed.rows && copied.columns.size() == parsed.columns.size(), name + ": copied shape");
+    }
+
+    // 列の型が違うスキーマではキャッシュを使わない
+    {
+        CsvSchema other;
+        other.Add("a", COLTYPE_DOUBLE).Add("b", COLTYPE_INT32).Add("s", COLTYPE_SKIP).Add("c", COLTYPE_DOUBLE);
+        CsvCacheView view;
+        Check(FastCsvLoadColumnsView(ToWide(path), other, view, readOpt) != 0, "cache: view with another column type");
+        CloseCsvCache(view);
+    }
+
+    // 不正な行がある CSV: SKIP ではキャッシュを書かず、後の STRICT は失敗する
+    {
+        std::remove(cachePath.c_str());
+        std::string csv = MakeCacheCsv(20000, 0);
+        csv += "1.5,x,skip,2.5\n";
+        Check(WriteFile(path, csv), "cache: write bad rows");
+
+        CsvLoadOptions skipOpt = writeOpt;
+        skipOpt.errorPolicy = ERRORPOLICY_SKIP;
+        CsvLoadErrors errors;
+        skipOpt.errors = &errors;
+        CsvTable table;
+        Check(FastCsvLoadColumns(ToWide(path), schema, table, skipOpt) == 0 && table.rows == 20000 && errors.count == 1,
+            "cache: SKIP load with a bad row");
+        Check(!std::ifstream(cachePath).good(), "cache: written from a load with bad rows");
+
+        CsvCacheView view;
+        Check(FastCsvLoadColumnsView(ToWide(path), schema, view, skipOpt) != 0, "cache: view from a load with bad rows");
+        CloseCsvCache(view);
+
+        CsvLoadOptions strictOpt = writeOpt;
+        strictOpt.errorPolicy = ERRORPOLICY_STRICT;
+        strictOpt.errors = &errors;
+        Check(FastCsvLoadColumns(ToWide(path), schema, table, strictOpt) != 0 && errors.count == 1,
+            "cache: STRICT load after a SKIP load");
+        std::vector<PointCloud> out;
+        Check(FastCsvLoad(ToWide(path), out, 3, strictOpt) != 0 && out.empty(), "cache: STRICT FastCsvLoad after a SKIP load");
+    }
+    std::remove(path.c_str());
+    std::remove(cachePath.c_str());
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 5) 区切り・空白・コメント行
+// 同じ値（x, y, z と文字列の列）を形式ごとに書き、FastCsvLoad（3列）と FastCsvLoadColumns（y を読み飛ばす）で読む。
+// ':' は構造インデックスの特殊化にない区切り文字（LOADMODE_STRUCTURAL でも1パス方式で読む）
+struct DialectCase {
+    const char* name;
+    char        delimiter;
+    bool        whitespace;
+    int         comment;
+};
+
+static const DialectCase kDialectCases[] = {
+    { "tab",            '\t', false, COMMENT_NONE },
+    { "semicolon CRLF", ';',  false, COMMENT_NONE },
+    { "colon",          ':',  false, COMMENT_NONE },
+    { "pipe comments",  '|',  false, COMMENT_HASH },
+    { "blanks",         ' ',  true,  COMMENT_HASH | COMMENT_SLASH },
+    { "comma blanks",   ',',  true,  COMMENT_SLASH },
+};
+
+static float DialectX(int i) { return static_cast<float>(i) * 0.5f; }
+static float DialectY(int i) { return static_cast<float>(-i); }
+static float DialectZ(int i) { return static_cast<float>(i % 7) + 0.25f; }
+
+static std::string MakeDialectCsv(const DialectCase& d, int rows)
+{
+    const std::string newline = (d.delimiter == ';') ? "\r\n" : "\n";
+    std::string csv;
+    for (int i = 0; i < rows; ++i) {
+        if ((d.comment & COMMENT_HASH) && i % 97 == 0) {
+            csv += "# 1,2,3" + newline;
+        }
+        if ((d.comment & COMMENT_SLASH) && i % 89 == 0) {
+            csv += "// 4,5,6" + newline;
+        }
+        const std::string fields[] = { std::to_string(i / 2) + (i % 2 ? ".5" : ""), std::to_string(-i),
+            std::to_string(i % 7) + ".25", "t" + std::to_string(i) };
+        for (int c = 0; c < 4; ++c) {
+            if (c > 0) {
+                csv += d.delimiter;
+            }
+            // 空白を読み飛ばす形式はフィールドの前後に空白・タブを入れる（区切りが空白なら連続した区切りになる）
+            csv += (d.whitespace && i % 3 == c % 3) ? " \t" + fields[c] + "  " : fields[c];
+        }
+        csv += newline;
+        if (d.whitespace && i % 101 == 0) {
+            csv += "  \t" + newline; // 空白だけの行
+        }
+    }
+    return csv;
+}
+
+static void TestDialects()
+{
+    const int kRows = 30000;
+    const std::string path = "fastcsvtest_dialect.csv";
+    static const int kModes[] = { LOADMODE_TWOPASS, LOADMODE_FUSED, LOADMODE_STRUCTURAL };
+    CsvSchema schema;
+    schema.Add("x", COLTYPE_FLOAT).Add("y", COLTYPE_SKIP).Add("z", COLTYPE_DOUBLE);
+
+    for (const DialectCase& d : kDialectCases) {
+        Check(WriteFile(path, MakeDialectCsv(d, kRows)), std::string("dialect: write ") + d.name);
+        for (int mode : kModes) {
+            const std::string name = std::string("dialect: ") + d.name + " mode " + std::to_string(mode);
+            CsvLoadOptions opt;
+            opt.quiet = true;
+            opt.loadMode = mode;
+            opt.delimiter = d.delimiter;
+            opt.whitespace = d.whitespace;
+            opt.comment = d.comment;
+            opt.cacheMode = CACHE_READWRITE; // 既定以外の形式ではキャッシュを書かない
+            CsvLoadErrors errors;
+            opt.errors = &errors;
+
+            std::vector<PointCloud> out;
+            Check(FastCsvLoad(ToWide(path), out, 3, opt) == 0 && errors.count == 0, name + ": FastCsvLoad rc / errors " +
+                std::to_string(errors.count));
+            Check(out.size() == static_cast<size_t>(kRows), name + ": FastCsvLoad rows " + std::to_string(out.size()));
+            for (size_t i = 0; i < out.size(); ++i) {
+                const int r = static_cast<int>(i);
+                if (!SameFloat(out[i].fields[0], DialectX(r)) || !SameFloat(out[i].fields[1], DialectY(r)) ||
+                    !SameFloat(out[i].fields[2], DialectZ(r))) {
+                    Check(false, name + ": FastCsvLoad row " + std::to_string(i) + " = " + RowText(out[i], 3));
+                    break;
+                }
+            }
+
+            CsvTable table;
+            Check(FastCsvLoadColumns(ToWide(path), schema, table, opt) == 0 && errors.count == 0,
+                name + ": FastCsvLoadColumns rc / errors " + std::to_string(errors.count));
+            Check(table.rows == static_cast<size_t>(kRows) && table.columns.size() == 2,
+                name + ": FastCsvLoadColumns rows " + std::to_string(table.rows));
+            if (table.rows == static_cast<size_t>(kRows) && table.columns.size() == 2) {
+                const float* x = table.columns[0].As<float>();
+                const double* z = table.columns[1].As<double>();
+                for (int r = 0; r < kRows; ++r) {
+                    if (!SameFloat(x[r], DialectX(r)) || z[r] != static_cast<double>(DialectZ(r))) {
+                        Check(false, name + ": FastCsvLoadColumns row " + std::to_string(r) + " = " +
+                            std::to_string(x[r]) + "," + std::to_string(z[r]));
+                        break;
+                    }
+                }
+            }
+            Check(!std::ifstream(path + ".fcc").good(), name + ": cache written for a non-default dialect");
+        }
+    }
+    std::remove(path.c_str());
+    std::remove((path + ".fcc").c_str());
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 6) 列の射影と行の絞り込み
+// 行 i は "i,-i,i%5"。columnMask で列 1 を読まず、where で列 2 >= 3 の行だけを残す。
+// 列数が 0 や COLUMN_SIZE を超える場合（マスクのシフトが 32 ビットを超える場合を含む）と
+// 範囲外の where の列は、行を読まずにエラーになる
+static void TestRowFilter()
+{
+    const int kRows = 50000;
+    const std::string path = "fastcsvtest_filter.csv";
+    std::string csv;
+    for (int i = 0; i < kRows; ++i) {
+        csv += std::to_string(i) + "," + std::to_string(-i) + "," + std::to_string(i % 5) + "\n";
+    }
+    Check(WriteFile(path, csv), "filter: write " + path);
+
+    static const int kModes[] = { LOADMODE_TWOPASS, LOADMODE_FUSED, LOADMODE_STRUCTURAL };
+    for (int mode : kModes) {
+        const std::string name = "filter: mode " + std::to_string(mode);
+        CsvLoadOptions opt;
+        opt.quiet = true;
+        opt.loadMode = mode;
+        opt.columnMask = 0x5; // 列 0, 2
+        CsvPredicate w;
+        w.column = 2;
+        w.op = PREDICATE_GE;
+        w.value = 3.0f;
+        opt.where.push_back(w);
+        std::vector<PointCloud> out;
+        Check(FastCsvLoad(ToWide(path), out, 3, opt) == 0, name + ": rc");
+        Check(out.size() == static_cast<size_t>(kRows / 5 * 2), name + ": rows " + std::to_string(out.size()));
+        for (size_t k = 0; k < out.size(); ++k) {
+            const int i = static_cast<int>(k / 2 * 5 + 3 + k % 2); // i % 5 が 3, 4 の行
+            if (!SameFloat(out[k].fields[0], static_cast<float>(i)) || !std::isnan(out[k].fields[1]) ||
+                !SameFloat(out[k].fields[2], static_cast<float>(i % 5))) {
+                Check(false, name + ": row " + std::to_string(k) + " = " + RowText(out[k], 3));
+                break;
+            }
+        }
+    }
+
+    static const int kBadCols[] = { 0, -1, COLUMN_SIZE + 1, 32, 40 };
+    for (int cols : kBadCols) {
+        const std::string name = "filter: num_cols " + std::to_string(cols);
+        CsvLoadOptions opt;
+        opt.quiet = true;
+        std::vector<PointCloud> out(1);
+        Check(FastCsvLoad(ToWide(path), out, cols, opt) != 0 && out.empty(), name + ": FastCsvLoad");
+        size_t streamed = 0;
+        Check(FastCsvLoadStream(ToWide(path), cols, [&](const PointCloud*, size_t count, size_t) { streamed += count; return 0; }, opt) != 0 &&
+            streamed == 0, name + ": FastCsvLoadStream");
+        std::vector<std::vector<PointCloud>> results;
+        Check(FastCsvLoadBatch({ ToWide(path) }, results, cols, opt) != 0, name + ": FastCsvLoadBatch");
+    }
+    {
+        CsvLoadOptions opt;
+        opt.quiet = true;
+        CsvPredicate w;
+        w.column = 3;
+        opt.where.push_back(w);
+        std::vector<PointCloud> out;
+        Check(FastCsvLoad(ToWide(path), out, 3, opt) != 0 && out.empty(), "filter: where column out of range");
+    }
+    std::remove(path.c_str());
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 7) 圧縮ファイル
+// 同じ CSV を1ストリーム（順に展開）と独立したフレーム（BGZF / zstd の複数フレーム、並列に展開）に圧縮し、
+// FastCsvLoad（読み込み方式・非同期読み込み）と FastCsvLoadColumns の結果を圧縮前と比べる
+#ifdef FASTCSVLOAD_HAVE_ZLIB
+// gzip の1メンバー　bgzf なら拡張フィールド "BC" にメンバーのバイト数 - 1 を入れる（BGZF）
+static std::string GzipMember(const char* data, size_t size, bool bgzf)
+{
+    z_stream zs = {};
+    deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    unsigned char extra[6] = { 'B', 'C', 2, 0, 0, 0 };
+    gz_header header = {};
+    if (bgzf) {
+        header.extra = extra;
+        header.extra_len = sizeof(extra);
+        deflateSetHeader(&zs, &header);
+    }
+    std::string out(deflateBound(&zs, static_cast<uLong>(size)) + 64, '\0');
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    zs.avail_in = static_cast<uInt>(size);
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+    deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    if (bgzf) {
+        // ID1 ID2 CM FLG MTIME(4) XFL OS XLEN(2) 'B' 'C' SLEN(2) の後が BSIZE
+        const size_t bsize = out.size() - 1;
+        out[16] = static_cast<char>(bsize & 0xFF);
+        out[17] = static_cast<char>(bsize >> 8);
+    }
+    return out;
+}
+#endif
+
+static void CheckCompressedLoad(const std::string& name, const std::string& path, const std::vector<PointCloud>& expected,
+    const CsvTable& expectedTable, const CsvSchema& schema)
+{
+    static const int kModes[] = { LOADMODE_TWOPASS, LOADMODE_FUSED, LOADMODE_STRUCTURAL };
+    for (int backend = IOBACKEND_MMAP; backend <= IOBACKEND_ASYNC; ++backend) {
+        for (int mode : kModes) {
+            const std::string what = name + " backend " + std::to_string(backend) + " mode " + std::to_string(mode);
+            CsvLoadOptions opt;
+            opt.quiet = true;
+            opt.loadMode = mode;
+            opt.ioBackend = backend;
+            opt.async.blockSize = 256u << 10; // 複数ブロックに分ける
+            CsvLoadStats stats;
+            opt.stats = &stats;
+            std::vector<PointCloud> out;
+            Check(FastCsvLoad(ToWide(path), out, 3, opt) == 0 && stats.compressedBytes > 0, what + ": FastCsvLoad rc");
+            bool same = out.size() == expected.size();
+            for (size_t i = 0; same && i < out.size(); ++i) {
+                same = std::memcmp(out[i].fields, expected[i].fields, 3 * sizeof(float)) == 0;
+            }
+            Check(same, what + ": FastCsvLoad rows " + std::to_string(out.size()));
+        }
+    }
+    CsvLoadOptions opt;
+    opt.quiet = true;
+    CsvTable table;
+    Check(FastCsvLoadColumns(ToWide(path), schema, table, opt) == 0, name + ": FastCsvLoadColumns rc");
+    bool same = table.rows == expectedTable.rows && table.columns.size() == expectedTable.columns.size();
+    for (size_t c = 0; same && c < table.columns.size(); ++c) {
+        same = std::memcmp(table.columns[c].data.data(), expectedTable.columns[c].data.data(),
+            table.rows * table.columns[c].elemSize) == 0;
+    }
+    Check(same, name + ": FastCsvLoadColumns rows " + std::to_string(table.rows));
+}
+
+static void TestCompressed()
+{
+    const int kRows = 200000;
+    std::string csv;
+    for (int i = 0; i < kRows; ++i) {
+        csv += std::to_string(i % 1000) + "." + std::to_string(i % 97) + "," + std::to_string(i) + "," +
+            std::to_string(-i % 13) + (i % 5 == 0 ? "\r\n" : "\n");
+    }
+    const std::string plainPath = "fastcsvtest_compressed.csv";
+    Check(WriteFile(plainPath, csv), "compressed: write " + plainPath);
+    CsvLoadOptions plainOpt;
+    plainOpt.quiet = true;
+    std::vector<PointCloud> expected;
+    Check(FastCsvLoad(ToWide(plainPath), expected, 3, plainOpt) == 0 && expected.size() == static_cast<size_t>(kRows),
+        "compressed: plain load");
+    CsvSchema schema;
+    schema.Add("a", COLTYPE_FLOAT).Add("b", COLTYPE_INT64).Add("c", COLTYPE_DOUBLE);
+    CsvTable expectedTable;
+    Check(FastCsvLoadColumns(ToWide(plainPath), schema, expectedTable, plainOpt) == 0, "compressed: plain columns");
+    std::remove(plainPath.c_str());
+
+    std::vector<std::pair<std::string, std::string>> files; // 名前と圧縮データ
+#ifdef FASTCSVLOAD_HAVE_ZLIB
+    files.push_back({ "gzip", GzipMember(csv.data(), csv.size(), false) });
+    {
+        // BGZF: 64KB 未満のメンバーに分け、末尾に空のメンバー（EOF マーカー）を置く
+        std::string bgzf;
+        for (size_t pos = 0; pos < csv.size(); pos += 32768) {
+            bgzf += GzipMember(csv.data() + pos, std::min<size_t>(32768, csv.size() - pos), true);
+        }
+        bgzf += GzipMember("", 0, true);
+        files.push_back({ "bgzf", bgzf });
+    }
+#endif
+#ifdef FASTCSVLOAD_HAVE_ZSTD
+    for (size_t frameBytes : { csv.size(), static_cast<size_t>(1u << 20) }) {
+        std::string zst;
+        for (size_t pos = 0; pos < csv.size(); pos += frameBytes) {
+            const size_t n = std::min(frameBytes, csv.size() - pos);
+            std::string frame(ZSTD_compressBound(n), '\0');
+            const size_t written = ZSTD_compress(&frame[0], frame.size(), csv.data() + pos, n, 1);
+            Check(!ZSTD_isError(written), "compressed: ZSTD_compress");
+            frame.resize(ZSTD_isError(written) ? 0 : written);
+            zst += frame;
+        }
+        files.push_back({ frameBytes == csv.size() ? "zstd" : "zstd frames", zst });
+    }
+#endif
+    for (const auto& file : files) {
+        const std::string path = "fastcsvtest_compressed." + file.first.substr(0, 4);
+        Check(WriteFile(path, file.second), "compressed: write " + path);
+        CheckCompressedLoad("compressed: " + file.first, path, expected, expectedTable, schema);
+        std::remove(path.c_str());
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 8) 2^32 を超える行数・バイト位置
+// 行頭オフセット・行数の見積もり・タスクごとの予約・行番号の基準を、数 GB のメモリを使わない合成値で確かめる
+static void CheckLineOffsets(const std::string& name, size_t rows, uint64_t (*offsetOf)(size_t), bool expectWide)
+{
+    LineOffsetArray a;
+    InitLineOffsetArray(a, rows, [&](size_t r) { return static_cast<size_t>(offsetOf(r)); });
+    Check(a.wide == expectWide, name + ": wide " + std::to_string(a.wide));
+    for (size_t r = 0; r < rows; ++r) {
+        a.Set(r, static_cast<size_t>(offsetOf(r)));
+    }
+    bool same = a.size == rows;
+    for (size_t r = 0; same && r < rows; ++r) {
+        same = (a[r] == offsetOf(r));
+    }
+    Check(same, name + ": offsets");
+
+    // size_t の配列からの変換（スカラー版の結果）も同じ
+    std::vector<size_t> offsets(rows);
+    for (size_t r = 0; r < rows; ++r) {
+        offsets[r] = static_cast<size_t>(offsetOf(r));
+    }
+    LineOffsetArray b;
+    AssignLineOffsets(b, offsets.data(), rows);
+    same = b.size == rows && b.wide == expectWide;
+    for (size_t r = 0; same && r < rows; ++r) {
+        same = (b[r] == offsets[r]);
+    }
+    Check(same, name + ": AssignLineOffsets");
+}
+
+// 5e9 行目あたり（約 100GB の位置）から 20 バイトずつ
+static uint64_t FarOffset(size_t r) { return 100000000000ULL + r * 20; }
+// 2^40 バイト付近で、2番目のブロックの途中に 5GB の行がある（ブロック内の差が 32 ビットに収まらない）
+static uint64_t WideOffset(size_t r) { return (1ULL << 40) + r * 20 + (r >= LINEOFFSET_BLOCK_ROWS + 100 ? (5ULL << 30) : 0); }
+
+static void TestLargeCounts()
+{
+    if (sizeof(size_t) < 8) {
+        return;
+    }
+    CheckLineOffsets("large: block bases past 2^32", 3 * LINEOFFSET_BLOCK_ROWS + 17, FarOffset, false);
+    CheckLineOffsets("large: wide fallback", 3 * LINEOFFSET_BLOCK_ROWS + 17, WideOffset, true);
+
+    // 行数の見積もり: 5e9 行（100GB、20 バイト/行）と、n * newlines が 64 ビットを超える場合
+    RowDensity density;
+    density.bytes = 4000000;
+    density.newlines = 200000;
+    const size_t rows = 5000000000ULL;
+    Check(density.Rows(100000000000ULL) == rows + rows / LINEESTIMATE_MARGIN + 1,
+        "large: RowDensity::Rows 5e9 = " + std::to_string(density.Rows(100000000000ULL)));
+    density.bytes = 4194303;
+    density.newlines = 4194000;
+    Check(density.Rows(5000000000000ULL) == 5077758151950ULL,
+        "large: RowDensity::Rows overflow = " + std::to_string(density.Rows(5000000000000ULL)));
+    density.newlines = 0;
+    Check(density.Rows(100000000000ULL) == 100000000000ULL / 4194303 + 1, "large: RowDensity::Rows no newline");
+
+    // タスクごとの予約: 全タスクの合計が見積もり以上で、1タスクが 2^32 を超えても切り詰めない
+    static const size_t kTasks[] = { 0, 1, 7, 1000, 65536 };
+    for (size_t tasks : kTasks) {
+        const size_t perTask = TaskRowsEstimate(rows, tasks);
+        Check(perTask * std::max<size_t>(tasks, 1) >= rows, "large: TaskRowsEstimate " + std::to_string(tasks) + " tasks = " +
+            std::to_string(perTask));
+    }
+    Check(TaskRowsEstimate(rows, 1) > 0xFFFFFFFFULL, "large: TaskRowsEstimate one task");
+
+    // 行番号の基準: タスクごとの行数の累積和が 2^32 を超え、さらに前のブロックの行数・バイト数が足される
+    std::vector<size_t> chunkRows = { 3000000000ULL, 2000000000ULL, 1500000000ULL, 10 };
+    std::vector<size_t> rowBase(chunkRows.size() + 1, 0);
+    for (size_t c = 0; c < chunkRows.size(); ++c) {
+        rowBase[c + 1] = rowBase[c] + chunkRows[c];
+    }
+    CsvLoadErrors errors;
+    RowErrorSink sink = MakeRowErrorSink(ERRORPOLICY_SKIP, &errors, 10);
+    sink.rows = 5000000000ULL;
+    sink.bytes = 100000000000ULL;
+    RowErrorLog log(sink, chunkRows.size());
+    log.Add(0, 5, 123, 1);
+    log.Add(2, 1499999999ULL, 90000000000ULL, 0);
+    log.Add(3, 9, 95000000000ULL, 2);
+    log.Finish(sink, &rowBase);
+    Check(errors.count == 3 && errors.records.size() == 3, "large: error records " + std::to_string(errors.records.size()));
+    if (errors.records.size() == 3) {
+        Check(errors.records[0].row == 5000000005ULL && errors.records[0].byteOffset == 100000000123ULL, "large: error row 0");
+        Check(errors.records[1].row == 5000000000ULL + 5000000000ULL + 1499999999ULL &&
+            errors.records[1].byteOffset == 190000000000ULL, "large: error row 1 = " + std::to_string(errors.records[1].row));
+        Check(errors.records[2].row == 5000000000ULL + 6500000000ULL + 9 && errors.records[2].column == 2,
+            "large: error row 2 = " + std::to_string(errors.records[2].row));
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 9) 改行の種類
+// 混在用（GetLineOffsets_Mixed_AVX2_OpenMP）は '\n' '\r' の連続を1つの区切りとみなし、空行を行にしない
+// （GetLineOffsets と同じ。ただし GetLineOffsets は先頭の空行も位置 0 の行にする）。
+// LF 用は '\n' だけで区切り（'\r' は行の中身）、CRLF 用は '\r' で区切る（従来どおり、混在用とは結果が違う入力がある）
+static std::vector<size_t> ReferenceLfOffsets(const std::string& text)
+{
+    std::vector<size_t> offsets;
+    for (size_t pos = 0; pos < text.size();) {
+        offsets.push_back(pos);
+        while (pos < text.size() && text[pos] != '\n') {
+            ++pos;
+        }
+        while (pos < text.size() && text[pos] == '\n') {
+            ++pos;
+        }
+    }
+    return offsets;
+}
+
+static void TestNewlines()
+{
+    std::mt19937_64 rng(24);
+    static const char* kNewlines[] = { "\n", "\r\n", "\r", "\n\n", "\r\n\r\n", "\r\r" };
+    const int kRows = 150000;
+
+    // 混在: 行ごとに改行の種類を変え、先頭の空行と改行のない最終行を置く
+    std::string mixed = "\r\n";
+    for (int i = 0; i < kRows; ++i) {
+        mixed += std::to_string(i) + "," + std::to_string(i % 11) + ",1.5";
+        if (i + 1 < kRows) {
+            mixed += kNewlines[rng() % 6];
+        }
+    }
+    std::vector<size_t> expected, offsets;
+    GetLineOffsets(mixed.data() + 2, mixed.size() - 2, expected); // 先頭の空行の後から
+    for (size_t& e : expected) {
+        e += 2;
+    }
+    Check(expected.size() == static_cast<size_t>(kRows), "newlines: scalar rows " + std::to_string(expected.size()));
+    offsets.clear();
+    GetLineOffsets_Mixed_AVX2_OpenMP(mixed.data(), mixed.size(), offsets);
+    Check(offsets == expected, "newlines: Mixed offsets");
+
+    // LF だけ（空行あり）: LF 用は LF の参照と同じ。'\r' を行の中に含めても区切らない
+    for (int withCr = 0; withCr < 2; ++withCr) {
+        std::string lf;
+        for (int i = 0; i < kRows; ++i) {
+            lf += std::to_string(i) + (withCr && i % 7 == 0 ? "\r" : "") + "," + std::to_string(i % 5);
+            lf += (i % 13 == 0) ? "\n\n" : "\n";
+        }
+        const std::string name = std::string("newlines: LF") + (withCr ? " with CR" : "");
+        const std::vector<size_t> lfExpected = ReferenceLfOffsets(lf);
+        offsets.clear();
+        GetLineOffsets_LF_AVX2_OpenMP(lf.data(), lf.size(), offsets);
+        Check(offsets == lfExpected, name + ": LF_AVX2 offsets");
+        offsets.clear();
+        GetLineOffsets_LF_OpenMP(lf.data(), lf.size(), offsets);
+        Check(offsets == lfExpected, name + ": LF_OpenMP offsets");
+        offsets.clear();
+        GetLineOffsets_Mixed_AVX2_OpenMP(lf.data(), lf.size(), offsets);
+        Check((offsets == lfExpected) == !withCr, name + ": Mixed splits at CR only when CR is present");
+    }
+
+    // CRLF だけ（空行なし）: CRLF 用・混在用・スカラー版が同じ
+    {
+        std::string crlf;
+        for (int i = 0; i < kRows; ++i) {
+            crlf += std::to_string(i) + ",2,3\r\n";
+        }
+        expected.clear();
+        GetLineOffsets(crlf.data(), crlf.size(), expected);
+        offsets.clear();
+        GetLineOffsets_CRLF_AVX2_OpenMP(crlf.data(), crlf.size(), offsets);
+        Check(offsets == expected, "newlines: CRLF_AVX2 offsets");
+        offsets.clear();
+        GetLineOffsets_CRLF_OpenMP(crlf.data(), crlf.size(), offsets);
+        Check(offsets == expected, "newlines: CRLF_OpenMP offsets");
+        offsets.clear();
+        GetLineOffsets_Mixed_AVX2_OpenMP(crlf.data(), crlf.size(), offsets);
+        Check(offsets == expected, "newlines: Mixed on CRLF offsets");
+    }
+
+    // 読み込み: 混在した改行のファイルをどの方式でも同じ行数・値で読む
+    const std::string path = "fastcsvtest_newlines.csv";
+    Check(WriteFile(path, mixed), "newlines: write " + path);
+    static const int kModes[] = { LOADMODE_TWOPASS, LOADMODE_FUSED, LOADMODE_STRUCTURAL };
+    for (int mode : kModes) {
+        const std::string name = "newlines: load mode " + std::to_string(mode);
+        CsvLoadOptions opt;
+        opt.quiet = true;
+        opt.loadMode = mode;
+        CsvLoadErrors errors;
+        opt.errors = &errors;
+        std::vector<PointCloud> out;
+        Check(FastCsvLoad(ToWide(path), out, 3, opt) == 0 && errors.count == 0, name + ": rc / errors " + std::to_string(errors.count));
+        bool same = out.size() == static_cast<size_t>(kRows);
+        for (size_t i = 0; same && i < out.size(); ++i) {
+            same = SameFloat(out[i].fields[0], static_cast<float>(i)) && SameFloat(out[i].fields[1], static_cast<float>(i % 11)) &&
+                SameFloat(out[i].fields[2], 1.5f);
+        }
+        Check(same, name + ": rows " + std::to_string(out.size()));
+    }
+    std::remove(path.c_str());
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 10) ストリーミング読み込みの窓
+// 小さい memoryBudget で窓を多数に分け、窓の末尾で途切れた行（CRLF の '\r' と '\n' の間で切れる場合を含む）と
+// 窓より長い行（窓を広げて読み直す）を読む。batchRows 行ずつ firstRow が続けて渡されること、
+// onBatch が非 0 を返すとその値で中断することも確かめる
+static std::string MakeStreamCsv(int rows, size_t longRow)
+{
+    std::string csv;
+    for (int i = 0; i < rows; ++i) {
+        csv += std::to_string(i) + "," + std::to_string(i % 97) + ".5," + std::to_string(-i);
+        if (i == rows / 3 || i == rows / 3 + 1) {
+            csv += "," + std::string(longRow, '7'); // 窓より長い行（読まない4列目）を2行続ける
+        }
+        csv += (i % 5 == 0) ? "\r\n" : "\n";
+    }
+    return csv;
+}
+
+static void TestStream()
+{
+    const std::string path = "fastcsvtest_stream.csv";
+    const int kRows = 200000;
+    Check(WriteFile(path, MakeStreamCsv(kRows, 600000)), "stream: write " + path);
+
+    static const int kModes[] = { LOADMODE_FUSED, LOADMODE_STRUCTURAL };
+    static const size_t kBatchRows[] = { 1, 1000, 65536 };
+    for (int mode : kModes) {
+        for (size_t batchRows : kBatchRows) {
+            const std::string name = "stream: mode " + std::to_string(mode) + ", batchRows " + std::to_string(batchRows);
+            CsvLoadOptions opt;
+            opt.quiet = true;
+            opt.loadMode = mode;
+            opt.memoryBudget = 1u << 20; // 窓は数十〜百数十 KB（長い行より短い）
+            opt.batchRows = batchRows;
+            std::vector<PointCloud> out;
+            bool ordered = true;
+            size_t shortBatches = 0;
+            const int rc = FastCsvLoadStream(ToWide(path), 3, [&](const PointCloud* rows, size_t count, size_t firstRow) {
+                ordered = ordered && firstRow == out.size() && count > 0 && count <= batchRows;
+                shortBatches += (count < batchRows) ? 1 : 0;
+                out.insert(out.end(), rows, rows + count);
+                return 0;
+            }, opt);
+            Check(rc == 0, name + ": rc " + std::to_string(rc));
+            Check(ordered && shortBatches <= 1, name + ": batches");
+            bool same = out.size() == static_cast<size_t>(kRows);
+            for (size_t i = 0; same && i < out.size(); ++i) {
+                same = SameFloat(out[i].fields[0], static_cast<float>(i)) && SameFloat(out[i].fields[1], static_cast<float>(i % 97) + 0.5f) &&
+                    SameFloat(out[i].fields[2], static_cast<float>(-static_cast<int>(i)));
+            }
+            Check(same, name + ": rows " + std::to_string(out.size()));
+        }
+    }
+
+    // 中断: 3回目の onBatch の戻り値を返し、それ以上呼ばない
+    CsvLoadOptions opt;
+    opt.quiet = true;
+    opt.memoryBudget = 1u << 20;
+    opt.batchRows = 1000;
+    int calls = 0;
+    const int rc = FastCsvLoadStream(ToWide(path), 3, [&](const PointCloud*, size_t, size_t) {
+        return (++calls == 3) ? 7 : 0;
+    }, opt);
+    Check(rc == 7 && calls == 3, "stream: abort rc " + std::to_string(rc) + ", calls " + std::to_string(calls));
+    std::remove(path.c_str());
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 11) 非同期読み込みのブロック境界
+// ヘッドルーム（ASYNC_READ_HEADROOM）より長い行がブロックをいくつもまたいでも、マップして読んだ結果と同じになる。
+// 長い行の後の不正な行は、マップして読んだ場合と同じ行番号・バイト位置で記録される
+static void TestAsyncBlocks()
+{
+    const std::string path = "fastcsvtest_async.csv";
+    const int kRows = 50000;
+    std::string csv = MakeStreamCsv(kRows, 3 * ASYNC_READ_HEADROOM);
+    csv += "1,x,3\n5,6,7"; // 不正な行と、改行のない最終行
+    Check(WriteFile(path, csv), "async: write " + path);
+
+    CsvLoadOptions mmapOpt;
+    mmapOpt.quiet = true;
+    mmapOpt.loadMode = LOADMODE_FUSED;
+    CsvLoadErrors expectedErrors;
+    mmapOpt.errors = &expectedErrors;
+    std::vector<PointCloud> expected;
+    Check(FastCsvLoad(ToWide(path), expected, 3, mmapOpt) == 0 && expected.size() == static_cast<size_t>(kRows) + 2,
+        "async: mmap load " + std::to_string(expected.size()));
+    Check(expectedErrors.records.size() == 1 && expectedErrors.records[0].row == static_cast<size_t>(kRows), "async: mmap error row");
+
+    static const size_t kBlockSizes[] = { 4096, 64 << 10, 1 << 20 };
+    static const int kModes[] = { LOADMODE_FUSED, LOADMODE_STRUCTURAL };
+    for (int mode : kModes) {
+        for (size_t blockSize : kBlockSizes) {
+            const std::string name = "async: mode " + std::to_string(mode) + ", block " + std::to_string(blockSize);
+            CsvLoadOptions opt = mmapOpt;
+            opt.loadMode = mode;
+            opt.ioBackend = IOBACKEND_ASYNC;
+            opt.async.blockSize = blockSize;
+            CsvLoadErrors errors;
+            opt.errors = &errors;
+            std::vector<PointCloud> out;
+            Check(FastCsvLoad(ToWide(path), out, 3, opt) == 0, name + ": rc");
+            bool same = out.size() == expected.size();
+            for (size_t i = 0; same && i < out.size(); ++i) {
+                same = SameFloat(out[i].fields[0], expected[i].fields[0]) && SameFloat(out[i].fields[1], expected[i].fields[1]) &&
+                    SameFloat(out[i].fields[2], expected[i].fields[2]);
+            }
+            Check(same, name + ": rows " + std::to_string(out.size()));
+            Check(errors.count == 1 && errors.records.size() == 1 && errors.records[0].row == expectedErrors.records[0].row &&
+                errors.records[0].byteOffset == expectedErrors.records[0].byteOffset, name + ": error record");
+        }
+    }
+    std::remove(path.c_str());
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 12) 行インデックス（<csv>.fci）
+// FastCsvLoadRows / FastCsvLoadSampled はインデックスがなければ作り、行頭は走査の結果と同じ。
+// 範囲の切り詰め・空の範囲、2 バイト・4 バイトの差分、FastCsvLoad（writeIndex）が書いたインデックスも確かめる。
+// CSV を同じサイズのまま書き換えると古いインデックスは使われない
+static std::string MakeIndexCsv(int rows, size_t pad)
+{
+    std::string csv;
+    for (int i = 0; i < rows; ++i) {
+        csv += std::to_string(i) + "," + std::to_string(i % 13) + "," + std::to_string(i * 2);
+        if (pad) {
+            csv += "," + std::string(pad + i % 3, '9'); // 読まない4列目で行を長くする
+        }
+        csv += (i % 7 == 3) ? "\r\n" : "\n";
+    }
+    return csv;
+}
+
+static bool IndexRowIs(const PointCloud& p, size_t i)
+{
+    return SameFloat(p.x, static_cast<float>(i)) && SameFloat(p.y, static_cast<float>(i % 13)) && SameFloat(p.z, static_cast<float>(i * 2));
+}
+
+// インデックスの行頭が走査の結果と同じか
+static bool IndexMatchesScan(const std::string& path, const std::string& csv, uint32_t deltaWidth)
+{
+    std::vector<size_t> offsets;
+    GetLineOffsets_Mixed_AVX2_OpenMP(csv.data(), csv.size(), offsets);
+    CsvIndex index;
+    if (OpenCsvIndex(ToWide(path), index) != 0) {
+        return false;
+    }
+    bool same = index.rows == offsets.size() && index.deltaWidth == deltaWidth && index.Offset(index.rows) == csv.size();
+    for (size_t r = 0; same && r < offsets.size(); ++r) {
+        same = (index.Offset(r) == offsets[r]);
+    }
+    CloseCsvIndex(index);
+    return same;
+}
+
+static void TestIndex()
+{
+    const std::string path = "fastcsvtest_index.csv";
+    const std::string indexPath = path + ".fci";
+    CsvLoadOptions opt;
+    opt.quiet = true;
+
+    // 短い行（2 バイトの差分）: インデックスを作り、範囲・間引きで読む
+    const int kRows = 10000;
+    const std::string csv = MakeIndexCsv(kRows, 0);
+    Check(WriteFile(path, csv), "index: write " + path);
+    std::remove(indexPath.c_str());
+    std::vector<PointCloud> out;
+    Check(FastCsvLoadRows(ToWide(path), 1000, 1500, out, 3, opt) == 0, "index: rows rc");
+    bool same = out.size() == 500;
+    for (size_t i = 0; same && i < out.size(); ++i) {
+        same = IndexRowIs(out[i], 1000 + i);
+    }
+    Check(same, "index: rows [1000, 1500) " + std::to_string(out.size()));
+    Check(IndexMatchesScan(path, csv, 2), "index: built index offsets");
+
+    Check(FastCsvLoadRows(ToWide(path), kRows - 10, kRows + 100, out, 3, opt) == 0 && out.size() == 10 && IndexRowIs(out[9], kRows - 1),
+        "index: rows past the end");
+    Check(FastCsvLoadRows(ToWide(path), 5000, 5000, out, 3, opt) == 0 && out.empty(), "index: empty range");
+
+    const size_t stride = 97;
+    Check(FastCsvLoadSampled(ToWide(path), stride, out, 3, opt) == 0, "index: sampled rc");
+    same = out.size() == (kRows + stride - 1) / stride;
+    for (size_t k = 0; same && k < out.size(); ++k) {
+        same = IndexRowIs(out[k], k * stride);
+    }
+    Check(same, "index: sampled rows " + std::to_string(out.size()));
+
+    // 同じサイズで先頭の行の区切りを変える: 古いインデックスでは行 0・1 がずれる
+    std::string changed = csv;
+    const std::string head = "0,0,0\n1,1,2\n";
+    Check(changed.compare(0, head.size(), head) == 0, "index: head rows");
+    changed.replace(0, head.size(), "0,0\n0,1,1,2\n");
+    Check(changed.size() == csv.size(), "index: changed size " + std::to_string(changed.size()));
+    Check(WriteFile(path, changed), "index: rewrite " + path);
+    Check(FastCsvLoadRows(ToWide(path), 1, 3, out, 3, opt) == 0 && out.size() == 2 &&
+        SameFloat(out[0].x, 0.0f) && SameFloat(out[0].y, 1.0f) && SameFloat(out[0].z, 1.0f) && IndexRowIs(out[1], 2), "index: rows after rewrite");
+    Check(IndexMatchesScan(path, changed, 2), "index: rebuilt index offsets");
+
+    // 長い行（1区間が 64KB 以上なので 4 バイトの差分）
+    const std::string longCsv = MakeIndexCsv(300, 2000);
+    Check(WriteFile(path, longCsv), "index: write long rows");
+    Check(FastCsvLoadRows(ToWide(path), 100, 200, out, 3, opt) == 0 && out.size() == 100 && IndexRowIs(out[0], 100) &&
+        IndexRowIs(out[99], 199), "index: long rows");
+    Check(IndexMatchesScan(path, longCsv, 4), "index: long row offsets");
+
+    // FastCsvLoad（2パス方式）が書いたインデックス
+    std::remove(indexPath.c_str());
+    Check(WriteFile(path, csv), "index: write " + path);
+    CsvLoadOptions writeOpt = opt;
+    writeOpt.writeIndex = true;
+    Check(FastCsvLoad(ToWide(path), out, 3, writeOpt) == 0 && out.size() == static_cast<size_t>(kRows), "index: writeIndex load");
+    Check(IndexMatchesScan(path, csv, 2), "index: writeIndex offsets");
+
+    std::remove(path.c_str());
+    std::remove(indexPath.c_str());
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 13) 行頭オフセットの圧縮形式（LineOffsetArray）
+// ScanLineOffsets が複数のタスク・ブロックにまたがる入力で GetLineOffsets_Mixed_AVX2_OpenMP と同じ行頭を返し、
+// size_t の配列の約半分の大きさであること。空の入力・改行のない1行も確かめる
+// （ブロック内の差が 32 ビットを超える wide の場合は 8) の合成値で確かめる）
+static void CheckScanLineOffsets(const std::string& name, const std::string& text)
+{
+    std::vector<size_t> expected;
+    GetLineOffsets_Mixed_AVX2_OpenMP(text.data(), text.size(), expected);
+    LineOffsetArray a;
+    const size_t rows = ScanLineOffsets(text.data(), text.size(), a);
+    bool same = rows == expected.size() && a.size == expected.size() && !a.wide;
+    for (size_t r = 0; same && r < expected.size(); ++r) {
+        same = (a[r] == expected[r]);
+    }
+    Check(same, name + ": rows " + std::to_string(rows) + " / " + std::to_string(expected.size()));
+}
+
+static void TestLineOffsetArray()
+{
+    std::mt19937_64 rng(16);
+    std::string text;
+    size_t rows = 0;
+    while (text.size() < 6 * TASK_TARGET_BYTES) {
+        // 行の長さを 1〜200 バイトで変え、ときどき空行・CRLF を入れる
+        text += std::string(1 + rng() % 200, 'a' + static_cast<char>(rows % 26));
+        text += (rng() % 4 == 0) ? "\r\n" : (rng() % 16 == 0) ? "\n\n" : "\n";
+        ++rows;
+    }
+    CheckScanLineOffsets("line offsets: multi-task", text);
+    CheckScanLineOffsets("line offsets: no final newline", text.substr(0, text.size() - 1) + "tail");
+    CheckScanLineOffsets("line offsets: one row", "1,2,3");
+    CheckScanLineOffsets("line offsets: empty", "");
+
+    LineOffsetArray a;
+    ScanLineOffsets(text.data(), text.size(), a);
+    Check(a.size >= LINEOFFSET_BLOCK_ROWS * 4 && a.Bytes() < a.size * sizeof(size_t) * 3 / 5,
+        "line offsets: bytes " + std::to_string(a.Bytes()) + " for " + std::to_string(a.size) + " rows");
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 14) 固定長の行（fixedWidth）
+// 全行が同じ長さなら行頭を計算で求め（stats.fixedRowLength が行の長さ）、判定の標本にない2行だけ長さが違うと
+// パース中に見つけて通常の方式で読み直す（fixedRowLength は 0）。どちらも値は同じ
+static std::string FixedRowText(int i, bool shortX, bool longZ)
+{
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), shortX ? "%04d,%03d,%04d" : longZ ? "%05d,%03d,%05d" : "%05d,%03d,%04d", i, i % 1000, i % 10000);
+    return buf;
+}
+
+static void TestFixedWidth()
+{
+    const std::string path = "fastcsvtest_fixed.csv";
+    const int kRows = 100000;
+
+    // 判定の標本（DetectFixedRows と同じ選び方）にない行
+    std::vector<bool> sampled(kRows, false);
+    for (size_t k = 0; k < FIXEDROW_SAMPLES; ++k) {
+        sampled[(kRows - 1) * k / (FIXEDROW_SAMPLES - 1)] = true;
+    }
+    int shifted = 5000;
+    while (sampled[shifted] || sampled[shifted + 1]) {
+        ++shifted;
+    }
+
+    for (int variant = 0; variant < 4; ++variant) {
+        const bool crlf = (variant & 1) != 0;
+        const bool fallback = (variant & 2) != 0;
+        std::string csv;
+        for (int i = 0; i < kRows; ++i) {
+            // fallback: 行 shifted を1バイト短く、次の行を1バイト長くする（ファイルの大きさは同じ）
+            csv += FixedRowText(i, fallback && i == shifted, fallback && i == shifted + 1);
+            if (i + 1 < kRows) {
+                csv += crlf ? "\r\n" : "\n"; // 最後の行は改行なし
+            }
+        }
+        Check(WriteFile(path, csv), "fixed: write " + path);
+
+        static const int kModes[] = { LOADMODE_TWOPASS, LOADMODE_FUSED };
+        for (int mode : kModes) {
+            const std::string name = std::string("fixed: ") + (crlf ? "CRLF" : "LF") + (fallback ? " fallback" : "") + ", mode " + std::to_string(mode);
+            CsvLoadOptions opt;
+            opt.quiet = true;
+            opt.loadMode = mode;
+            opt.fixedWidth = true;
+            opt.writeIndex = true;
+            CsvLoadStats stats;
+            opt.stats = &stats;
+            std::remove((path + ".fci").c_str());
+            std::vector<PointCloud> out;
+            Check(FastCsvLoad(ToWide(path), out, 3, opt) == 0, name + ": rc");
+            const size_t rowLength = fallback ? 0 : crlf ? 16 : 15;
+            Check(stats.fixedRowLength == rowLength, name + ": fixedRowLength " + std::to_string(stats.fixedRowLength));
+            bool same = out.size() == static_cast<size_t>(kRows);
+            for (size_t i = 0; same && i < out.size(); ++i) {
+                same = SameFloat(out[i].x, static_cast<float>(i)) && SameFloat(out[i].y, static_cast<float>(i % 1000)) &&
+                    SameFloat(out[i].z, static_cast<float>(i % 10000));
+            }
+            Check(same, name + ": rows " + std::to_string(out.size()));
+            if (mode == LOADMODE_TWOPASS) {
+                Check(IndexMatchesScan(path, csv, 2), name + ": index offsets"); // 固定長の行からも同じインデックスを書く
+            }
+        }
+    }
+    std::remove(path.c_str());
+    std::remove((path + ".fci").c_str());
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 15) 複数ファイルの一括読み込み
+// 小さいファイル（1タスク）と大きいファイル（チャンクに分ける）、改行のない最終行・1行だけのファイルをまぜ、
+// ファイルごとの結果・つなげた結果と fileRows が1ファイルずつ FastCsvLoad で読んだ結果と同じになる。
+// 不正な行はファイル番号とファイル内の行番号・バイト位置で記録され、SKIP ではそのファイルの行だけが減る
+struct BatchFile {
+    int  rows;
+    int  badRow;       // 不正な行の位置（-1 ならなし）
+    bool finalNewline;
+};
+
+static const BatchFile kBatchFiles[] = {
+    { 1000,   -1,     true  },
+    { 250000, 200000, true  }, // 約 4MB（複数のチャンク）　不正な行は後ろのチャンク
+    { 1,      -1,     false },
+    { 3000,   7,      false },
+    { 120000, -1,     true  },
+};
+static const int kBatchFileCount = static_cast<int>(sizeof(kBatchFiles) / sizeof(kBatchFiles[0]));
+
+static std::string MakeBatchCsv(int file, const BatchFile& b, size_t& badOffset)
+{
+    std::string csv;
+    for (int i = 0; i < b.rows; ++i) {
+        if (i == b.badRow) {
+            badOffset = csv.size();
+            csv += "1,bad,3";
+        }
+        else {
+            csv += std::to_string(file) + "," + std::to_string(i) + "," + std::to_string(i % 100) + ".25";
+        }
+        if (i + 1 < b.rows || b.finalNewline) {
+            csv += (i % 3 == 0) ? "\r\n" : "\n";
+        }
+    }
+    return csv;
+}
+
+static bool SameRows(const PointCloud* a, const PointCloud* b, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            if (!SameFloat(a[i].fields[c], b[i].fields[c])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void TestBatch()
+{
+    std::vector<std::wstring> files;
+    std::vector<std::string> paths;
+    std::vector<size_t> badOffsets(kBatchFileCount, 0);
+    std::vector<std::vector<PointCloud>> expected(kBatchFileCount);
+    for (int f = 0; f < kBatchFileCount; ++f) {
+        paths.push_back("fastcsvtest_batch" + std::to_string(f) + ".csv");
+        files.push_back(ToWide(paths[f]));
+        Check(WriteFile(paths[f], MakeBatchCsv(f, kBatchFiles[f], badOffsets[f])), "batch: write " + paths[f]);
+        CsvLoadOptions opt;
+        opt.quiet = true;
+        Check(FastCsvLoad(files[f], expected[f], 3, opt) == 0 && expected[f].size() == static_cast<size_t>(kBatchFiles[f].rows),
+            "batch: reference " + paths[f]);
+    }
+
+    static const int kModes[] = { LOADMODE_FUSED, LOADMODE_STRUCTURAL };
+    for (int mode : kModes) {
+        const std::string name = "batch: mode " + std::to_string(mode);
+        CsvLoadOptions opt;
+        opt.quiet = true;
+        opt.loadMode = mode;
+        opt.batchThreads = 3;
+        CsvLoadErrors errors;
+        opt.errors = &errors;
+
+        std::vector<std::vector<PointCloud>> results;
+        Check(FastCsvLoadBatch(files, results, 3, opt) == 0 && results.size() == expected.size(), name + ": per-file rc");
+        for (size_t f = 0; f < results.size(); ++f) {
+            Check(results[f].size() == expected[f].size() && SameRows(results[f].data(), expected[f].data(), expected[f].size()),
+                name + ": file " + std::to_string(f) + " rows " + std::to_string(results[f].size()));
+        }
+
+        // 不正な行の記録: ファイル番号の順に、ファイル内の行番号・バイト位置
+        bool recorded = errors.count == 2 && errors.records.size() == 2;
+        int k = 0;
+        for (int f = 0; recorded && f < kBatchFileCount; ++f) {
+            if (kBatchFiles[f].badRow >= 0) {
+                const CsvRowError& e = errors.records[k++];
+                recorded = e.file == static_cast<size_t>(f) && e.row == static_cast<size_t>(kBatchFiles[f].badRow) &&
+                    e.byteOffset == badOffsets[f] && e.column == 1;
+            }
+        }
+        Check(recorded, name + ": error records " + std::to_string(errors.records.size()));
+
+        std::vector<PointCloud> joined;
+        std::vector<size_t> fileRows;
+        Check(FastCsvLoadBatch(files, joined, fileRows, 3, opt) == 0 && fileRows.size() == files.size() + 1 && fileRows[0] == 0,
+            name + ": joined rc");
+        for (size_t f = 0; f + 1 < fileRows.size(); ++f) {
+            Check(fileRows[f + 1] - fileRows[f] == expected[f].size() && fileRows[f + 1] <= joined.size() &&
+                SameRows(joined.data() + fileRows[f], expected[f].data(), expected[f].size()), name + ": joined file " + std::to_string(f));
+        }
+
+        // SKIP: 不正な行のあるファイルだけ1行減る
+        CsvLoadOptions skipOpt = opt;
+        skipOpt.errorPolicy = ERRORPOLICY_SKIP;
+        Check(FastCsvLoadBatch(files, joined, fileRows, 3, skipOpt) == 0 && fileRows.size() == files.size() + 1, name + ": SKIP rc");
+        bool skipped = true;
+        for (int f = 0; skipped && f < kBatchFileCount; ++f) {
+            skipped = fileRows[f + 1] - fileRows[f] == static_cast<size_t>(kBatchFiles[f].rows - (kBatchFiles[f].badRow >= 0 ? 1 : 0));
+        }
+        Check(skipped, name + ": SKIP rows per file");
+
+        CsvLoadOptions strictOpt = opt;
+        strictOpt.errorPolicy = ERRORPOLICY_STRICT;
+        Check(FastCsvLoadBatch(files, results, 3, strictOpt) != 0 && results.empty() && errors.records.size() == 1 &&
+            errors.records[0].file == 1, name + ": STRICT");
+    }
+
+    // 存在しないファイルが1つでもあれば失敗する
+    std::vector<std::wstring> missing = files;
+    missing.push_back(ToWide("fastcsvtest_batch_missing.csv"));
+    std::vector<std::vector<PointCloud>> results;
+    CsvLoadOptions opt;
+    opt.quiet = true;
+    Check(FastCsvLoadBatch(missing, results, 3, opt) != 0 && results.empty(), "batch: missing file");
+
+    for (const std::string& path : paths) {
+        std::remove(path.c_str());
+    }
+}
+
+int main()
+{
+    TestDecimal();
+    TestQuotedChunks();
+    TestErrorPolicies();
+    TestCache();
+    TestDialects();
+    TestRowFilter();
+    TestCompressed();
+    TestLargeCounts();
+    TestNewlines();
+    TestStream();
+    TestAsyncBlocks();
+    TestIndex();
+    TestLineOffsetArray();
+    TestFixedWidth();
+    TestBatch();
+    if (g_failures > 0) {
+        std::cerr << g_failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all checks passed" << std::endl;
+    return 0;
+}
@@ -1,13 +1,14 @@
 ﻿
-#define NOMINMAX // この定義をWindows.hをインクルードする前に追加しないとエラーになる
-#include <windows.h>
 #include <vector>
 #include <string>
 #include <iostream>
 #include <omp.h>
-#include <intrin.h>    // MSVCのビルトイン関数
-#include <immintrin.h> // AVX2 ヘッダ
+#include <immintrin.h> // SSE2 / AVX2 ヘッダ
 #include <chrono> // 処理時間計測用 時間計測しない場合は不要
+#include <algorithm>
+#include <cstring>
+#include <atomic>
+#include <limits>
 
 // fast_float ライブラリを使用
 // 下記から入手
@@ -15,6 +16,13 @@
 #include "../fast_float/fast_float.h"  // fast_floatヘッダファイルのインクルード
 
 #include "FastCsvLoad.h"
+#include "CsvScan.h"
+#include "StructuralIndex.h"
+#include "CsvCache.h"
+#include "CsvIndex.h"
+#include "CsvCompressed.h"
+#include "TaskScheduler.h"
+#include "FixedDecimal.h"
 
 //////////////////////////////////////////////////////////////////////////////////////////////
 //CSVファイル全体の「行の先頭位置（オフセット）」を取得
@@ -45,23 +53,148 @@ size_t GetLineOffsets(const char* fileContent, size_t contentSize, std::vector<s
     return lineOffsets.size();
 }
 
+//////////////////////////////////////////////////////////////////////////////////
+// 行数の見積もり・改行コードの判別に使う標本の区間（offset, bytes）
+// ファイル全体から先頭と末尾を含む等間隔に LINEESTIMATE_SAMPLES か所（小さいファイルは全体）
+static std::vector<std::pair<size_t, size_t>> SampleRanges(size_t size)
+{
+    std::vector<std::pair<size_t, size_t>> samples;
+    if (size <= static_cast<size_t>(LINEESTIMATE_SAMPLES) * LINEESTIMATE_SAMPLE_BYTES) {
+        samples.emplace_back(0, size);
+    }
+    else {
+        const size_t step = (size - LINEESTIMATE_SAMPLE_BYTES) / (LINEESTIMATE_SAMPLES - 1);
+        for (size_t k = 0; k < LINEESTIMATE_SAMPLES; ++k) {
+            samples.emplace_back(step * k, LINEESTIMATE_SAMPLE_BYTES);
+        }
+    }
+    return samples;
+}
+
+// [pos, end) にある文字 c の数
+FASTCSV_TARGET("avx2")
+static uint64_t CountChar_AVX2(const char* pos, const char* end, char c)
+{
+    const __m256i vC = _mm256_set1_epi8(c);
+    uint64_t n = 0;
+    while (pos + 32 <= end) {
+        __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pos));
+        n += PopCount32(static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(data, vC))));
+        pos += 32;
+    }
+    for (; pos < end; ++pos) {
+        n += (*pos == c);
+    }
+    return n;
+}
+
+static uint64_t CountChar_SSE2(const char* pos, const char* end, char c)
+{
+    const __m128i vC = _mm_set1_epi8(c);
+    uint64_t n = 0;
+    while (pos + 16 <= end) {
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+        n += PopCount32(static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(data, vC))));
+        pos += 16;
+    }
+    for (; pos < end; ++pos) {
+        n += (*pos == c);
+    }
+    return n;
+}
+
+static uint64_t CountChar(const char* pos, const char* end, char c)
+{
+    return UseAvx2() ? CountChar_AVX2(pos, end, c) : CountChar_SSE2(pos, end, c);
+}
+
+// NewlineKinds の戻り値（ビットの OR）
+#define NEWLINEKIND_LF   1 // '\r' の後でない '\n'
+#define NEWLINEKIND_CRLF 2
+#define NEWLINEKIND_CR   4 // '\n' が続かない '\r'
+
+// data[i] の改行の種類（改行でなければ 0）
+static inline int NewlineKindAt(const char* data, size_t size, size_t i)
+{
+    if (data[i] == '\n') {
+        return (i > 0 && data[i - 1] == '\r') ? NEWLINEKIND_CRLF : NEWLINEKIND_LF;
+    }
+    if (data[i] == '\r' && !(i + 1 < size && data[i + 1] == '\n')) {
+        return NEWLINEKIND_CR;
+    }
+    return 0;
+}
+
+// [begin, end) にある改行の種類を調べる（前後の1バイトはファイル内なら見る）
+// 32バイトごとに1バイト前・後ろからの読み込みと比べ、'\n' の直前の '\r'・'\r' の直後の '\n' を求める
+FASTCSV_TARGET("avx2")
+static int NewlineKinds_AVX2(const char* data, size_t size, size_t begin, size_t end)
+{
+    const __m256i vLF = _mm256_set1_epi8('\n');
+    const __m256i vCR = _mm256_set1_epi8('\r');
+    __m256i loneLF = _mm256_setzero_si256();
+    __m256i crlf = _mm256_setzero_si256();
+    __m256i loneCR = _mm256_setzero_si256();
+    size_t pos = begin;
+    int kinds = 0;
+    if (pos == 0 && pos < end) {
+        kinds |= NewlineKindAt(data, size, pos++);
+    }
+    // data[pos - 1] から data[pos + 32] まで読めるところをベクトルで調べる
+    for (; pos + 32 <= end && pos + 33 <= size; pos += 32) {
+        const __m256i cur = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        const __m256i prevCR = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos - 1)), vCR);
+        const __m256i nextLF = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos + 1)), vLF);
+        const __m256i isLF = _mm256_cmpeq_epi8(cur, vLF);
+        const __m256i isCR = _mm256_cmpeq_epi8(cur, vCR);
+        loneLF = _mm256_or_si256(loneLF, _mm256_andnot_si256(prevCR, isLF));
+        crlf = _mm256_or_si256(crlf, _mm256_and_si256(prevCR, isLF));
+        loneCR = _mm256_or_si256(loneCR, _mm256_andnot_si256(nextLF, isCR));
+    }
+    for (; pos < end; ++pos) {
+        kinds |= NewlineKindAt(data, size, pos);
+    }
+    kinds |= (_mm256_movemask_epi8(loneLF) != 0) ? NEWLINEKIND_LF : 0;
+    kinds |= (_mm256_movemask_epi8(crlf) != 0) ? NEWLINEKIND_CRLF : 0;
+    kinds |= (_mm256_movemask_epi8(loneCR) != 0) ? NEWLINEKIND_CR : 0;
+    return kinds;
+}
+
+// AVX2 のない CPU は逐次走査（標本の判別だけなので十分速い）
+static int NewlineKinds(const char* data, size_t size, size_t begin, size_t end)
+{
+    if (UseAvx2()) {
+        return NewlineKinds_AVX2(data, size, begin, end);
+    }
+    int kinds = 0;
+    for (size_t pos = begin; pos < end && kinds != (NEWLINEKIND_LF | NEWLINEKIND_CRLF | NEWLINEKIND_CR); ++pos) {
+        kinds |= NewlineKindAt(data, size, pos);
+    }
+    return kinds;
+}
+
 /////////////////////////////////////////////////////////////////////////
-#define NEWLINETYPE_CRLF    2
-#define NEWLINETYPE_LF      1
-#define NEWLINETYPE_UNKNOWN 0
-/////////////////////////////////////////////////////////////////////////
-//改行コードの種類を最初の1行で判別
+//改行コードの種類を標本で判別（CsvScan.h）
 int DetectNewlineType(const char* fileContent, size_t contentSize) {
-    for (size_t i = 0; i < contentSize; ++i) {
-        if (fileContent[i] == '\n') {
-            // 直前の文字が '\r' であれば CRLF と判断
-            if (i > 0 && fileContent[i - 1] == '\r') {
-                return NEWLINETYPE_CRLF;   //
-            }
-            else {
-                return NEWLINETYPE_LF;   //LF
-            }
-        }
+    int kinds = 0;
+    for (const auto& s : SampleRanges(contentSize)) {
+        kinds |= NewlineKinds(fileContent, contentSize, s.first, s.first + s.second);
+    }
+    if (kinds == 0) {
+        // 標本より長い行　ファイル全体を調べる
+        kinds = NewlineKinds(fileContent, contentSize, 0, contentSize);
+    }
+    if (kinds & NEWLINEKIND_CR) {
+        return NEWLINETYPE_CR;
+    }
+    if ((kinds & NEWLINEKIND_LF) && (kinds & NEWLINEKIND_CRLF)) {
+        return NEWLINETYPE_MIXED;
+    }
+    if (kinds & NEWLINEKIND_CRLF) {
+        return NEWLINETYPE_CRLF;   //CRLF
+    }
+    if (kinds & NEWLINEKIND_LF) {
+        return NEWLINETYPE_LF;   //LF
     }
     return NEWLINETYPE_UNKNOWN;
 }
@@ -70,10 +203,10 @@ int DetectNewlineType(const char* fileContent, size_t contentSize) {
 //メモリマップのCSVデータを行ごとに分解
 size_t GetLineOffsets_OpenMP(const char* fileContent, size_t contentSize, std::vector<size_t>& lineOffsets)
 {
-    //改行コードの種類を最初の1行で判別
+    //改行コードの種類を判別
     int _nltype = DetectNewlineType(fileContent, contentSize);
 
-    //改行コードの種類で処理を分ける 改行コードが混在しないと仮定
+    //改行コードの種類で処理を分ける 混在・CR のみ・改行なしは汎用版
     if (_nltype == NEWLINETYPE_CRLF)
     {
         GetLineOffsets_CRLF_OpenMP(fileContent, contentSize, lineOffsets);
@@ -90,26 +223,160 @@ size_t GetLineOffsets_OpenMP(const char* fileContent, size_t contentSize, std::v
 }
 
 /////////////////////////////////////////////////////////////////////////
-//メモリマップのCSVデータを行ごとに分解　AVX2を使用 ほーんの少し速くなる
+//メモリマップのCSVデータを行ごとに分解　AVX2を使用 ほーんの少し速くなる（AVX2 のない CPU は SSE2）
+// 走査の結果はタスクごとのアリーナ（TaskArena）に、タスク先頭からの 32ビットの相対位置として書く
+// 結合先（size_t の配列・圧縮形式の LineOffsetArray）は呼び出し側が選ぶ
+static size_t ScanLineOffsets_Mixed(const char* fileContent, size_t contentSize, TaskArena& arena, CsvLoadStats* stats);
+
+// アリーナに行頭を集める
+// 改行コードは標本では判別せず、常に混在用の走査で読む（ファイルのどこに CR があっても行を正しく区切る）
+// 混在用の走査は LF 用の走査より遅くない（改行文字のビットマスクから行頭を直接求める）
+static void ScanLineOffsetsToArena(const char* fileContent, size_t contentSize, TaskArena& arena, CsvLoadStats* stats)
+{
+    ScanLineOffsets_Mixed(fileContent, contentSize, arena, stats);
+}
+
+// アリーナの行頭を lineOffsets の末尾に追加する（size_t のアリーナ用）
+static size_t AppendLineOffsets(const TaskArena& arena, std::vector<size_t>& lineOffsets, CsvLoadStats* stats)
+{
+    StatsPhase mergePhase(stats ? &stats->mergeSeconds : nullptr);
+    const size_t first = lineOffsets.size();
+    lineOffsets.resize(first + arena.Offsets().back());
+    arena.CopyAll(reinterpret_cast<unsigned char*>(lineOffsets.data() + first));
+    return lineOffsets.size();
+}
+
+// AVX2 版の走査結果（タスク先頭 TaskBegin からの 32ビットの相対位置）を lineOffsets の末尾に追加する
+static size_t AppendRelativeOffsets(const TaskArena& arena, size_t contentSize, std::vector<size_t>& lineOffsets)
+{
+    const std::vector<size_t> base = arena.Offsets();
+    const size_t numTasks = arena.NumTasks();
+    const size_t first = lineOffsets.size();
+    lineOffsets.resize(first + base.back());
+    size_t* dest = lineOffsets.data() + first;
+#pragma omp parallel for schedule(dynamic, 1)
+    for (long long t = 0; t < static_cast<long long>(numTasks); ++t) {
+        const size_t taskBase = TaskBegin(contentSize, numTasks, t);
+        size_t* out = dest + base[t];
+        arena.Visit<uint32_t>(t, [&](size_t j, uint32_t rel) { out[j] = taskBase + rel; });
+    }
+    return lineOffsets.size();
+}
+
+void AssignLineOffsets(LineOffsetArray& lineOffsets, const size_t* offsets, size_t rows)
+{
+    InitLineOffsetArray(lineOffsets, rows, [&](size_t row) { return offsets[row]; });
+#pragma omp parallel for schedule(static)
+    for (long long i = 0; i < static_cast<long long>(rows); ++i) {
+        lineOffsets.Set(i, offsets[i]);
+    }
+}
+
+size_t ScanLineOffsets(const char* fileContent, size_t contentSize, LineOffsetArray& lineOffsets, CsvLoadStats* stats)
+{
+    TaskArena arena;
+    ScanLineOffsetsToArena(fileContent, contentSize, arena, stats);
+
+    // 累積和で決まる合計行数ぶんを1回だけ確保し、タスクごとに並列に圧縮形式で書き込む
+    // ブロックの基準位置はブロック先頭の行（行番号からタスクを二分探索して求める）
+    StatsPhase mergePhase(stats ? &stats->mergeSeconds : nullptr);
+    const std::vector<size_t> base = arena.Offsets();
+    const size_t numTasks = arena.NumTasks();
+    auto offsetOf = [&](size_t row) {
+        const size_t t = static_cast<size_t>(std::upper_bound(base.begin(), base.end(), row) - base.begin()) - 1;
+        return TaskBegin(contentSize, numTasks, t) + arena.At<uint32_t>(t, row - base[t]);
+    };
+    InitLineOffsetArray(lineOffsets, base.back(), offsetOf);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (long long t = 0; t < static_cast<long long>(numTasks); ++t) {
+        const size_t taskBase = TaskBegin(contentSize, numTasks, t);
+        const size_t first = base[t];
+        arena.Visit<uint32_t>(t, [&](size_t j, uint32_t rel) { lineOffsets.Set(first + j, taskBase + rel); });
+    }
+    return lineOffsets.size;
+}
+
 size_t GetLineOffsets_AVX2_OpenMP(const char* fileContent, size_t contentSize, std::vector<size_t>& lineOffsets)
 {
-    //改行コードの種類を最初の1行で判別
-    int _nltype = DetectNewlineType(fileContent, contentSize);
+    TaskArena arena;
+    ScanLineOffsetsToArena(fileContent, contentSize, arena, nullptr);
+    return AppendRelativeOffsets(arena, contentSize, lineOffsets);
+}
 
-    //改行コードの種類で処理を分ける 改行コードが混在しないと仮定
-    if (_nltype == NEWLINETYPE_CRLF)
-    {
-        GetLineOffsets_CRLF_AVX2_OpenMP(fileContent, contentSize, lineOffsets);
+//////////////////////////////////////////////////////////////////////////////////
+// 行数の見積もり（CsvScan.h）
+RowDensity SampleRowDensity(const char* data, size_t size)
+{
+    const std::vector<std::pair<size_t, size_t>> samples = SampleRanges(size);
+    RowDensity d;
+    for (const auto& s : samples) {
+        d.newlines += CountChar(data + s.first, data + s.first + s.second, '\n');
+        d.bytes += s.second;
     }
-    else if (_nltype == NEWLINETYPE_LF)
-    {
-        GetLineOffsets_LF_AVX2_OpenMP(fileContent, contentSize, lineOffsets);
+    if (d.newlines == 0) {
+        // CR だけの改行
+        for (const auto& s : samples) {
+            d.newlines += CountChar(data + s.first, data + s.first + s.second, '\r');
+        }
     }
-    else
-    {
-        GetLineOffsets_LFCRLF_OpenMP(fileContent, contentSize, lineOffsets);
+    return d;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// 固定長の行の判定（CsvScan.h）
+bool DetectFixedRows(const char* fileContent, size_t contentSize, FixedRowLayout& layout)
+{
+    layout = FixedRowLayout();
+    const char* end = fileContent + contentSize;
+    const char* nl = FindChar(fileContent, end, '\n');
+    if (nl == end) {
+        return false;
     }
-    return lineOffsets.size();
+    FixedRowLayout l;
+    l.rowLength = static_cast<size_t>(nl - fileContent) + 1;
+    l.newlineLength = (nl > fileContent && nl[-1] == '\r') ? 2 : 1;
+    if (l.rowLength <= l.newlineLength) {
+        return false; // 先頭が空行
+    }
+
+    // ファイルサイズが行の長さで割り切れる（最後の行は改行がなくてもよい）
+    const size_t rest = contentSize % l.rowLength;
+    if (rest == 0) {
+        l.rows = contentSize / l.rowLength;
+    }
+    else if (rest == l.rowLength - l.newlineLength && end[-1] != '\n' && end[-1] != '\r') {
+        l.rows = contentSize / l.rowLength + 1;
+    }
+    else {
+        return false;
+    }
+
+    // 全体から均等に選んだ行の行末が改行で、行の途中に改行がないこと
+    const size_t samples = std::min<size_t>(l.rows, FIXEDROW_SAMPLES);
+    for (size_t k = 0; k < samples; ++k) {
+        const size_t r = (samples > 1) ? (l.rows - 1) * k / (samples - 1) : 0;
+        if (!CheckFixedRow(fileContent, contentSize, l, r)) {
+            return false;
+        }
+        const char* rowBegin = fileContent + r * l.rowLength;
+        const char* rowEnd = fileContent + FixedRowEnd(contentSize, l, r);
+        if (FindChar(rowBegin, rowEnd, '\n') != rowEnd) {
+            return false;
+        }
+    }
+    layout = l;
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// 標本の行の密度からタスクあたりの行数を見積もる（アリーナの大きさ）
+// 見積もりを超えたタスクは追加領域に書くので、結果は見積もりに依存しない
+static size_t ArenaRowsPerTask(const char* fileContent, size_t contentSize, size_t numTasks)
+{
+    const size_t rows = SampleRowDensity(fileContent, contentSize).Rows(contentSize);
+    // 空行は数えないので1行は2バイト以上（1タスクのバイト数の半分を超えることはない）
+    const size_t taskBytes = contentSize / std::max<size_t>(numTasks, 1) + 1;
+    return std::min(TaskRowsEstimate(rows, numTasks), taskBytes / 2 + 16);
 }
 
 
@@ -117,7 +384,8 @@ size_t GetLineOffsets_AVX2_OpenMP(const char* fileContent, size_t contentSize, s
 //メモリマップのCSVデータを行ごとに分解　改行コードが混在している場合 汎用だが遅い
 size_t GetLineOffsets_LFCRLF_OpenMP(const char* fileContent, size_t contentSize, std::vector<size_t>& lineOffsets) {
     const int numThreads = omp_get_max_threads(); // 使用可能な最大スレッド数
-    std::vector<std::vector<size_t>> localOffsets(numThreads); // スレッドごとの結果を格納
+    TaskArena arena; // スレッドごとの結果を格納（1回の確保）
+    arena.Init(numThreads, ArenaRowsPerTask(fileContent, contentSize, numThreads), sizeof(size_t));
 
 #pragma omp parallel
     {
@@ -126,9 +394,10 @@ size_t GetLineOffsets_LFCRLF_OpenMP(const char* fileContent, size_t contentSize,
         size_t start = threadId * chunkSize;
         size_t end = (threadId == numThreads - 1) ? contentSize : start + chunkSize;
 
-        // 先頭位置を調整（改行文字の途中から始まらないようにする）
+        // 先頭位置を調整（行の途中・改行文字の途中から始まらないようにする）
+        // （start がちょうど行頭ならその行はこのスレッドの担当）
         if (threadId != 0) {
-            while (start < contentSize && (fileContent[start] != '\r' || fileContent[start] != '\n')) {
+            while (start < contentSize && fileContent[start - 1] != '\r' && fileContent[start - 1] != '\n') {
                 ++start;
             }
             while (start < contentSize && (fileContent[start] == '\r' || fileContent[start] == '\n')) {
@@ -138,7 +407,7 @@ size_t GetLineOffsets_LFCRLF_OpenMP(const char* fileContent, size_t contentSize,
 
         for (size_t pos = start; pos < end;) {
             // 現在の pos を行の先頭として記録
-            localOffsets[threadId].push_back(pos);
+            arena.Push(threadId, pos);
 
             // 改行文字 (\n, \r) 以外の文字まで進む
             while (pos < end && fileContent[pos] != '\r' && fileContent[pos] != '\n') {
@@ -152,18 +421,16 @@ size_t GetLineOffsets_LFCRLF_OpenMP(const char* fileContent, size_t contentSize,
         }
     }
 
-    // 結果を統合（`localOffsets` を `lineOffsets` にマージ）
-    for (const auto& offsets : localOffsets) {
-        lineOffsets.insert(lineOffsets.end(), offsets.begin(), offsets.end());
-    }
-    return lineOffsets.size();
+    // 各スレッドの結果を累積和の位置へ並列にコピー
+    return AppendLineOffsets(arena, lineOffsets, nullptr);
 }
 
 //////////////////////////////////////////////////////////////////////////////////
 //メモリマップのCSVデータを行ごとに分解　改行コードCRLF用
 size_t GetLineOffsets_CRLF_OpenMP(const char* fileContent, size_t contentSize, std::vector<size_t>& lineOffsets) {
     const int numThreads = omp_get_max_threads();
-    std::vector<std::vector<size_t>> localOffsets(numThreads);
+    TaskArena arena; // スレッドごとの結果を格納（1回の確保）
+    arena.Init(numThreads, ArenaRowsPerTask(fileContent, contentSize, numThreads), sizeof(size_t));
 
 #pragma omp parallel
     {
@@ -172,9 +439,10 @@ size_t GetLineOffsets_CRLF_OpenMP(const char* fileContent, size_t contentSize, s
         size_t start = threadId * chunkSize;
         size_t end = (threadId == numThreads - 1) ? contentSize : start + chunkSize;
 
-        // 先頭が CRLF の途中にならないように調整
+        // 先頭が行・CRLF の途中にならないように調整
+        // （start がちょうど行頭ならその行はこのスレッドの担当）
         if (threadId != 0) {
-            while (start < contentSize && (fileContent[start] != '\r' || fileContent[start] != '\n')) {
+            while (start < contentSize && fileContent[start - 1] != '\r' && fileContent[start - 1] != '\n') {
                 ++start;
             }
             while (start < contentSize && (fileContent[start] == '\r' || fileContent[start] == '\n')) {
@@ -184,7 +452,7 @@ size_t GetLineOffsets_CRLF_OpenMP(const char* fileContent, size_t contentSize, s
 
         for (size_t pos = start; pos < end;) {
             // 現在の pos を行の先頭として記録
-            localOffsets[threadId].push_back(pos);
+            arena.Push(threadId, pos);
 
             // CR (\r) 以外の文字まで進む
             while (pos < end && fileContent[pos] != '\r') {
@@ -203,11 +471,8 @@ size_t GetLineOffsets_CRLF_OpenMP(const char* fileContent, size_t contentSize, s
         }
     }
 
-    // 各スレッドの結果を統合
-    for (const auto& offsets : localOffsets) {
-        lineOffsets.insert(lineOffsets.end(), offsets.begin(), offsets.end());
-    }
-    return lineOffsets.size();
+    // 各スレッドの結果を累積和の位置へ並列にコピー
+    return AppendLineOffsets(arena, lineOffsets, nullptr);
 }
 
 //////////////////////////////////////////////////////////////////////////////////
@@ -215,7 +480,8 @@ size_t GetLineOffsets_CRLF_OpenMP(const char* fileContent, size_t contentSize, s
 size_t GetLineOffsets_LF_OpenMP(const char* fileContent, size_t contentSize, std::vector<size_t>& lineOffsets) {
     //omp_set_num_threads(1); //OpenMPの効果をキャンセルするためのコード
     const int numThreads = omp_get_max_threads();
-    std::vector<std::vector<size_t>> localOffsets(numThreads);
+    TaskArena arena; // スレッドごとの結果を格納（1回の確保）
+    arena.Init(numThreads, ArenaRowsPerTask(fileContent, contentSize, numThreads), sizeof(size_t));
 #pragma omp parallel
     {
         int threadId = omp_get_thread_num();
@@ -236,7 +502,7 @@ size_t GetLineOffsets_LF_OpenMP(const char* fileContent, size_t contentSize, std
 
         for (size_t pos = start; pos < end;) {
             // 現在の pos を行の先頭として記録
-            localOffsets[threadId].push_back(pos);
+            arena.Push(threadId, pos);
 
             // 改行文字以外の文字まで進む
             while (pos < end && fileContent[pos] != '\n') {
@@ -250,28 +516,30 @@ size_t GetLineOffsets_LF_OpenMP(const char* fileContent, size_t contentSize, std
         }
     }
 
-    // 各スレッドの結果を統合
-    for (const auto& offsets : localOffsets) {
-        lineOffsets.insert(lineOffsets.end(), offsets.begin(), offsets.end());
-    }
-    return lineOffsets.size();
+    // 各スレッドの結果を累積和の位置へ並列にコピー
+    return AppendLineOffsets(arena, lineOffsets, nullptr);
 }
 //////////////////////////////////////////////////////////////////////////////////
 // AVX2 + OpenMP による高速行オフセット取得
 //メモリマップのCSVデータを行ごとに分解　改行コードLF用
-size_t GetLineOffsets_LF_AVX2_OpenMP(const char* fileContent, size_t contentSize, std::vector<size_t>& lineOffsets) {
-    const int numThreads = omp_get_max_threads();
-    std::vector<std::vector<size_t>> localOffsets(numThreads);
-#pragma omp parallel
-    {
-        int threadId = omp_get_thread_num();
-        size_t chunkSize = contentSize / numThreads;
-        size_t start = threadId * chunkSize;
-        size_t end = (threadId == numThreads - 1) ? contentSize : start + chunkSize;
+// ファイルを TASK_TARGET_BYTES 程度のタスクに分け、ワークスティーリングで分配する
+// stats を指定すると走査・結合の時間とスレッドごとの作業時間を加算する
+static size_t ScanLineOffsets_LF_AVX2(const char* fileContent, size_t contentSize, TaskArena& arena,
+    CsvLoadStats* stats)
+{
+    StatsPhase scanPhase(stats ? &stats->scanSeconds : nullptr);
+    const size_t numTasks = TaskCountForBytes(contentSize, omp_get_max_threads());
+    arena.Init(numTasks, ArenaRowsPerTask(fileContent, contentSize, numTasks), sizeof(uint32_t));
+    RunStealingTasks(numTasks, [&](size_t task, int threadId) {
+        const double t0 = StatsNow();
+        const size_t taskBase = TaskBegin(contentSize, numTasks, task);
+        size_t start = taskBase;
+        size_t end = TaskBegin(contentSize, numTasks, task + 1);
 
         // 誤って改行文字の途中から処理しないように調整
-        if (threadId != 0) {
-            while (start < contentSize && fileContent[start] != '\n') {
+        // （start がちょうど行頭ならその行はこのタスクの担当）
+        if (task != 0) {
+            while (start < contentSize && fileContent[start - 1] != '\n' && fileContent[start] != '\n') {
                 ++start;
             }
             while (start < contentSize && fileContent[start] == '\n') {
@@ -280,42 +548,13 @@ size_t GetLineOffsets_LF_AVX2_OpenMP(const char* fileContent, size_t contentSize
         }
 
         size_t pos = start;
-        const __m256i LF = _mm256_set1_epi8('\n');  // 改行文字'\n'を32バイトごとに比較するためのレジスタ
-
         while (pos < end) {
             // 現在のposを「行の先頭」として記録
-            localOffsets[threadId].push_back(pos);
+            arena.Push(task, static_cast<uint32_t>(pos - taskBase)); // タスクは 2 * TASK_TARGET_BYTES 未満
 
             // 次の改行文字を検索する
-            size_t searchPos = pos;
-            bool newlineFound = false;
-            while (searchPos < end) {
-                if (searchPos + 32 <= end) {
-                    // 32バイト分をロードして一括比較
-                    __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(fileContent + searchPos));
-                    __m256i cmp = _mm256_cmpeq_epi8(data, LF);
-                    int mask = _mm256_movemask_epi8(cmp);
-                    if (mask != 0) {
-                        // マスクに1ビットが立っている＝改行文字が見つかった
-                        unsigned long offset;
-                        _BitScanForward(&offset, mask);  // 最下位の1ビット（＝最初の改行文字）の位置を取得
-                        searchPos += offset;
-                        newlineFound = true;
-                        break;
-                    }
-                    else {
-                        searchPos += 32;
-                    }
-                }
-                else {
-                    // 残りのバイト数が32未満の場合は逐次走査
-                    if (fileContent[searchPos] == '\n') {
-                        newlineFound = true;
-                        break;
-                    }
-                    ++searchPos;
-                }
-            }
+            size_t searchPos = static_cast<size_t>(FindChar(fileContent + pos, fileContent + end, '\n') - fileContent);
+            bool newlineFound = (searchPos < end);
 
             if (!newlineFound) {
                 // 改行が見つからなければこのブロック内は終了
@@ -329,31 +568,38 @@ size_t GetLineOffsets_LF_AVX2_OpenMP(const char* fileContent, size_t contentSize
             }
             pos = searchPos;
         }
-    }
+        StatsAddBusy(stats, threadId, StatsNow() - t0);
+    });
+    return arena.Offsets().back();
+}
 
-    // 各スレッドの結果を統合
-    for (const auto& offsets : localOffsets) {
-        lineOffsets.insert(lineOffsets.end(), offsets.begin(), offsets.end());
-    }
-    return lineOffsets.size();
+size_t GetLineOffsets_LF_AVX2_OpenMP(const char* fileContent, size_t contentSize, std::vector<size_t>& lineOffsets) {
+    TaskArena arena;
+    ScanLineOffsets_LF_AVX2(fileContent, contentSize, arena, nullptr);
+    return AppendRelativeOffsets(arena, contentSize, lineOffsets);
 }
 
 //////////////////////////////////////////////////////////////////////////////////
 //メモリマップのCSVデータを行ごとに分解　改行コードCRLF用
-size_t GetLineOffsets_CRLF_AVX2_OpenMP(const char* fileContent, size_t contentSize, std::vector<size_t>& lineOffsets) {
-    const int numThreads = omp_get_max_threads();
-    std::vector<std::vector<size_t>> localOffsets(numThreads);
-
-#pragma omp parallel
-    {
-        int threadId = omp_get_thread_num();
-        size_t chunkSize = contentSize / numThreads;
-        size_t start = threadId * chunkSize;
-        size_t end = (threadId == numThreads - 1) ? contentSize : start + chunkSize;
-
-        // 先頭が CRLF の途中にならないように調整（前のスレッドで終わった改行をスキップ）
-        if (threadId != 0) {
-            while (start < contentSize && (fileContent[start] != '\r' || fileContent[start] != '\n')) {
+// ファイルを TASK_TARGET_BYTES 程度のタスクに分け、ワークスティーリングで分配する
+// stats を指定すると走査・結合の時間とスレッドごとの作業時間を加算する
+static size_t ScanLineOffsets_CRLF_AVX2(const char* fileContent, size_t contentSize, TaskArena& arena,
+    CsvLoadStats* stats)
+{
+    StatsPhase scanPhase(stats ? &stats->scanSeconds : nullptr);
+    const size_t numTasks = TaskCountForBytes(contentSize, omp_get_max_threads());
+    arena.Init(numTasks, ArenaRowsPerTask(fileContent, contentSize, numTasks), sizeof(uint32_t));
+
+    RunStealingTasks(numTasks, [&](size_t task, int threadId) {
+        const double t0 = StatsNow();
+        const size_t taskBase = TaskBegin(contentSize, numTasks, task);
+        size_t start = taskBase;
+        size_t end = TaskBegin(contentSize, numTasks, task + 1);
+
+        // 先頭が CRLF の途中にならないように調整（前のタスクで終わった改行をスキップ）
+        // （start がちょうど行頭ならその行はこのタスクの担当）
+        if (task != 0) {
+            while (start < contentSize && fileContent[start - 1] != '\n' && fileContent[start] != '\n') {
                 ++start;
             }
             while (start < contentSize && (fileContent[start] == '\r' || fileContent[start] == '\n')) {
@@ -361,44 +607,14 @@ size_t GetLineOffsets_CRLF_AVX2_OpenMP(const char* fileContent, size_t contentSi
             }
         }
 
-        const __m256i vCR = _mm256_set1_epi8('\r');  // CR文字を全バイトにセット
         size_t pos = start;
         while (pos < end) {
             // 現在の pos を行の先頭として記録
-            localOffsets[threadId].push_back(pos);
-
-            // pos以降から CR を探す（AVX2による高速検索）
-            size_t scanPos = pos;
-            bool foundCR = false;
-            while (scanPos < end) {
-                if (scanPos + 32 <= end) {
-                    // 32バイト分を一括読み込み
-                    __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(fileContent + scanPos));
-                    // CRとの比較
-                    __m256i cmp = _mm256_cmpeq_epi8(data, vCR);
-                    // 各バイトの最上位ビットをまとめた32ビットのマスクを取得
-                    int mask = _mm256_movemask_epi8(cmp);
-                    if (mask != 0) {
-                        // マスク内で最も下位の1ビットの位置を取得（最初に現れる CR）
-                        unsigned long offset;
-                        _BitScanForward(&offset, mask);
-                        scanPos += offset;
-                        foundCR = true;
-                        break;
-                    }
-                    else {
-                        scanPos += 32;
-                    }
-                }
-                else {
-                    // 32バイト未満の残り領域は逐次走査
-                    if (fileContent[scanPos] == '\r') {
-                        foundCR = true;
-                        break;
-                    }
-                    ++scanPos;
-                }
-            }
+            arena.Push(task, static_cast<uint32_t>(pos - taskBase)); // タスクは 2 * TASK_TARGET_BYTES 未満
+
+            // pos以降から CR を探す（AVX2 / SSE2 による高速検索）
+            size_t scanPos = static_cast<size_t>(FindChar(fileContent + pos, fileContent + end, '\r') - fileContent);
+            bool foundCR = (scanPos < end);
             if (!foundCR) {
                 // CRが見つからなかったので、このスレッドの処理は終了
                 pos = end;
@@ -414,160 +630,1539 @@ size_t GetLineOffsets_CRLF_AVX2_OpenMP(const char* fileContent, size_t contentSi
                 pos = scanPos + 1;
             }
         }
-    }
-
-    // 各スレッドの結果を統合
-    for (const auto& offsets : localOffsets) {
-        lineOffsets.insert(lineOffsets.end(), offsets.begin(), offsets.end());
-    }
+        StatsAddBusy(stats, threadId, StatsNow() - t0);
+    });
+    return arena.Offsets().back();
+}
 
-    return lineOffsets.size();
+size_t GetLineOffsets_CRLF_AVX2_OpenMP(const char* fileContent, size_t contentSize, std::vector<size_t>& lineOffsets) {
+    TaskArena arena;
+    ScanLineOffsets_CRLF_AVX2(fileContent, contentSize, arena, nullptr);
+    return AppendRelativeOffsets(arena, contentSize, lineOffsets);
 }
 
-//////////////////////////////////////////////////////////////////////////////////////////////
-// @brief 1行10要素のCSV ファイルを読み込み、pointClouds に格納する
-// @param[in]  filename     入力ファイルパス（ワイド文字列）
-// @param[out] pointClouds  読み込んだ点群データを格納するベクター
-// @return                  成功時は 0、失敗時は非 0
-#define USE_AVX2
-int FastCsvLoad(const std::wstring& filename, std::vector<PointCloud>& pointClouds, int num_cols)
-{
-    // ファイルを開く (Windows API)
-    HANDLE hFile = CreateFileW(
-        filename.c_str(),
-        GENERIC_READ,
-        FILE_SHARE_READ,
-        NULL,
-        OPEN_EXISTING,
-        FILE_ATTRIBUTE_NORMAL,
-        NULL
-    );
-    if (hFile == INVALID_HANDLE_VALUE) {
-        std::wcerr << L"ファイルを開けません: " << filename << std::endl;
-        return 1;
-    }
+//////////////////////////////////////////////////////////////////////////////////
+//メモリマップのCSVデータを行ごとに分解　改行コード混在用（LF / CRLF / CR・空行）
+// '\n' と '\r' をまとめて改行文字とみなし、改行文字の直後の改行文字でない文字を行頭とする（空行は行にならない）。
+// 64バイトごとに改行文字のビットマスクを作り、1ビットずらしたマスクとの AND NOT で行頭のビットを求める。
+// 行頭かどうかはその位置と直前の1バイトだけで決まるので、タスク境界の調整が要らない
 
-    // ファイルサイズを取得
-    LARGE_INTEGER fileSize;
-    if (!GetFileSizeEx(hFile, &fileSize)) {
-        std::wcerr << L"ファイルサイズの取得に失敗しました。" << std::endl;
-        CloseHandle(hFile);
-        return 1;
+// 64バイト分の改行文字のマスク nl から行頭を arena に書く　prevNewline は直前のバイトが改行文字なら 1
+static inline void PushRowStarts(TaskArena& arena, size_t task, size_t rel, uint64_t nl, uint64_t& prevNewline)
+{
+    // 行頭 = 改行文字でなく、直前が改行文字
+    uint64_t starts = ~nl & ((nl << 1) | prevNewline);
+    prevNewline = nl >> 63;
+    while (starts != 0) {
+        arena.Push(task, static_cast<uint32_t>(rel + BitScanForward64(starts))); // タスクは 2 * TASK_TARGET_BYTES 未満
+        starts &= starts - 1;
     }
+}
 
-    std::cout.imbue(std::locale("")); // カンマ区切りの数値フォーマットを適用
-    std::cout << "FileSize: " << fileSize.QuadPart << " byte" << std::endl;
-
-    // ファイルをメモリにマップ
-    HANDLE hMap = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
-    if (hMap == NULL) {
-        std::wcerr << L"ファイルマッピングの作成に失敗しました。" << std::endl;
-        CloseHandle(hFile);
-        return 1;
+// [pos, end) を 64バイトずつ走査し、走査を終えた位置を返す（残りは呼び出し側が逐次走査）
+FASTCSV_TARGET("avx2")
+static size_t ScanRowStarts_AVX2(const char* fileContent, size_t taskBase, size_t pos, size_t end,
+    TaskArena& arena, size_t task, uint64_t& prevNewline)
+{
+    const __m256i vLF = _mm256_set1_epi8('\n');
+    const __m256i vCR = _mm256_set1_epi8('\r');
+    for (; pos + 64 <= end; pos += 64) {
+        const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(fileContent + pos));
+        const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(fileContent + pos + 32));
+        const uint64_t nlLo = static_cast<uint32_t>(_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(lo, vLF), _mm256_cmpeq_epi8(lo, vCR))));
+        const uint64_t nlHi = static_cast<uint32_t>(_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(hi, vLF), _mm256_cmpeq_epi8(hi, vCR))));
+        PushRowStarts(arena, task, pos - taskBase, nlLo | (nlHi << 32), prevNewline);
     }
+    return pos;
+}
 
-    // ファイル全体をマッピング
-    LPCVOID pData = MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
-    if (pData == NULL) {
-        std::wcerr << L"ファイルのマッピングに失敗しました。" << std::endl;
-        CloseHandle(hMap);
-        CloseHandle(hFile);
-        return 1;
+static size_t ScanRowStarts_SSE2(const char* fileContent, size_t taskBase, size_t pos, size_t end,
+    TaskArena& arena, size_t task, uint64_t& prevNewline)
+{
+    const __m128i vLF = _mm_set1_epi8('\n');
+    const __m128i vCR = _mm_set1_epi8('\r');
+    for (; pos + 64 <= end; pos += 64) {
+        uint64_t nl = 0;
+        for (int k = 0; k < 4; ++k) {
+            const __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(fileContent + pos + k * 16));
+            nl |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(
+                _mm_or_si128(_mm_cmpeq_epi8(data, vLF), _mm_cmpeq_epi8(data, vCR))))) << (k * 16);
+        }
+        PushRowStarts(arena, task, pos - taskBase, nl, prevNewline);
     }
+    return pos;
+}
 
-    // ファイル内容を文字列として扱う
-    const char* fileContent = static_cast<const char*>(pData);
-    size_t contentSize = static_cast<size_t>(fileSize.QuadPart);
+static size_t ScanLineOffsets_Mixed(const char* fileContent, size_t contentSize, TaskArena& arena,
+    CsvLoadStats* stats)
+{
+    StatsPhase scanPhase(stats ? &stats->scanSeconds : nullptr);
+    const size_t numTasks = TaskCountForBytes(contentSize, omp_get_max_threads());
+    arena.Init(numTasks, ArenaRowsPerTask(fileContent, contentSize, numTasks), sizeof(uint32_t));
+    const bool avx2 = UseAvx2();
+
+    RunStealingTasks(numTasks, [&](size_t task, int threadId) {
+        const double t0 = StatsNow();
+        const size_t taskBase = TaskBegin(contentSize, numTasks, task);
+        const size_t end = TaskBegin(contentSize, numTasks, task + 1);
+        auto isNewline = [](char c) { return static_cast<uint64_t>(c == '\n' || c == '\r'); };
+
+        // 直前のバイトが改行文字なら 1（ファイルの先頭は行頭になりうる）
+        uint64_t prevNewline = (taskBase == 0) ? 1 : isNewline(fileContent[taskBase - 1]);
+        size_t pos = avx2
+            ? ScanRowStarts_AVX2(fileContent, taskBase, taskBase, end, arena, task, prevNewline)
+            : ScanRowStarts_SSE2(fileContent, taskBase, taskBase, end, arena, task, prevNewline);
+        // 64バイト未満の残り領域は逐次走査
+        for (; pos < end; ++pos) {
+            const uint64_t nl = isNewline(fileContent[pos]);
+            if (!nl && prevNewline) {
+                arena.Push(task, static_cast<uint32_t>(pos - taskBase));
+            }
+            prevNewline = nl;
+        }
+        StatsAddBusy(stats, threadId, StatsNow() - t0);
+    });
+    return arena.Offsets().back();
+}
+
+size_t GetLineOffsets_Mixed_AVX2_OpenMP(const char* fileContent, size_t contentSize, std::vector<size_t>& lineOffsets) {
+    TaskArena arena;
+    ScanLineOffsets_Mixed(fileContent, contentSize, arena, nullptr);
+    return AppendRelativeOffsets(arena, contentSize, lineOffsets);
+}
 
-    // 最初の行サイズを測定
-    size_t firstLineSize = 0;
-    while (firstLineSize < contentSize && fileContent[firstLineSize] != '\n') {
-        ++firstLineSize;
+//////////////////////////////////////////////////////////////////////////////////
+// 行のパースは区切り方 Fields（CsvDialect.h の DelimitedFields / BlankFields）に特殊化する
+// 既定の ',' 区切りは2パス方式・固定長の行・1パス方式で共通
+static const DelimitedFields<false> kCommaFields = { ',', COMMENT_NONE };
+
+// 不正な列がある行を1列ずつ読み直す（ParseLine の遅い経路）
+// 読めない列は NaN にして次の区切りまで読み飛ばし、後ろの列は読める限り読む
+template <class Fields>
+static uint32_t ReparseLine(const char* ptr, const char* end, PointCloud& p, int num_cols, const Fields& f)
+{
+    uint32_t bad = 0;
+    for (int i = 0; i < num_cols; ++i) {
+        ptr = f.FieldBegin(ptr, end);
+        auto result = ParseDecimal(ptr, end, p.fields[i]);
+        const char* next = result.ptr;
+        if (result.ec != std::errc() || !f.Next(next, end)) {
+            bad |= 1u << i;
+            p.fields[i] = std::numeric_limits<float>::quiet_NaN();
+            next = f.Skip(ptr, end);
+        }
+        ptr = next;
     }
-    std::cout << "firstLineSize: " << firstLineSize << " byte" << std::endl;
+    return bad;
+}
 
-    // 推定行数を計算
-    size_t estimatedLines = 0;
-    if (firstLineSize > 0) {
-        estimatedLines = (contentSize / firstLineSize) * MARGIN_RATIO;//5%多めに設定
+//////////////////////////////////////////////////////////////////////////////////
+// 1行分（num_cols個の float）をパース　2パス方式・1パス方式で共通
+// @return 読めなかった列（変換の失敗・数値の後ろの余計な文字・列の不足）のビットマスク　0 なら正常
+//         読めなかった列は NaN になる
+template <class Fields>
+static inline uint32_t ParseLine(const char* ptr, const char* end, PointCloud& p, int num_cols, const Fields& f)
+{
+    // 単純に num_cols個の float を CSV から読み込む
+    // 列ごとの判定はビットの OR だけにして、分岐は行ごとに1回（不正な列があるか）にする
+    const char* const lineBegin = ptr;
+    uint32_t bad = 0;
+    for (int i = 0; i < num_cols; ++i) {
+        // 固定小数点形式なら SIMD の高速パス、それ以外は fast_float でパース（結果は同じ）
+        ptr = f.FieldBegin(ptr, end);
+        auto result = ParseDecimal(ptr, end, p.fields[i]);
+        ptr = result.ptr;
+        // 区切りがあればスキップ（行末近くで区切りがない場合もあるので Next でチェック）
+        bad |= static_cast<uint32_t>((result.ec != std::errc()) | !f.Next(ptr, end)) << i;
+    }
+    if (bad != 0) {
+        bad = ReparseLine(lineBegin, end, p, num_cols, f);
     }
-    std::cout << "estimatedLines: " << estimatedLines << " line" << std::endl;
+    return bad;
+}
 
-    //--------------------------------------------------------------------------
-    // 1) 行頭オフセットの取得
-    // 固定長の場合、この処理は省ける
-    //--------------------------------------------------------------------------
-    std::vector<size_t> lineOffsets;
+//////////////////////////////////////////////////////////////////////////////////
+// 列の射影と行の絞り込み（CsvLoadOptions::columnMask / where）
+// 条件で絞り込む場合は残る行数が分からないので、出力を推定行数で予約しない（チャンクごとの追加領域が伸びる）
+// 数十億行のファイルから一部を取り出すときに全行分を確保しないため
 
-    // 推定行数で lineOffsets を事前予約
-    lineOffsets.reserve(estimatedLines);
+struct RowFilter {
+    uint32_t parseMask = 0;  // 読む列（射影 + 条件の列）
+    int      lastColumn = -1; // 読む最後の列　それより後ろは行末まで見ない
+    std::vector<CsvPredicate> where;
 
-#ifndef USE_AVX2
-    //AVX2不使用
-    GetLineOffsets(fileContent, contentSize, lineOffsets);
-#else
-    //AVX2使用
-    GetLineOffsets_AVX2_OpenMP(fileContent, contentSize, lineOffsets);
-#endif
-    //--------------------------------------------------------------------------
-    // 2) 結果を格納するベクターを行数分確保
-    //--------------------------------------------------------------------------
-    pointClouds.resize(lineOffsets.size());
+    // 条件をすべて満たすか（NaN は PREDICATE_NE 以外を満たさない）
+    bool Pass(const PointCloud& p) const
+    {
+        for (const CsvPredicate& w : where) {
+            const float v = p.fields[w.column];
+            bool ok;
+            switch (w.op) {
+            case PREDICATE_LT: ok = v < w.value;  break;
+            case PREDICATE_LE: ok = v <= w.value; break;
+            case PREDICATE_GT: ok = v > w.value;  break;
+            case PREDICATE_GE: ok = v >= w.value; break;
+            case PREDICATE_EQ: ok = v == w.value; break;
+            default:           ok = v != w.value; break;
+            }
+            if (!ok) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
 
-    //--------------------------------------------------------------------------
-    // 3) 各行を並列でパース（OpenMP 使用）
-    //--------------------------------------------------------------------------
-    //PointCloud p; // 一行分を格納する構造体
-#pragma omp parallel for
-        for (int lineIndex = 0; lineIndex < static_cast<int>(lineOffsets.size()); ++lineIndex)
-        {
-            // この行の開始位置と終了位置
-            size_t startPos = lineOffsets[lineIndex];
-            size_t endPos = (lineIndex + 1 < static_cast<int>(lineOffsets.size()))
-                ? lineOffsets[lineIndex + 1]
-                : contentSize;
-            // ポインタをセット
-            const char* ptr = &fileContent[startPos];
-            const char* end = &fileContent[endPos];
+// @brief opt から RowFilter を作る
+// @return 射影・絞り込みがなければ 0、あれば 1（filter に設定）、列数・条件の列番号が範囲外なら -1
+static int MakeRowFilter(const CsvLoadOptions& opt, int num_cols, RowFilter& filter)
+{
+    // 列のマスクは num_cols ビット（1u << 32 以上のシフトにならないよう先に列数を確かめる）
+    if (num_cols <= 0 || num_cols > COLUMN_SIZE) {
+        std::cerr << "列数が範囲外です（" << num_cols << "、1～" << COLUMN_SIZE << "）。" << std::endl;
+        return -1;
+    }
+    const uint32_t all = (1u << num_cols) - 1;
+    filter.parseMask = (opt.columnMask != 0) ? (opt.columnMask & all) : all;
+    for (const CsvPredicate& w : opt.where) {
+        if (w.column < 0 || w.column >= num_cols) {
+            std::cerr << "where の列番号が範囲外です（" << w.column << "）。" << std::endl;
+            return -1;
+        }
+        filter.parseMask |= 1u << w.column;
+    }
+    if (filter.parseMask == all && opt.where.empty()) {
+        return 0;
+    }
+    filter.lastColumn = -1;
+    for (int i = 0; i < num_cols; ++i) {
+        if ((filter.parseMask >> i) & 1) {
+            filter.lastColumn = i;
+        }
+    }
+    filter.where = opt.where;
+    return 1;
+}
+
+// 射影した1行をパースする（ParseLine の射影版）
+// 読まない列は区切りまで読み飛ばして NaN にし、最後に読む列より後ろは見ない
+// @return 読む列のうち読めなかった列のビットマスク
+template <class Fields>
+static inline uint32_t ParseLineProjected(const char* ptr, const char* end, PointCloud& p, int num_cols, const RowFilter& filter,
+    const Fields& f)
+{
+    const char* const lineBegin = ptr;
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    uint32_t bad = 0;
+    for (int i = 0; i <= filter.lastColumn; ++i) {
+        ptr = f.FieldBegin(ptr, end);
+        if ((filter.parseMask >> i) & 1) {
+            auto result = ParseDecimal(ptr, end, p.fields[i]);
+            ptr = result.ptr;
+            bad |= static_cast<uint32_t>((result.ec != std::errc()) | !f.Next(ptr, end)) << i;
+        }
+        else {
+            p.fields[i] = nan;
+            ptr = f.Skip(ptr, end);
+        }
+    }
+    for (int i = filter.lastColumn + 1; i < num_cols; ++i) {
+        p.fields[i] = nan;
+    }
+    if (bad != 0) {
+        // 遅い経路は全列を読み直してから、読まない列を NaN に戻す
+        bad = ReparseLine(lineBegin, end, p, num_cols, f) & filter.parseMask;
+        for (int i = 0; i < num_cols; ++i) {
+            if (((filter.parseMask >> i) & 1) == 0) {
+                p.fields[i] = nan;
+            }
+        }
+    }
+    return bad;
+}
 
-            PointCloud p; // 一行分を格納する構造体
+//////////////////////////////////////////////////////////////////////////////////
+// 構造インデックスで読む1行分の状態
+// フィールドごとに判定をビットで OR し、行末で受け取らなかった列（列の不足）を加える
+// parseMask にない列は読まずに NaN にする（射影、フィールド境界は構造インデックスで分かる）
+struct StructuralRow {
+    PointCloud  p;
+    uint32_t    bad = 0;
+    int         fields = 0;       // 受け取ったフィールド数
+    const char* begin = nullptr;  // 先頭フィールドの位置
+    char        delimiter = ',';  // 区切り文字（走査関数と同じもの）
+
+    void Field(int field, const char* fieldBegin, const char* fieldEnd, int num_cols, uint32_t parseMask)
+    {
+        if (field < num_cols && ((parseMask >> field) & 1)) {
+            auto result = ParseDecimal(fieldBegin, fieldEnd, p.fields[field]);
+            bad |= static_cast<uint32_t>((result.ec != std::errc()) | !IsFieldEnd(result.ptr, fieldEnd, delimiter)) << field;
+        }
+        if (field == 0) {
+            begin = fieldBegin;
+        }
+        fields = field + 1;
+    }
 
-            // 単純に num_cols個の float を CSV から読み込む
+    // 行末の処理: 読めなかった列・読まない列を NaN にして読めなかった列のビットマスクを返し、次の行に備える
+    uint32_t End(int num_cols, uint32_t parseMask)
+    {
+        // フィールドは先頭から順に渡されるので、fields 以降の列が不足
+        const uint32_t all = (1u << num_cols) - 1;
+        const uint32_t mask = (bad | ((fields < num_cols) ? all & ~((1u << fields) - 1) : 0)) & parseMask;
+        const uint32_t fill = mask | (all & ~parseMask);
+        bad = 0;
+        if (fill != 0) {
             for (int i = 0; i < num_cols; ++i) {
-                // fast_float でパース
-                auto result = fast_float::from_chars(ptr, end, p.fields[i]);
-                ptr = result.ptr;
-                // カンマがあればスキップ（行末近くで区切りがない場合もあるのでチェック）
-                if (ptr < end && *ptr == ',') {
-                    ++ptr;
+                if ((fill >> i) & 1) {
+                    p.fields[i] = std::numeric_limits<float>::quiet_NaN();
                 }
             }
-
-#ifdef _DEBUG
-            std::cout << p.fields[0] << std::endl;
-#endif
-            // 出来上がった PointCloud をベクターに格納
-            pointClouds[lineIndex] = p;
-
-#ifdef _DEBUG
-            std::cout << p.x << std::endl;
-#endif
         }
-    // メモリマップの後始末
-    UnmapViewOfFile(pData);
-    CloseHandle(hMap);
-    CloseHandle(hFile);
+        return mask;
+    }
+};
 
-    return 0; // 正常終了
+// 不正な行（読めなかった列のビットマスク bad）を記録し、出力に残すかを返す（ERRORPOLICY_FILLNAN のみ残す）
+static inline bool KeepBadRow(RowErrorLog& log, size_t task, size_t row, uint64_t byteOffset, uint32_t bad)
+{
+    return log.Add(task, row, byteOffset, static_cast<int>(BitScanForward32(bad)));
 }
 
-#include <fstream>
-#include <sstream>
-#include <mutex>
-//#define _FASTFLOAT fast floatを使う場合は有効にする。
-//////////////////////////////////////////////////////////////////////////////////////////////
-// @brief 1行10要素のCSV ファイルを読み込み、pointClouds に格納する
-// @param[in]  filename     入力ファイルパス（ワイド文字列）
+//////////////////////////////////////////////////////////////////////////////////
+// ParseChunkRows の構造インデックスを使わない場合（区切り方 Fields に特殊化した行のループ）
+template <class Fields>
+static size_t ParseChunkLines(const char* base, const char* pos, const char* end, int num_cols, const Fields& f,
+    TaskArena& arena, RowErrorLog& log, size_t task, const RowFilter* filter)
+{
+    size_t rows = 0;
+    while (pos < end) {
+        const char* nl = FindNewline(pos, end);
+        // 空行（CRLF の '\r' と '\n' の間を含む）・コメント行は行として数えない
+        if (nl > pos && !f.IgnoreLine(pos, nl)) {
+            // アリーナの書き込み先に直接パースする
+            PointCloud& p = *reinterpret_cast<PointCloud*>(arena.Reserve(task));
+            const uint32_t bad = filter ? ParseLineProjected(pos, nl, p, num_cols, *filter, f) : ParseLine(pos, nl, p, num_cols, f);
+            if (bad == 0 || KeepBadRow(log, task, rows, static_cast<uint64_t>(pos - base), bad)) {
+                // 条件を満たさない行は確定しない（次の行が同じ位置に上書きする）
+                if (!filter || filter->Pass(p)) {
+                    arena.Commit(task);
+                }
+            }
+            else if (log.Policy() == ERRORPOLICY_STRICT) {
+                break;
+            }
+            ++rows;
+        }
+        if (nl == end) {
+            break;
+        }
+        pos = nl + 1;
+    }
+    return rows;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// 行頭から始まる [pos, end) の行をパースし、アリーナのタスク task の領域に書く（1パス方式のチャンク1つ分）
+// scan を指定すると構造インデックスでフィールド境界を求める（区切り文字は dialect.delimiter、空白・コメント行は扱わない）
+// 不正な行はタスク内の行番号と base からのバイト位置で log に記録する
+// filter を指定すると読む列だけをパースし、条件を満たさない行はアリーナに書かない
+// @return 入力の行数（空行・コメント行は数えず、除いた不正な行・条件を満たさない行は数える）
+static size_t ParseChunkRows(const char* base, const char* pos, const char* end, int num_cols, ScanBlockFn scan,
+    const CsvDialect& dialect, TaskArena& arena, RowErrorLog& log, size_t task, const RowFilter* filter = nullptr)
+{
+    size_t rows = 0;
+    const uint32_t parseMask = filter ? filter->parseMask : ~0u;
+    if (scan) {
+        // 区切りと改行を同時に取り出し、フィールド境界を直接 ParseDecimal に渡す
+        StructuralRow row; // 一行分の状態
+        row.delimiter = dialect.delimiter;
+        WalkStructural(pos, end, scan,
+            [&](int field, const char* fieldBegin, const char* fieldEnd) {
+                row.Field(field, fieldBegin, fieldEnd, num_cols, parseMask);
+            },
+            [&]() {
+                const uint32_t bad = row.End(num_cols, parseMask);
+                if ((bad == 0 || KeepBadRow(log, task, rows, static_cast<uint64_t>(row.begin - base), bad)) &&
+                    (!filter || filter->Pass(row.p))) {
+                    arena.Push(task, row.p);
+                }
+                ++rows;
+            });
+        return rows;
+    }
+
+    // 区切り方はチャンクごとに一度だけ選ぶ（行のループは区切り方ごとに特殊化）
+    return WithFields(dialect, [&](const auto& f) {
+        return ParseChunkLines(base, pos, end, num_cols, f, arena, log, task, filter);
+    });
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// 出力を rows 行にする
+// PointCloud は集成体なので resize は 0 で埋める（呼び出し側の値の型は変えない）。
+// firstTouch の場合は 0 埋めで呼び出し元のスレッドのノードに載ったページを返し、
+// 後で各行を書き込むスレッドのノードに載せ直す（NUMA_FIRSTTOUCH）
+static void ResizeOutput(std::vector<PointCloud>& pointClouds, size_t rows, bool firstTouch)
+{
+    const size_t first = pointClouds.size();
+    pointClouds.resize(rows);
+    if (firstTouch && rows > first) {
+        NumaReleasePages(pointClouds.data() + first, (rows - first) * sizeof(PointCloud));
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// 1パス方式（改行探索とパースを融合）
+// 各チャンクを改行位置に揃えて分割し、スレッドごとに改行を探しながら直接パースする。
+// 引用符なしの場合はチャンクを TASK_TARGET_BYTES 程度に細かく分け、ワークスティーリングで分配する。
+// チャンクごとの行数を累積和して最終位置を決めるので、lineOffsets は作らない。
+// scan を指定すると構造インデックスでフィールド境界を求める（LOADMODE_STRUCTURAL）
+// quoted の場合は引用符付きフィールドに対応する（scan 必須）
+// dialect は区切り文字・空白・コメント行（scan の走査関数は dialect.delimiter 用であること）
+// errors は不正な行の扱い　行番号・バイト位置は errors.rows / errors.bytes からとし、読んだ分だけ進める
+// stats を指定するとパース・確保・結合の時間とスレッドごとの作業時間を加算する
+// firstTouch の場合は各チャンクをパースしたスレッドが結合先にコピーする（NUMA_FIRSTTOUCH）
+// filter を指定すると読む列だけをパースし、条件を満たす行だけを各チャンクのアリーナに詰めて書く
+// append の場合は pointClouds の末尾に追加する（ブロックごとの読み込み、結合はチャンクごとに並列）
+// @return ERRORPOLICY_STRICT で不正な行があれば非 0、それ以外は 0
+static int LoadPointClouds_Fused(const char* fileContent, size_t contentSize,
+    std::vector<PointCloud>& pointClouds, int num_cols, size_t estimatedLines, ScanBlockFn scan, bool quoted,
+    const CsvDialect& dialect, RowErrorSink& errors, CsvLoadStats* stats = nullptr, bool firstTouch = false, const RowFilter* filter = nullptr,
+    bool append = false)
+{
+    StatsPhase parsePhase(stats ? &stats->parseSeconds : nullptr);
+    const int numThreads = omp_get_max_threads();
+    const int numChunks = quoted
+        ? numThreads * 4 // 行長の偏りを吸収するため多めに分割
+        : static_cast<int>(TaskCountForBytes(contentSize, numThreads));
+    // チャンクごとの出力は1つのアリーナにまとめて確保する（行ごと・チャンクごとの再確保なし）
+    TaskArena arena;
+    const size_t outputLines = (filter && !filter->where.empty()) ? 0 : estimatedLines;
+    arena.Init(numChunks, TaskRowsEstimate(outputLines, numChunks), sizeof(PointCloud));
+    std::vector<int> chunkThread(numChunks, -1); // チャンクをパースしたスレッド
+    // 不正な行はチャンク内の行番号で記録し、チャンクごとの入力行数（除いた行を含む）の累積和で行番号にする
+    RowErrorLog log(errors, numChunks);
+    std::vector<size_t> chunkRows(numChunks, 0);
+
+    if (quoted) {
+        // 引用符の状態はチャンク先頭では分からないので、投機的にパースして後で修正する
+        const PrefixXorFn prefixXor = SelectPrefixXor();
+        const uint32_t parseMask = filter ? filter->parseMask : ~0u;
+        RunQuotedChunks(contentSize, numChunks,
+            [&](int c, size_t nominalBegin, size_t nominalEnd, bool insideAtBegin) {
+                const double t0 = StatsNow();
+                chunkThread[c] = omp_get_thread_num();
+                arena.Reset(c); // やり直しの場合は投機的な結果を捨てる
+                log.Reset(c);
+
+                size_t quotesHead, quotesBody;
+                size_t rowBegin = FindRowStartQuoted(fileContent, contentSize, nominalBegin, insideAtBegin, nominalEnd, quotesHead);
+                StructuralRow row; // 一行分の状態
+                row.delimiter = dialect.delimiter;
+                size_t rows = 0;
+                WalkStructuralQuoted(fileContent + rowBegin, fileContent + nominalEnd, fileContent + contentSize, scan, prefixXor,
+                    [&](int field, const char* fieldBegin, const char* fieldEnd) {
+                        row.Field(field, fieldBegin, fieldEnd, num_cols, parseMask);
+                    },
+                    [&]() {
+                        const uint32_t bad = row.End(num_cols, parseMask);
+                        if ((bad == 0 || KeepBadRow(log, c, rows, static_cast<uint64_t>(row.begin - fileContent), bad)) &&
+                            (!filter || filter->Pass(row.p))) {
+                            arena.Push(c, row.p);
+                        }
+                        ++rows;
+                    },
+                    quotesBody);
+                chunkRows[c] = rows;
+                StatsAddBusy(stats, omp_get_thread_num(), StatsNow() - t0);
+                return static_cast<int>((quotesHead + quotesBody) & 1);
+            });
+    }
+    else {
+        // チャンク境界（行頭）を決定
+        std::vector<size_t> bounds(numChunks + 1);
+        for (int c = 0; c < numChunks; ++c) {
+            bounds[c] = AlignToLineStart(fileContent, contentSize, contentSize / numChunks * c);
+        }
+        bounds[numChunks] = contentSize;
+
+        // チャンクごとにパース
+        RunStealingTasks(numChunks, [&](size_t c, int thread) {
+            if (log.Skip(c)) {
+                return;
+            }
+            const double t0 = StatsNow();
+            chunkThread[c] = thread;
+            chunkRows[c] = ParseChunkRows(fileContent, fileContent + bounds[c], fileContent + bounds[c + 1], num_cols, scan,
+                dialect, arena, log, c, filter);
+            StatsAddBusy(stats, thread, StatsNow() - t0);
+        });
+    }
+    parsePhase.Stop();
+
+    // チャンクごとの入力行数を累積和して行番号の基準を決め、不正な行をまとめる
+    std::vector<size_t> rowBase(numChunks + 1, 0);
+    for (int c = 0; c < numChunks; ++c) {
+        rowBase[c + 1] = rowBase[c] + chunkRows[c];
+    }
+    log.Finish(errors, &rowBase);
+    errors.rows += rowBase[numChunks];
+    errors.bytes += contentSize;
+    if (log.Policy() == ERRORPOLICY_STRICT && log.Count() > 0) {
+        return 1;
+    }
+
+    // チャンクごとの行数を累積和して格納位置を決定
+    const std::vector<size_t> base = arena.Offsets();
+    const size_t first = append ? pointClouds.size() : 0;
+    StatsPhase allocPhase(stats ? &stats->allocSeconds : nullptr);
+    ResizeOutput(pointClouds, first + base[numChunks], firstTouch);
+    allocPhase.Stop();
+
+    StatsPhase mergePhase(stats ? &stats->mergeSeconds : nullptr);
+    auto copyChunk = [&](size_t c) {
+        arena.CopyTask(c, reinterpret_cast<unsigned char*>(pointClouds.data() + first + base[c]));
+    };
+    if (firstTouch) {
+        RunOwnedTasks(chunkThread, copyChunk);
+    }
+    else {
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int c = 0; c < numChunks; ++c) {
+            copyChunk(c);
+        }
+    }
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// 順に届くブロック（AsyncBlockReader / DecompressBlockReader）を1パス方式で並列にパースする
+// ブロック末尾で途切れた行は次のブロックの前（ヘッドルーム）にコピーしてつなげる。
+// ヘッドルームに収まらない長い行は、行の残りまでを carry に足してから単独でパースする。
+// 不正な行の行番号・バイト位置は errors の基準をブロックごとに進めて入力全体の位置にする
+// sizeHint は入力全体のバイト数の見込み（出力の予約用、0 なら予約しない）
+template <class BlockReader>
+static int ParseBlocks(BlockReader& reader, uint64_t sizeHint, std::vector<PointCloud>& pointClouds,
+    int num_cols, const CsvLoadOptions& opt, RowErrorSink& errors, const RowFilter* filter, double& parseSeconds)
+{
+    const CsvDialect dialect = DialectOf(opt);
+    ScanBlockFn scan = (opt.loadMode == LOADMODE_STRUCTURAL) ? SelectDialectScan(opt.simdLevel, dialect) : nullptr;
+    std::vector<char> carry; // 前のブロックから続く行
+    RowDensity density;
+    pointClouds.clear();
+
+    // 行頭から始まる [begin, end) をパースして pointClouds の末尾に追加する
+    // （ブロックの行数だけ伸ばし、チャンクごとのアリーナから並列に直接コピーする）
+    auto parseRange = [&](const char* begin, const char* end) {
+        const auto t0 = std::chrono::steady_clock::now();
+        if (end > begin) {
+            const size_t len = static_cast<size_t>(end - begin);
+            if (LoadPointClouds_Fused(begin, len, pointClouds, num_cols,
+                    density.Rows(len), scan, false, dialect, errors, opt.stats, false, filter, true) != 0) {
+                return CheckRowErrors(errors);
+            }
+        }
+        parseSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        return 0;
+    };
+
+    AsyncBlock block;
+    while (reader.Next(block)) {
+        char* begin = block.data;
+        const char* end = block.data + block.size;
+        if (carry.size() <= ASYNC_READ_HEADROOM) {
+            // 途切れた行をブロックの直前に置いて連続した領域にする
+            begin -= carry.size();
+            if (!carry.empty()) {
+                std::memcpy(begin, carry.data(), carry.size());
+            }
+        }
+        else {
+            // ヘッドルームに収まらない行: このブロックの最初の改行までを carry に足す
+            const size_t head = static_cast<size_t>(FindNewline(block.data, end) - block.data);
+            const bool found = (head < block.size);
+            const size_t take = found ? head + 1 : head;
+            carry.insert(carry.end(), block.data, block.data + take);
+            if (!found && !block.last) {
+                // このブロックにも改行がない（行がまだ続く）
+                reader.Release(block);
+                continue;
+            }
+            const int result = parseRange(carry.data(), carry.data() + carry.size());
+            if (result != 0) {
+                return result;
+            }
+            carry.clear();
+            begin = block.data + take;
+        }
+        const char* cut = end;
+        if (!block.last) {
+            while (cut > begin && cut[-1] != '\n' && cut[-1] != '\r') {
+                --cut;
+            }
+        }
+
+        if (density.bytes == 0 && begin < end) {
+            // 最初のブロックの標本で行の密度を求め、出力を予約
+            density = SampleRowDensity(begin, static_cast<size_t>(end - begin));
+            StatsPhase allocPhase(opt.stats ? &opt.stats->allocSeconds : nullptr);
+            if (!filter || filter->where.empty()) {
+                pointClouds.reserve(density.Rows(static_cast<size_t>(sizeHint)));
+            }
+        }
+
+        const int result = parseRange(begin, cut);
+        if (result != 0) {
+            return result;
+        }
+        carry.assign(cut, end);
+        reader.Release(block);
+    }
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// 非同期ブロック読み込み（IOBACKEND_ASYNC）
+// 読み込みスレッドが先行して読んだブロックを順に受け取り、ブロック内を1パス方式で並列にパースする。
+static int LoadPointClouds_Async(const std::wstring& filename, std::vector<PointCloud>& pointClouds,
+    int num_cols, const CsvLoadOptions& opt, RowErrorSink& errors, const RowFilter* filter)
+{
+    if (opt.quoting == QUOTING_RFC4180) {
+        std::cerr << "非同期読み込みは引用符付き CSV に対応していません。" << std::endl;
+        return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    AsyncBlockReader reader;
+    StatsPhase mapPhase(opt.stats ? &opt.stats->mapSeconds : nullptr);
+    if (reader.Open(filename, opt.async) != 0) {
+        return 1;
+    }
+    mapPhase.Stop();
+    if (opt.stats) {
+        opt.stats->bytes = reader.FileSize();
+    }
+
+    if (!opt.quiet) {
+        std::cout.imbue(std::locale("")); // カンマ区切りの数値フォーマットを適用
+        std::cout << "FileSize: " << reader.FileSize() << " byte" << std::endl;
+    }
+
+    double parseSeconds = 0.0;
+    const int parsed = ParseBlocks(reader, reader.FileSize(), pointClouds, num_cols, opt, errors, filter, parseSeconds);
+    if (parsed != 0) {
+        return parsed;
+    }
+    const bool failed = reader.Failed();
+    const bool direct = reader.Direct();
+    reader.Close();
+    if (failed) {
+        return 1;
+    }
+
+    // 読み込みとパースの重なり: 重ならなければ経過時間 = 読み込み + パース
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const double readWall = reader.ReadSeconds() / std::max(1, opt.async.readThreads);
+    if (opt.quiet) {
+        return 0;
+    }
+    std::cout << "AsyncRead: " << (direct ? "direct" : "buffered")
+        << ", read " << static_cast<long long>(readWall * 1000) << " msec"
+        << ", parse " << static_cast<long long>(parseSeconds * 1000) << " msec"
+        << ", wait " << static_cast<long long>(reader.WaitSeconds() * 1000) << " msec"
+        << ", overlap " << static_cast<long long>(std::max(0.0, readWall + parseSeconds - elapsed) * 1000) << " msec"
+        << std::endl;
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// 圧縮ファイルの展開とパースの重ね合わせ
+// 独立したフレームに分けられない gzip / zstd は展開が1スレッドになるので、展開スレッドが次のブロックを
+// 展開している間に、展開済みのブロックを残りのスレッドで1パス方式でパースする（非同期読み込みと同じ流れ）
+static int LoadPointClouds_Compressed(const char* data, size_t size, int compression, std::vector<PointCloud>& pointClouds,
+    int num_cols, const CsvLoadOptions& opt, RowErrorSink& errors, const RowFilter* filter)
+{
+    DecompressBlockReader reader;
+    if (reader.Open(data, size, compression, opt.async) != 0) {
+        return 1;
+    }
+    double parseSeconds = 0.0;
+    const int parsed = ParseBlocks(reader, DecompressedSizeHint(data, size, compression), pointClouds, num_cols, opt, errors, filter, parseSeconds);
+    if (parsed != 0) {
+        return parsed;
+    }
+    const bool failed = reader.Failed();
+    reader.Close();
+    if (failed) {
+        return 1;
+    }
+    if (opt.stats) {
+        opt.stats->decompressSeconds = reader.DecompressSeconds();
+        opt.stats->bytes = reader.OutputBytes();
+    }
+    if (!opt.quiet) {
+        std::cout << "Decompress: " << CompressionName(compression) << " (stream)"
+            << ", decompress " << static_cast<long long>(reader.DecompressSeconds() * 1000) << " msec"
+            << ", parse " << static_cast<long long>(parseSeconds * 1000) << " msec"
+            << ", wait " << static_cast<long long>(reader.WaitSeconds() * 1000) << " msec" << std::endl;
+    }
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// キャッシュから読み込む　列指向のキャッシュを構造体の配列に並べ替える
+static int LoadPointClouds_Cache(const std::wstring& filename, std::vector<PointCloud>& pointClouds, int num_cols, const CsvLoadOptions& opt)
+{
+    std::vector<CsvColumnDef> columns = PointCloudSchema().columns;
+    if (num_cols <= 0 || num_cols > static_cast<int>(columns.size())) {
+        return 1;
+    }
+    columns.resize(num_cols);
+
+    CsvCacheView view;
+    if (OpenCsvCache(filename, columns, view) != 0) {
+        return 1;
+    }
+    if (!opt.quiet) {
+        std::cout << "Cache: " << view.rows << " line" << std::endl;
+    }
+    if (opt.stats) {
+        opt.stats->fromCache = true;
+        opt.stats->bytes = view.mf.size;
+    }
+
+    StatsPhase allocPhase(opt.stats ? &opt.stats->allocSeconds : nullptr);
+    pointClouds.resize(view.rows);
+    allocPhase.Stop();
+    StatsPhase parsePhase(opt.stats ? &opt.stats->parseSeconds : nullptr);
+    const long long rows = static_cast<long long>(view.rows);
+#pragma omp parallel for
+    for (long long r = 0; r < rows; ++r) {
+        for (int i = 0; i < num_cols; ++i) {
+            pointClouds[r].fields[i] = view.columns[i].As<float>()[r];
+        }
+    }
+    parsePhase.Stop();
+    StatsPhase unmapPhase(opt.stats ? &opt.stats->unmapSeconds : nullptr);
+    CloseCsvCache(view);
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 固定長の行（CsvLoadOptions::fixedWidth）
+// 行 r の先頭を r * rowLength で求めてパースする（行頭オフセットの走査・配列なし）
+// パースしながら各行の行末が改行かを確かめ、1行でも合わなければ非 0 を返す（呼び出し側が通常の方式で読み直す）
+// 不正な行は errors にまとめる（ERRORPOLICY_STRICT の判定は呼び出し側）
+static int LoadPointClouds_FixedWidth(const char* fileContent, size_t contentSize, const FixedRowLayout& layout,
+    std::vector<PointCloud>& pointClouds, int num_cols, RowErrorSink& errors, CsvLoadStats* stats)
+{
+    StatsPhase allocPhase(stats ? &stats->allocSeconds : nullptr);
+    pointClouds.resize(layout.rows);
+    allocPhase.Stop();
+
+    StatsPhase parsePhase(stats ? &stats->parseSeconds : nullptr);
+    std::atomic<bool> mismatch(false);
+    const size_t numTasks = (layout.rows + TASK_ROWS - 1) / TASK_ROWS;
+    RowErrorLog log(errors, numTasks);
+    RunStealingTasks(numTasks, [&](size_t task, int thread) {
+        if (log.Skip(task)) {
+            return;
+        }
+        const double t0 = StatsNow();
+        const size_t taskEnd = std::min(layout.rows, (task + 1) * TASK_ROWS);
+        for (size_t r = task * TASK_ROWS; r < taskEnd; ++r) {
+            if (!CheckFixedRow(fileContent, contentSize, layout, r)) {
+                mismatch.store(true, std::memory_order_relaxed);
+                break;
+            }
+            const uint32_t bad = ParseLine(fileContent + r * layout.rowLength, fileContent + FixedRowEnd(contentSize, layout, r), pointClouds[r], num_cols,
+                kCommaFields);
+            if (bad != 0 && !KeepBadRow(log, task, r, r * layout.rowLength, bad) && log.Policy() == ERRORPOLICY_STRICT) {
+                break;
+            }
+        }
+        StatsAddBusy(stats, thread, StatsNow() - t0);
+    });
+    if (mismatch.load()) {
+        return 1;
+    }
+    log.Finish(errors, nullptr);
+    if (log.Policy() == ERRORPOLICY_SKIP) {
+        pointClouds.resize(CompactRows(reinterpret_cast<unsigned char*>(pointClouds.data()), sizeof(PointCloud),
+            pointClouds.size(), log.SkippedRows()));
+    }
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// CSV をパースして読み込む（FastCsvLoad の本体）
+// 不正な行は errors にまとめる（呼び出し側はその数でキャッシュを書くかを決める）
+#define USE_AVX2
+static int LoadPointClouds_Csv(const std::wstring& filename, std::vector<PointCloud>& pointClouds, int num_cols, const CsvLoadOptions& opt,
+    RowErrorSink& errors)
+{
+    // 列の射影と行の絞り込み（指定がなければ nullptr）
+    RowFilter rowFilter;
+    const int filtered = MakeRowFilter(opt, num_cols, rowFilter);
+    if (filtered < 0) {
+        return 1;
+    }
+    const RowFilter* filter = filtered ? &rowFilter : nullptr;
+    // 区切り文字・空白・コメント行（既定以外は1パス方式で読む）
+    if (CheckDialect(opt) != 0) {
+        return 1;
+    }
+    const CsvDialect dialect = DialectOf(opt);
+    // 圧縮ファイルは非同期読み込みを使わず、マップして展開する
+    if (opt.ioBackend == IOBACKEND_ASYNC &&
+        (opt.compression == COMPRESSION_NONE || (opt.compression == COMPRESSION_AUTO && DetectFileCompression(filename) == COMPRESSION_NONE))) {
+        return LoadPointClouds_Async(filename, pointClouds, num_cols, opt, errors, filter);
+    }
+
+    CsvLoadStats* stats = opt.stats;
+
+    // ファイルをメモリにマップ (Windows: MapViewOfFile / POSIX: mmap)
+    MappedFile mf;
+    StatsPhase mapPhase(stats ? &stats->mapSeconds : nullptr);
+    if (OpenMappedFile(filename, mf, opt.map) != 0) {
+        return 1;
+    }
+    mapPhase.Stop();
+    if (stats) {
+        stats->bytes = mf.size;
+        stats->mapNumaPolicy = mf.numaPolicy;
+    }
+
+    if (!opt.quiet) {
+        std::cout.imbue(std::locale("")); // カンマ区切りの数値フォーマットを適用
+        std::cout << "FileSize: " << mf.size << " byte" << std::endl;
+    }
+
+    // ファイル内容を文字列として扱う
+    const char* fileContent = mf.data;
+    size_t contentSize = mf.size;
+
+    //--------------------------------------------------------------------------
+    // 圧縮ファイル: 独立したフレームに分けられれば並列に展開してから通常の方式で読み、
+    // 分けられなければ展開とパースを重ねる（引用符付き・固定長の行は全体を展開してから読む）
+    //--------------------------------------------------------------------------
+    const int compression = (opt.compression == COMPRESSION_AUTO) ? DetectCompression(mf.data, mf.size) : opt.compression;
+    AlignedBuffer decompressed;
+    if (compression != COMPRESSION_NONE) {
+        if (!CompressionSupported(compression)) {
+            std::cerr << CompressionName(compression) << " の展開には対応していません（ビルド時に無効）。" << std::endl;
+            CloseMappedFile(mf);
+            return 1;
+        }
+        if (stats) {
+            stats->compressedBytes = mf.size;
+        }
+        std::vector<CompressedFrame> frames;
+        if (opt.quoting != QUOTING_RFC4180 && !opt.fixedWidth && !SplitCompressedFrames(mf.data, mf.size, compression, frames)) {
+            const int result = LoadPointClouds_Compressed(mf.data, mf.size, compression, pointClouds, num_cols, opt, errors, filter);
+            StatsPhase unmapPhase(stats ? &stats->unmapSeconds : nullptr);
+            CloseMappedFile(mf);
+            return (result != 0) ? result : CheckRowErrors(errors);
+        }
+        StatsPhase decompressPhase(stats ? &stats->decompressSeconds : nullptr);
+        const int decompressResult = frames.empty()
+            ? DecompressAll(mf.data, mf.size, compression, decompressed, contentSize)
+            : DecompressFrames(mf.data, compression, frames, decompressed);
+        decompressPhase.Stop();
+        if (decompressResult != 0) {
+            CloseMappedFile(mf);
+            return 1;
+        }
+        if (!frames.empty()) {
+            contentSize = decompressed.size();
+        }
+        fileContent = reinterpret_cast<const char*>(decompressed.data());
+        if (stats) {
+            stats->bytes = contentSize;
+        }
+        if (!opt.quiet) {
+            std::cout << "Decompress: " << CompressionName(compression) << " (" << (frames.empty() ? "serial" : "parallel")
+                << ", " << frames.size() << " frames), " << contentSize << " byte" << std::endl;
+        }
+    }
+    // 行インデックスは圧縮前のファイル内の位置なので、圧縮ファイルには作らない
+    const bool writeIndex = opt.writeIndex && compression == COMPRESSION_NONE;
+
+    // ファイル全体の標本から推定行数を計算（LINEESTIMATE_MARGIN 分の1 多めに設定）
+    const RowDensity density = SampleRowDensity(fileContent, contentSize);
+    const size_t estimatedLines = density.Rows(contentSize);
+    if (!opt.quiet) {
+        std::cout << "bytesPerRow: " << density.BytesPerRow() << " byte" << std::endl;
+        std::cout << "estimatedLines: " << estimatedLines << " line" << std::endl;
+    }
+
+    // 引用符付き CSV は行頭オフセットを引用符なしでは求められないので、常に構造インデックスを使う
+    const bool quoted = (opt.quoting == QUOTING_RFC4180);
+
+    //--------------------------------------------------------------------------
+    // 固定長の行: 行頭を計算で求める（読み込み方式によらず、判定に失敗したら通常の方式）
+    // 行を絞り込む場合・区切りの指定がある場合は1パス方式で読む
+    //--------------------------------------------------------------------------
+    FixedRowLayout fixedRows;
+    if (opt.fixedWidth && !quoted && !filter && dialect.IsDefault() && DetectFixedRows(fileContent, contentSize, fixedRows)) {
+        if (LoadPointClouds_FixedWidth(fileContent, contentSize, fixedRows, pointClouds, num_cols, errors, stats) == 0) {
+            if (stats) {
+                stats->fixedRowLength = fixedRows.rowLength;
+            }
+            if (writeIndex) {
+                LineOffsetArray lineOffsets;
+                InitLineOffsetArray(lineOffsets, fixedRows.rows, [&](size_t r) { return r * fixedRows.rowLength; });
+                for (size_t r = 0; r < fixedRows.rows; ++r) {
+                    lineOffsets.Set(r, r * fixedRows.rowLength);
+                }
+                WriteCsvIndex(filename, lineOffsets);
+            }
+            StatsPhase unmapPhase(stats ? &stats->unmapSeconds : nullptr);
+            CloseMappedFile(mf);
+            return CheckRowErrors(errors);
+        }
+        if (!opt.quiet) {
+            std::cout << "fixedWidth: 行の長さが一定でないため通常の方式で読み込みます" << std::endl;
+        }
+    }
+
+    // 1パス方式・構造インデックスは改行文字（'\n' / '\r'）で行を区切るので LF / CRLF / CR の混在も読める
+    // 引用符付きは改行の有無・種類によらず常に構造インデックスで読む
+    if (opt.loadMode == LOADMODE_FUSED || opt.loadMode == LOADMODE_STRUCTURAL || quoted || filter || !dialect.IsDefault()) {
+        //--------------------------------------------------------------------------
+        // 1パス方式: 改行探索とパースを同時に行う（lineOffsets 不要）
+        // 射影・絞り込み・区切りの指定もこちら（各チャンクが条件を満たす行だけをアリーナに詰めて書く）
+        //--------------------------------------------------------------------------
+        const bool structural = quoted || opt.loadMode == LOADMODE_STRUCTURAL;
+        ScanBlockFn scan = structural ? SelectDialectScan(opt.simdLevel, dialect) : nullptr;
+        LoadPointClouds_Fused(fileContent, contentSize, pointClouds, num_cols, estimatedLines, scan, quoted, dialect, errors, stats,
+            (opt.numa & NUMA_FIRSTTOUCH) != 0, filter);
+        StatsPhase unmapPhase(stats ? &stats->unmapSeconds : nullptr);
+        CloseMappedFile(mf);
+        return CheckRowErrors(errors);
+    }
+
+    //--------------------------------------------------------------------------
+    // 1) 行頭オフセットの取得
+    // 固定長の場合、この処理は省ける（CsvLoadOptions::fixedWidth）
+    //--------------------------------------------------------------------------
+    // 行頭オフセットはブロックごとの基準位置 + 32ビットの差（LineOffsetArray）で持つ
+    LineOffsetArray lineOffsets;
+#ifndef USE_AVX2
+    //AVX2不使用
+    {
+        std::vector<size_t> scalarOffsets;
+
+        // 推定行数で lineOffsets を事前予約
+        StatsPhase reservePhase(stats ? &stats->allocSeconds : nullptr);
+        scalarOffsets.reserve(estimatedLines);
+        reservePhase.Stop();
+        GetLineOffsets(fileContent, contentSize, scalarOffsets);
+        AssignLineOffsets(lineOffsets, scalarOffsets.data(), scalarOffsets.size());
+    }
+#else
+    //AVX2使用　タスクごとのアリーナから累積和の位置へ直接書き込む（結合時の再確保なし）
+    ScanLineOffsets(fileContent, contentSize, lineOffsets, stats);
+#endif
+    const size_t numLines = lineOffsets.size;
+    // 行インデックスとして保存（FastCsvLoadRows / FastCsvLoadSampled で再利用）
+    if (writeIndex) {
+        WriteCsvIndex(filename, lineOffsets);
+    }
+    //--------------------------------------------------------------------------
+    // 2) 結果を格納するベクターを行数分確保
+    //--------------------------------------------------------------------------
+    StatsPhase allocPhase(stats ? &stats->allocSeconds : nullptr);
+    ResizeOutput(pointClouds, numLines, (opt.numa & NUMA_FIRSTTOUCH) != 0);
+    allocPhase.Stop();
+
+    //--------------------------------------------------------------------------
+    // 3) 各行を並列でパース（OpenMP 使用）
+    // TASK_ROWS 行ずつのタスクをワークスティーリングで分配（行の長さが偏っていても均等になる）
+    //--------------------------------------------------------------------------
+    //PointCloud p; // 一行分を格納する構造体
+    StatsPhase parsePhase(stats ? &stats->parseSeconds : nullptr);
+    const size_t numTasks = (numLines + TASK_ROWS - 1) / TASK_ROWS;
+    RowErrorLog log(errors, numTasks); // 行番号は全体の行番号のまま記録する
+    RunStealingTasks(numTasks, [&](size_t task, int thread) {
+        if (log.Skip(task)) {
+            return;
+        }
+        const double t0 = StatsNow();
+        const size_t taskEnd = std::min(numLines, (task + 1) * TASK_ROWS);
+        // 行の終了位置は次の行の開始位置なので、オフセットは1行につき1回だけ読む
+        size_t nextPos = lineOffsets[task * TASK_ROWS];
+        for (size_t lineIndex = task * TASK_ROWS; lineIndex < taskEnd; ++lineIndex)
+        {
+            // この行の開始位置と終了位置
+            size_t startPos = nextPos;
+            size_t endPos = (lineIndex + 1 < numLines)
+                ? lineOffsets[lineIndex + 1]
+                : contentSize;
+            nextPos = endPos;
+
+            // 一行分を出力へ直接パース
+            PointCloud& p = pointClouds[lineIndex];
+            const uint32_t bad = ParseLine(&fileContent[startPos], &fileContent[endPos], p, num_cols, kCommaFields);
+            if (bad != 0 && !KeepBadRow(log, task, lineIndex, startPos, bad) && log.Policy() == ERRORPOLICY_STRICT) {
+                break;
+            }
+
+#ifdef _DEBUG
+            std::cout << p.fields[0] << std::endl;
+            std::cout << p.x << std::endl;
+#endif
+        }
+        StatsAddBusy(stats, thread, StatsNow() - t0);
+    });
+    parsePhase.Stop();
+
+    // 不正な行をまとめ、ERRORPOLICY_SKIP の場合は除いた行を詰める
+    log.Finish(errors, nullptr);
+    if (log.Policy() == ERRORPOLICY_SKIP) {
+        pointClouds.resize(CompactRows(reinterpret_cast<unsigned char*>(pointClouds.data()), sizeof(PointCloud),
+            pointClouds.size(), log.SkippedRows()));
+    }
+
+    // メモリマップの後始末
+    StatsPhase unmapPhase(stats ? &stats->unmapSeconds : nullptr);
+    CloseMappedFile(mf);
+
+    return CheckRowErrors(errors); // ERRORPOLICY_STRICT で不正な行があれば非 0
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// @brief 1行10要素のCSV ファイルを読み込み、pointClouds に格納する
+// @param[in]  filename     入力ファイルパス（ワイド文字列）
+// @param[out] pointClouds  読み込んだ点群データを格納するベクター（失敗時は空）
+// @param[in]  num_cols     1行の列数
+// @param[in]  opt          読み込みオプション（メモリマップのページフォルト戦略など）
+// @return                  成功時は 0、失敗時は非 0
+int FastCsvLoad(const std::wstring& filename, std::vector<PointCloud>& pointClouds, int num_cols, const CsvLoadOptions& opt)
+{
+    CsvStatsContext statsCtx;
+    StatsBegin(opt.stats, opt.perfCounters, statsCtx);
+    NumaPinState pin;
+    if (opt.numa & NUMA_PIN) {
+        NumaPinThreads(pin);
+    }
+    StatsNuma(opt.stats, opt.numa, pin.pinned);
+
+    // 不正な行の扱いと記録先（キャッシュから読んだ場合は不正な行なしのまま）
+    RowErrorSink errors = MakeRowErrorSink(opt.errorPolicy, opt.errors, opt.maxErrorRecords);
+
+    // 有効なキャッシュがあればパースしない（キャッシュは全列・全行なので、射影・絞り込みでは使わない）
+    int result = 1;
+    // 区切りの指定がある場合も、キャッシュに区切りは記録されないので使わない
+    const bool cacheable = (opt.columnMask == 0 && opt.where.empty() && DialectOf(opt).IsDefault());
+    const bool fromCache = (opt.cacheMode != CACHE_NONE && cacheable && LoadPointClouds_Cache(filename, pointClouds, num_cols, opt) == 0);
+    if (!fromCache) {
+        result = LoadPointClouds_Csv(filename, pointClouds, num_cols, opt, errors);
+    }
+    NumaUnpinThreads(pin);
+    if (opt.stats) {
+        opt.stats->rows = (fromCache || result == 0) ? pointClouds.size() : 0;
+    }
+    StatsEnd(opt.stats, statsCtx);
+    if (fromCache) {
+        return 0;
+    }
+    if (result != 0) {
+        // 2パス方式は先に全行分を確保してからパースするので、途中で失敗した結果を残さない
+        pointClouds.clear();
+        return 1;
+    }
+
+    // キャッシュは不正な行がなかった読み込みからだけ書く（errorPolicy によらず同じ結果になる）
+    // キャッシュの書き出しに失敗しても読み込み結果は有効
+    if (opt.cacheMode == CACHE_READWRITE && cacheable && errors.count == 0) {
+        WriteCsvCache(filename, pointClouds, num_cols);
+    }
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 行インデックスを開く（ない・古い場合は作り直す）
+static int OpenOrBuildCsvIndex(const std::wstring& filename, CsvIndex& index, const CsvLoadOptions& opt)
+{
+    // 行番号はファイルの行なので、コメント行を読み飛ばすと合わなくなる
+    if (opt.comment != COMMENT_NONE) {
+        std::cerr << "行インデックスによる読み込みは comment に対応していません。" << std::endl;
+        return 1;
+    }
+    if (CheckDialect(opt) != 0) {
+        return 1;
+    }
+    if (OpenCsvIndex(filename, index) == 0) {
+        return 0;
+    }
+    if (BuildCsvIndex(filename, opt) != 0) {
+        return 1;
+    }
+    return OpenCsvIndex(filename, index);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// @brief 行インデックスを使い、[beginRow, endRow) の行だけを読み込む
+// ファイルは必要な範囲だけをマップする
+// @return 成功時は 0、失敗時は非 0
+int FastCsvLoadRows(const std::wstring& filename, size_t beginRow, size_t endRow, std::vector<PointCloud>& pointClouds, int num_cols, const CsvLoadOptions& opt)
+{
+    pointClouds.clear();
+    CsvIndex index;
+    if (OpenOrBuildCsvIndex(filename, index, opt) != 0) {
+        return 1;
+    }
+    endRow = std::min(endRow, index.rows);
+    if (beginRow >= endRow) {
+        CloseCsvIndex(index);
+        return 0;
+    }
+
+    const uint64_t first = index.Offset(beginRow);
+    const uint64_t last = index.Offset(endRow);
+    MappedFile mf;
+    MappedView view;
+    if (OpenFileForViews(filename, mf, opt.map) != 0 ||
+        MapFileView(mf, first, static_cast<size_t>(last - first), view, opt.map) != 0) {
+        CloseMappedFile(mf);
+        CloseCsvIndex(index);
+        return 1;
+    }
+
+    const long long rows = static_cast<long long>(endRow - beginRow);
+    pointClouds.resize(static_cast<size_t>(rows));
+    WithFields(DialectOf(opt), [&](const auto& f) {
+#pragma omp parallel for
+        for (long long r = 0; r < rows; ++r) {
+            const size_t row = beginRow + static_cast<size_t>(r);
+            ParseLine(view.data + (index.Offset(row) - first), view.data + (index.Offset(row + 1) - first), pointClouds[r], num_cols, f);
+        }
+    });
+
+    UnmapFileView(view);
+    CloseMappedFile(mf);
+    CloseCsvIndex(index);
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// @brief 行インデックスを使い、stride 行ごとに1行を読み込む（プレビュー用）
+// 読む行のページだけがフォルトするよう、先読みなしでマップする
+// @return 成功時は 0、失敗時は非 0
+int FastCsvLoadSampled(const std::wstring& filename, size_t stride, std::vector<PointCloud>& pointClouds, int num_cols, const CsvLoadOptions& opt)
+{
+    stride = std::max<size_t>(stride, 1);
+    pointClouds.clear();
+    CsvIndex index;
+    if (OpenOrBuildCsvIndex(filename, index, opt) != 0) {
+        return 1;
+    }
+
+    MapOptions mapOpt = opt.map;
+    mapOpt.advice = MAPADVICE_RANDOM;
+    MappedFile mf;
+    if (OpenMappedFile(filename, mf, mapOpt) != 0) {
+        CloseCsvIndex(index);
+        return 1;
+    }
+
+    const long long rows = static_cast<long long>((index.rows + stride - 1) / stride);
+    pointClouds.resize(static_cast<size_t>(rows));
+    WithFields(DialectOf(opt), [&](const auto& f) {
+#pragma omp parallel for
+        for (long long r = 0; r < rows; ++r) {
+            const size_t row = static_cast<size_t>(r) * stride;
+            ParseLine(mf.data + index.Offset(row), mf.data + index.Offset(row + 1), pointClouds[r], num_cols, f);
+        }
+    });
+
+    CloseMappedFile(mf);
+    CloseCsvIndex(index);
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// @brief CSV を窓ごとにマップしながら読み込み、batchRows 行ずつ onBatch に渡す
+// ピークメモリは窓（マップ）+ 窓内のパース結果 + 1バッチ分に抑える
+// @param[in]  filename     入力ファイルパス（ワイド文字列）
+// @param[in]  num_cols     1行の列数
+// @param[in]  onBatch      バッチごとに呼ばれるコールバック（非 0 を返すと中断）
+// @param[in]  opt          読み込みオプション（memoryBudget, batchRows）
+// @return                  成功時は 0、失敗時は非 0（中断時は onBatch の戻り値）
+int FastCsvLoadStream(const std::wstring& filename, int num_cols, const PointCloudBatchFn& onBatch, const CsvLoadOptions& opt)
+{
+    if (opt.quoting == QUOTING_RFC4180) {
+        std::cerr << "ストリーミング読み込みは引用符付き CSV に対応していません。" << std::endl;
+        return 1;
+    }
+    if (CheckDialect(opt) != 0) {
+        return 1;
+    }
+    const CsvDialect dialect = DialectOf(opt);
+
+    MappedFile mf;
+    if (OpenFileForViews(filename, mf, opt.map) != 0) {
+        return 1;
+    }
+    const size_t fileSize = mf.size;
+    const size_t granularity = MapGranularity();
+    const size_t batchRows = std::max<size_t>(opt.batchRows, 1);
+
+    // 先頭の一部だけをマップして行の密度を求める
+    RowDensity density;
+    {
+        MappedView probe;
+        if (MapFileView(mf, 0, std::min<size_t>(fileSize, 1u << 20), probe, opt.map) != 0) {
+            CloseMappedFile(mf);
+            return 1;
+        }
+        if (opt.compression != COMPRESSION_NONE && DetectCompression(probe.data, probe.size) != COMPRESSION_NONE) {
+            std::cerr << "ストリーミング読み込みは圧縮ファイルに対応していません。" << std::endl;
+            UnmapFileView(probe);
+            CloseMappedFile(mf);
+            return 1;
+        }
+        density = SampleRowDensity(probe.data, probe.size);
+        UnmapFileView(probe);
+    }
+    const size_t bytesPerRow = std::max<size_t>(density.BytesPerRow(), 2);
+
+    // 窓の大きさ: 窓 W バイトに対しパース結果は (W / 1行のバイト数) 行
+    // 1パス方式はチャンク別の結果と結合後の結果を同時に持つので 2 倍（と見積もりの余裕）で見積もる
+    const size_t batchBytes = batchRows * sizeof(PointCloud);
+    const size_t budget = (opt.memoryBudget > batchBytes + granularity) ? opt.memoryBudget - batchBytes : granularity;
+    const size_t outPerRow = 2 * sizeof(PointCloud) + 2 * sizeof(PointCloud) / LINEESTIMATE_MARGIN + 1;
+    size_t window = budget / (bytesPerRow + outPerRow) * bytesPerRow;
+    window = std::max(window / granularity * granularity, granularity);
+
+    if (!opt.quiet) {
+        std::cout.imbue(std::locale("")); // カンマ区切りの数値フォーマットを適用
+        std::cout << "FileSize: " << fileSize << " byte" << std::endl;
+        std::cout << "StreamWindow: " << window << " byte" << std::endl;
+    }
+
+    ScanBlockFn scan = (opt.loadMode == LOADMODE_STRUCTURAL) ? SelectDialectScan(opt.simdLevel, dialect) : nullptr;
+    RowErrorSink errors = MakeRowErrorSink(opt.errorPolicy, opt.errors, opt.maxErrorRecords);
+    RowFilter rowFilter;
+    const int filtered = MakeRowFilter(opt, num_cols, rowFilter);
+    if (filtered < 0) {
+        CloseMappedFile(mf);
+        return 1;
+    }
+    std::vector<PointCloud> rows;  // 窓内のパース結果（窓ごとに再利用）
+    std::vector<PointCloud> batch; // 窓をまたぐ端数をためるバッファ
+    batch.reserve(batchRows);
+    size_t firstRow = 0;
+    int ret = 0;
+
+    uint64_t offset = 0;
+    size_t windowSize = window;
+    while (offset < fileSize && ret == 0) {
+        MappedView view;
+        if (MapFileView(mf, offset, windowSize, view, opt.map) != 0) {
+            CloseMappedFile(mf);
+            return 1;
+        }
+
+        // 最後の窓以外は最後の改行文字までを処理し、途切れた行は次の窓で読み直す
+        size_t used = view.size;
+        if (offset + view.size < fileSize) {
+            const char* p = view.data + view.size;
+            while (p > view.data && p[-1] != '\n' && p[-1] != '\r') {
+                --p;
+            }
+            if (p == view.data) {
+                // 1行が窓より長い　窓を広げて読み直す
+                UnmapFileView(view);
+                windowSize *= 2;
+                continue;
+            }
+            used = static_cast<size_t>(p - view.data);
+        }
+
+        const size_t estimatedLines = density.Rows(used);
+        const int parsed = LoadPointClouds_Fused(view.data, used, rows, num_cols, estimatedLines, scan, false, dialect, errors,
+            nullptr, false, filtered ? &rowFilter : nullptr);
+        UnmapFileView(view);
+        if (parsed != 0) {
+            CloseMappedFile(mf);
+            return CheckRowErrors(errors);
+        }
+        offset += used;
+        windowSize = window;
+
+        // batchRows 行ずつ渡す　端数があるときだけ batch にコピーする
+        size_t i = 0;
+        while (i < rows.size() && ret == 0) {
+            if (batch.empty() && rows.size() - i >= batchRows) {
+                ret = onBatch(rows.data() + i, batchRows, firstRow);
+                i += batchRows;
+                firstRow += batchRows;
+                continue;
+            }
+            const size_t take = std::min(batchRows - batch.size(), rows.size() - i);
+            batch.insert(batch.end(), rows.begin() + i, rows.begin() + i + take);
+            i += take;
+            if (batch.size() == batchRows) {
+                ret = onBatch(batch.data(), batch.size(), firstRow);
+                firstRow += batch.size();
+                batch.clear();
+            }
+        }
+    }
+
+    // 最後の端数
+    if (ret == 0 && !batch.empty()) {
+        ret = onBatch(batch.data(), batch.size(), firstRow);
+    }
+
+    CloseMappedFile(mf);
+    return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 複数ファイルの一括読み込み（FastCsvLoadBatch の本体）
+// 全ファイルのチャンクを1つのタスク列にし、1つの OpenMP 並列領域（batchThreads スレッド）でワークスティーリングする。
+// 小さいファイルはファイル全体を1タスク、大きいファイルは行頭に揃えたチャンクに分けるので、
+// 小さいファイルが並列に進み、大きいファイルのチャンクとも重なる。
+// 結果はタスクごとのアリーナに書き、ファイルごと・タスクごとの行数の累積和で格納位置を決める。
+struct BatchLoad {
+    size_t              numFiles = 0;
+    std::vector<size_t> fileTaskBegin; // ファイル f のタスクは [fileTaskBegin[f], fileTaskBegin[f + 1])
+    std::vector<size_t> taskFile;      // タスクのファイル番号
+    std::vector<int>    taskThread;    // タスクをパースしたスレッド
+    TaskArena           arena;         // タスクごとの PointCloud
+};
+
+static int LoadPointClouds_Batch(const std::vector<std::wstring>& filenames, int num_cols, const CsvLoadOptions& opt,
+    BatchLoad& batch)
+{
+    if (opt.quoting == QUOTING_RFC4180) {
+        std::cerr << "一括読み込みは引用符付き CSV に対応していません。" << std::endl;
+        return 1;
+    }
+    if (CheckDialect(opt) != 0) {
+        return 1;
+    }
+    const CsvDialect dialect = DialectOf(opt);
+    RowFilter rowFilter;
+    const int filtered = MakeRowFilter(opt, num_cols, rowFilter);
+    if (filtered < 0) {
+        return 1;
+    }
+    CsvLoadStats* stats = opt.stats;
+    const int numThreads = (opt.batchThreads > 0) ? opt.batchThreads : omp_get_max_threads();
+    const long long numFiles = static_cast<long long>(filenames.size());
+    batch.numFiles = filenames.size();
+
+    // 全ファイルを並列にマップ
+    StatsPhase mapPhase(stats ? &stats->mapSeconds : nullptr);
+    std::vector<MappedFile> files(filenames.size());
+    std::vector<int> opened(filenames.size(), 0);
+#pragma omp parallel for schedule(dynamic, 1) num_threads(numThreads)
+    for (long long f = 0; f < numFiles; ++f) {
+        opened[f] = (OpenMappedFile(filenames[f], files[f], opt.map) == 0) ? 1 : 0;
+    }
+    mapPhase.Stop();
+    auto closeFiles = [&]() {
+        StatsPhase unmapPhase(stats ? &stats->unmapSeconds : nullptr);
+#pragma omp parallel for schedule(dynamic, 1) num_threads(numThreads)
+        for (long long f = 0; f < numFiles; ++f) {
+            if (opened[f]) {
+                CloseMappedFile(files[f]);
+            }
+        }
+    };
+    uint64_t totalBytes = 0;
+    for (long long f = 0; f < numFiles; ++f) {
+        if (!opened[f]) {
+            closeFiles();
+            return 1;
+        }
+        if (opt.compression != COMPRESSION_NONE && DetectCompression(files[f].data, files[f].size) != COMPRESSION_NONE) {
+            std::cerr << "一括読み込みは圧縮ファイルに対応していません（" << f << " 番目のファイル）。" << std::endl;
+            closeFiles();
+            return 1;
+        }
+        totalBytes += files[f].size;
+    }
+    if (stats) {
+        stats->bytes = totalBytes;
+    }
+
+    // チャンクの大きさ: TASK_TARGET_BYTES、全体が小さい場合はスレッドあたり TASK_MIN_PER_THREAD 個になるよう細かく
+    const uint64_t chunkBytes = std::max<uint64_t>(TASK_MIN_BYTES,
+        std::min<uint64_t>(TASK_TARGET_BYTES, totalBytes / (static_cast<uint64_t>(numThreads) * TASK_MIN_PER_THREAD)));
+    std::vector<size_t> taskBegin;
+    std::vector<size_t> taskEnd;
+    std::vector<size_t> taskCapacity; // アリーナの見積もり行数
+    batch.fileTaskBegin.assign(1, 0);
+    batch.taskFile.clear();
+    for (size_t f = 0; f < batch.numFiles; ++f) {
+        const MappedFile& mf = files[f];
+        const size_t n = std::max<size_t>(static_cast<size_t>(mf.size / chunkBytes), 1);
+        const RowDensity density = SampleRowDensity(mf.data, mf.size);
+        size_t begin = 0;
+        for (size_t k = 0; k < n; ++k) {
+            const size_t end = (k + 1 == n) ? mf.size : AlignToLineStart(mf.data, mf.size, mf.size / n * (k + 1));
+            taskBegin.push_back(begin);
+            taskEnd.push_back(end);
+            taskCapacity.push_back(density.Rows(end - begin) + 16);
+            batch.taskFile.push_back(f);
+            begin = end;
+        }
+        batch.fileTaskBegin.push_back(taskBegin.size());
+    }
+    const size_t numTasks = taskBegin.size();
+
+    // 全タスクを1つの並列領域で処理する
+    StatsPhase allocPhase(stats ? &stats->allocSeconds : nullptr);
+    batch.arena.Init(taskCapacity, sizeof(PointCloud));
+    allocPhase.Stop();
+    StatsPhase parsePhase(stats ? &stats->parseSeconds : nullptr);
+    RowErrorSink errors = MakeRowErrorSink(opt.errorPolicy, opt.errors, opt.maxErrorRecords);
+    RowErrorLog log(errors, numTasks);
+    ScanBlockFn scan = (opt.loadMode == LOADMODE_STRUCTURAL) ? SelectDialectScan(opt.simdLevel, dialect) : nullptr;
+    std::vector<size_t> taskRows(numTasks, 0);
+    batch.taskThread.assign(numTasks, -1);
+    RunStealingTasks(numTasks, [&](size_t t, int thread) {
+        if (log.Skip(t)) {
+            return;
+        }
+        const double t0 = StatsNow();
+        batch.taskThread[t] = thread;
+        const char* data = files[batch.taskFile[t]].data;
+        taskRows[t] = ParseChunkRows(data, data + taskBegin[t], data + taskEnd[t], num_cols, scan, dialect, batch.arena, log, t,
+            filtered ? &rowFilter : nullptr);
+        StatsAddBusy(stats, thread, StatsNow() - t0);
+    }, numThreads);
+    parsePhase.Stop();
+    closeFiles();
+
+    // 不正な行の行番号はファイルごとに数える
+    std::vector<size_t> rowBase(numTasks, 0);
+    for (size_t f = 0; f < batch.numFiles; ++f) {
+        size_t rows = 0;
+        for (size_t t = batch.fileTaskBegin[f]; t < batch.fileTaskBegin[f + 1]; ++t) {
+            rowBase[t] = rows;
+            rows += taskRows[t];
+        }
+    }
+    log.Finish(errors, &rowBase, &batch.taskFile);
+    if (errors.policy == ERRORPOLICY_STRICT && errors.count > 0) {
+        std::cerr << "FastCsvLoadBatch: " << errors.first.file << " 番目のファイル" << std::endl;
+        return CheckRowErrors(errors);
+    }
+    return 0;
+}
+
+// タスクの結果を結合先へコピーする（NUMA_FIRSTTOUCH の場合はパースしたスレッドが書き込む）
+template <class CopyTask>
+static void CopyBatchTasks(const BatchLoad& batch, const CsvLoadOptions& opt, CopyTask&& copyTask)
+{
+    StatsPhase mergePhase(opt.stats ? &opt.stats->mergeSeconds : nullptr);
+    if (opt.numa & NUMA_FIRSTTOUCH) {
+        RunOwnedTasks(batch.taskThread, copyTask);
+        return;
+    }
+    const long long numTasks = static_cast<long long>(batch.taskFile.size());
+#pragma omp parallel for schedule(dynamic, 1) num_threads((opt.batchThreads > 0) ? opt.batchThreads : omp_get_max_threads())
+    for (long long t = 0; t < numTasks; ++t) {
+        copyTask(static_cast<size_t>(t));
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// @brief 複数の CSV ファイルを1つのスレッド数の枠で並列に読み込み、ファイルごとに格納する
+// @param[in]  filenames  入力ファイルパスの一覧
+// @param[out] results    ファイルごとの点群（filenames と同じ順序）
+// @param[in]  num_cols   1行の列数
+// @param[in]  opt        読み込みオプション（batchThreads, loadMode, errorPolicy など）
+// @return                成功時は 0、失敗時は非 0
+int FastCsvLoadBatch(const std::vector<std::wstring>& filenames, std::vector<std::vector<PointCloud>>& results, int num_cols, const CsvLoadOptions& opt)
+{
+    CsvStatsContext statsCtx;
+    StatsBegin(opt.stats, opt.perfCounters, statsCtx);
+    NumaPinState pin;
+    if (opt.numa & NUMA_PIN) {
+        NumaPinThreads(pin);
+    }
+    StatsNuma(opt.stats, opt.numa, pin.pinned);
+
+    BatchLoad batch;
+    const int result = LoadPointClouds_Batch(filenames, num_cols, opt, batch);
+    results.clear();
+    if (result == 0) {
+        // タスクごとの行数を累積和し、ファイル f の先頭タスクの位置を引いてファイル内の位置にする
+        const std::vector<size_t> base = batch.arena.Offsets();
+        StatsPhase allocPhase(opt.stats ? &opt.stats->allocSeconds : nullptr);
+        results.resize(batch.numFiles);
+        for (size_t f = 0; f < batch.numFiles; ++f) {
+            ResizeOutput(results[f], base[batch.fileTaskBegin[f + 1]] - base[batch.fileTaskBegin[f]], (opt.numa & NUMA_FIRSTTOUCH) != 0);
+        }
+        allocPhase.Stop();
+        CopyBatchTasks(batch, opt, [&](size_t t) {
+            const size_t f = batch.taskFile[t];
+            batch.arena.CopyTask(t, reinterpret_cast<unsigned char*>(results[f].data() + (base[t] - base[batch.fileTaskBegin[f]])));
+        });
+        if (opt.stats) {
+            opt.stats->rows = base.back();
+        }
+    }
+    NumaUnpinThreads(pin);
+    StatsEnd(opt.stats, statsCtx);
+    return result;
+}
+
+// @brief 複数の CSV ファイルを1つのスレッド数の枠で並列に読み込み、ファイル順につなげて格納する
+// @param[out] pointClouds  全ファイルの点群（ファイル順）
+// @param[out] fileRows     ファイル f の行は [fileRows[f], fileRows[f + 1])（ファイル数 + 1 個）
+// @return                  成功時は 0、失敗時は非 0
+int FastCsvLoadBatch(const std::vector<std::wstring>& filenames, std::vector<PointCloud>& pointClouds, std::vector<size_t>& fileRows, int num_cols, const CsvLoadOptions& opt)
+{
+    CsvStatsContext statsCtx;
+    StatsBegin(opt.stats, opt.perfCounters, statsCtx);
+    NumaPinState pin;
+    if (opt.numa & NUMA_PIN) {
+        NumaPinThreads(pin);
+    }
+    StatsNuma(opt.stats, opt.numa, pin.pinned);
+
+    BatchLoad batch;
+    const int result = LoadPointClouds_Batch(filenames, num_cols, opt, batch);
+    pointClouds.clear();
+    fileRows.clear();
+    if (result == 0) {
+        const std::vector<size_t> base = batch.arena.Offsets();
+        for (size_t f = 0; f <= batch.numFiles; ++f) {
+            fileRows.push_back(base[batch.fileTaskBegin[f]]);
+        }
+        StatsPhase allocPhase(opt.stats ? &opt.stats->allocSeconds : nullptr);
+        ResizeOutput(pointClouds, base.back(), (opt.numa & NUMA_FIRSTTOUCH) != 0);
+        allocPhase.Stop();
+        CopyBatchTasks(batch, opt, [&](size_t t) {
+            batch.arena.CopyTask(t, reinterpret_cast<unsigned char*>(pointClouds.data() + base[t]));
+        });
+        if (opt.stats) {
+            opt.stats->rows = base.back();
+        }
+    }
+    NumaUnpinThreads(pin);
+    StatsEnd(opt.stats, statsCtx);
+    return result;
+}
+
+#include <fstream>
+#include <sstream>
+#include <mutex>
+//#define _FASTFLOAT fast floatを使う場合は有効にする。
+//////////////////////////////////////////////////////////////////////////////////////////////
+// @brief 1行10要素のCSV ファイルを読み込み、pointClouds に格納する
+// @param[in]  filename     入力ファイルパス（ワイド文字列）
 // @param[out] pointClouds  読み込んだ点群データを格納するベクター
 // @return                  成功時は 0、失敗時は非 0
 int SlowCsvLoad(const std::wstring& filePath, std::vector<PointCloud>& pointClouds)
@@ -575,7 +2170,11 @@ int SlowCsvLoad(const std::wstring& filePath, std::vector<PointCloud>& pointClou
     //DbgOutW _o;
 
     // CSVファイルのパスを指定します
+#ifdef _WIN32
     std::ifstream file(filePath);
+#else
+    std::ifstream file(NarrowPath(filePath));
+#endif
     if (!file.is_open())
     {
         std::cerr << "ファイルを開くことができませんでした。\n";
@@ -652,7 +2251,7 @@ int SlowCsvLoad(const std::wstring& filePath, std::vector<PointCloud>& pointClou
             std::vector<PointCloud> localClouds;
 
 #pragma omp for nowait
-            for (int i = 0; i < lines.size(); ++i) {
+            for (long long i = 0; i < static_cast<long long>(lines.size()); ++i) {
                 std::stringstream ss(lines[i]);
                 std::string item;
                 std::vector<float> values;
@@ -1,7 +1,17 @@
 #pragma once
+#include <vector>
+#include <string>
+#include <functional>
+#include "MappedFile.h"
+#include "AlignedBuffer.h"
+#include "AsyncReader.h"
+#include "CsvStats.h"
+#include "CsvErrors.h"
+#include "CsvDialect.h"
+#include "CsvCompressed.h"
+#include "NumaTopology.h"
 
 #define COLUMN_SIZE 10 //CSV̗񐔂Ⴄꍇ͂ύX
-#define MARGIN_RATIO 1.01 //mۂ̗̎]T
 
 //////////////////////////////////////////////////////////////////////////////////////////////
 // ǂݍ݃f[^̍\̒`
@@ -24,9 +34,212 @@ struct PointCloud {
 
 
 
+//////////////////////////////////////////////////////////////////////////////////////////////
+// ǂݍ݃IvV
+#define LOADMODE_TWOPASS 0 // sItZbg擾Ăp[Xi]j
+#define LOADMODE_FUSED   1 // sTƃp[X1pXōsilineOffsets Ȃj
+#define LOADMODE_STRUCTURAL 2 // 1pX + \CfbNXi؂Es64oCgPʂ̃rbg}XNŎ擾j
+
+// \CfbNX̖߃ZbgiCPUID ŎsɑIj
+#define SIMD_AUTO     0 // s CPU Ŏgŏ
+#define SIMD_SSE42    1
+#define SIMD_AVX2     2
+#define SIMD_AVX512BW 3
+
+// p̈
+#define QUOTING_NONE    0 // pʈȂiőj
+#define QUOTING_RFC4180 1 // "..."  ',' Ɖs؂Ƃ݂ȂȂi\CfbNXŕ񏈗j
+
+// ͌oH
+#define IOBACKEND_MMAP  0 // }bviy[WtHgœǂݍށj
+#define IOBACKEND_ASYNC 1 // ǂ݃Xbhɂ񓯊ubNǂݍ݁iǂݍ݂ƃp[Xd˂j
+
+// p[Xς݃oCiLbVi<csv>.fccj̈
+#define CACHE_NONE      0 // gȂ
+#define CACHE_READ      1 // LȃLbV CSV p[Xɓǂ
+#define CACHE_READWRITE 2 // CACHE_READ ɉAp[Xꍇ̓LbVoisȍsȂꍇ̂݁j
+
+// s̍i荞݁iCsvLoadOptions::wherej̔r@fields[column]  value ׂ
+#define PREDICATE_LT 0 // <
+#define PREDICATE_LE 1 // <=
+#define PREDICATE_GT 2 // >
+#define PREDICATE_GE 3 // >=
+#define PREDICATE_EQ 4 // ==
+#define PREDICATE_NE 5 // !=
+
+struct CsvPredicate {
+    int   column = 0;            // PointCloud::fields ̓Yi0 n܂j
+    int   op = PREDICATE_GE;
+    float value = 0.0f;
+};
+
+struct CsvLoadOptions {
+    MapOptions map;                         // }bṽy[WtHg헪
+    int        loadMode = LOADMODE_TWOPASS; // ǂݍݕ
+    int        simdLevel = SIMD_AUTO;       // LOADMODE_STRUCTURAL ̖߃Zbg
+    int        quoting = QUOTING_NONE;      // p̈iQUOTING_RFC4180 ͓ǂݍݕɂ炸\CfbNXgj
+    int        ioBackend = IOBACKEND_MMAP;  // ͌oHiIOBACKEND_ASYNC  FastCsvLoad ̂ݑΉAp͖Ήj
+    AsyncReadOptions async;                 // IOBACKEND_ASYNC ̃ubNTCYEobt@
+    int        cacheMode = CACHE_NONE;      // oCiLbViFastCsvLoad / FastCsvLoadColumnsj
+    bool       writeIndex = false;          // 2pXŋ߂sItZbgsCfbNXi<csv>.fcijɕۑ
+    bool       fixedWidth = false;          // SsoCgȂsvZŋ߂issłȂsΒʏ̕œǂݒj
+    int        compression = COMPRESSION_AUTO; // kt@Cigzip / zstdj̈iFastCsvLoad / FastCsvLoadColumns ̂ݓWJłj
+                                            // FastCsvLoadColumns ̓t[ɕȂ1Xg[ɑS̓WJĂp[X
+
+    // sȍsiǂ߂ȂtB[hE̕sj̈
+    int        errorPolicy = ERRORPOLICY_FILLNAN; // ERRORPOLICY_FILLNAN / ERRORPOLICY_SKIP / ERRORPOLICY_STRICT
+    CsvLoadErrors* errors = nullptr;        // w肷ƕsȍs̐ƈʒuisԍEoCgʒuEj
+    size_t     maxErrorRecords = 100;       // errors ɋL^s̏iׂ͂Đj
+
+    // ̎ˉeƍs̍i荞݁iFastCsvLoad / FastCsvLoadStream / FastCsvLoadBatchj
+    // w肷1pXœǂ݁A𖞂s`NƂɋl߂ďo͂iLbVEŒ蒷̍s͎gȂj
+    uint32_t   columnMask = 0;              // ǂޗibit i  fields[i]A0 Ȃ炷ׂāj@ǂ܂Ȃ NaN
+    std::vector<CsvPredicate> where;        // ׂĂ𖞂so͂i̗ columnMask ɂȂĂǂށj
+
+    // ؂E󔒁ERgsiFastCsvLoad / FastCsvLoadStream / FastCsvLoadBatch / FastCsvLoadColumnsAsCfbNX comment ȊOj
+    // ȊOw肷1pXœǂށiLbVEŒ蒷̍s͎gȂj
+    // LOADMODE_STRUCTURAL ̍\CfbNX͋؂蕶 ',' '\t' ';' '|' ' ' ɂꉻĂB
+    // ȊŐ؂蕶 whitespace / comment ̎wł͍\CfbNXg킸Aʏ1pXœǂށipt̓G[j
+    char       delimiter = ',';             // ؂蕶i'\t' / ';' / ' ' Ȃǁj
+    bool       whitespace = false;          // tB[hŐ󔒁E^uǂݔ΂i؂肪󔒁E^uȂA1̋؂Ƃ݂Ȃj
+    int        comment = COMMENT_NONE;      // ǂݔ΂RgsiCOMMENT_HASH / COMMENT_SLASH ̑gݍ킹j
+
+    // vEo
+    CsvLoadStats* stats = nullptr;          // FastCsvLoad / FastCsvLoadColumns: w肷ƃtF[YƂ̎ԁEsȂǂ
+    bool       perfCounters = false;        // stats Ƀn[hEFAJE^iTCNEߐjiLinux ̂݁j
+    bool       quiet = false;               // FileSize Ȃǂ̓ro߂Wo͂ɏoȂ
+
+    // NUMAi}`\Pbgj: NUMA_FIRSTTOUCH / NUMA_PIN ̑gݍ킹it@C̔zu map.numaPolicyj
+    int        numa = NUMA_OFF;
+
+    // FastCsvLoadStream p
+    size_t     memoryBudget = 256u << 20;   // }bv鑋Ƒ̃p[XʂɎg̏iڈj
+    size_t     batchRows = 65536;           // R[obNɓn1񕪂̍siŌ1j
+
+    // FastCsvLoadBatch p
+    int        batchThreads = 0;            // St@CŋLXbhi0 Ȃ omp_get_max_threads()j
+};
+
 //////////////////////////////////////////////////////////////////////////////////////////////
 //xyz^̓_Qf[^L̍\̂̔zɊi[֐
-int FastCsvLoad(const std::wstring& filename, std::vector<PointCloud>& pointClouds, int num_cols);
+int FastCsvLoad(const std::wstring& filename, std::vector<PointCloud>& pointClouds, int num_cols, const CsvLoadOptions& opt = CsvLoadOptions());
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// Xg[~Oǂݍ݁iRAM 傫t@Cpj
+// t@C memoryBudget Ɏ܂鑋ƂɃ}bvA̒1pXŕɃp[XB
+// ̖œr؂ꂽs͎̑̐擪ǂݒB
+// ʂ batchRows s onBatch ɓnirows ͌Ăяo̊ԂLjB
+// onBatch  0 ԂƓǂݍ݂𒆒fA̒lԂB
+// QUOTING_RFC4180 ɂ͖Ήi̋Eňp̏ԂȂ߁j
+typedef std::function<int(const PointCloud* rows, size_t count, size_t firstRow)> PointCloudBatchFn;
+
+int FastCsvLoadStream(const std::wstring& filename, int num_cols, const PointCloudBatchFn& onBatch, const CsvLoadOptions& opt = CsvLoadOptions());
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// t@C̈ꊇǂݍ
+// St@C batchThreads Xbh1̈̕œǂށit@CƂɕ̈蒼ȂjB
+// t@C̓t@CPʁA傫t@C̓`NPʂ̃^XNɂă[NXeB[OŕzB
+// 1pXiloadMode  LOADMODE_STRUCTURAL Ȃ\CfbNXjœǂ݁As LF / CRLF / CRB
+// LbVEŒ蒷̍sE񓯊ǂݍ݁Epɂ͖ΉB
+// sȍs̋L^ierrorsj̍sԍEoCgʒu̓t@CƂŁACsvRowError::file Ƀt@Cԍ
+// t@CƂɊi[iresults  filenames Ɠj
+int FastCsvLoadBatch(const std::vector<std::wstring>& filenames, std::vector<std::vector<PointCloud>>& results, int num_cols, const CsvLoadOptions& opt = CsvLoadOptions());
+// t@CɂȂĊi[it@C f ̍s [fileRows[f], fileRows[f + 1])j
+int FastCsvLoadBatch(const std::vector<std::wstring>& filenames, std::vector<PointCloud>& pointClouds, std::vector<size_t>& fileRows, int num_cols, const CsvLoadOptions& opt = CsvLoadOptions());
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// sCfbNXi<csv>.fcijgǂݍ
+// CfbNXȂEÂꍇ͈x쐬iBuildCsvIndexjB
+// sԍ GetLineOffsets_* ̍si0 n܂j
+// ǂ߂Ȃ NaN ɂȂierrorPolicy ͎gȂj
+// [beginRow, endRow) ̍sǂށiendRow ͍sŐ؂l߂j
+int FastCsvLoadRows(const std::wstring& filename, size_t beginRow, size_t endRow, std::vector<PointCloud>& pointClouds, int num_cols, const CsvLoadOptions& opt = CsvLoadOptions());
+// stride sƂ1si0, stride, 2*stride, ...jǂ
+int FastCsvLoadSampled(const std::wstring& filename, size_t stride, std::vector<PointCloud>& pointClouds, int num_cols, const CsvLoadOptions& opt = CsvLoadOptions());
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// sXL[}ɂǂݍ
+// 񂲂ƂɌ^w肵A^t̗obt@iwjɊi[
+// COLTYPE_SKIP ̗͐lϊ؂蕶܂œǂݔ΂
+#define COLTYPE_SKIP   0
+#define COLTYPE_FLOAT  1
+#define COLTYPE_DOUBLE 2
+#define COLTYPE_INT32  3
+#define COLTYPE_INT64  4
+#define COLTYPE_UINT8  5
+
+// ^̃oCgiCOLTYPE_SKIP  0j
+size_t ColumnTypeSize(int type);
+
+struct CsvColumnDef {
+    std::string name;
+    int         type;
+};
+
+struct CsvSchema {
+    std::vector<CsvColumnDef> columns; // CSV ̗
+
+    CsvSchema& Add(const std::string& name, int type) {
+        columns.push_back({ name, type });
+        return *this;
+    }
+};
+
+// 1񕪂̌^tobt@i\̂̔zł͂Ȃ񂲂ƂɘA: SoAj
+// 擪64oCgEA64oCgPʂɃpfBOiArrow ̃obt@zuƌ݊j
+struct CsvColumn {
+    std::string   name;
+    int           type = COLTYPE_SKIP;
+    size_t        elemSize = 0;
+    AlignedBuffer data; // rows * elemSize oCg
+
+    template <class T> T*       As()       { return reinterpret_cast<T*>(data.data()); }
+    template <class T> const T* As() const { return reinterpret_cast<const T*>(data.data()); }
+};
+
+// ǂݍ݌ʁ@COLTYPE_SKIP ȊO̗XL[}̏ɕێ
+struct CsvTable {
+    size_t                 rows = 0;
+    std::vector<CsvColumn> columns;
+
+    CsvColumn*       Find(const std::string& name);
+    const CsvColumn* Find(const std::string& name) const;
+};
+
+// PointCloud Ɠ10ix, y, z, acc, r, g, b, nx, ny, nzj float œǂރXL[}
+// FastCsvLoadColumns ɓn PointCloud  SoA ł
+CsvSchema PointCloudSchema();
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// XL[}ɏ] CSV ^tobt@Ɋi[֐
+int FastCsvLoadColumns(const std::wstring& filename, const CsvSchema& schema, CsvTable& table, const CsvLoadOptions& opt = CsvLoadOptions());
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// p[Xς݃LbVi<csv>.fccj̗Rs[ɎQƂ
+// FastCsvLoadColumns ̓LbVǂޏꍇobt@mۂăRs[iL CsvTable vꍇɎgjB
+// ǂނȂ炱gƁA̓LbV}bv̈𒼐ڎw
+// columns[i].data  CloseCsvCache ĂԂ܂ŗL
+struct CsvCacheView {
+    struct Column {
+        std::string name;
+        int         type = COLTYPE_SKIP;
+        const void* data = nullptr; // rows ̒li64oCgEj
+
+        template <class T> const T* As() const { return static_cast<const T*>(data); }
+    };
+
+    MappedFile          mf;
+    size_t              rows = 0;
+    std::vector<Column> columns; // COLTYPE_SKIP ȊO̗iXL[}̏j
+};
+
+// XL[} COLTYPE_SKIP ȊO̗񂪖OE^ƂvLbV}bv
+// LȃLbVȂ cacheMode  CACHE_READWRITE ȂAFastCsvLoadColumns œǂݍŃLbVoĂ}bv
+// iFastCsvLoad LbV PointCloudSchema() ̐擪 num_cols j
+int FastCsvLoadColumnsView(const std::wstring& filename, const CsvSchema& schema, CsvCacheView& view, const CsvLoadOptions& opt = CsvLoadOptions());
+
+// LbṼ}bviview ̗͂ȍ~gȂj
+void CloseCsvCache(CsvCacheView& view);
 
 //////////////////////////////////////////////////////////////////////////////////////////////
 //CSVt@CŜ́us̐擪ʒuiItZbgjv擾 ɍȂ
@@ -39,12 +252,18 @@ size_t GetLineOffsets_LF_OpenMP(const char* fileContent, size_t contentSize, std
 size_t GetLineOffsets_OpenMP(const char* fileContent, size_t contentSize, std::vector<size_t>& lineOffsets);
 
 // AVX2 + OpenMP ɂ鍂sItZbg擾
+// LF p '\n' ŋ؂i'\r' ͍s̒gAPƂ CR ł͋؂ȂjB
+// CRLF p '\r' ŋ؂i'\r\n' ̋ssɂȂAPƂ LF ł͋؂ȂjB
+// ǂs1ނ̃t@CpŁA݂t@C GetLineOffsets_Mixed_AVX2_OpenMP g
 size_t GetLineOffsets_AVX2_OpenMP(const char* fileContent, size_t contentSize, std::vector<size_t>& lineOffsets);
 size_t GetLineOffsets_CRLF_AVX2_OpenMP(const char* fileContent, size_t contentSize, std::vector<size_t>& lineOffsets);
 size_t GetLineOffsets_LF_AVX2_OpenMP(const char* fileContent, size_t contentSize, std::vector<size_t>& lineOffsets);
 
 //݂̏ꍇ
 size_t GetLineOffsets_LFCRLF_OpenMP(const char* fileContent, size_t contentSize, std::vector<size_t>& lineOffsets);
+// ݁iLF / CRLF / CREsj AVX2 Ł@s̃rbg}XNs߂
+// '\n' '\r' ̘A1̋؂Ƃ݂ȂAsi擪̋s܂ށj͍sɂȂ
+size_t GetLineOffsets_Mixed_AVX2_OpenMP(const char* fileContent, size_t contentSize, std::vector<size_t>& lineOffsets);
 
 int SlowCsvLoad(const std::wstring& filePath, std::vector<PointCloud>& pointClouds);
 
@@ -0,0 +1,199 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <system_error>
+#if defined(__AVX2__) || defined(__SSE4_1__) || defined(_M_X64)
+#include <immintrin.h>
+#define FIXEDDECIMAL_SIMD
+#endif
+
+#include "../fast_float/fast_float.h"  // fast_floatヘッダファイルのインクルード
+#include "CsvScan.h" // BitScanForward32
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 固定小数点形式（[-]d+ または [-]d+.d+、数字は合計 15 桁まで）の数値の高速パース
+// 16バイトを一度に読み、数字の判定・小数点の除去・桁の結合を SSE で行う。
+// 仮数 w（< 10^15 < 2^53）と 10^小数桁数 はどちらも double で正確に表せるので、
+// w / 10^n は IEEE の除算1回で正しく丸められる（Clinger の高速パス）。
+// float は double から丸め直すが、double の値がちょうど float の中間点になった場合だけ
+// 二重丸めで結果が変わりうるので fast_float に任せる。
+// 指数・inf / nan・桁数の多い仮数など、パターンに合わないものはすべて fast_float で読むので、
+// 結果（値と次の位置）は fast_float::from_chars と常に一致する。
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+#define FIXEDDECIMAL_MAX_DIGITS 15
+
+static const double kFixedDecimalPow10[FIXEDDECIMAL_MAX_DIGITS + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+};
+
+// 仮数 w・小数桁数 fracDigits から値を作る（false なら fast_float に任せる）
+static inline bool FixedDecimalValue(uint64_t w, int fracDigits, bool negative, double& value)
+{
+    double d = static_cast<double>(w);
+    if (fracDigits > 0) {
+        d /= kFixedDecimalPow10[fracDigits];
+    }
+    value = negative ? -d : d;
+    return true;
+}
+
+static inline bool FixedDecimalValue(uint64_t w, int fracDigits, bool negative, float& value)
+{
+    double d = static_cast<double>(w);
+    if (fracDigits > 0) {
+        d /= kFixedDecimalPow10[fracDigits];
+    }
+    // float の中間点（仮数の下位 29 ビットが 1000...0）なら二重丸めの可能性がある
+    uint64_t bits;
+    std::memcpy(&bits, &d, sizeof(bits));
+    if ((bits & 0x1FFFFFFFULL) == 0x10000000ULL) {
+        return false;
+    }
+    const float f = static_cast<float>(d);
+    value = negative ? -f : f;
+    return true;
+}
+
+// 数字の後ろが指数なら固定小数点形式ではない
+static inline bool IsExponentChar(char c)
+{
+    return c == 'e' || c == 'E';
+}
+
+#ifdef FIXEDDECIMAL_SIMD
+// 16個の数字（0～9、上位桁から順）を整数にする
+static inline uint64_t FixedDecimalDigits_SSE(__m128i digits)
+{
+    const __m128i mul10 = _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1);
+    const __m128i mul100 = _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1);
+    const __m128i mul10000 = _mm_setr_epi16(10000, 1, 10000, 1, 10000, 1, 10000, 1);
+    const __m128i t2 = _mm_maddubs_epi16(digits, mul10); // 2桁 x 8
+    const __m128i t4 = _mm_madd_epi16(t2, mul100);       // 4桁 x 4
+    const __m128i t4p = _mm_packus_epi32(t4, t4);
+    const __m128i t8 = _mm_madd_epi16(t4p, mul10000);    // 8桁 x 2
+    const uint64_t hi = static_cast<uint32_t>(_mm_cvtsi128_si32(t8));
+    const uint64_t lo = static_cast<uint32_t>(_mm_extract_epi32(t8, 1));
+    return hi * 100000000ULL + lo;
+}
+
+// p から 16 バイト読んでもページをまたがない（p のページは読めるので安全）
+static inline bool FixedDecimalCanLoad16(const char* p)
+{
+    return (reinterpret_cast<uintptr_t>(p) & 4095) <= 4096 - 16;
+}
+
+// SSE 版: [p, last) の先頭の固定小数点形式を読む
+static inline bool ParseFixedDigits_SSE(const char* p, const char* last, uint64_t& w, int& fracDigits, const char*& next)
+{
+    const int len = (last - p < 16) ? static_cast<int>(last - p) : 16;
+    const __m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i x = _mm_sub_epi8(raw, _mm_set1_epi8('0'));
+    // 0～9 の範囲（符号なし比較）のバイトが数字
+    unsigned int digitMask = static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(9)), x)));
+    digitMask &= (1u << len) - 1;
+
+    const int intDigits = static_cast<int>(BitScanForward32(~digitMask));
+    if (intDigits == 0 || intDigits >= 16) {
+        return false;
+    }
+    int numDigits = intDigits;
+    fracDigits = 0;
+    int end = intDigits; // 数字の直後の位置
+    if (intDigits < len && p[intDigits] == '.') {
+        fracDigits = static_cast<int>(BitScanForward32(~(digitMask >> (intDigits + 1))));
+        if (fracDigits == 0) {
+            return false; // "123." は fast_float に任せる
+        }
+        numDigits += fracDigits;
+        end = intDigits + 1 + fracDigits;
+    }
+    // 16バイトを使い切った場合は続きが見えない
+    if (numDigits > FIXEDDECIMAL_MAX_DIGITS || end >= 16) {
+        return false;
+    }
+    if (end < len && IsExponentChar(p[end])) {
+        return false;
+    }
+
+    // 数字を右詰めに並べ直す（小数点を飛ばし、左側は 0）
+    // 出力位置 i の数字は数字列の j = i - (16 - numDigits) 番目、元の位置は j（小数点より後なら j + 1）
+    const __m128i iota = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m128i j = _mm_add_epi8(iota, _mm_set1_epi8(static_cast<char>(numDigits - 16)));
+    const __m128i afterDot = _mm_cmpgt_epi8(j, _mm_set1_epi8(static_cast<char>(intDigits - 1)));
+    const __m128i src = _mm_sub_epi8(j, afterDot); // j < 0 は最上位ビットが立つので 0 になる
+    w = FixedDecimalDigits_SSE(_mm_shuffle_epi8(x, src));
+    next = p + end;
+    return true;
+}
+#endif
+
+// スカラー版: [p, last) の先頭の固定小数点形式を読む
+static inline bool ParseFixedDigits_Scalar(const char* p, const char* last, uint64_t& w, int& fracDigits, const char*& next)
+{
+    const char* q = p;
+    w = 0;
+    int numDigits = 0;
+    while (q < last && static_cast<unsigned char>(*q - '0') <= 9) {
+        w = w * 10 + static_cast<unsigned int>(*q - '0');
+        ++q;
+        if (++numDigits > FIXEDDECIMAL_MAX_DIGITS) {
+            return false;
+        }
+    }
+    if (numDigits == 0) {
+        return false;
+    }
+    fracDigits = 0;
+    if (q < last && *q == '.') {
+        ++q;
+        while (q < last && static_cast<unsigned char>(*q - '0') <= 9) {
+            w = w * 10 + static_cast<unsigned int>(*q - '0');
+            ++q;
+            ++fracDigits;
+            if (numDigits + fracDigits > FIXEDDECIMAL_MAX_DIGITS) {
+                return false;
+            }
+        }
+        if (fracDigits == 0) {
+            return false;
+        }
+    }
+    if (q < last && IsExponentChar(*q)) {
+        return false;
+    }
+    next = q;
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// @brief fast_float::from_chars と同じ結果を返す数値パース（固定小数点形式なら高速パス）
+template <class T>
+static inline fast_float::from_chars_result ParseDecimal(const char* first, const char* last, T& value)
+{
+    const char* p = first;
+    const bool negative = (p < last && *p == '-');
+    p += negative ? 1 : 0;
+    if (p < last) {
+        uint64_t w;
+        int fracDigits;
+        const char* next;
+#ifdef FIXEDDECIMAL_SIMD
+        const bool matched = FixedDecimalCanLoad16(p)
+            ? ParseFixedDigits_SSE(p, last, w, fracDigits, next)
+            : ParseFixedDigits_Scalar(p, last, w, fracDigits, next);
+#else
+        const bool matched = ParseFixedDigits_Scalar(p, last, w, fracDigits, next);
+#endif
+        T v;
+        if (matched && FixedDecimalValue(w, fracDigits, negative, v)) {
+            value = v;
+            fast_float::from_chars_result result;
+            result.ptr = next;
+            result.ec = std::errc();
+            return result;
+        }
+    }
+    return fast_float::from_chars(first, last, value);
+}
@@ -0,0 +1,331 @@
+﻿#ifdef _WIN32
+#define NOMINMAX // この定義をWindows.hをインクルードする前に追加しないとエラーになる
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+
+#include "MappedFile.h"
+#include "NumaTopology.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// ワイド文字列のパスをマルチバイトに変換
+// ロケールで変換できない場合は1文字1バイトとして扱う（main.cpp と同じ扱い）
+std::string NarrowPath(const std::wstring& filename)
+{
+    std::string path;
+    size_t len = std::wcstombs(nullptr, filename.c_str(), 0);
+    if (len != static_cast<size_t>(-1)) {
+        path.resize(len);
+        std::wcstombs(&path[0], filename.c_str(), len);
+    }
+    else {
+        path.reserve(filename.size());
+        for (wchar_t c : filename) {
+            path.push_back(static_cast<char>(c));
+        }
+    }
+    return path;
+}
+
+#ifdef _WIN32
+//////////////////////////////////////////////////////////////////////////////////////////////
+// Windows 版
+int OpenFileForViews(const std::wstring& filename, MappedFile& mf, const MapOptions& opt)
+{
+    // ファイルを開く (Windows API)
+    DWORD flags = FILE_ATTRIBUTE_NORMAL;
+    if (opt.advice & MAPADVICE_SEQUENTIAL) {
+        flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+    }
+    else if (opt.advice & MAPADVICE_RANDOM) {
+        flags |= FILE_FLAG_RANDOM_ACCESS;
+    }
+    HANDLE hFile = CreateFileW(
+        filename.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        NULL,
+        OPEN_EXISTING,
+        flags,
+        NULL
+    );
+    if (hFile == INVALID_HANDLE_VALUE) {
+        std::wcerr << L"ファイルを開けません: " << filename << std::endl;
+        return 1;
+    }
+
+    // ファイルサイズを取得
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(hFile, &fileSize)) {
+        std::wcerr << L"ファイルサイズの取得に失敗しました。" << std::endl;
+        CloseHandle(hFile);
+        return 1;
+    }
+
+    // ファイルマッピングオブジェクトを作成
+    HANDLE hMap = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (hMap == NULL) {
+        std::wcerr << L"ファイルマッピングの作成に失敗しました。" << std::endl;
+        CloseHandle(hFile);
+        return 1;
+    }
+
+    mf.data = nullptr;
+    mf.size = static_cast<size_t>(fileSize.QuadPart);
+    mf.hFile = hFile;
+    mf.hMap = hMap;
+    return 0;
+}
+
+// 先読み要求 (Windows 8 以降)
+static void PrefetchRange(const void* p, size_t size, const MapOptions& opt)
+{
+    if (opt.advice & MAPADVICE_WILLNEED) {
+        WIN32_MEMORY_RANGE_ENTRY range;
+        range.VirtualAddress = const_cast<void*>(p);
+        range.NumberOfBytes = static_cast<SIZE_T>(size);
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+}
+
+// MAPNUMA_BIND の場合は配置先ノードを指定してマップする（インターリーブは非対応）
+static LPVOID MapView(HANDLE hMap, uint64_t offset, size_t size, const MapOptions& opt, int* appliedNuma)
+{
+    const DWORD high = static_cast<DWORD>(offset >> 32);
+    const DWORD low = static_cast<DWORD>(offset & 0xFFFFFFFF);
+    if (opt.numaPolicy == MAPNUMA_BIND && NumaNodeCount() > 1) {
+        LPVOID p = MapViewOfFileExNuma(hMap, FILE_MAP_READ, high, low, size, NULL, static_cast<DWORD>(opt.numaNode));
+        if (p != NULL) {
+            if (appliedNuma) {
+                *appliedNuma = MAPNUMA_BIND;
+            }
+            return p;
+        }
+    }
+    return MapViewOfFile(hMap, FILE_MAP_READ, high, low, size);
+}
+
+int OpenMappedFile(const std::wstring& filename, MappedFile& mf, const MapOptions& opt)
+{
+    if (OpenFileForViews(filename, mf, opt) != 0) {
+        return 1;
+    }
+
+    // ファイル全体をマッピング
+    LPCVOID pData = MapView(static_cast<HANDLE>(mf.hMap), 0, 0, opt, &mf.numaPolicy);
+    if (pData == NULL) {
+        std::wcerr << L"ファイルのマッピングに失敗しました。" << std::endl;
+        CloseMappedFile(mf);
+        return 1;
+    }
+    PrefetchRange(pData, mf.size, opt);
+
+    mf.data = static_cast<const char*>(pData);
+    return 0;
+}
+
+size_t MapGranularity()
+{
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return static_cast<size_t>(si.dwAllocationGranularity);
+}
+
+int MapFileView(const MappedFile& mf, uint64_t offset, size_t length, MappedView& view, const MapOptions& opt)
+{
+    if (offset >= mf.size) {
+        view = MappedView();
+        return 0;
+    }
+    length = static_cast<size_t>(std::min<uint64_t>(length, mf.size - offset));
+    const uint64_t aligned = offset - offset % MapGranularity();
+    const size_t baseSize = static_cast<size_t>(offset - aligned) + length;
+
+    LPVOID pData = MapView(static_cast<HANDLE>(mf.hMap), aligned, baseSize, opt, nullptr);
+    if (pData == NULL) {
+        std::wcerr << L"ファイルのマッピングに失敗しました。" << std::endl;
+        return 1;
+    }
+    PrefetchRange(pData, baseSize, opt);
+
+    view.base = pData;
+    view.baseSize = baseSize;
+    view.data = static_cast<const char*>(pData) + (offset - aligned);
+    view.size = length;
+    return 0;
+}
+
+void UnmapFileView(MappedView& view)
+{
+    if (view.base) {
+        UnmapViewOfFile(view.base);
+    }
+    view = MappedView();
+}
+
+void CloseMappedFile(MappedFile& mf)
+{
+    // メモリマップの後始末
+    if (mf.data) {
+        UnmapViewOfFile(mf.data);
+    }
+    if (mf.hMap) {
+        CloseHandle(static_cast<HANDLE>(mf.hMap));
+    }
+    if (mf.hFile) {
+        CloseHandle(static_cast<HANDLE>(mf.hFile));
+    }
+    mf = MappedFile();
+}
+
+#else
+//////////////////////////////////////////////////////////////////////////////////////////////
+// POSIX 版
+int OpenFileForViews(const std::wstring& filename, MappedFile& mf, const MapOptions& opt)
+{
+    (void)opt;
+    const std::string path = NarrowPath(filename);
+
+    // ファイルを開く
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "ファイルを開けません: " << path << " (" << std::strerror(errno) << ")" << std::endl;
+        return 1;
+    }
+
+    // ファイルサイズを取得
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        std::cerr << "ファイルサイズの取得に失敗しました。" << std::endl;
+        close(fd);
+        return 1;
+    }
+    if (st.st_size == 0) {
+        // 空ファイルはマップできない (Windows 版の CreateFileMappingW と同じ扱い)
+        std::cerr << "ファイルマッピングの作成に失敗しました。" << std::endl;
+        close(fd);
+        return 1;
+    }
+
+    mf.data = nullptr;
+    mf.size = static_cast<size_t>(st.st_size);
+    mf.fd = fd;
+    return 0;
+}
+
+// mmap して madvise を適用する
+// NUMA ポリシーは先読み（MADV_WILLNEED / MAP_POPULATE）の間だけ呼び出したスレッドに設定する
+static void* MapRange(int fd, uint64_t offset, size_t size, const MapOptions& opt, int* appliedNuma)
+{
+    NumaPolicyState numaSaved;
+    if (opt.numaPolicy != MAPNUMA_DEFAULT && NumaSetThreadPolicy(opt.numaPolicy, opt.numaNode, numaSaved) == 0 && appliedNuma) {
+        *appliedNuma = opt.numaPolicy;
+    }
+
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    if (opt.populate) {
+        flags |= MAP_POPULATE;
+    }
+#endif
+    void* pData = mmap(nullptr, size, PROT_READ, flags, fd, static_cast<off_t>(offset));
+    if (pData == MAP_FAILED) {
+        std::cerr << "ファイルのマッピングに失敗しました。 (" << std::strerror(errno) << ")" << std::endl;
+        NumaRestoreThreadPolicy(numaSaved);
+        return nullptr;
+    }
+
+    // ページフォルト戦略 madvise はフラグを OR できないので個別に呼ぶ
+    // 失敗しても読み込み自体には影響しないので無視する
+    if (opt.advice & MAPADVICE_SEQUENTIAL) {
+        madvise(pData, size, MADV_SEQUENTIAL);
+    }
+    if (opt.advice & MAPADVICE_WILLNEED) {
+        madvise(pData, size, MADV_WILLNEED);
+    }
+    if (opt.advice & MAPADVICE_RANDOM) {
+        madvise(pData, size, MADV_RANDOM);
+    }
+#ifdef MADV_HUGEPAGE
+    if (opt.advice & MAPADVICE_HUGEPAGE) {
+        madvise(pData, size, MADV_HUGEPAGE);
+    }
+#endif
+    NumaRestoreThreadPolicy(numaSaved);
+    return pData;
+}
+
+int OpenMappedFile(const std::wstring& filename, MappedFile& mf, const MapOptions& opt)
+{
+    if (OpenFileForViews(filename, mf, opt) != 0) {
+        return 1;
+    }
+
+    // ファイル全体をマッピング
+    void* pData = MapRange(mf.fd, 0, mf.size, opt, &mf.numaPolicy);
+    if (pData == nullptr) {
+        CloseMappedFile(mf);
+        return 1;
+    }
+
+    mf.data = static_cast<const char*>(pData);
+    return 0;
+}
+
+size_t MapGranularity()
+{
+    static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return pageSize;
+}
+
+int MapFileView(const MappedFile& mf, uint64_t offset, size_t length, MappedView& view, const MapOptions& opt)
+{
+    if (offset >= mf.size) {
+        view = MappedView();
+        return 0;
+    }
+    length = static_cast<size_t>(std::min<uint64_t>(length, mf.size - offset));
+    const uint64_t aligned = offset - offset % MapGranularity();
+    const size_t baseSize = static_cast<size_t>(offset - aligned) + length;
+
+    void* pData = MapRange(mf.fd, aligned, baseSize, opt, nullptr);
+    if (pData == nullptr) {
+        return 1;
+    }
+
+    view.base = pData;
+    view.baseSize = baseSize;
+    view.data = static_cast<const char*>(pData) + (offset - aligned);
+    view.size = length;
+    return 0;
+}
+
+void UnmapFileView(MappedView& view)
+{
+    if (view.base) {
+        munmap(view.base, view.baseSize);
+    }
+    view = MappedView();
+}
+
+void CloseMappedFile(MappedFile& mf)
+{
+    // メモリマップの後始末
+    if (mf.data) {
+        munmap(const_cast<char*>(mf.data), mf.size);
+    }
+    if (mf.fd >= 0) {
+        close(mf.fd);
+    }
+    mf = MappedFile();
+}
+#endif
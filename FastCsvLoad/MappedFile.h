@@ -0,0 +1,81 @@
+﻿#pragma once
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// ファイルのメモリマップ (Windows / POSIX 共通レイヤ)
+// Windows: CreateFileW + CreateFileMappingW + MapViewOfFile
+// POSIX  : open + fstat + mmap + madvise
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+// ページフォルト戦略（ビットの組み合わせで指定）
+#define MAPADVICE_NONE       0x00
+#define MAPADVICE_SEQUENTIAL 0x01 // 先頭から順に読む (MADV_SEQUENTIAL)
+#define MAPADVICE_WILLNEED   0x02 // 先読みを要求 (MADV_WILLNEED / PrefetchVirtualMemory)
+#define MAPADVICE_HUGEPAGE   0x04 // 可能ならヒュージページ (MADV_HUGEPAGE) Linuxのみ
+#define MAPADVICE_RANDOM     0x08 // ランダムアクセス、先読みしない (MADV_RANDOM / FILE_FLAG_RANDOM_ACCESS)
+
+// ページキャッシュを置く NUMA ノード
+// 先読み（MAPADVICE_WILLNEED / populate）で読み込まれるページに効く。既にキャッシュにあるページは移動しない
+#define MAPNUMA_DEFAULT    0 // OS の既定（読み込んだスレッドのノード）
+#define MAPNUMA_INTERLEAVE 1 // 全ノードにページ単位で分散 (MPOL_INTERLEAVE) Linuxのみ
+#define MAPNUMA_BIND       2 // numaNode に優先して配置 (MPOL_PREFERRED / MapViewOfFileExNuma)
+
+struct MapOptions {
+    int  advice   = MAPADVICE_SEQUENTIAL | MAPADVICE_WILLNEED;
+    bool populate = false; // マップ時に全ページを読み込む (MAP_POPULATE) Linuxのみ
+    int  numaPolicy = MAPNUMA_DEFAULT;
+    int  numaNode   = 0;   // MAPNUMA_BIND の配置先
+};
+
+struct MappedFile {
+    const char* data = nullptr; // ファイル先頭
+    size_t      size = 0;       // ファイルサイズ
+    int         numaPolicy = MAPNUMA_DEFAULT; // 実際に適用できた NUMA ポリシー
+#ifdef _WIN32
+    void* hFile = nullptr;
+    void* hMap  = nullptr;
+#else
+    int   fd    = -1;
+#endif
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// @brief ファイル全体を読み取り専用でメモリにマップする
+// @param[in]  filename  入力ファイルパス（ワイド文字列）
+// @param[out] mf        マップ結果
+// @param[in]  opt       ページフォルト戦略
+// @return               成功時は 0、失敗時は非 0
+int OpenMappedFile(const std::wstring& filename, MappedFile& mf, const MapOptions& opt = MapOptions());
+
+// マップを解除してファイルを閉じる
+void CloseMappedFile(MappedFile& mf);
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// ファイルの一部分だけをマップする（ストリーミング読み込み用）
+// OpenFileForViews でファイルを開き、MapFileView / UnmapFileView で窓を動かしながら読む。
+// 後始末は CloseMappedFile（mf.data は nullptr のまま）
+
+struct MappedView {
+    const char* data     = nullptr; // 要求したオフセットの位置
+    size_t      size     = 0;       // 要求した長さ（ファイル末尾で切り詰め）
+    void*       base     = nullptr; // 実際にマップした先頭（アロケーション粒度に揃えた位置）
+    size_t      baseSize = 0;
+};
+
+// ファイルを開いてサイズを取得する（ファイル全体はマップしない）
+int OpenFileForViews(const std::wstring& filename, MappedFile& mf, const MapOptions& opt = MapOptions());
+
+// @brief [offset, offset + length) を読み取り専用でマップする
+// offset は任意（内部でアロケーション粒度に切り下げてマップする）
+// @return 成功時は 0、失敗時は非 0
+int MapFileView(const MappedFile& mf, uint64_t offset, size_t length, MappedView& view, const MapOptions& opt = MapOptions());
+
+void UnmapFileView(MappedView& view);
+
+// マップ開始位置の粒度（Windows: dwAllocationGranularity / POSIX: ページサイズ）
+size_t MapGranularity();
+
+// ワイド文字列のパスを OS のマルチバイトパスに変換 (POSIX 用)
+std::string NarrowPath(const std::wstring& filename);
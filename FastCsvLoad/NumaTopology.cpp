@@ -0,0 +1,309 @@
+﻿#ifdef _WIN32
+#define NOMINMAX // この定義をWindows.hをインクルードする前に追加しないとエラーになる
+#include <windows.h>
+#else
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <omp.h>
+
+#include "NumaTopology.h"
+
+#ifdef _WIN32
+//////////////////////////////////////////////////////////////////////////////////////////////
+// Windows 版
+int NumaNodeCount()
+{
+    ULONG highest = 0;
+    if (!GetNumaHighestNodeNumber(&highest)) {
+        return 1;
+    }
+    return static_cast<int>(highest) + 1;
+}
+
+int NumaPinThreads(NumaPinState& state)
+{
+    state = NumaPinState();
+    const int numNodes = NumaNodeCount();
+    if (numNodes <= 1) {
+        return 0;
+    }
+    const int numThreads = omp_get_max_threads();
+    state.stride = sizeof(GROUP_AFFINITY);
+    state.saved.assign(state.stride * numThreads, 0);
+    int pinned = 0;
+#pragma omp parallel num_threads(numThreads) reduction(+:pinned)
+    {
+        const int t = omp_get_thread_num();
+        GROUP_AFFINITY ga;
+        GROUP_AFFINITY prev;
+        std::memset(&ga, 0, sizeof(ga));
+        std::memset(&prev, 0, sizeof(prev));
+        const USHORT node = static_cast<USHORT>(static_cast<long long>(t) * numNodes / numThreads);
+        if (GetNumaNodeProcessorMaskEx(node, &ga) && ga.Mask != 0 &&
+            SetThreadGroupAffinity(GetCurrentThread(), &ga, &prev)) {
+            std::memcpy(&state.saved[state.stride * t], &prev, sizeof(prev));
+            pinned = 1;
+        }
+    }
+    state.pinned = pinned;
+    return pinned;
+}
+
+void NumaUnpinThreads(NumaPinState& state)
+{
+    if (state.pinned == 0) {
+        return;
+    }
+    const int numThreads = static_cast<int>(state.saved.size() / state.stride);
+#pragma omp parallel num_threads(numThreads)
+    {
+        GROUP_AFFINITY prev;
+        std::memcpy(&prev, &state.saved[state.stride * omp_get_thread_num()], sizeof(prev));
+        if (prev.Mask != 0) {
+            SetThreadGroupAffinity(GetCurrentThread(), &prev, NULL);
+        }
+    }
+    state = NumaPinState();
+}
+
+// Windows のスレッド単位のポリシーはないので、配置先は MapViewOfFileExNuma で指定する
+int NumaSetThreadPolicy(int, int, NumaPolicyState& saved)
+{
+    saved = NumaPolicyState();
+    return 1;
+}
+
+void NumaRestoreThreadPolicy(NumaPolicyState& saved)
+{
+    saved = NumaPolicyState();
+}
+
+// Windows には 0 に戻すことを保証してページを返す方法がないので何もしない
+void NumaReleasePages(void*, size_t)
+{
+}
+
+#else
+//////////////////////////////////////////////////////////////////////////////////////////////
+// POSIX 版（NUMA の API は Linux のみ）
+#ifdef __linux__
+
+// "0-3,8,10-11" 形式のリストを展開する
+static std::vector<int> ParseList(const std::string& text)
+{
+    std::vector<int> items;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        int first = 0;
+        int last = 0;
+        int used = 0;
+        const char* p = text.c_str() + pos;
+        if (std::sscanf(p, "%d-%d%n", &first, &last, &used) != 2) {
+            if (std::sscanf(p, "%d%n", &first, &used) != 1) {
+                break;
+            }
+            last = first;
+        }
+        for (int i = first; i <= last; ++i) {
+            items.push_back(i);
+        }
+        pos += used;
+        if (pos < text.size() && text[pos] == ',') {
+            ++pos;
+        }
+        else {
+            break;
+        }
+    }
+    return items;
+}
+
+static std::string ReadLine(const std::string& path)
+{
+    std::ifstream f(path);
+    std::string line;
+    std::getline(f, line);
+    return line;
+}
+
+static std::vector<int> OnlineNodes()
+{
+    return ParseList(ReadLine("/sys/devices/system/node/online"));
+}
+
+// CPU を持つノードごとの CPU 集合（プロセスのアフィニティと重なる部分のみ）
+static std::vector<cpu_set_t> NodeCpuSets()
+{
+    std::vector<cpu_set_t> sets;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return sets;
+    }
+    for (int node : OnlineNodes()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : ParseList(ReadLine("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"))) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        if (CPU_COUNT(&set) > 0) {
+            sets.push_back(set);
+        }
+    }
+    return sets;
+}
+#endif
+
+int NumaNodeCount()
+{
+#ifdef __linux__
+    const size_t n = NodeCpuSets().size();
+    return (n > 0) ? static_cast<int>(n) : 1;
+#else
+    return 1;
+#endif
+}
+
+int NumaPinThreads(NumaPinState& state)
+{
+    state = NumaPinState();
+#ifdef __linux__
+    const std::vector<cpu_set_t> nodes = NodeCpuSets();
+    const int numNodes = static_cast<int>(nodes.size());
+    if (numNodes <= 1) {
+        return 0;
+    }
+    const int numThreads = omp_get_max_threads();
+    state.stride = sizeof(cpu_set_t);
+    state.saved.assign(state.stride * numThreads, 0);
+    int pinned = 0;
+#pragma omp parallel num_threads(numThreads) reduction(+:pinned)
+    {
+        // pid 0 は呼び出したスレッド
+        const int t = omp_get_thread_num();
+        cpu_set_t prev;
+        const cpu_set_t& set = nodes[static_cast<long long>(t) * numNodes / numThreads];
+        if (sched_getaffinity(0, sizeof(prev), &prev) == 0 &&
+            sched_setaffinity(0, sizeof(set), &set) == 0) {
+            std::memcpy(&state.saved[state.stride * t], &prev, sizeof(prev));
+            pinned = 1;
+        }
+    }
+    state.pinned = pinned;
+    return pinned;
+#else
+    return 0;
+#endif
+}
+
+void NumaUnpinThreads(NumaPinState& state)
+{
+#ifdef __linux__
+    if (state.pinned == 0) {
+        return;
+    }
+    const int numThreads = static_cast<int>(state.saved.size() / state.stride);
+#pragma omp parallel num_threads(numThreads)
+    {
+        cpu_set_t prev;
+        std::memcpy(&prev, &state.saved[state.stride * omp_get_thread_num()], sizeof(prev));
+        if (CPU_COUNT(&prev) > 0) {
+            sched_setaffinity(0, sizeof(prev), &prev);
+        }
+    }
+#endif
+    state = NumaPinState();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// set_mempolicy / get_mempolicy（numaif.h の定数）
+#define NUMA_MPOL_DEFAULT    0
+#define NUMA_MPOL_PREFERRED  1
+#define NUMA_MPOL_INTERLEAVE 3
+#define NUMA_MAX_NODES       1024
+
+int NumaSetThreadPolicy(int policy, int node, NumaPolicyState& saved)
+{
+    saved = NumaPolicyState();
+#if defined(__linux__) && defined(SYS_set_mempolicy) && defined(SYS_get_mempolicy)
+    const std::vector<int> nodes = OnlineNodes();
+    if (policy == MAPNUMA_DEFAULT || nodes.size() <= 1) {
+        return 1;
+    }
+
+    const size_t bits = sizeof(unsigned long) * 8;
+    std::vector<unsigned long> mask(NUMA_MAX_NODES / bits, 0);
+    int mode = NUMA_MPOL_INTERLEAVE;
+    if (policy == MAPNUMA_BIND) {
+        if (node < 0 || node >= NUMA_MAX_NODES) {
+            return 1;
+        }
+        mode = NUMA_MPOL_PREFERRED;
+        mask[node / bits] |= 1ul << (node % bits);
+    }
+    else {
+        for (int n : nodes) {
+            if (n >= 0 && n < NUMA_MAX_NODES) {
+                mask[n / bits] |= 1ul << (n % bits);
+            }
+        }
+    }
+
+    saved.mask.assign(mask.size(), 0);
+    if (syscall(SYS_get_mempolicy, &saved.mode, saved.mask.data(), NUMA_MAX_NODES, nullptr, 0) != 0) {
+        saved = NumaPolicyState();
+        return 1;
+    }
+    if (syscall(SYS_set_mempolicy, mode, mask.data(), NUMA_MAX_NODES) != 0) {
+        saved = NumaPolicyState();
+        return 1;
+    }
+    saved.changed = true;
+    return 0;
+#else
+    (void)policy;
+    (void)node;
+    return 1;
+#endif
+}
+
+void NumaRestoreThreadPolicy(NumaPolicyState& saved)
+{
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+    if (saved.changed) {
+        syscall(SYS_set_mempolicy, saved.mode, (saved.mode == NUMA_MPOL_DEFAULT) ? nullptr : saved.mask.data(), NUMA_MAX_NODES);
+    }
+#endif
+    saved = NumaPolicyState();
+}
+
+void NumaReleasePages(void* data, size_t bytes)
+{
+#ifdef __linux__
+    if (bytes == 0 || NumaNodeCount() <= 1) {
+        return;
+    }
+    const uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const uintptr_t begin = (reinterpret_cast<uintptr_t>(data) + page - 1) & ~(page - 1);
+    const uintptr_t end = (reinterpret_cast<uintptr_t>(data) + bytes) & ~(page - 1);
+    if (begin < end) {
+        madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+    }
+#else
+    (void)data;
+    (void)bytes;
+#endif
+}
+#endif
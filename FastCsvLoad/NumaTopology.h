@@ -0,0 +1,55 @@
+﻿#pragma once
+#include <cstddef>
+#include <vector>
+#include "MappedFile.h" // MAPNUMA_* の定義
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// NUMA（マルチソケット）対応の内部ヘルパー
+// Linux: /sys/devices/system/node + sched_setaffinity + set_mempolicy（libnuma は使わない）
+// Windows: GetNumaNodeProcessorMaskEx + SetThreadGroupAffinity
+// NUMA でない環境（ノード 1 つ）ではどの関数も何もしない
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+// CsvLoadOptions::numa（ビットの組み合わせで指定）
+#define NUMA_OFF        0x00
+#define NUMA_FIRSTTOUCH 0x01 // 出力はそのチャンクをパースしたスレッドが最初に書き込む（ページがそのノードに載る）
+#define NUMA_PIN        0x02 // OpenMP のスレッドをノードに固定する（スレッド番号の連続した範囲が同じノード）
+#define NUMA_ALL        (NUMA_FIRSTTOUCH | NUMA_PIN)
+
+// CPU を持つ NUMA ノードの数（取得できない場合は 1）
+int NumaNodeCount();
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// OpenMP のスレッドの固定
+// スレッド t（全 T スレッド）はノード t * ノード数 / T に固定する。
+// ワークスティーリングは隣のスレッドから奪うので、まず同じノードのスレッドの間で仕事が移る。
+struct NumaPinState {
+    int pinned = 0;                  // 固定したスレッド数（0 なら何もしていない）
+    size_t stride = 0;               // saved の1スレッド分のバイト数
+    std::vector<unsigned char> saved; // スレッドごとの元のアフィニティ（OS の構造体をそのまま保存）
+};
+
+// @brief omp_get_max_threads() 個の OpenMP スレッドをノードに固定する
+// @return 固定したスレッド数（NUMA でない・失敗した場合は 0）
+int NumaPinThreads(NumaPinState& state);
+
+// NumaPinThreads の前のアフィニティに戻す
+void NumaUnpinThreads(NumaPinState& state);
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 呼び出したスレッドのメモリ配置ポリシー（MAPNUMA_*）を一時的に変更する（Linux のみ）
+struct NumaPolicyState {
+    bool changed = false;
+    int  mode = 0;
+    std::vector<unsigned long> mask;
+};
+
+// @return 変更できた場合は 0、非対応・失敗時は非 0
+int NumaSetThreadPolicy(int policy, int node, NumaPolicyState& saved);
+void NumaRestoreThreadPolicy(NumaPolicyState& saved);
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 0 で埋めた出力のページを OS に返す（Linux のみ、MADV_DONTNEED）
+// [data, data + bytes) に全体が含まれるページだけを返す。内容は 0 のままで、
+// 次に書き込んだスレッドのノードにページが載り直す（NUMA_FIRSTTOUCH）
+void NumaReleasePages(void* data, size_t bytes);
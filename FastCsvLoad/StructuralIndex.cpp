@@ -0,0 +1,238 @@
+﻿#include <iostream>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "StructuralIndex.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 区切り文字 Delim ごとに特殊化する（比較する値は即値）
+
+// SSE4.2 版 16バイト x 4
+template <char Delim>
+FASTCSV_TARGET("sse4.2")
+static void ScanBlock_SSE42(const char* block, BlockMasks& m)
+{
+    const __m128i vComma = _mm_set1_epi8(Delim);
+    const __m128i vLF = _mm_set1_epi8('\n');
+    const __m128i vCR = _mm_set1_epi8('\r');
+    const __m128i vQuote = _mm_set1_epi8('"');
+    m.comma = m.lf = m.cr = m.quote = 0;
+    for (int k = 0; k < 4; ++k) {
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + k * 16));
+        const int shift = k * 16;
+        m.comma |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(data, vComma)))) << shift;
+        m.lf    |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(data, vLF)))) << shift;
+        m.cr    |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(data, vCR)))) << shift;
+        m.quote |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(data, vQuote)))) << shift;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// AVX2 版 32バイト x 2
+FASTCSV_TARGET("avx2")
+static inline uint64_t Mask64_AVX2(__m256i lo, __m256i hi, __m256i v)
+{
+    uint32_t l = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, v)));
+    uint32_t h = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, v)));
+    return static_cast<uint64_t>(l) | (static_cast<uint64_t>(h) << 32);
+}
+
+template <char Delim>
+FASTCSV_TARGET("avx2")
+static void ScanBlock_AVX2(const char* block, BlockMasks& m)
+{
+    const __m256i vComma = _mm256_set1_epi8(Delim);
+    const __m256i vLF = _mm256_set1_epi8('\n');
+    const __m256i vCR = _mm256_set1_epi8('\r');
+    const __m256i vQuote = _mm256_set1_epi8('"');
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+    __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+
+    m.comma = Mask64_AVX2(lo, hi, vComma);
+    m.lf = Mask64_AVX2(lo, hi, vLF);
+    m.cr = Mask64_AVX2(lo, hi, vCR);
+    m.quote = Mask64_AVX2(lo, hi, vQuote);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// AVX-512BW 版 64バイト x 1（比較結果がそのまま64ビットマスク）
+template <char Delim>
+FASTCSV_TARGET("avx512f,avx512bw")
+static void ScanBlock_AVX512BW(const char* block, BlockMasks& m)
+{
+    __m512i data = _mm512_loadu_si512(reinterpret_cast<const void*>(block));
+    m.comma = _mm512_cmpeq_epi8_mask(data, _mm512_set1_epi8(Delim));
+    m.lf = _mm512_cmpeq_epi8_mask(data, _mm512_set1_epi8('\n'));
+    m.cr = _mm512_cmpeq_epi8_mask(data, _mm512_set1_epi8('\r'));
+    m.quote = _mm512_cmpeq_epi8_mask(data, _mm512_set1_epi8('"'));
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 前置 XOR
+// キャリーレス乗算で全ビット 1 を掛けると、各ビット位置にそれ以下のビットの XOR が入る
+FASTCSV_TARGET("pclmul,sse2")
+static uint64_t PrefixXor_CLMUL(uint64_t bits)
+{
+    __m128i v = _mm_set_epi64x(0, static_cast<long long>(bits));
+    __m128i r = _mm_clmulepi64_si128(v, _mm_set1_epi8(static_cast<char>(0xFF)), 0);
+    return static_cast<uint64_t>(_mm_cvtsi128_si64(r));
+}
+
+// PCLMULQDQ がない CPU 用
+static uint64_t PrefixXor_Shift(uint64_t bits)
+{
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// CPUID による判定
+static void CpuId(int leaf, int subleaf, int regs[4])
+{
+#ifdef _MSC_VER
+    __cpuidex(regs, leaf, subleaf);
+#else
+    unsigned int a, b, c, d;
+    __asm__ __volatile__("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(leaf), "c"(subleaf));
+    regs[0] = static_cast<int>(a);
+    regs[1] = static_cast<int>(b);
+    regs[2] = static_cast<int>(c);
+    regs[3] = static_cast<int>(d);
+#endif
+}
+
+// OS がレジスタ状態を保存するか（XGETBV）
+static uint64_t XGetBv()
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    unsigned int lo, hi;
+    __asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return (static_cast<uint64_t>(hi) << 32) | lo;
+#endif
+}
+
+int DetectSimdLevel()
+{
+    int regs[4];
+    CpuId(0, 0, regs);
+    const int maxLeaf = regs[0];
+
+    CpuId(1, 0, regs);
+    const bool sse42 = (regs[2] & (1 << 20)) != 0;
+    const bool osxsave = (regs[2] & (1 << 27)) != 0;
+    const bool avx = (regs[2] & (1 << 28)) != 0;
+    if (!sse42) {
+        return SIMD_SSE42; // SSE4.2 未満の CPU は対象外（-DFASTCSVLOAD_SSE42=OFF でビルドすれば SSE2 の命令のみで動作する）
+    }
+
+    uint64_t xcr0 = osxsave ? XGetBv() : 0;
+    const bool osYmm = (xcr0 & 0x06) == 0x06;  // XMM + YMM
+    const bool osZmm = (xcr0 & 0xE6) == 0xE6;  // XMM + YMM + opmask + ZMM
+    if (maxLeaf < 7 || !avx || !osYmm) {
+        return SIMD_SSE42;
+    }
+
+    CpuId(7, 0, regs);
+    const bool avx2 = (regs[1] & (1 << 5)) != 0;
+    const bool avx512f = (regs[1] & (1 << 16)) != 0;
+    const bool avx512bw = (regs[1] & (1 << 30)) != 0;
+    if (avx512f && avx512bw && osZmm) {
+        return SIMD_AVX512BW;
+    }
+    return avx2 ? SIMD_AVX2 : SIMD_SSE42;
+}
+
+template <char Delim>
+static ScanBlockFn ScanBlockForLevel(int level)
+{
+    switch (level) {
+    case SIMD_AVX512BW: return ScanBlock_AVX512BW<Delim>;
+    case SIMD_AVX2:     return ScanBlock_AVX2<Delim>;
+    default:            return ScanBlock_SSE42<Delim>;
+    }
+}
+
+ScanBlockFn SelectScanBlock(int level, char delimiter, int* selectedLevel)
+{
+    static const int detected = DetectSimdLevel();
+    if (level == SIMD_AUTO || level > detected) {
+        level = detected;
+    }
+    if (selectedLevel) {
+        *selectedLevel = level;
+    }
+    switch (delimiter) {
+    case ',':  return ScanBlockForLevel<','>(level);
+    case '\t': return ScanBlockForLevel<'\t'>(level);
+    case ';':  return ScanBlockForLevel<';'>(level);
+    case '|':  return ScanBlockForLevel<'|'>(level);
+    case ' ':  return ScanBlockForLevel<' '>(level);
+    default:   return nullptr;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 区切り文字・空白・コメント行
+CsvDialect DialectOf(const CsvLoadOptions& opt)
+{
+    CsvDialect dialect;
+    dialect.delimiter = opt.delimiter;
+    dialect.whitespace = opt.whitespace;
+    dialect.comment = opt.comment;
+    return dialect;
+}
+
+int CheckDialect(const CsvLoadOptions& opt)
+{
+    const char d = opt.delimiter;
+    if (d == '\0' || d == '\n' || d == '\r' || d == '"' || d == '.' || d == '-' || d == '+' || (d >= '0' && d <= '9')) {
+        std::cerr << "区切り文字に使えない文字です（" << static_cast<int>(static_cast<unsigned char>(d)) << "）。" << std::endl;
+        return 1;
+    }
+    if (opt.quoting == QUOTING_RFC4180) {
+        if (opt.whitespace || opt.comment != COMMENT_NONE) {
+            std::cerr << "引用符付き CSV では whitespace / comment を指定できません。" << std::endl;
+            return 1;
+        }
+        if (SelectScanBlock(SIMD_AUTO, d) == nullptr) {
+            std::cerr << "引用符付き CSV の区切り文字は ',' '\\t' ';' '|' ' ' のみ対応しています。" << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+ScanBlockFn SelectDialectScan(int simdLevel, const CsvDialect& dialect)
+{
+    if (dialect.whitespace || dialect.comment != COMMENT_NONE) {
+        return nullptr;
+    }
+    return SelectScanBlock(simdLevel, dialect.delimiter);
+}
+
+PrefixXorFn SelectPrefixXor()
+{
+    int regs[4];
+    CpuId(1, 0, regs);
+    const bool pclmul = (regs[2] & (1 << 1)) != 0;
+    return pclmul ? PrefixXor_CLMUL : PrefixXor_Shift;
+}
+
+const char* SimdLevelName(int level)
+{
+    switch (level) {
+    case SIMD_AVX512BW: return "AVX-512BW";
+    case SIMD_AVX2:     return "AVX2";
+    case SIMD_SSE42:    return "SSE4.2";
+    default:            return "auto";
+    }
+}
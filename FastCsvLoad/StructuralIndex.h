@@ -0,0 +1,280 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <omp.h>
+#include "FastCsvLoad.h" // SIMD_* の定義
+#include "CsvScan.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 構造インデックス（simdcsv / simdjson 方式）
+// 64バイトのブロックごとに区切り文字（既定は ','）・'\n' '\r' '"' の位置をビットマスクで求め、
+// tzcnt / blsr のループで区切り位置を順に取り出す。
+// 行は '\n' と '\r' のどちらでも終わる（CRLF の '\n' は空行として読み飛ばすので、LF / CRLF / CR の混在も読める）。
+// フィールド境界が分かっているので、パーサは区切り文字を再走査しない。
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+#define STRUCTURAL_BLOCK_SIZE 64
+
+struct BlockMasks {
+    uint64_t comma; // 区切り文字（既定は ','）
+    uint64_t lf;    // '\n'
+    uint64_t cr;    // '\r'
+    uint64_t quote; // '"'
+};
+
+// 64バイトのブロックからマスクを作る関数
+typedef void (*ScanBlockFn)(const char* block, BlockMasks& m);
+
+// レベル・区切り文字に対応するブロック走査関数（SIMD_AUTO なら DetectSimdLevel の結果）
+// CPU が対応していないレベルを指定した場合は使える最上位レベルに落とす
+// 区切り文字は ',' '\t' ';' '|' ' ' に特殊化してあり、それ以外は nullptr を返す（構造インデックスを使わない）
+ScanBlockFn SelectScanBlock(int level, char delimiter = ',', int* selectedLevel = nullptr);
+
+// 区切り文字・空白・コメント行（CsvLoadOptions::delimiter / whitespace / comment）
+CsvDialect DialectOf(const CsvLoadOptions& opt);
+
+// @brief 区切りの指定が使えるかを調べる（FastCsvLoad / FastCsvLoadColumns などで共通）
+// @return 使える場合は 0、区切り文字に数値・改行・引用符を指定した場合や、引用符付きと両立しない場合は非 0
+int CheckDialect(const CsvLoadOptions& opt);
+
+// 構造インデックスの走査関数（dialect の区切り文字用）
+// 空白・コメント行は構造インデックスでは扱わない。区切り文字が特殊化にない場合も nullptr（1パス方式で読む）
+ScanBlockFn SelectDialectScan(int simdLevel, const CsvDialect& dialect);
+
+const char* SimdLevelName(int level);
+
+// 64ビットの前置 XOR（ビット i までの XOR をビット i に置く）
+// 引用符マスクに適用すると「引用符の内側」のマスクになる
+typedef uint64_t (*PrefixXorFn)(uint64_t bits);
+
+// PCLMULQDQ（キャリーレス乗算）が使えればそれを、なければシフトと XOR で計算する関数
+PrefixXorFn SelectPrefixXor();
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 64ビット版の最下位ビット位置（tzcnt）　mask は 0 以外であること
+static inline unsigned long BitScanForward64(uint64_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long offset;
+    _BitScanForward64(&offset, mask);
+    return offset;
+#else
+    return static_cast<unsigned long>(__builtin_ctzll(mask));
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// [begin, end) を構造インデックスで走査し、フィールドと行の境界ごとにコールバックを呼ぶ
+//   onField(fieldIndex, fieldBegin, fieldEnd)  フィールド1つ分（fieldEnd は区切り文字の位置）
+//   onRowEnd()                                 1行分のフィールドを渡し終えた
+// 空行（CRLF の '\r' と '\n' の間を含む）は行として数えない。begin は行頭であること。
+template <class OnField, class OnRowEnd>
+static inline void WalkStructural(const char* begin, const char* end, ScanBlockFn scan,
+    OnField&& onField, OnRowEnd&& onRowEnd)
+{
+    const char* rowStart = begin;
+    const char* fieldStart = begin;
+    int field = 0;
+
+    for (const char* block = begin; block < end; block += STRUCTURAL_BLOCK_SIZE) {
+        BlockMasks m;
+        if (end - block >= STRUCTURAL_BLOCK_SIZE) {
+            scan(block, m);
+        }
+        else {
+            // 末尾の64バイト未満は0埋めしたコピーを走査（範囲外を読まない）
+            alignas(64) char tail[STRUCTURAL_BLOCK_SIZE] = {};
+            std::memcpy(tail, block, static_cast<size_t>(end - block));
+            scan(tail, m);
+        }
+
+        const uint64_t newline = m.lf | m.cr;
+        uint64_t bits = m.comma | newline;
+        while (bits != 0) {
+            const unsigned long i = BitScanForward64(bits);
+            bits &= bits - 1; // blsr: 最下位ビットを落とす
+            const char* p = block + i;
+            if (((newline >> i) & 1) == 0) {
+                // 区切り文字
+                onField(field++, fieldStart, p);
+                fieldStart = p + 1;
+                continue;
+            }
+            // '\n' / '\r'
+            if (p > rowStart) {
+                onField(field, fieldStart, p);
+                onRowEnd();
+            }
+            field = 0;
+            rowStart = fieldStart = p + 1;
+        }
+    }
+
+    // 改行で終わらない最終行
+    if (rowStart < end) {
+        onField(field, fieldStart, end);
+        onRowEnd();
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// RFC 4180 の引用符付きフィールドに対応した走査
+// 引用符の内側にある区切り文字・'\n'・'\r' は区切りとして扱わない。
+// フィールドが '"' で始まる場合は前後の引用符を外して onField に渡す
+// （数値列が対象なので "" のエスケープは展開しない）。
+//
+// begin は引用符の外側にある行頭。limit 以降に始まる行は処理せずに止まり、次の行頭を返す。
+// quotesBeforeLimit には [begin, limit) にある '"' の数を返す（チャンクの引用符パリティ用）。
+static inline void TrimQuotes(const char*& fieldBegin, const char*& fieldEnd)
+{
+    if (fieldBegin < fieldEnd && *fieldBegin == '"') {
+        ++fieldBegin;
+        const char* e = fieldEnd;
+        if (e > fieldBegin && e[-1] == '"') {
+            --e;
+        }
+        fieldEnd = e;
+    }
+}
+
+template <class OnField, class OnRowEnd>
+static inline const char* WalkStructuralQuoted(const char* begin, const char* limit, const char* end,
+    ScanBlockFn scan, PrefixXorFn prefixXor, OnField&& onField, OnRowEnd&& onRowEnd, size_t& quotesBeforeLimit)
+{
+    quotesBeforeLimit = 0;
+    if (begin >= limit) {
+        return begin;
+    }
+
+    const char* rowStart = begin;
+    const char* fieldStart = begin;
+    int field = 0;
+    uint64_t carry = 0; // 直前のブロック末尾が引用符の内側なら全ビット 1
+
+    for (const char* block = begin; block < end; block += STRUCTURAL_BLOCK_SIZE) {
+        BlockMasks m;
+        if (end - block >= STRUCTURAL_BLOCK_SIZE) {
+            scan(block, m);
+        }
+        else {
+            alignas(64) char tail[STRUCTURAL_BLOCK_SIZE] = {};
+            std::memcpy(tail, block, static_cast<size_t>(end - block));
+            scan(tail, m);
+        }
+
+        // limit より前の引用符を数える
+        if (block < limit) {
+            uint64_t q = m.quote;
+            if (limit - block < STRUCTURAL_BLOCK_SIZE) {
+                q &= (uint64_t(1) << (limit - block)) - 1;
+            }
+            for (; q != 0; q &= q - 1) {
+                ++quotesBeforeLimit;
+            }
+        }
+
+        const uint64_t inside = prefixXor(m.quote) ^ carry;
+        carry = static_cast<uint64_t>(static_cast<int64_t>(inside) >> 63);
+
+        const uint64_t newline = m.lf | m.cr;
+        uint64_t bits = (m.comma | newline) & ~inside;
+        while (bits != 0) {
+            const unsigned long i = BitScanForward64(bits);
+            bits &= bits - 1;
+            const char* p = block + i;
+            const char* fb = fieldStart;
+            const char* fe = p;
+            TrimQuotes(fb, fe);
+            if (((newline >> i) & 1) == 0) {
+                // 区切り文字
+                onField(field++, fb, fe);
+                fieldStart = p + 1;
+                continue;
+            }
+            // '\n' / '\r'
+            if (p > rowStart) {
+                onField(field, fb, fe);
+                onRowEnd();
+            }
+            field = 0;
+            rowStart = fieldStart = p + 1;
+            if (rowStart >= limit) {
+                return rowStart;
+            }
+        }
+    }
+
+    // 改行で終わらない最終行
+    if (rowStart < end) {
+        const char* fb = fieldStart;
+        const char* fe = end;
+        TrimQuotes(fb, fe);
+        onField(field, fb, fe);
+        onRowEnd();
+    }
+    return end;
+}
+
+// pos 以降で最初の行頭（引用符の外側にある '\n' / '\r' の直後）を返す
+// insideAtPos は pos 直前までの引用符の状態。[pos, limit) にある '"' の数を quotes に返す
+static inline size_t FindRowStartQuoted(const char* fileContent, size_t contentSize,
+    size_t pos, bool insideAtPos, size_t limit, size_t& quotes)
+{
+    quotes = 0;
+    if (pos == 0) {
+        return 0;
+    }
+    if (!insideAtPos && (fileContent[pos - 1] == '\n' || fileContent[pos - 1] == '\r')) {
+        return pos;
+    }
+    bool inside = insideAtPos;
+    for (size_t p = pos; p < contentSize; ++p) {
+        const char c = fileContent[p];
+        if (c == '"') {
+            inside = !inside;
+            if (p < limit) {
+                ++quotes;
+            }
+        }
+        else if ((c == '\n' || c == '\r') && !inside) {
+            return p + 1;
+        }
+    }
+    return contentSize;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// 引用符付き CSV のチャンク並列処理（投機的実行 + 修正）
+// 1) 各チャンクは「先頭は引用符の外側」と仮定して並列にパースし、
+//    担当バイト範囲 [nominal_c, nominal_c+1) の引用符パリティを返す
+// 2) パリティの前置 XOR で各チャンク先頭の本当の状態を求める（チャンク数のみの逐次処理）
+// 3) 仮定が外れていたチャンク（先頭が引用符の内側だった）だけを並列に再パースする
+// parseChunk(c, nominalBegin, nominalEnd, insideAtBegin) はチャンク内の結果を作り直し、パリティを返す
+template <class ParseChunk>
+static inline void RunQuotedChunks(size_t contentSize, int numChunks, ParseChunk&& parseChunk)
+{
+    std::vector<int> parity(numChunks, 0);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int c = 0; c < numChunks; ++c) {
+        parity[c] = parseChunk(c, contentSize / numChunks * c,
+            (c + 1 == numChunks) ? contentSize : contentSize / numChunks * (c + 1), false);
+    }
+
+    std::vector<int> redo;
+    bool inside = false;
+    for (int c = 0; c < numChunks; ++c) {
+        if (inside) {
+            redo.push_back(c);
+        }
+        inside ^= (parity[c] != 0);
+    }
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int i = 0; i < static_cast<int>(redo.size()); ++i) {
+        const int c = redo[i];
+        parseChunk(c, contentSize / numChunks * c,
+            (c + 1 == numChunks) ? contentSize : contentSize / numChunks * (c + 1), true);
+    }
+}
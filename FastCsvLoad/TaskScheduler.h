@@ -0,0 +1,300 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <omp.h>
+#include "AlignedBuffer.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// ワークスティーリングによるタスクの分配
+// タスク番号 [0, numTasks) をスレッド数で連続区間に分けて各スレッドに持たせる。
+// 自分の区間は先頭から1つずつ取り、空になったら他のスレッドの区間の後半を奪う。
+// 区間は (先頭, 末尾) を1つの 64ビット atomic に詰めて CAS で更新するので、全体のロックはない。
+// 結果はタスク番号ごとの領域に書き、最後に番号順につなげれば元の順序が保たれる。
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+#define TASK_TARGET_BYTES      (1u << 20) // 1タスクのバイト数の目安
+#define TASK_MIN_BYTES         4096       // これより小さいタスクには分けない
+#define TASK_MIN_PER_THREAD    8          // スレッドあたりの最小タスク数
+#define TASK_ROWS              16384      // 行単位のタスク（2パス方式のパース）の行数
+
+class StealingTaskQueue {
+public:
+    StealingTaskQueue(size_t numTasks, int numThreads)
+        : numThreads_(std::max(1, numThreads)), slots_(new Slot[std::max(1, numThreads)])
+    {
+        for (int t = 0; t < numThreads_; ++t) {
+            const uint64_t begin = numTasks * t / numThreads_;
+            const uint64_t end = numTasks * (t + 1) / numThreads_;
+            slots_[t].range.store(Pack(begin, end), std::memory_order_relaxed);
+        }
+    }
+
+    // スレッド thread が次に処理するタスクを task に返す（全タスクが配られたら false）
+    bool Pop(int thread, size_t& task)
+    {
+        if (thread >= numThreads_) {
+            return false;
+        }
+        if (PopFront(slots_[thread].range, task)) {
+            return true;
+        }
+        // 自分の区間が空: 他のスレッドの区間の後半を奪う
+        for (int k = 1; k < numThreads_; ++k) {
+            std::atomic<uint64_t>& victim = slots_[(thread + k) % numThreads_].range;
+            uint64_t r = victim.load(std::memory_order_acquire);
+            while (Begin(r) < End(r)) {
+                const uint64_t half = (End(r) - Begin(r) + 1) / 2;
+                const uint64_t stolen = End(r) - half;
+                if (victim.compare_exchange_weak(r, Pack(Begin(r), stolen), std::memory_order_acq_rel)) {
+                    // 奪った区間の先頭を処理し、残りを自分の区間にする
+                    // （空の区間を CAS で書き換えるスレッドはいないので store でよい）
+                    slots_[thread].range.store(Pack(stolen + 1, stolen + half), std::memory_order_release);
+                    task = static_cast<size_t>(stolen);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> range{ 0 }; // 下位32ビット: 次のタスク、上位32ビット: 末尾（含まない）
+    };
+
+    static uint64_t Pack(uint64_t begin, uint64_t end) { return begin | (end << 32); }
+    static uint64_t Begin(uint64_t r) { return r & 0xFFFFFFFFu; }
+    static uint64_t End(uint64_t r) { return r >> 32; }
+
+    static bool PopFront(std::atomic<uint64_t>& range, size_t& task)
+    {
+        uint64_t r = range.load(std::memory_order_acquire);
+        while (Begin(r) < End(r)) {
+            if (range.compare_exchange_weak(r, Pack(Begin(r) + 1, End(r)), std::memory_order_acq_rel)) {
+                task = static_cast<size_t>(Begin(r));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int numThreads_;
+    std::unique_ptr<Slot[]> slots_;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// contentSize バイトを分けるタスク数（TASK_TARGET_BYTES ごと、少なくともスレッドあたり TASK_MIN_PER_THREAD）
+// 1タスクのバイト数は常に 2 * TASK_TARGET_BYTES 未満（タスク内の位置は 32ビットで表せる）
+static inline size_t TaskCountForBytes(size_t contentSize, int numThreads)
+{
+    size_t n = std::max(contentSize / TASK_TARGET_BYTES, static_cast<size_t>(numThreads) * TASK_MIN_PER_THREAD);
+    n = std::min(n, contentSize / TASK_MIN_BYTES);
+    return std::max<size_t>(n, 1);
+}
+
+// タスク c の担当バイト範囲の先頭（行頭への調整は呼び出し側で行う）
+static inline size_t TaskBegin(size_t contentSize, size_t numTasks, size_t c)
+{
+    return static_cast<size_t>(static_cast<unsigned long long>(contentSize) * c / numTasks);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// タスク [0, numTasks) を OpenMP のスレッドでワークスティーリングしながら処理する
+// body(task, thread) はタスクごとに1回だけ呼ばれる（呼ばれる順序は不定）
+// numThreads が 0 なら omp_get_max_threads() 個のスレッドを使う
+template <class Body>
+static inline void RunStealingTasks(size_t numTasks, Body&& body, int numThreads = 0)
+{
+    if (numThreads <= 0) {
+        numThreads = omp_get_max_threads();
+    }
+    StealingTaskQueue queue(numTasks, numThreads);
+#pragma omp parallel num_threads(numThreads)
+    {
+        const int thread = omp_get_thread_num();
+        size_t task;
+        // 実際のスレッド数が少ない場合（OMP_DYNAMIC など）も、起動しなかったスレッドの区間は奪われて処理される
+        while (queue.Pop(thread, task)) {
+            body(task, thread);
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// タスク c を owner[c] のスレッド自身に処理させる（NUMA のファーストタッチ用）
+// パースしたスレッドが結合先にも最初に書き込むので、出力のページがそのスレッドのノードに載る。
+// 実際のスレッド数が少ない場合、担当のいないタスクはスレッド 0 が処理する
+template <class Body>
+static inline void RunOwnedTasks(const std::vector<int>& owner, Body&& body)
+{
+    const int numThreads = omp_get_max_threads();
+#pragma omp parallel num_threads(numThreads)
+    {
+        const int thread = omp_get_thread_num();
+        const int team = omp_get_num_threads();
+        for (size_t c = 0; c < owner.size(); ++c) {
+            if (owner[c] == thread || (thread == 0 && (owner[c] >= team || owner[c] < 0))) {
+                body(c);
+            }
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+// タスクごとの出力領域（アリーナ）
+// 1つの未初期化バッファをタスクごとの区間に分け、タスク task は自分の区間に要素を順に書く。
+// 見積もりより多い場合だけ、そのタスク専用の追加領域（overflow）に書く。
+// 確保は行数によらず Init の1回（+ 見積もりを超えたタスクの追加領域）で済む。
+// 要素は elemSize バイトの単純なコピーで移せる型（float / int64_t / PointCloud / size_t など）
+class TaskArena {
+public:
+    // numTasks 個のタスクに rowsPerTask 個ずつの領域を割り当てる（中身は未初期化）
+    void Init(size_t numTasks, size_t rowsPerTask, size_t elemSize)
+    {
+        Init(std::vector<size_t>(numTasks, rowsPerTask), elemSize);
+    }
+
+    // タスク task に rowsPerTask[task] 個の領域を割り当てる（大きさの違うタスクが混ざる場合）
+    void Init(const std::vector<size_t>& rowsPerTask, size_t elemSize)
+    {
+        const size_t numTasks = rowsPerTask.size();
+        elemSize_ = elemSize;
+        begin_.resize(numTasks);
+        capacity_.resize(numTasks);
+        size_t total = 0;
+        for (size_t t = 0; t < numTasks; ++t) {
+            begin_[t] = total;
+            capacity_[t] = std::max<size_t>(rowsPerTask[t], 1);
+            total += capacity_[t];
+        }
+        buf_.Allocate(total * elemSize_);
+        counts_.assign(numTasks, 0);
+        overflow_.assign(numTasks, std::vector<unsigned char>());
+    }
+
+    // タスク task の次の要素の書き込み先（Commit するまで数に入らない）
+    // 追加領域のアドレスは次の Reserve で変わることがあるので、すぐに書き込むこと
+    unsigned char* Reserve(size_t task)
+    {
+        const size_t n = counts_[task];
+        if (n < capacity_[task]) {
+            return buf_.data() + (begin_[task] + n) * elemSize_;
+        }
+        std::vector<unsigned char>& o = overflow_[task];
+        const size_t need = (n - capacity_[task] + 1) * elemSize_;
+        if (o.size() < need) {
+            o.resize(std::max(need, o.size() * 2));
+        }
+        return o.data() + need - elemSize_;
+    }
+    void Commit(size_t task) { ++counts_[task]; }
+
+    template <class T>
+    void Push(size_t task, const T& value)
+    {
+        std::memcpy(Reserve(task), &value, sizeof(T));
+        Commit(task);
+    }
+
+    // タスク task の要素を捨てる（投機的なパースのやり直し用）
+    void Reset(size_t task)
+    {
+        counts_[task] = 0;
+        std::vector<unsigned char>().swap(overflow_[task]);
+    }
+
+    size_t Count(size_t task) const { return counts_[task]; }
+    size_t NumTasks() const { return counts_.size(); }
+
+    // タスクごとの要素数を累積和して格納位置（base[task]、base[NumTasks()] が合計）を求める
+    std::vector<size_t> Offsets() const
+    {
+        std::vector<size_t> base(counts_.size() + 1, 0);
+        for (size_t t = 0; t < counts_.size(); ++t) {
+            base[t + 1] = base[t] + counts_[t];
+        }
+        return base;
+    }
+
+    // タスク task の要素を dest（要素 base[task] の位置）に順にコピーする
+    void CopyTask(size_t task, unsigned char* dest) const
+    {
+        const size_t inSlice = std::min(counts_[task], capacity_[task]);
+        if (inSlice == 0) {
+            return;
+        }
+        std::memcpy(dest, buf_.data() + begin_[task] * elemSize_, inSlice * elemSize_);
+        if (counts_[task] > inSlice) {
+            std::memcpy(dest + inSlice * elemSize_, overflow_[task].data(), (counts_[task] - inSlice) * elemSize_);
+        }
+    }
+
+    // タスク task の j 番目の要素（j < Count(task)）
+    template <class T>
+    T At(size_t task, size_t j) const
+    {
+        T value;
+        const unsigned char* src = (j < capacity_[task])
+            ? buf_.data() + (begin_[task] + j) * elemSize_
+            : overflow_[task].data() + (j - capacity_[task]) * elemSize_;
+        std::memcpy(&value, src, sizeof(T));
+        return value;
+    }
+
+    // タスク task の要素を順に fn(j, value) に渡す
+    template <class T, class Fn>
+    void Visit(size_t task, Fn&& fn) const
+    {
+        const size_t n = counts_[task];
+        const size_t inSlice = std::min(n, capacity_[task]);
+        const T* slice = reinterpret_cast<const T*>(buf_.data() + begin_[task] * elemSize_);
+        for (size_t j = 0; j < inSlice; ++j) {
+            fn(j, slice[j]);
+        }
+        if (n > inSlice) {
+            const T* over = reinterpret_cast<const T*>(overflow_[task].data());
+            for (size_t j = inSlice; j < n; ++j) {
+                fn(j, over[j - inSlice]);
+            }
+        }
+    }
+
+    // 全タスクの要素をタスク順に dest へ並列にコピーする（dest は合計個数分の領域）
+    void CopyAll(unsigned char* dest) const
+    {
+        const std::vector<size_t> base = Offsets();
+#pragma omp parallel for schedule(dynamic, 1)
+        for (long long t = 0; t < static_cast<long long>(counts_.size()); ++t) {
+            CopyTask(static_cast<size_t>(t), dest + base[t] * elemSize_);
+        }
+    }
+
+    void Free()
+    {
+        buf_.Free();
+        begin_.clear();
+        capacity_.clear();
+        counts_.clear();
+        overflow_.clear();
+    }
+
+private:
+    AlignedBuffer buf_;
+    size_t elemSize_ = 1;
+    std::vector<size_t> begin_;    // タスクごとの区間の先頭（要素単位）
+    std::vector<size_t> capacity_; // タスクごとの区間の要素数
+    std::vector<size_t> counts_;
+    std::vector<std::vector<unsigned char>> overflow_;
+};
+
+// estimatedLines 行を numTasks 個に分けたときの1タスクあたりの行数の見積もり
+// （タスクごとの偏りに備えて多めにとる　超えた分は追加領域に入る）
+static inline size_t TaskRowsEstimate(size_t estimatedLines, size_t numTasks)
+{
+    return estimatedLines / std::max<size_t>(numTasks, 1) * 5 / 4 + 16;
+}
@@ -1,11 +1,9 @@
-#define NOMINMAX // ̒`Windows.hCN[hOɒǉȂƃG[ɂȂ
-#include <windows.h>
 #include <vector>
 #include <string>
 #include <iostream>
+#include <clocale>
+#include <cstdlib>
 #include <omp.h>
-//#include <emmintrin.h> // SSE2 (SIMD)
-#include <immintrin.h> // AVX2 wb_
 #include <chrono> // Ԍvp ԌvȂꍇ͕sv
 
 #include "FastCsvLoad.h"
@@ -23,19 +21,37 @@ int main(int argc, char* argv[]) {
 
     // ̓t@C擾
     std::string inputFilePath = argv[1];
+#ifdef _WIN32
     std::wstring wideFilePath(inputFilePath.begin(), inputFilePath.end()); // }`oCg烏Chɕϊ
+#else
+    // POSIX ̓P[ɏ]ĕϊiϊłȂꍇ1oCg1j
+    std::setlocale(LC_CTYPE, "");
+    std::wstring wideFilePath;
+    size_t wlen = std::mbstowcs(nullptr, inputFilePath.c_str(), 0);
+    if (wlen != static_cast<size_t>(-1)) {
+        wideFilePath.resize(wlen);
+        std::mbstowcs(&wideFilePath[0], inputFilePath.c_str(), wlen);
+    }
+    else {
+        wideFilePath.assign(inputFilePath.begin(), inputFilePath.end());
+    }
+#endif
 
-    std::wcout << L"FastCsvLoad.exe " << std::endl;
-    std::wcout << L"Read File: " << wideFilePath << std::endl;
+    // wcout  cout ݂ glibc ł͏o͂̂ cout ɓ
+    std::cout << "FastCsvLoad.exe " << std::endl;
+    std::cout << "Read File: " << inputFilePath << std::endl;
 
     int maxThreads = omp_get_max_threads();
     std::cout << "Max threads available: " << maxThreads << std::endl;
 
     std::vector<PointCloud> pointClouds;
+    CsvLoadStats stats;
+    CsvLoadOptions opt;
+    opt.stats = &stats;
 
     // Ԍv̊Jn
     auto start = std::chrono::high_resolution_clock::now();
-    if (FastCsvLoad(wideFilePath, pointClouds, COLUMN_SIZE) != 0) {
+    if (FastCsvLoad(wideFilePath, pointClouds, COLUMN_SIZE, opt) != 0) {
     //if (SlowCsvLoad(wideFilePath, pointClouds) != 0) {
             std::cerr << "Failed to load the file: " << inputFilePath << std::endl;
         return 1;
@@ -54,6 +70,16 @@ int main(int argc, char* argv[]) {
     std::cout << "Data Size (bytes): " << dataSizeBytes << " bytes" << std::endl;
     std::cout << "Processing Time: " << duration << " msec" << std::endl;
 
+    // tF[YƂ̓
+    std::cout << "  map: " << static_cast<long long>(stats.mapSeconds * 1000) << " msec"
+        << ", scan: " << static_cast<long long>(stats.scanSeconds * 1000) << " msec"
+        << ", merge: " << static_cast<long long>(stats.mergeSeconds * 1000) << " msec"
+        << ", alloc: " << static_cast<long long>(stats.allocSeconds * 1000) << " msec"
+        << ", parse: " << static_cast<long long>(stats.parseSeconds * 1000) << " msec"
+        << ", unmap: " << static_cast<long long>(stats.unmapSeconds * 1000) << " msec" << std::endl;
+    std::cout << "  imbalance: " << stats.imbalance
+        << ", page faults: " << stats.minorFaults << " minor / " << stats.majorFaults << " major" << std::endl;
+
     return 0;
 }
 //////////////////////////////////////////////////////////////////////////////////////////////